@@ -0,0 +1,48 @@
+#ifndef ACL_H
+#define ACL_H
+#include <stdio.h>
+#include "utils.h"
+
+/**
+ * @brief 收包入口的访问控制列表
+ *        每条规则为"动作 [条件]..."，动作为drop或pass，条件可以组合，省略的条件匹配任意值：
+ *          type arp|ip|0x86dd   以太网类型
+ *          src 10.0.0.0/8       源IP前缀，省略长度时为/32
+ *          proto icmp|udp|tcp|N IP协议号
+ *          dport 53 或 1000-2000 UDP/TCP目的端口，不带端口的包(其他协议、非首个分片)不匹配
+ *        带src、proto或dport的规则只匹配IP包。按添加顺序取第一条匹配的规则，都不匹配时放行
+ *
+ *        规则在添加时编译为每个字段一张区间表，查表得到匹配该字段的规则位图，
+ *        各字段的位图相与后最低位即第一条匹配的规则，代价与规则数无关，只读取原始帧头部
+ */
+
+/**
+ * @brief 添加一条规则并重新编译
+ *
+ * @param rule 规则文本，如"drop src 10.0.0.0/8 proto udp dport 53"
+ * @return int 成功为0，格式错误或规则已满为-1
+ */
+int acl_add(const char *rule);
+
+/**
+ * @brief 删除所有规则
+ *
+ */
+void acl_clear();
+
+/**
+ * @brief 对驱动交来的以太网帧做分类，计入命中规则的计数器
+ *        在任何校验和计算之前调用，帧长度至少为以太网头部
+ *
+ * @param buf 收到的以太网帧
+ * @return int 需要丢弃为1，否则为0
+ */
+int acl_filter(buf_t *buf);
+
+/**
+ * @brief 按配置文件的格式打印所有规则
+ *
+ * @param f 输出文件
+ */
+void acl_dump(FILE *f);
+#endif
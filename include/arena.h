@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include "utils.h"
+
+/**
+ * @brief 内存区域使用的页
+ *
+ */
+typedef enum arena_page
+{
+    ARENA_PAGE_NORMAL,  //普通的4KB页
+    ARENA_PAGE_THP,     //已建议内核使用透明大页
+    ARENA_PAGE_HUGETLB, //预留的2MB大页
+} arena_page_t;
+
+/**
+ * @brief 从连续的内存区域中分配一块，不能释放
+ *        第一次调用时按net_conf中的容量一次性创建整个区域，包括各表与各模块的数据包缓冲区：
+ *        net_conf.hugepage为1时先尝试预留的大页，没有则退回按2MB对齐并建议使用透明大页的匿名内存；
+ *        区域首选放在net_conf.numa_node节点上，为-1时为调用线程(即轮询线程)所在的节点，
+ *        并在创建时预先触发所有缺页
+ *
+ * @param size 大小
+ * @return void* 按缓存行对齐的内存，已清零，区域不足时为NULL
+ */
+void *arena_alloc(size_t size);
+
+/**
+ * @brief 查询内存区域的使用情况
+ *
+ * @param used 已分配的字节数，可为NULL
+ * @param page 使用的页，可为NULL
+ * @param node 内存实际所在的NUMA节点，未知为-1，可为NULL
+ * @return size_t 区域大小，尚未创建时为0
+ */
+size_t arena_usage(size_t *used, arena_page_t *page, int *node);
+
+/**
+ * @brief 取模块自己的数据包缓冲区，第一次使用时从内存区域分配
+ *
+ * @param slot 保存缓冲区指针的变量
+ * @return buf_t* 缓冲区
+ */
+static inline buf_t *arena_buf(buf_t **slot)
+{
+    if (*slot == NULL)
+        *slot = arena_alloc(sizeof(buf_t));
+    return *slot;
+}
+#endif
@@ -15,6 +15,7 @@ typedef enum arp_state
     ARP_PENDING, //等待响应
     ARP_VALID,   //有效
     ARP_INVALID, //无效
+    ARP_STATIC,  //静态配置，永不过期，不会被替换
 } arp_state_t;
 
 typedef struct arp_entry
@@ -50,8 +51,9 @@ typedef struct arp_pkt
 /**
  * @brief 初始化arp协议
  * 
+ * @return int 成功为0，内存区域不足时为-1
  */
-void arp_init();
+int arp_init();
 
 /**
  * @brief 处理一个收到的数据包
@@ -69,6 +71,15 @@ void arp_in(buf_t *buf);
  */
 void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
 
+/**
+ * @brief 处理一个要发送的分段数据包
+ * 
+ * @param chain 要处理的数据包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void arp_out_chain(buf_chain_t *chain, uint8_t *ip, net_protocol_t protocol);
+
 /**
  * @brief 更新arp表
  * 
@@ -77,4 +88,23 @@ void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
  * @param state 表项的状态
  */
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state);
+
+/**
+ * @brief 到时间时保存arp表快照，由net_poll()调用
+ * 
+ */
+void arp_poll();
+
+/**
+ * @brief 把有效的动态表项保存到net_conf.arp_snapshot，先写临时文件再改名，不会留下写了一半的快照
+ * 
+ * @return int 成功或未配置快照文件为0，失败为-1
+ */
+int arp_snapshot_save();
+
+/**
+ * @brief 关闭arp协议，保存最后一次快照
+ * 
+ */
+void arp_close();
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef CONF_H
+#define CONF_H
+#include <stdio.h>
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+
+#define CONF_IF_NAME_LEN 32 //网卡名最大长度
+#define CONF_PATH_LEN 256   //文件名最大长度
+
+/**
+ * @brief 一个静态arp表项
+ *
+ */
+typedef struct conf_arp_static
+{
+    uint8_t ip[NET_IP_LEN];
+    uint8_t mac[NET_MAC_LEN];
+} conf_arp_static_t;
+
+/**
+ * @brief 运行时配置，默认值取config.h中的宏，启动时可由配置文件或命令行覆盖
+ *        各表的容量只在第一次分配前生效，之后修改不起作用
+ */
+typedef struct net_conf
+{
+    char if_name[CONF_IF_NAME_LEN]; //网卡名称
+    int mtu;                        //以太网最大传输单元
+    int arp_max_entry;              //arp表最大长度
+    int arp_timeout_sec;            //arp表过期时间
+    int arp_max_buf;                //等待arp回应的分组队列长度
+    int udp_max_handler;            //最多的UDP处理程序数
+    int udp_tx_bufs;                //零拷贝发送缓冲池中的缓冲区数
+    int hugepage;                   //内存区域是否使用大页，没有预留大页时使用透明大页
+    int numa_node;                  //内存区域所在的NUMA节点，-1为轮询线程所在的节点
+    int rx_timestamp;               //接收时间戳，0不记录，1软件，2软件与硬件，见buf_ts_t
+    int csum_offload;               //是否使用驱动的校验和卸载，见buf_csum_t
+    int vector_size;                //矢量处理图每次轮询最多收取的包数，0为逐包处理，见graph.h
+    int qos_queue;                  //按优先级分类的接收队列容量，0为不分类，见qos.h
+    int qos_budget;                 //每次轮询最多处理的帧数
+    int qos_budget_us;              //每次轮询最长的处理时间(微秒)，0为不限制
+    int qos_low_watermark;          //积压达到队列容量的这个百分比时丢弃最低优先级的帧
+    int qos_high_watermark;         //达到这个百分比时再丢弃TCP与优先UDP端口的帧
+    int qos_udp_port_num;           //优先处理的UDP端口数
+    uint16_t qos_udp_port[QOS_MAX_UDP_PORT]; //优先处理的UDP端口
+    char arp_snapshot[CONF_PATH_LEN]; //arp表快照文件，为空时不使用
+    int arp_snapshot_sec;           //定期保存快照的间隔，0表示只在关闭时保存
+    int arp_snapshot_max_age;       //超过这么久的快照不再加载
+    int arp_static_num;             //静态表项个数
+    conf_arp_static_t arp_static[ARP_MAX_STATIC]; //静态表项，arp_init()时装入arp表
+} net_conf_t;
+
+extern net_conf_t net_conf;
+
+/**
+ * @brief 设置一个配置项，ip与mac写入net_if_ip与net_if_mac
+ *
+ * @param key 配置项名，与net_conf_t的成员同名，另有ip、mac，以及每次添加一条规则的acl(见acl.h)、
+ *            每次添加一个静态表项的arp_static(值为"ip mac")、
+ *            每次添加一个优先处理的UDP端口的qos_udp_port
+ * @param value 值
+ * @return int 成功为0，失败为-1
+ */
+int conf_set(const char *key, const char *value);
+
+/**
+ * @brief 读取配置文件，每行一个"key = value"，#开头的为注释
+ *
+ * @param path 文件名
+ * @return int 成功为0，失败为-1
+ */
+int conf_load(const char *path);
+
+/**
+ * @brief 处理命令行中的"--key=value"或"--key value"，"--config 文件"读取配置文件
+ *        识别的参数从argv中移除，其余参数依次前移
+ *
+ * @param argc 参数个数
+ * @param argv 参数
+ * @return int 剩余的参数个数，出错为-1
+ */
+int conf_parse_args(int argc, char *argv[]);
+
+/**
+ * @brief 打印当前配置
+ *
+ * @param f 输出文件
+ */
+void conf_dump(FILE *f);
+#endif
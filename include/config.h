@@ -1,25 +1,119 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#ifndef DRIVER_IF_NAME
 #define DRIVER_IF_NAME "enp0s3" //使用的物理网卡名称
+#endif
+#ifndef DRIVER_IF_IP //可在编译时指定，用于在同一进程中构建多个协议栈实例
 #define DRIVER_IF_IP      \
     {                     \
         192, 168, 56, 9   \
     } //自定义网卡ip地址
+#endif
+#ifndef DRIVER_IF_MAC
 #define DRIVER_IF_MAC                      \
     {                                      \
         0x00, 0x11, 0x22, 0x33, 0x44, 0x55 \
     }                     //自定义网卡mac地址
+#endif
 
 
+// #define DRIVER_TAP           //使用TAP后端代替pcap，也可用cmake -DDRIVER_TAP=ON打开
+#define DRIVER_TAP_NAME "tap0"  //TAP设备名称
+#ifndef DRIVER_TAP_QUEUES
+#define DRIVER_TAP_QUEUES 1     //TAP队列数，driver_recv轮流读取各队列，多个工作线程时各自用driver_select_queue固定一个
+#endif
+
+// #define DRIVER_XDP           //使用AF_XDP后端代替pcap，优先零拷贝模式，协议栈直接使用UMEM中的接收帧，也可用cmake -DDRIVER_XDP=ON打开
+#define DRIVER_XDP_QUEUE 0      //AF_XDP套接字绑定的网卡队列
+#define DRIVER_XDP_FRAMES 4096  //UMEM帧数，接收与发送各一半，必须为2的幂；接收的一半要多于协议栈的接收缓冲区数(1 + vector_size + qos_queue + 1)
+#define DRIVER_XDP_BATCH 64     //每批从接收环取出或向发送环提交的最大描述符数
+
+// #define DRIVER_PACKET        //使用AF_PACKET原始套接字后端代替pcap，也可用cmake -DDRIVER_PACKET=ON打开
+
+#if defined(DRIVER_TAP) || defined(DRIVER_PACKET)
+#define DRIVER_TX_CSUM //驱动能让设备补全传输层校验和(virtio_net_hdr的VIRTIO_NET_HDR_F_NEEDS_CSUM)
+#endif
+#define RX_TIMESTAMP 0 //接收时间戳：0不记录，1软件，2软件与硬件(只有AF_PACKET后端支持)，可在启动时用rx_timestamp覆盖
+#define CSUM_OFFLOAD 1 //信任驱动报告的接收校验和状态，并在驱动支持时把发送的传输层校验和交给设备补全，可在启动时用csum_offload覆盖
+
+// #define DRIVER_REPLAY            //从pcap/pcapng文件回放代替网卡，也可用cmake -DDRIVER_REPLAY=ON打开
+#define DRIVER_REPLAY_IN "in.pcap"      //回放的输入文件，可用环境变量NET_REPLAY_IN覆盖
+#define DRIVER_REPLAY_OUT "out.pcap"    //发送的帧写入的文件，可用NET_REPLAY_OUT覆盖
+#define DRIVER_REPLAY_SPEED "max"       //max、orig、orig*N或每秒包数，可用NET_REPLAY_SPEED覆盖
+#define DRIVER_REPLAY_LOOPS 1           //回放次数，0表示无限循环，可用NET_REPLAY_LOOPS覆盖
+#define DRIVER_REPLAY_OUT_BUF (1 << 20) //输出文件的缓冲区大小
+
 #define ETHERNET_MTU 1500 //以太网最大传输单元
+#define ETHERNET_MAX_MTU 9216 //可配置的最大MTU(巨型帧)
+
+#define BUF_MAX_SEG 8 //分段数据包中负载段的最大个数
+
+#define GRAPH_VECTOR_SIZE 0  //矢量处理图每次轮询最多收取的包数，0为逐包处理，可在启动时用vector_size覆盖
+#define GRAPH_VECTOR_MAX 256 //vector_size的上限
+#define GRAPH_PREFETCH 4     //处理第i个包时预取第i+GRAPH_PREFETCH个包的头部
 
+#define QOS_QUEUE 0           //按优先级分类的接收队列容量(帧数)，0为不分类、按到达顺序处理，可在启动时用qos_queue覆盖
+#define QOS_QUEUE_MAX 1024    //qos_queue的上限，每帧占一个buf_t
+#define QOS_BUDGET 64         //每次轮询最多处理的帧数，可用qos_budget覆盖
+#define QOS_BUDGET_US 200     //每次轮询最长的处理时间(微秒)，0为不限制，可用qos_budget_us覆盖
+#define QOS_LOW_WATERMARK 50  //积压达到队列容量的这个百分比时丢弃新到的最低优先级帧，可用qos_low_watermark覆盖
+#define QOS_HIGH_WATERMARK 80 //达到这个百分比时再丢弃TCP与优先UDP端口的帧，可用qos_high_watermark覆盖
+#define QOS_MAX_UDP_PORT 8    //优先处理的UDP端口的最大个数
+
+#define ARENA_USE_HUGEPAGE 1 //表与数据包缓冲区所在的内存区域默认使用2MB大页，没有预留大页时退回透明大页
+#define ARENA_NUMA_NODE -1   //内存区域所在的NUMA节点，-1为轮询线程所在的节点
+
+#define ACL_MAX_RULE 16 //最多的ACL规则数，不超过32，与stats.h中ACL_RULEn_HITS的个数一致
+#define ACL_TEXT_LEN 96 //每条规则文本的最大长度
+
+// 下列网卡与各表容量的设置为默认值，可在启动时用配置文件或命令行覆盖，见conf.h
+#ifndef ARP_MAX_ENTRY //可在编译时指定，用于测试不同的表大小
 #define ARP_MAX_ENTRY 16       //arp表最大长度
+#endif
 #define ARP_TIMEOUT_SEC 60 * 5 //arp表过期时间
+#define MAX_ARP_BUF 5          //等待arp回应的分组队列长度
 #define ARP_MIN_INTERVAL 1     //向相同地址发送arp请求的最小间隔
+#define ARP_MAX_STATIC 8       //静态(永不过期)表项的最大个数
+#define ARP_SNAPSHOT_FILE ""   //arp表快照文件，为空时不保存也不加载
+#define ARP_SNAPSHOT_SEC 30    //定期保存快照的间隔，0表示只在关闭时保存
+#define ARP_SNAPSHOT_MAX_AGE 600 //快照保存后超过这么久则不再加载
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
 
+#define ICMP_ERR_RATE 200        //每秒最多发送的ICMP差错报文数，0表示不限制
+#define ICMP_ERR_BURST 50        //ICMP差错报文的突发上限
+#define ICMP_ERR_SRC_RATE 10     //对每个源地址每秒最多发送的ICMP差错报文数，0表示不限制
+#define ICMP_ERR_SRC_BURST 10    //对每个源地址的突发上限
+#define ICMP_ERR_SRC_ENTRY 256   //按源地址限速的哈希表大小，必须为2的幂
+
+#ifndef UDP_MAX_HANDLER //可在编译时指定，用于测试不同的表大小
 #define UDP_MAX_HANDLER 16 //最多的UDP处理程序数
+#endif
+#define UDP_TX_BUFS 8      //零拷贝发送缓冲池中的缓冲区数
+#define UDP_BATCH_PORTS 8  //最多的批量交付端口数
+#define UDP_BATCH_MAX 64   //每个端口一批最多的数据报数，满时立即交付
+
+#define TCP_MAX_CONN 16                       //最多的TCP连接数
+#define TCP_HASH_SIZE 64                      //TCP连接哈希表桶数，必须为2的幂
+#define TCP_MAX_LISTEN 8                      //最多的TCP监听端口数
+#define TCP_MAX_BACKLOG 8                     //每个监听端口的最大等待队列长度
+#define TCP_BUF_SIZE (1 << 18)                //每个连接收发缓冲区大小，必须为2的幂
+#define TCP_DELACK_MS 40                      //延迟ACK的最长等待时间
+#define TCP_RTO_INIT_MS 1000                  //初始重传超时时间
+#define TCP_RTO_MIN_MS 200                    //最小重传超时时间
+#define TCP_RTO_MAX_MS 60000                  //最大重传超时时间
+#define TCP_MAX_RETRIES 8                     //最多的连续超时重传次数
+#define TCP_TIMEWAIT_MS 2000                  //TIME_WAIT状态持续时间
+#define TCP_DEFAULT_CC "reno"                 //默认的拥塞控制算法
+
+#define STATS_MAX_THREADS 16           //有独立计数器的最大线程数，超出的线程共用最后一块
+#ifndef STATS_SHM_NAME
+#define STATS_SHM_NAME "/net_lab_stats" //导出统计快照的共享内存名
+#endif
+#define STATS_EXPORT_MS 100            //导出统计快照的间隔
+
+#define TRACE_MAX_THREADS 16  //有跟踪缓冲区的最大线程数
+#define TRACE_RING_SIZE (1 << 16) //每个线程的跟踪记录数，必须为2的幂
 
 #endif
\ No newline at end of file
@@ -25,6 +25,30 @@ int driver_recv(buf_t *buf);
  */
 int driver_send(buf_t *buf);
 
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包，各段依次连接为一帧，协议栈不先合并
+ *        函数返回后各段即可重用
+ * 
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数，不超过BUF_MAX_SEG + 1
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt);
+
+/**
+ * @brief 为当前线程选择使用的队列，只有多队列后端支持多个队列
+ * 
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue);
+
+/**
+ * @brief 把驱动层的计数（收到、丢弃的包数）写入统计计数器
+ * 
+ */
+void driver_stats();
+
 /**
  * @brief 关闭网卡
  * 
@@ -21,6 +21,15 @@ typedef struct ether_hdr
  */
 int ethernet_init();
 
+/**
+ * @brief 检查收到的以太网帧并去掉以太网头部，不交给上层
+ *        在此之前先按ACL规则过滤，被丢弃的帧不做任何校验和计算
+ * 
+ * @param buf 要处理的数据包
+ * @return int 上层协议NET_PROTOCOL_ARP或NET_PROTOCOL_IP，帧被丢弃时为-1
+ */
+int ethernet_demux(buf_t *buf);
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -37,6 +46,16 @@ void ethernet_in(buf_t *buf);
  */
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
 
+/**
+ * @brief 处理一个要发送的分段数据包
+ *        以太网头部添加到头部段中，头部段与各负载段以iovec一起交给驱动
+ * 
+ * @param chain 要处理的数据包
+ * @param mac 目标mac地址
+ * @param protocol 上层协议
+ */
+void ethernet_out_chain(buf_chain_t *chain, const uint8_t *mac, net_protocol_t protocol);
+
 /**
  * @brief 一次以太网轮询
  * 
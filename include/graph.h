@@ -0,0 +1,29 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+#include "utils.h"
+
+/**
+ * @brief 初始化矢量处理图，从内存区域分配net_conf.vector_size个接收缓冲区
+ *        vector_size为0时不分配，net_poll()仍逐包处理
+ *
+ * @return int 成功为0，失败为-1
+ */
+int graph_init();
+
+/**
+ * @brief 让一个已经收到的矢量依次经过以太网、arp、ip、icmp、udp、tcp节点，每个节点处理完整个矢量后，
+ *        下一个节点再处理分给它的那部分；处理第i个包时预取后面的包
+ *
+ * @param bufs 数据包，批量交付的udp数据报仍指向其中，调用者在udp_flush()之后才能重用
+ * @param num 包数，不超过GRAPH_VECTOR_MAX
+ */
+void graph_process(buf_t **bufs, int num);
+
+/**
+ * @brief 一次矢量轮询：从驱动收取至多net_conf.vector_size个包组成矢量，交给graph_process()
+ *        接收缓冲区到下次轮询才重新收取，net_poll()在此之前调用udp_flush()，积压的批交付前一直有效
+ *
+ * @return int 收到的包数
+ */
+int graph_poll();
+#endif
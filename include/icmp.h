@@ -26,6 +26,13 @@ typedef enum icmp_code
     ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
 } icmp_code_t;
 
+typedef struct icmp_ratelimit_stats
+{
+    uint64_t sent;              // 已发送的差错报文数
+    uint64_t suppressed_global; // 因全局限速而未发送的差错报文数
+    uint64_t suppressed_src;    // 因源地址限速而未发送的差错报文数
+} icmp_ratelimit_stats_t;
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -42,4 +49,21 @@ void icmp_in(buf_t *buf, uint8_t *src_ip);
  * @param code icmp code，协议不可达或端口不可达
  */
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+
+/**
+ * @brief 设置ICMP差错报文的令牌桶限速参数，速率为0表示不限制
+ * 
+ * @param rate 全局每秒令牌数
+ * @param burst 全局令牌桶容量
+ * @param src_rate 每个源地址每秒令牌数
+ * @param src_burst 每个源地址令牌桶容量
+ */
+void icmp_ratelimit_set(uint32_t rate, uint32_t burst, uint32_t src_rate, uint32_t src_burst);
+
+/**
+ * @brief 获取ICMP差错报文的限速统计
+ * 
+ * @param stats 统计结果
+ */
+void icmp_ratelimit_get_stats(icmp_ratelimit_stats_t *stats);
 #endif
@@ -25,6 +25,16 @@ typedef struct ip_hdr
 #define IP_VERSION_4 (4)           //ipv4
 #define IP_MORE_FRAGMENT 1 << 5    //ip分片mf位
 
+/**
+ * @brief 检查收到的IP数据报并去掉IP头部，不交给上层
+ *        不支持的协议在这里回送ICMP协议不可达
+ * 
+ * @param buf 要处理的包
+ * @param src_ip 写入源ip地址
+ * @return int 上层协议NET_PROTOCOL_ICMP、NET_PROTOCOL_UDP或NET_PROTOCOL_TCP，数据报被丢弃时为-1
+ */
+int ip_demux(buf_t *buf, uint8_t *src_ip);
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -32,6 +42,14 @@ typedef struct ip_hdr
  */
 void ip_in(buf_t *buf);
 
+/**
+ * @brief 发送的传输层校验和能否交给设备补全：驱动支持、打开了csum_offload，并且数据报不分片
+ * 
+ * @param len IP数据部分的长度
+ * @return int 可以为1，否则为0
+ */
+int ip_csum_offload(uint32_t len);
+
 /**
  * @brief 处理一个要发送的ip数据包
  * 
@@ -40,4 +58,13 @@ void ip_in(buf_t *buf);
  * @param protocol 上层协议
  */
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+
+/**
+ * @brief 处理一个要发送的分段ip数据包，分片时也不复制负载
+ * 
+ * @param chain 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out_chain(buf_chain_t *chain, uint8_t *ip, net_protocol_t protocol);
 #endif
\ No newline at end of file
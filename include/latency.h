@@ -0,0 +1,122 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <stdint.h>
+#include <stdio.h>
+#include "config.h"
+#include "utils.h"
+
+/**
+ * @brief 打上时间戳的处理阶段，每个阶段的直方图记录与上一个时间戳的差值
+ *
+ */
+typedef enum latency_stage
+{
+    LATENCY_DRIVER_RECV,  //驱动收到数据包，作为起点
+    LATENCY_ETHERNET_IN,  //进入ethernet_in
+    LATENCY_IP_IN,        //进入ip_in
+    LATENCY_UDP_IN,       //进入udp_in
+    LATENCY_HANDLER,      //调用udp处理程序
+    LATENCY_DRIVER_SEND,  //调用driver_send
+    LATENCY_E2E_HANDLER,  //从收到到调用udp处理程序
+    LATENCY_E2E_SEND,     //从收到到发出应答
+    LATENCY_STAGE_MAX,
+} latency_stage_t;
+
+#ifdef LATENCY_ENABLE
+
+#define LATENCY_SUB_BITS 4                                          //每个2的幂区间再细分为2^LATENCY_SUB_BITS个桶
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/**
+ * @brief 对数-线性分桶的直方图(类似HdrHistogram)，相对误差不超过1/2^LATENCY_SUB_BITS
+ *
+ */
+typedef struct latency_hist
+{
+    uint64_t count;
+    uint64_t min, max;
+    uint64_t bucket[LATENCY_BUCKETS];
+} latency_hist_t;
+
+/**
+ * @brief 当前正在处理的数据包的起始时间与上一个时间戳，起始时间为0表示没有正在处理的包
+ *
+ */
+extern uint64_t latency_start, latency_last;
+
+void latency_record(latency_stage_t stage, uint64_t cycles);
+
+/**
+ * @brief 驱动收到数据包时调用，开始计时
+ *
+ */
+static inline void latency_begin()
+{
+    latency_start = latency_last = tsc_now();
+}
+
+/**
+ * @brief 记录到达一个阶段的时间，不在处理收到的包时不记录
+ *
+ */
+static inline void latency_stamp(latency_stage_t stage)
+{
+    if (latency_start == 0)
+        return;
+    uint64_t now = tsc_now();
+    latency_record(stage, now - latency_last);
+    latency_last = now;
+    if (stage == LATENCY_HANDLER)
+        latency_record(LATENCY_E2E_HANDLER, now - latency_start);
+    else if (stage == LATENCY_DRIVER_SEND)
+        latency_record(LATENCY_E2E_SEND, now - latency_start);
+}
+
+/**
+ * @brief 收到的包处理完毕，之后由定时器等触发的发送不计入
+ *
+ */
+static inline void latency_end()
+{
+    latency_start = 0;
+}
+
+/**
+ * @brief 测量时间戳计数器的频率
+ *
+ */
+void latency_init();
+
+/**
+ * @brief 清空所有直方图
+ *
+ */
+void latency_reset();
+
+/**
+ * @brief 获取一个阶段的分位数
+ *
+ * @param stage 阶段
+ * @param q 分位，如0.99
+ * @return uint64_t 时延(纳秒)，没有样本时为0
+ */
+uint64_t latency_percentile(latency_stage_t stage, double q);
+
+/**
+ * @brief 输出每个阶段的样本数、最小值、p50/p99/p99.9与最大值(纳秒)
+ *
+ * @param f 输出的文件
+ */
+void latency_report(FILE *f);
+
+#define LATENCY_INIT() latency_init()
+#define LATENCY_BEGIN() latency_begin()
+#define LATENCY_STAMP(stage) latency_stamp(stage)
+#define LATENCY_END() latency_end()
+#else
+#define LATENCY_INIT() ((void)0)
+#define LATENCY_BEGIN() ((void)0)
+#define LATENCY_STAMP(stage) ((void)0)
+#define LATENCY_END() ((void)0)
+#endif
+#endif
@@ -2,6 +2,7 @@
 #define NET_H
 #include "config.h"
 #include <stdint.h>
+#include <signal.h>
 typedef enum net_protocol
 {
     NET_PROTOCOL_ARP = 0x0806,
@@ -11,23 +12,35 @@ typedef enum net_protocol
     NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
-static uint8_t net_if_mac[] = DRIVER_IF_MAC;
-static uint8_t net_if_ip[] = DRIVER_IF_IP;
-
 #define NET_MAC_LEN (6)                                     //mac地址长度
 #define NET_IP_LEN (4)                                      //ip地址长度
+
+extern uint8_t net_if_mac[NET_MAC_LEN]; //本机mac地址，默认为DRIVER_IF_MAC，可在启动时配置
+extern uint8_t net_if_ip[NET_IP_LEN];   //本机ip地址，默认为DRIVER_IF_IP，可在启动时配置
+extern volatile sig_atomic_t net_running; //主循环的条件，收到退出信号或驱动没有更多输入(如回放结束)时清零
 #define swap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
+#define swap32(x) ((((uint32_t)(x)&0xFF) << 24) | (((uint32_t)(x)&0xFF00) << 8) | \
+                   (((uint32_t)(x) >> 8) & 0xFF00) | (((uint32_t)(x) >> 24) & 0xFF)) //为32位数据交换大小端
 
 /**
  * @brief 初始化协议栈
  * 
+ * @return int 成功为0，网卡打开失败或内存区域不足时为-1
  */
-void net_init();
+int net_init();
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 一次协议栈轮询，net_conf.qos_queue不为0时按优先级分类并在预算内处理(见qos.h)，
+ *        否则net_conf.vector_size不为0时经矢量处理图一次收取多个包；
+ *        处理完后把积压的udp数据报一次交给批量处理程序
  * 
  */
 void net_poll();
 
+/**
+ * @brief 关闭协议栈
+ * 
+ */
+void net_close();
+
 #endif
\ No newline at end of file
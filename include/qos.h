@@ -0,0 +1,47 @@
+#ifndef QOS_H
+#define QOS_H
+#include "utils.h"
+
+/**
+ * @brief 接收帧的优先级类别，数值越小优先级越高
+ *        顺序与stats.h中的QOS_DROP_*计数器一致
+ */
+typedef enum qos_class
+{
+    QOS_ARP,       //arp，它的回应放出arp_buf中等待的所有包
+    QOS_ICMP,      //icmp
+    QOS_TCP,       //tcp
+    QOS_UDP_PRIO,  //目的端口为net_conf.qos_udp_port之一的udp
+    QOS_BULK,      //其余的udp、分片与无法识别的帧
+    QOS_CLASS_NUM,
+} qos_class_t;
+
+/**
+ * @brief 初始化优先级接收队列，从内存区域分配net_conf.qos_queue + 1个接收缓冲区
+ *        qos_queue为0时不分配，net_poll()仍按到达顺序处理
+ *
+ * @return int 成功为0，失败为-1
+ */
+int qos_init();
+
+/**
+ * @brief 只看各层头部判断帧的类别，不做任何检查与校验和计算
+ *
+ * @param buf 以太网帧
+ * @return qos_class_t 类别
+ */
+qos_class_t qos_classify(const buf_t *buf);
+
+/**
+ * @brief 一次带预算的轮询：
+ *        （1）把驱动中积压的帧(至多qos_queue个)分类放入各自的队列，积压达到类别的水位时丢弃新到的帧：
+ *             QOS_BULK为qos_low_watermark，QOS_TCP与QOS_UDP_PRIO为qos_high_watermark，QOS_ARP与QOS_ICMP为队列满；
+ *             队列满时挤掉优先级更低的类别中最新的一帧，没有则丢弃新到的帧
+ *        （2）按优先级从高到低处理，至多qos_budget帧、qos_budget_us微秒，剩下的留到下次轮询
+ *        net_conf.vector_size不为0时按优先级顺序取出的帧组成矢量交给graph_process()
+ *        处理完的接收缓冲区回到空闲列表，到下次轮询才重新收取，net_poll()在此之前调用udp_flush()，积压的批交付前一直有效
+ *
+ * @return int 处理的帧数
+ */
+int qos_poll();
+#endif
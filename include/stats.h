@@ -0,0 +1,233 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * @brief 统计计数器列表，X(名称, 导出时显示的名字)
+ *        RX/TX为各层收发的包数与字节数，DROP为按原因分类的丢包数，
+ *        UDP_RX_BATCHES为交给批量处理程序的批数，UDP_RX_COALESCED为合并到上一项中的数据报数，
+ *        CSUM_OFFLOAD为接收时信任驱动报告的校验和状态、发送时交给设备补全校验和的包数，
+ *        ACL_RULEn_HITS为第n条ACL规则的命中数，共ACL_MAX_RULE个，
+ *        DRIVER开头的为驱动层读取的计数（如pcap_stats），由driver_stats()写入，
+ *        GRAPH开头的为矢量处理图收取的矢量数与包数，两者之比为平均矢量长度，
+ *        QOS_DROP为优先级接收队列按类别(顺序与qos_class_t一致)的丢包数，QOS_BACKLOG为队列中积压的帧数，
+ *        ARENA开头的为内存区域的大小、用量、页的种类(见arena_page_t)与所在节点
+ */
+#define STATS_LIST(X)                                          \
+    X(ETH_RX_PKTS, "ethernet.rx_packets")                      \
+    X(ETH_RX_BYTES, "ethernet.rx_bytes")                       \
+    X(ETH_TX_PKTS, "ethernet.tx_packets")                      \
+    X(ETH_TX_BYTES, "ethernet.tx_bytes")                       \
+    X(ETH_DROP_BAD_LEN, "ethernet.drop.bad_length")            \
+    X(ETH_DROP_UNKNOWN_TYPE, "ethernet.drop.unknown_type")     \
+    X(ETH_DROP_ACL, "ethernet.drop.acl")                       \
+    X(ARP_RX_PKTS, "arp.rx_packets")                           \
+    X(ARP_TX_PKTS, "arp.tx_packets")                           \
+    X(ARP_DROP_BAD_HDR, "arp.drop.bad_header")                 \
+    X(ARP_DROP_QUEUE_FULL, "arp.drop.queue_full")              \
+    X(ARP_SNAPSHOT_SAVED, "arp.snapshot.saved")                \
+    X(ARP_SNAPSHOT_RESTORED, "arp.snapshot.restored_entries")  \
+    X(IP_RX_PKTS, "ip.rx_packets")                             \
+    X(IP_RX_BYTES, "ip.rx_bytes")                              \
+    X(IP_TX_PKTS, "ip.tx_packets")                             \
+    X(IP_TX_BYTES, "ip.tx_bytes")                              \
+    X(IP_DROP_BAD_VERSION, "ip.drop.bad_version")              \
+    X(IP_DROP_BAD_LEN, "ip.drop.bad_length")                   \
+    X(IP_DROP_BAD_CHECKSUM, "ip.drop.bad_checksum")            \
+    X(IP_DROP_NOT_FOR_US, "ip.drop.not_for_us")                \
+    X(IP_DROP_UNKNOWN_PROTO, "ip.drop.unknown_protocol")       \
+    X(ICMP_RX_PKTS, "icmp.rx_packets")                         \
+    X(ICMP_TX_PKTS, "icmp.tx_packets")                         \
+    X(ICMP_DROP_BAD_LEN, "icmp.drop.bad_length")               \
+    X(ICMP_ERR_SENT, "icmp.error.sent")                        \
+    X(ICMP_ERR_SUPPRESSED_GLOBAL, "icmp.error.suppressed_global") \
+    X(ICMP_ERR_SUPPRESSED_SRC, "icmp.error.suppressed_src")    \
+    X(UDP_RX_PKTS, "udp.rx_packets")                           \
+    X(UDP_RX_BYTES, "udp.rx_bytes")                            \
+    X(UDP_TX_PKTS, "udp.tx_packets")                           \
+    X(UDP_TX_BYTES, "udp.tx_bytes")                            \
+    X(UDP_DROP_BAD_LEN, "udp.drop.bad_length")                 \
+    X(UDP_DROP_BAD_CHECKSUM, "udp.drop.bad_checksum")          \
+    X(UDP_DROP_NO_PORT, "udp.drop.no_port")                    \
+    X(UDP_TX_ZEROCOPY, "udp.tx_zerocopy")                      \
+    X(UDP_TX_NO_BUF, "udp.tx_no_buffer")                       \
+    X(UDP_TX_SCATTER, "udp.tx_scatter")                        \
+    X(UDP_RX_CSUM_OFFLOAD, "udp.rx_csum_offloaded")            \
+    X(UDP_TX_CSUM_OFFLOAD, "udp.tx_csum_offloaded")            \
+    X(UDP_RX_BATCHES, "udp.rx_batches")                        \
+    X(UDP_RX_COALESCED, "udp.rx_coalesced")                    \
+    X(TCP_RX_PKTS, "tcp.rx_packets")                           \
+    X(TCP_RX_BYTES, "tcp.rx_bytes")                            \
+    X(TCP_TX_PKTS, "tcp.tx_packets")                           \
+    X(TCP_TX_BYTES, "tcp.tx_bytes")                            \
+    X(TCP_DROP_BAD_HDR, "tcp.drop.bad_header")                 \
+    X(TCP_DROP_BAD_CHECKSUM, "tcp.drop.bad_checksum")          \
+    X(TCP_DROP_NO_PORT, "tcp.drop.no_port")                    \
+    X(TCP_RX_CSUM_OFFLOAD, "tcp.rx_csum_offloaded")            \
+    X(TCP_TX_CSUM_OFFLOAD, "tcp.tx_csum_offloaded")            \
+    X(ACL_RULE0_HITS, "acl.rule0.hits")                        \
+    X(ACL_RULE1_HITS, "acl.rule1.hits")                        \
+    X(ACL_RULE2_HITS, "acl.rule2.hits")                        \
+    X(ACL_RULE3_HITS, "acl.rule3.hits")                        \
+    X(ACL_RULE4_HITS, "acl.rule4.hits")                        \
+    X(ACL_RULE5_HITS, "acl.rule5.hits")                        \
+    X(ACL_RULE6_HITS, "acl.rule6.hits")                        \
+    X(ACL_RULE7_HITS, "acl.rule7.hits")                        \
+    X(ACL_RULE8_HITS, "acl.rule8.hits")                        \
+    X(ACL_RULE9_HITS, "acl.rule9.hits")                        \
+    X(ACL_RULE10_HITS, "acl.rule10.hits")                      \
+    X(ACL_RULE11_HITS, "acl.rule11.hits")                      \
+    X(ACL_RULE12_HITS, "acl.rule12.hits")                      \
+    X(ACL_RULE13_HITS, "acl.rule13.hits")                      \
+    X(ACL_RULE14_HITS, "acl.rule14.hits")                      \
+    X(ACL_RULE15_HITS, "acl.rule15.hits")                      \
+    X(DRIVER_SEND_FAIL, "driver.drop.send_fail")               \
+    X(DRIVER_RING_DROP, "driver.drop.ring_full")               \
+    X(DRIVER_RECV, "driver.pcap.recv")                         \
+    X(DRIVER_DROP, "driver.pcap.drop")                         \
+    X(DRIVER_IFDROP, "driver.pcap.ifdrop")                     \
+    X(DRIVER_TAP_CSUM_PARTIAL, "driver.tap.csum_partial")      \
+    X(DRIVER_TAP_DROP_GSO, "driver.tap.drop.gso")              \
+    X(DRIVER_TAP_DROP_BAD_HDR, "driver.tap.drop.bad_vnet_hdr") \
+    X(DRIVER_XDP_DROP_NO_FRAME, "driver.xdp.drop.no_tx_frame") \
+    X(DRIVER_XDP_RX_DROPPED, "driver.xdp.rx_dropped")          \
+    X(DRIVER_XDP_RX_RING_FULL, "driver.xdp.rx_ring_full")      \
+    X(DRIVER_XDP_FILL_EMPTY, "driver.xdp.fill_ring_empty")     \
+    X(DRIVER_REPLAY_FRAMES, "driver.replay.frames")            \
+    X(DRIVER_REPLAY_RESTARTS, "driver.replay.restarts")        \
+    X(DRIVER_REPLAY_SKIPPED, "driver.replay.skipped")          \
+    X(GRAPH_VECTORS, "graph.vectors")                          \
+    X(GRAPH_PACKETS, "graph.packets")                          \
+    X(QOS_DROP_ARP, "qos.drop.arp")                            \
+    X(QOS_DROP_ICMP, "qos.drop.icmp")                          \
+    X(QOS_DROP_TCP, "qos.drop.tcp")                            \
+    X(QOS_DROP_UDP_PRIO, "qos.drop.udp_priority")              \
+    X(QOS_DROP_BULK, "qos.drop.bulk")                          \
+    X(QOS_BUDGET_EXHAUSTED, "qos.budget_exhausted")            \
+    X(QOS_BACKLOG, "qos.backlog")                              \
+    X(ARENA_SIZE, "arena.size_bytes")                          \
+    X(ARENA_USED, "arena.used_bytes")                          \
+    X(ARENA_PAGE_KIND, "arena.page_kind")                      \
+    X(ARENA_NODE, "arena.numa_node")
+
+typedef enum stats_id
+{
+#define STATS_ENUM(id, name) STATS_##id,
+    STATS_LIST(STATS_ENUM)
+#undef STATS_ENUM
+    STATS_MAX,
+} stats_id_t;
+
+static const char *const stats_names[STATS_MAX] = {
+#define STATS_NAME(id, name) name,
+    STATS_LIST(STATS_NAME)
+#undef STATS_NAME
+};
+
+/**
+ * @brief 每个线程独占一块计数器，按缓存行对齐避免伪共享。
+ *        只有所属线程写入，读取方汇总时不需要加锁
+ */
+typedef struct stats_block
+{
+    uint64_t counter[STATS_MAX];
+} __attribute__((aligned(64))) stats_block_t;
+
+#define STATS_SHM_MAGIC 0x4e455453 //"NETS"
+#define STATS_SHM_VERSION 2 //STATS_LIST中计数器的个数、顺序或名字改变时加1，旧版本的读取方会拒绝新的共享内存
+
+/**
+ * @brief 共享内存中的快照，使用序列锁：写入时seq为奇数，
+ *        读取方在seq为偶数且前后一致时得到的才是完整的快照
+ */
+typedef struct stats_shm
+{
+    uint32_t magic;             //STATS_SHM_MAGIC
+    uint32_t version;           //STATS_SHM_VERSION
+    uint32_t count;             //计数器个数，即STATS_MAX
+    uint32_t seq;               //序列号
+    uint64_t time_ms;           //快照时间(毫秒，单调时钟)
+    uint64_t counter[STATS_MAX];
+} stats_shm_t;
+
+extern __thread stats_block_t *stats_local;
+
+/**
+ * @brief 为当前线程分配一块计数器，由STATS_ADD在第一次计数时调用
+ *
+ * @return stats_block_t* 当前线程的计数器
+ */
+stats_block_t *stats_register();
+
+/**
+ * @brief 当前线程的计数器
+ *
+ */
+static inline stats_block_t *stats_block()
+{
+    stats_block_t *block = stats_local;
+    return block ? block : stats_register();
+}
+
+/**
+ * @brief 计数器加n，只由所属线程写入，用原子读写保证汇总时不会读到一半的值
+ *
+ */
+#define STATS_ADD(id, n) STATS_ADD_ID(STATS_##id, n)
+#define STATS_INC(id) STATS_ADD(id, 1)
+
+/**
+ * @brief 按运行时的编号计数，用于成组的计数器(如每条ACL规则一个)
+ *
+ */
+#define STATS_ADD_ID(sid, n)                                                                      \
+    do                                                                                            \
+    {                                                                                             \
+        uint64_t *stats_c_ = &stats_block()->counter[(sid)];                                      \
+        __atomic_store_n(stats_c_, __atomic_load_n(stats_c_, __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED); \
+    } while (0)
+#define STATS_SET(id, v) __atomic_store_n(&stats_block()->counter[STATS_##id], (uint64_t)(v), __ATOMIC_RELAXED)
+
+/**
+ * @brief 汇总所有线程的计数器
+ *
+ * @param counter 汇总结果，长度为STATS_MAX
+ */
+void stats_snapshot(uint64_t *counter);
+
+/**
+ * @brief 汇总一个计数器
+ *
+ * @param id 计数器
+ * @return uint64_t 所有线程的和
+ */
+uint64_t stats_get(stats_id_t id);
+
+/**
+ * @brief 创建共享内存并导出快照，其他进程可以随时读取而不需要停止协议栈
+ *
+ * @param name 共享内存名，NULL时使用STATS_SHM_NAME
+ * @return int 成功为0，失败为-1
+ */
+int stats_export_open(const char *name);
+
+/**
+ * @brief 距离上次导出是否已经超过STATS_EXPORT_MS
+ *
+ * @return int 需要导出为1，否则为0
+ */
+int stats_export_due();
+
+/**
+ * @brief 汇总计数器并写入共享内存
+ *
+ */
+void stats_export();
+
+/**
+ * @brief 关闭并删除共享内存
+ *
+ */
+void stats_export_close();
+#endif
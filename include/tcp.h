@@ -0,0 +1,303 @@
+#ifndef TCP_H
+#define TCP_H
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+#include "utils.h"
+
+#define TCP_FLAG_FIN 0x01 // 结束
+#define TCP_FLAG_SYN 0x02 // 同步
+#define TCP_FLAG_RST 0x04 // 复位
+#define TCP_FLAG_PSH 0x08 // 推送
+#define TCP_FLAG_ACK 0x10 // 确认
+
+#define TCP_MAX_SACK 4 // 最多记录的SACK块数
+
+#pragma pack(1)
+typedef struct tcp_hdr
+{
+    uint16_t src_port;       // 源端口
+    uint16_t dest_port;      // 目标端口
+    uint32_t seq;            // 序号
+    uint32_t ack;            // 确认号
+    uint8_t reserved : 4;    // 保留
+    uint8_t data_offset : 4; // 首部长, 4字节为单位
+    uint8_t flags;           // 标志
+    uint16_t window;         // 窗口大小
+    uint16_t checksum;       // 校验和
+    uint16_t urgent;         // 紧急指针
+} tcp_hdr_t;
+#pragma pack()
+
+typedef enum tcp_state
+{
+    TCP_CLOSED,      //关闭
+    TCP_LISTEN,      //监听
+    TCP_SYN_SENT,    //已发送SYN
+    TCP_SYN_RCVD,    //已收到SYN
+    TCP_ESTABLISHED, //已建立
+    TCP_FIN_WAIT_1,  //主动关闭，等待FIN的确认
+    TCP_FIN_WAIT_2,  //主动关闭，等待对方FIN
+    TCP_CLOSE_WAIT,  //被动关闭，等待应用关闭
+    TCP_CLOSING,     //同时关闭
+    TCP_LAST_ACK,    //被动关闭，等待FIN的确认
+    TCP_TIME_WAIT,   //等待2MSL
+} tcp_state_t;
+
+typedef enum tcp_event
+{
+    TCP_EVENT_ACCEPT,    //被动打开的连接已建立并进入等待队列
+    TCP_EVENT_CONNECTED, //主动打开的连接已建立
+    TCP_EVENT_RECV,      //有新的数据可读
+    TCP_EVENT_SEND,      //发送缓冲区有新的空间
+    TCP_EVENT_CLOSE,     //对方已关闭发送方向
+    TCP_EVENT_RESET,     //连接被复位或超时，之后连接不可再使用
+    TCP_EVENT_CLOSED,    //连接已完全关闭，之后连接不可再使用
+} tcp_event_t;
+
+typedef struct tcp_conn tcp_conn_t;
+typedef void (*tcp_handler_t)(tcp_conn_t *conn, tcp_event_t event);
+
+/**
+ * @brief 拥塞控制算法，通过tcp_cc_register注册
+ *
+ */
+typedef struct tcp_cc_ops
+{
+    const char *name;                                  //算法名称
+    void (*init)(tcp_conn_t *conn);                    //连接建立时初始化cwnd与ssthresh
+    void (*on_ack)(tcp_conn_t *conn, uint32_t acked);  //新数据被确认
+    void (*on_loss)(tcp_conn_t *conn, int timeout);    //快速重传(timeout为0)或超时重传(timeout为1)
+    void (*on_recovery_exit)(tcp_conn_t *conn);        //快速恢复结束
+} tcp_cc_ops_t;
+
+typedef struct tcp_ring
+{
+    uint32_t head;              //第一个有效字节的位置
+    uint32_t len;               //有效字节数
+    uint8_t data[TCP_BUF_SIZE]; //环形缓冲区
+} tcp_ring_t;
+
+typedef struct tcp_sack_block
+{
+    uint32_t start; //起始序号
+    uint32_t end;   //结束序号(不含)
+} tcp_sack_block_t;
+
+typedef struct tcp_listener tcp_listener_t;
+
+struct tcp_conn
+{
+    tcp_state_t state;                  //状态
+    uint8_t remote_ip[NET_IP_LEN];      //对方ip地址
+    uint16_t remote_port;               //对方端口号
+    uint16_t local_port;                //本地端口号
+    tcp_conn_t *hash_next;              //哈希链表中的下一个连接
+    tcp_listener_t *listener;           //被动打开时所属的监听端口
+    tcp_handler_t handler;              //事件处理程序
+    void *user;                         //留给应用使用
+
+    uint32_t iss;                       //初始发送序号
+    uint32_t snd_una;                   //最早未被确认的序号
+    uint32_t snd_nxt;                   //下一个要发送的序号
+    uint32_t snd_max;                   //已发送过的最大序号
+    uint32_t snd_wnd;                   //对方通告的窗口(已缩放)
+    uint32_t snd_wl1, snd_wl2;          //最后一次更新窗口时的seq与ack
+    uint32_t fin_seq;                   //FIN的序号
+    uint16_t mss;                       //发送方向的最大报文段长度
+    uint8_t snd_wscale;                 //对方的窗口缩放因子
+    uint8_t rcv_wscale;                 //本方的窗口缩放因子
+    uint8_t sack_ok;                    //双方都支持SACK
+    uint8_t fin_pending;                //应用已关闭，待发送FIN
+    uint8_t fin_sent;                   //FIN已发送
+    uint8_t probe;                      //需要发送零窗口探测
+    uint8_t wscale_ok;                  //双方都支持窗口缩放
+
+    tcp_sack_block_t sacked[TCP_MAX_SACK]; //对方SACK通告的已收到的数据块
+    int sacked_cnt;
+    uint32_t rexmit_nxt;                //快速恢复中已重传到的序号
+
+    const tcp_cc_ops_t *cc;             //拥塞控制算法
+    uint32_t cwnd;                      //拥塞窗口
+    uint32_t ssthresh;                  //慢启动阈值
+    uint32_t cc_priv[4];                //拥塞控制算法私有数据
+    int dupacks;                        //连续重复ACK数
+    int in_recovery;                    //处于快速恢复
+    uint32_t recover;                   //进入快速恢复时的snd_max
+
+    int32_t srtt, rttvar;               //平滑RTT与RTT偏差(毫秒)
+    uint32_t rto;                       //重传超时时间(毫秒)
+    int retries;                        //连续超时次数
+    int rtt_timing;                     //正在测量RTT
+    uint32_t rtt_seq;                   //用于测量RTT的序号
+    uint64_t rtt_start;                 //开始测量RTT的时间
+    uint64_t rto_deadline;              //重传定时器，0表示未启动
+    uint64_t persist_deadline;          //坚持定时器，只被零窗口阻塞发送时启动，0表示未启动
+    uint32_t persist_backoff;           //坚持定时器的当前间隔(毫秒)，窗口打开时清零
+
+    uint32_t irs;                       //初始接收序号
+    uint32_t rcv_nxt;                   //期望收到的下一个序号
+    tcp_sack_block_t ooo[TCP_MAX_SACK]; //已收到的乱序数据块，最新的在前
+    int ooo_cnt;
+    int ack_pending;                    //已收到但未确认的报文段数
+    uint64_t delack_deadline;           //延迟ACK定时器，0表示未启动
+    uint64_t timewait_deadline;         //TIME_WAIT定时器
+
+    tcp_ring_t snd;                     //发送缓冲区，从snd_una开始
+    tcp_ring_t rcv;                     //接收缓冲区，从应用未读取的数据开始
+};
+
+struct tcp_listener
+{
+    int valid;                                //有效位
+    uint16_t port;                            //端口号
+    int backlog;                              //等待队列长度
+    int pending;                              //正在握手的连接数
+    int head, count;                          //已建立未accept的连接队列
+    tcp_conn_t *queue[TCP_MAX_BACKLOG];
+    tcp_handler_t handler;                    //连接继承的事件处理程序
+};
+
+/**
+ * @brief 初始化tcp协议
+ *
+ * @return int 成功为0，内存区域不足时为-1
+ */
+int tcp_init();
+
+/**
+ * @brief 处理一个收到的tcp数据包
+ *
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址
+ */
+void tcp_in(buf_t *buf, uint8_t *src_ip);
+
+/**
+ * @brief 处理tcp的定时器，由协议栈轮询调用
+ *
+ */
+void tcp_poll();
+
+/**
+ * @brief 注册一个拥塞控制算法
+ *
+ * @param ops 算法
+ * @return int 成功为0，失败为-1
+ */
+int tcp_cc_register(const tcp_cc_ops_t *ops);
+
+/**
+ * @brief 为连接选择拥塞控制算法
+ *
+ * @param conn 连接
+ * @param name 算法名称
+ * @return int 成功为0，未找到为-1
+ */
+int tcp_set_cc(tcp_conn_t *conn, const char *name);
+
+/**
+ * @brief 打开一个tcp端口进行监听
+ *
+ * @param port 端口号
+ * @param backlog 等待队列长度
+ * @param handler 新连接的事件处理程序
+ * @return int 成功为0，失败为-1
+ */
+int tcp_listen(uint16_t port, int backlog, tcp_handler_t handler);
+
+/**
+ * @brief 关闭一个tcp监听端口，已建立的连接不受影响
+ *
+ * @param port 端口号
+ */
+void tcp_unlisten(uint16_t port);
+
+/**
+ * @brief 从监听端口的等待队列中取出一个已建立的连接
+ *
+ * @param port 端口号
+ * @return tcp_conn_t* 连接，队列为空时为NULL
+ */
+tcp_conn_t *tcp_accept(uint16_t port);
+
+/**
+ * @brief 主动打开一个tcp连接
+ *
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param handler 事件处理程序
+ * @return tcp_conn_t* 连接，失败为NULL
+ */
+tcp_conn_t *tcp_connect(uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port, tcp_handler_t handler);
+
+/**
+ * @brief 获取发送缓冲区中可直接写入的连续空间，写入后调用tcp_send_commit
+ *
+ * @param conn 连接
+ * @param len 返回可写入的长度
+ * @return uint8_t* 可写入的起始地址
+ */
+uint8_t *tcp_send_buf(tcp_conn_t *conn, uint32_t *len);
+
+/**
+ * @brief 提交已写入发送缓冲区的数据并尝试发送
+ *
+ * @param conn 连接
+ * @param len 写入的长度
+ * @return int 成功为0，失败为-1
+ */
+int tcp_send_commit(tcp_conn_t *conn, uint32_t len);
+
+/**
+ * @brief 复制数据到发送缓冲区并尝试发送
+ *
+ * @param conn 连接
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @return int 放入发送缓冲区的长度，失败为-1
+ */
+int tcp_send(tcp_conn_t *conn, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief 获取接收缓冲区中可直接读取的连续数据，读取后调用tcp_recv_consume
+ *
+ * @param conn 连接
+ * @param len 返回可读取的长度
+ * @return uint8_t* 可读取的起始地址
+ */
+uint8_t *tcp_recv_buf(tcp_conn_t *conn, uint32_t *len);
+
+/**
+ * @brief 释放接收缓冲区中已读取的数据，必要时通告新的窗口
+ *
+ * @param conn 连接
+ * @param len 已读取的长度
+ */
+void tcp_recv_consume(tcp_conn_t *conn, uint32_t len);
+
+/**
+ * @brief 从接收缓冲区复制数据
+ *
+ * @param conn 连接
+ * @param data 目的地址
+ * @param len 最多复制的长度
+ * @return int 复制的长度
+ */
+int tcp_recv(tcp_conn_t *conn, uint8_t *data, uint32_t len);
+
+/**
+ * @brief 关闭连接的发送方向，发送完缓冲区中的数据后发送FIN
+ *
+ * @param conn 连接
+ */
+void tcp_close(tcp_conn_t *conn);
+
+/**
+ * @brief 发送RST并立即释放连接
+ *
+ * @param conn 连接
+ */
+void tcp_abort(tcp_conn_t *conn);
+#endif
@@ -0,0 +1,187 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "stats.h"
+#include "utils.h"
+
+/**
+ * @brief 可以单独打开跟踪的层，X(名称, 显示的名字)
+ *
+ */
+#define TRACE_LAYER_LIST(X) \
+    X(DRIVER, "driver")     \
+    X(ETHERNET, "ethernet") \
+    X(ARP, "arp")           \
+    X(IP, "ip")             \
+    X(ICMP, "icmp")         \
+    X(UDP, "udp")           \
+    X(TCP, "tcp")
+
+/**
+ * @brief 跟踪事件，X(名称, 显示的名字, 参数名)
+ *        参数名以ip开头的按ip地址显示，reason按统计计数器名显示，flags按十六进制显示
+ */
+#define TRACE_EVENT_LIST(X)                                     \
+    X(RX, "rx", "len,proto")                                    \
+    X(TX, "tx", "len,proto")                                    \
+    X(DROP, "drop", "reason")                                   \
+    X(ARP_UPDATE, "arp_update", "ip,state")                     \
+    X(ARP_REQUEST, "arp_request", "ip")                         \
+    X(ARP_QUEUE, "arp_queue", "ip,len")                         \
+    X(IP_FRAGMENT, "fragment", "ip,id,offset,mf,len")           \
+    X(ICMP_ERROR, "icmp_error", "ip,code")                      \
+    X(UDP_DELIVER, "deliver", "ip,sport,dport,len")             \
+    X(TCP_IN, "seg_in", "ip,sport,dport,flags,len")             \
+    X(TCP_OUT, "seg_out", "ip,sport,dport,flags,len")           \
+    X(TCP_RETRANSMIT, "retransmit", "lport,seq,len")            \
+    X(TCP_TIMEOUT, "timeout", "lport,retries,rto")
+
+typedef enum trace_layer
+{
+#define TRACE_LAYER_ENUM(id, name) TRACE_LAYER_##id,
+    TRACE_LAYER_LIST(TRACE_LAYER_ENUM)
+#undef TRACE_LAYER_ENUM
+    TRACE_LAYER_MAX,
+} trace_layer_t;
+
+typedef enum trace_event
+{
+#define TRACE_EVENT_ENUM(id, name, args) TRACE_##id,
+    TRACE_EVENT_LIST(TRACE_EVENT_ENUM)
+#undef TRACE_EVENT_ENUM
+    TRACE_EVENT_MAX,
+} trace_event_t;
+
+#define TRACE_ARGS 5
+
+/**
+ * @brief 一条跟踪记录，固定32字节
+ *
+ */
+typedef struct trace_rec
+{
+    uint64_t ts;              //时间戳计数
+    uint16_t event;           //trace_event_t
+    uint8_t layer;            //trace_layer_t
+    uint8_t reserved;
+    uint32_t arg[TRACE_ARGS]; //参数
+} trace_rec_t;
+
+/**
+ * @brief 每个线程一个环形缓冲区，只有所属线程写入，写满后覆盖最旧的记录
+ *
+ */
+typedef struct trace_ring
+{
+    uint64_t head;                    //已写入的记录总数
+    trace_rec_t rec[TRACE_RING_SIZE];
+} trace_ring_t;
+
+#define TRACE_FILE_MAGIC 0x4352544e //"NTRC"
+#define TRACE_FILE_VERSION 1
+
+/**
+ * @brief 跟踪文件头，其后是每个线程的trace_file_ring_t和按时间顺序排列的记录
+ *
+ */
+typedef struct trace_file_hdr
+{
+    uint32_t magic;          //TRACE_FILE_MAGIC
+    uint32_t version;        //TRACE_FILE_VERSION
+    uint32_t rec_size;       //sizeof(trace_rec_t)
+    uint32_t rings;          //线程数
+    uint64_t ticks_per_sec;  //时间戳计数的频率
+} trace_file_hdr_t;
+
+typedef struct trace_file_ring
+{
+    uint32_t thread;         //线程序号
+    uint32_t reserved;
+    uint64_t count;          //记录数
+} trace_file_ring_t;
+
+/**
+ * @brief 按层打开的跟踪掩码，第i位对应trace_layer_t中的第i层
+ *
+ */
+extern uint32_t trace_mask;
+extern __thread trace_ring_t *trace_local;
+
+/**
+ * @brief 为当前线程分配环形缓冲区，线程数超过TRACE_MAX_THREADS时返回NULL
+ *
+ */
+trace_ring_t *trace_register();
+
+static inline void trace_write(int layer, int event, const uint32_t *arg)
+{
+    trace_ring_t *ring = trace_local ? trace_local : trace_register();
+    if (ring == NULL)
+        return;
+    uint64_t head = ring->head;
+    trace_rec_t *rec = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+    rec->ts = tsc_now();
+    rec->event = event;
+    rec->layer = layer;
+    rec->reserved = 0;
+    memcpy(rec->arg, arg, sizeof(rec->arg));
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief ip地址按网络字节序存入一个参数
+ *
+ */
+static inline uint32_t trace_ip(const uint8_t *ip)
+{
+    uint32_t v;
+    memcpy(&v, ip, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief 记录一个事件，该层未打开时只有一次判断的开销，省略的参数为0
+ *
+ */
+#define TRACE(layer, event, ...)                                                                \
+    do                                                                                          \
+    {                                                                                           \
+        if (__builtin_expect((trace_mask >> TRACE_LAYER_##layer) & 1, 0))                       \
+            trace_write(TRACE_LAYER_##layer, TRACE_##event, (const uint32_t[TRACE_ARGS]){__VA_ARGS__}); \
+    } while (0)
+
+/**
+ * @brief 丢弃一个包：增加丢包计数并记录丢包原因
+ *
+ */
+#define NET_DROP(layer, id)                              \
+    do                                                   \
+    {                                                    \
+        STATS_INC(id);                                   \
+        TRACE(layer, DROP, STATS_##id);                  \
+    } while (0)
+
+/**
+ * @brief 根据NET_TRACE环境变量打开跟踪，如"ip,udp"或"all"，
+ *        退出时把记录写入NET_TRACE_FILE(默认trace.bin)
+ *
+ */
+void trace_init();
+
+/**
+ * @brief 设置打开跟踪的层
+ *
+ * @param mask 第i位对应trace_layer_t中的第i层
+ */
+void trace_enable(uint32_t mask);
+
+/**
+ * @brief 把所有线程的记录写入文件，应在各线程停止写入后调用
+ *
+ * @param path 文件名
+ * @return int 成功为0，失败为-1
+ */
+int trace_dump(const char *path);
+#endif
@@ -1,6 +1,7 @@
 #ifndef UDP_H
 #define UDP_H
 #include <stdint.h>
+#include "net.h"
 #include "utils.h"
 #pragma pack(1)
 typedef struct udp_hdr
@@ -22,19 +23,65 @@ typedef struct udp_peso_hdr
 #pragma pack()
 
 typedef struct udp_entry udp_entry_t;
+/**
+ * @brief udp处理程序，buf为去掉udp头部后的数据
+ *        net_conf.rx_timestamp打开时buf->ts带有接收时间戳：sw为驱动或内核收到帧的时间，
+ *        hw为网卡的时间(没有为0)，stack为协议栈开始处理的时间；time_ns() - buf->ts.stack为在协议栈内的时间
+ * 
+ */
 typedef void (*udp_handler_t)(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf);
+
+/**
+ * @brief 批量交付中的一项：一个数据报，或合并后同一来源的若干个连续数据报
+ *        各数据报保持各自的buf_t(去掉了udp头部，带有长度与接收时间戳)，不复制负载
+ * 
+ */
+typedef struct udp_dgram
+{
+    uint8_t src_ip[NET_IP_LEN]; //源ip地址
+    uint16_t src_port;          //源端口号
+    uint16_t seg_num;           //数据报个数，不合并时为1
+    uint32_t len;               //各数据报负载的总长度
+    buf_t *seg[BUF_MAX_SEG];    //各数据报，按到达顺序
+} udp_dgram_t;
+
+/**
+ * @brief 批量处理程序，一次收到同一本地端口的num项，返回后各buf_t不再有效
+ * 
+ */
+typedef void (*udp_batch_handler_t)(udp_entry_t *entry, udp_dgram_t *dgram, int num);
 struct udp_entry
 {
-    int valid;             //有效位
-    int port;              //端口号
-    udp_handler_t handler; //处理程序
+    int valid;                         //有效位
+    int port;                          //端口号
+    udp_handler_t handler;             //处理程序
+    udp_batch_handler_t batch_handler; //批量处理程序，不为NULL时代替handler
+    int coalesce;                      //批量交付时是否合并同一来源的连续数据报
+    int batch;                         //待交付的批在udp_batches中的位置
 };
 
+/**
+ * @brief 零拷贝发送的完成回调，驱动释放帧后调用，回调返回后buf回到发送缓冲池
+ * 
+ */
+typedef void (*udp_done_t)(buf_t *buf, void *ctx);
+
+/**
+ * @brief 发送缓冲池中的一个缓冲区
+ * 
+ */
+typedef struct udp_txbuf
+{
+    buf_t buf;  //必须是第一个成员，由buf_t指针找回所在的缓冲区
+    int in_use; //是否已分配
+} udp_txbuf_t;
+
 /**
  * @brief 初始化udp协议
  * 
+ * @return int 成功为0，内存区域不足时为-1
  */
-void udp_init();
+int udp_init();
 
 /**
  * @brief 处理一个收到的udp数据包
@@ -44,6 +91,12 @@ void udp_init();
  */
 void udp_in(buf_t *buf, uint8_t *src_ip);
 
+/**
+ * @brief 把各端口积压的批交给批量处理程序，net_poll()每次从驱动收取并处理完后调用
+ * 
+ */
+void udp_flush();
+
 /**
  * @brief 处理一个要发送的数据包
  * 
@@ -54,6 +107,16 @@ void udp_in(buf_t *buf, uint8_t *src_ip);
  */
 void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
 
+/**
+ * @brief 处理一个要发送的分段数据包，UDP头部添加到头部段中
+ * 
+ * @param chain 要处理的包
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ */
+void udp_out_chain(buf_chain_t *chain, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+
 /**
  * @brief 发送一个udp包
  * 
@@ -69,15 +132,68 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
  * @brief 打开一个udp端口并注册处理程序
  * 
  * @param port 端口号
- * @param handler 处理程序
+ * @param handler 处理程序，收到的数据带有接收时间戳，见udp_handler_t
  * @return int 成功为0，失败为-1
  */
 int udp_open(uint16_t port, udp_handler_t handler);
 
 /**
- * @brief 关闭一个udp端口
+ * @brief 打开一个udp端口并注册批量处理程序：一次轮询中发往该端口的数据报先积压起来，
+ *        由udp_flush()一次交给处理程序，积压到UDP_BATCH_MAX项时提前交付
+ *        矢量处理图或优先级接收队列一次轮询处理多个包时才有多于一项的批
+ * 
+ * @param port 端口号
+ * @param handler 批量处理程序
+ * @param coalesce 为1时同一源ip与源端口的连续数据报合并为一项，至多BUF_MAX_SEG个
+ * @return int 成功为0，表已满或已有UDP_BATCH_PORTS个批量端口时为-1
+ */
+int udp_open_batch(uint16_t port, udp_batch_handler_t handler, int coalesce);
+
+/**
+ * @brief 关闭一个udp端口，积压的数据报被丢弃
  * 
  * @param port 端口号
  */
 void udp_close(uint16_t port);
-#endif
\ No newline at end of file
+/**
+ * @brief 从发送缓冲池分配一个缓冲区，buf->data处有len字节供应用直接写入负载，
+ *        前面为UDP、IP与以太网头部留出了空间
+ * 
+ * @param len 负载长度
+ * @return buf_t* 缓冲区，池已用完或len过大时为NULL
+ */
+buf_t *udp_alloc(uint16_t len);
+
+/**
+ * @brief 把未发送的缓冲区还给发送缓冲池
+ * 
+ * @param buf udp_alloc()得到的缓冲区
+ */
+void udp_free(buf_t *buf);
+
+/**
+ * @brief 零拷贝发送：在buf中原地添加各层头部并交给驱动，协议栈不再复制负载
+ *        调用后buf归协议栈所有，驱动释放帧后调用done，再把buf还给缓冲池
+ * 
+ * @param buf udp_alloc()得到并已写入负载的缓冲区
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param done 完成回调，可为NULL
+ * @param ctx 传给回调的参数
+ */
+void udp_send_buf(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port, udp_done_t done, void *ctx);
+
+/**
+ * @brief 分散发送：负载由应用内存中的若干段依次组成，与协议栈构造的头部一起交给驱动，不先合并
+ *        返回后各段即可重用
+ * 
+ * @param iov 负载的各段
+ * @param cnt 段数，不超过BUF_MAX_SEG - 1
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @return int 成功为0，段数过多或负载过长为-1
+ */
+int udp_sendv(const struct iovec *iov, int cnt, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+#endif
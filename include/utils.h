@@ -1,16 +1,53 @@
 #ifndef UTILS_H
 #define UTILS_H
 #include <stdint.h>
+#include <sys/uio.h>
 #include "config.h"
 #define BUF_MAX_LEN (UINT16_MAX + 14) //最大udp包 + 以太网帧报头长度
 
+/**
+ * @brief 数据包的校验和状态，接收时由驱动填写，发送时由传输层填写，buf_init()时为BUF_CSUM_NONE
+ * 
+ */
+typedef enum buf_csum
+{
+    BUF_CSUM_NONE,    // 接收时各层自己校验；发送时校验和已由协议栈算好
+    BUF_CSUM_VALID,   // 接收：内核或网卡已确认传输层校验和正确，udp_in与tcp_in不再计算；IP头部校验和仍由ip_demux检查
+    BUF_CSUM_PARTIAL, // 发送：传输层校验和字段中只有伪首部的部分和，由设备从传输层头部开始补全
+} buf_csum_t;
+
+/**
+ * @brief 收到数据包的时间戳，均为CLOCK_REALTIME的纳秒数，0表示没有，net_conf.rx_timestamp打开时由驱动与协议栈填写
+ * 
+ */
+typedef struct buf_ts
+{
+    uint64_t sw;    // 软件时间戳：内核收到帧的时间，后端拿不到内核时间戳时为驱动取到帧的时间
+    uint64_t hw;    // 硬件时间戳：网卡收到帧的时间(SO_TIMESTAMPING)，网卡或后端不支持时为0
+    uint64_t stack; // 协议栈从驱动取到帧、开始处理的时间
+} buf_ts_t;
+
 typedef struct buf
 {
     uint16_t len;                       // 包中有效数据大小
+    uint8_t csum;                       // 校验和状态，见buf_csum_t
+    uint8_t csum_offset;                // BUF_CSUM_PARTIAL时校验和字段相对传输层头部的偏移
     uint8_t *data;                      // 包的数据起始地址
+    buf_ts_t ts;                        // 接收时间戳
     uint8_t payload[BUF_MAX_LEN];       // 最大负载数据量
 } buf_t;
-static buf_t rxbuf, txbuf;          //一个buf足够单线程使用
+
+/**
+ * @brief 分段的数据包：各层头部在hdr中原地添加，其后依次是seg中的负载段
+ *        负载段可以位于任意内存，发送时与头部一起以iovec交给驱动，不复制到hdr中
+ * 
+ */
+typedef struct buf_chain
+{
+    buf_t *hdr;                    // 头部段
+    int seg_num;                   // 负载段个数
+    struct iovec seg[BUF_MAX_SEG]; // 负载段
+} buf_chain_t;
 
 /**
  * @brief 初始化buffer为给定的长度，用于装载数据包
@@ -44,6 +81,22 @@ void buf_remove_header(buf_t *buf, int len);
  */
 void buf_copy(buf_t *dst, buf_t *src);
 
+/**
+ * @brief 分段数据包的总长度
+ * 
+ * @param chain 分段数据包
+ * @return uint32_t 头部段与所有负载段的长度之和
+ */
+uint32_t buf_chain_len(const buf_chain_t *chain);
+
+/**
+ * @brief 把分段数据包合并到一个buffer中
+ * 
+ * @param dst 目的buffer
+ * @param chain 分段数据包，总长度不能超过BUF_MAX_LEN
+ */
+void buf_chain_copy(buf_t *dst, const buf_chain_t *chain);
+
 /**
  * @brief 计算16位校验和
  * 
@@ -53,6 +106,78 @@ void buf_copy(buf_t *dst, buf_t *src);
  */
 uint16_t checksum16(uint16_t *buf, int len);
 
+/**
+ * @brief 计算若干段内存依次连接后的16位校验和，段长度可以为奇数
+ * 
+ * @param iov 各段
+ * @param cnt 段数
+ * @return uint16_t 校验和
+ */
+uint16_t checksum16_iov(const struct iovec *iov, int cnt);
+
+/**
+ * @brief 计算伪首部的部分和(不取反)，发送时填入传输层校验和字段，由设备补全(BUF_CSUM_PARTIAL)
+ * 
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @param protocol 传输层协议
+ * @param len 传输层头部与数据的总长度
+ * @return uint16_t 伪首部的部分和
+ */
+uint16_t checksum_pseudo(const uint8_t *src_ip, const uint8_t *dest_ip, uint8_t protocol, uint16_t len);
+
+/**
+ * @brief 增量更新16位校验和
+ * 
+ * @param checksum 原校验和
+ * @param old_val 被修改的16位字的原值
+ * @param new_val 被修改的16位字的新值
+ * @return uint16_t 新的校验和
+ */
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_val, uint16_t new_val);
+
+/**
+ * @brief 获取毫秒级的单调时间，用于协议定时器
+ * 
+ * @return uint64_t 当前时间(毫秒)
+ */
+uint64_t time_ms();
+
+/**
+ * @brief 获取纳秒级的系统时间(CLOCK_REALTIME)，与内核的接收时间戳可以直接比较
+ * 
+ * @return uint64_t 当前时间(纳秒)
+ */
+uint64_t time_ns();
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+/**
+ * @brief 读取时间戳计数器，用于跟踪、时延直方图与基准测试的高精度计时
+ * 
+ * @return uint64_t 时间戳计数
+ */
+static inline uint64_t tsc_now()
+{
+    return __rdtsc();
+}
+#else
+#include <time.h>
+static inline uint64_t tsc_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/**
+ * @brief 获取时间戳计数器的频率，第一次调用时用单调时钟测量，约耗时10毫秒
+ * 
+ * @return uint64_t 每秒的计数
+ */
+uint64_t tsc_ticks_per_sec();
+
 /**
  * @brief ip转字符串
  * 
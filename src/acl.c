@@ -0,0 +1,348 @@
+#include "acl.h"
+#include "net.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if ACL_MAX_RULE > 32
+#error "ACL_MAX_RULE must not exceed 32"
+#endif
+
+#define ACL_BOUND_MAX (2 * ACL_MAX_RULE + 1) //区间表的最大长度
+
+typedef uint32_t acl_mask_t; //规则位图，第i位为第i条规则
+
+/**
+ * @brief 一条规则
+ *
+ */
+typedef struct acl_rule
+{
+    int drop;                      //1为drop，0为pass
+    int has_type, has_src, has_proto, has_dport;
+    uint16_t type;                 //以太网类型
+    uint32_t src, src_mask;        //源IP前缀，主机字节序
+    uint8_t proto;                 //IP协议号
+    uint16_t dport_lo, dport_hi;   //目的端口范围
+    char text[ACL_TEXT_LEN];       //规则原文
+} acl_rule_t;
+
+/**
+ * @brief 一个字段的区间表：bound递增，值v落在最后一个bound[i] <= v的区间，匹配的规则为mask[i]
+ *
+ */
+typedef struct acl_ranges
+{
+    int num;
+    uint32_t bound[ACL_BOUND_MAX];
+    acl_mask_t mask[ACL_BOUND_MAX];
+} acl_ranges_t;
+
+static acl_rule_t acl_rules[ACL_MAX_RULE];
+static int acl_rule_num;
+
+/**
+ * @brief 编译后的决策结构
+ *
+ */
+static struct
+{
+    int type_num;
+    uint16_t type_val[ACL_MAX_RULE]; //规则中出现过的以太网类型
+    acl_mask_t type_mask[ACL_MAX_RULE];
+    acl_mask_t type_any;             //没有指定type的规则
+    acl_mask_t no_ip;                //不需要IP头部字段的规则，用于非IP帧
+    acl_mask_t no_port;              //没有指定dport的规则，用于不带端口的IP包
+    acl_mask_t proto_mask[256];
+    acl_ranges_t src;
+    acl_ranges_t dport;
+} acl;
+
+/**
+ * @brief 查区间表，二分查找最后一个不大于v的边界
+ *
+ */
+static inline acl_mask_t acl_ranges_lookup(const acl_ranges_t *r, uint32_t v)
+{
+    int lo = 0, hi = r->num - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (r->bound[mid] <= v)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return r->mask[lo];
+}
+
+static int acl_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 由各规则的[lo, hi]区间建立区间表
+ *        所有区间的端点把值域分成若干段，每段内各规则是否匹配不变，只需对每段的起点求一次位图
+ *
+ * @param r 区间表
+ * @param lo 每条规则区间的下界
+ * @param hi 每条规则区间的上界
+ * @param used 每条规则是否指定了该字段，没有指定的在所有区间都匹配
+ */
+static void acl_ranges_build(acl_ranges_t *r, const uint32_t *lo, const uint32_t *hi, const int *used)
+{
+    uint32_t bound[ACL_BOUND_MAX];
+    int n = 0;
+    bound[n++] = 0;
+    for (int i = 0; i < acl_rule_num; i++)
+    {
+        if (!used[i])
+            continue;
+        bound[n++] = lo[i];
+        if (hi[i] != UINT32_MAX)
+            bound[n++] = hi[i] + 1;
+    }
+    qsort(bound, n, sizeof(bound[0]), acl_cmp_u32);
+    r->num = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (r->num && r->bound[r->num - 1] == bound[i])
+            continue;
+        acl_mask_t mask = 0;
+        for (int j = 0; j < acl_rule_num; j++)
+            if (!used[j] || (bound[i] >= lo[j] && bound[i] <= hi[j]))
+                mask |= 1u << j;
+        r->bound[r->num] = bound[i];
+        r->mask[r->num++] = mask;
+    }
+}
+
+/**
+ * @brief 把规则列表编译为决策结构
+ *
+ */
+static void acl_compile()
+{
+    uint32_t lo[ACL_MAX_RULE], hi[ACL_MAX_RULE];
+    int used[ACL_MAX_RULE];
+    memset(&acl, 0, sizeof(acl));
+    for (int i = 0; i < acl_rule_num; i++)
+    {
+        acl_rule_t *r = &acl_rules[i];
+        acl_mask_t bit = 1u << i;
+        if (!r->has_type)
+            acl.type_any |= bit;
+        else
+        {
+            int t = 0;
+            while (t < acl.type_num && acl.type_val[t] != r->type)
+                t++;
+            if (t == acl.type_num)
+                acl.type_val[acl.type_num++] = r->type;
+            acl.type_mask[t] |= bit;
+        }
+        if (!r->has_src && !r->has_proto && !r->has_dport)
+            acl.no_ip |= bit;
+        if (!r->has_dport)
+            acl.no_port |= bit;
+        for (int p = 0; p < 256; p++)
+            if (!r->has_proto || r->proto == p)
+                acl.proto_mask[p] |= bit;
+    }
+    for (int t = 0; t < acl.type_num; t++)
+        acl.type_mask[t] |= acl.type_any;
+
+    for (int i = 0; i < acl_rule_num; i++)
+    {
+        used[i] = acl_rules[i].has_src;
+        lo[i] = acl_rules[i].src;
+        hi[i] = acl_rules[i].src | ~acl_rules[i].src_mask;
+    }
+    acl_ranges_build(&acl.src, lo, hi, used);
+    for (int i = 0; i < acl_rule_num; i++)
+    {
+        used[i] = acl_rules[i].has_dport;
+        lo[i] = acl_rules[i].dport_lo;
+        hi[i] = acl_rules[i].dport_hi;
+    }
+    acl_ranges_build(&acl.dport, lo, hi, used);
+}
+
+/**
+ * @brief 解析一条规则
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int acl_parse(const char *text, acl_rule_t *r)
+{
+    char copy[ACL_TEXT_LEN], *save, *tok;
+    if (strlen(text) >= ACL_TEXT_LEN)
+        return -1;
+    memset(r, 0, sizeof(*r));
+    strcpy(r->text, text);
+    strcpy(copy, text);
+    if ((tok = strtok_r(copy, " \t", &save)) == NULL)
+        return -1;
+    if (strcmp(tok, "drop") == 0)
+        r->drop = 1;
+    else if (strcmp(tok, "pass") != 0)
+        return -1;
+    while ((tok = strtok_r(NULL, " \t", &save)) != NULL)
+    {
+        char *arg = strtok_r(NULL, " \t", &save), *end;
+        if (arg == NULL)
+            return -1;
+        if (strcmp(tok, "type") == 0)
+        {
+            r->has_type = 1;
+            if (strcmp(arg, "arp") == 0)
+                r->type = NET_PROTOCOL_ARP;
+            else if (strcmp(arg, "ip") == 0)
+                r->type = NET_PROTOCOL_IP;
+            else
+            {
+                unsigned long v = strtoul(arg, &end, 0);
+                if (*end || v > 0xFFFF)
+                    return -1;
+                r->type = v;
+            }
+        }
+        else if (strcmp(tok, "src") == 0)
+        {
+            uint8_t ip[NET_IP_LEN];
+            int len = 32, n;
+            char tail;
+            n = sscanf(arg, "%hhu.%hhu.%hhu.%hhu/%d%c", &ip[0], &ip[1], &ip[2], &ip[3], &len, &tail);
+            if ((n != 4 && n != 5) || (n == 4 && strchr(arg, '/')) || len < 0 || len > 32)
+                return -1;
+            r->has_src = 1;
+            r->src_mask = len ? ~0u << (32 - len) : 0;
+            r->src = ((uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3]) & r->src_mask;
+        }
+        else if (strcmp(tok, "proto") == 0)
+        {
+            r->has_proto = 1;
+            if (strcmp(arg, "icmp") == 0)
+                r->proto = NET_PROTOCOL_ICMP;
+            else if (strcmp(arg, "udp") == 0)
+                r->proto = NET_PROTOCOL_UDP;
+            else if (strcmp(arg, "tcp") == 0)
+                r->proto = NET_PROTOCOL_TCP;
+            else
+            {
+                unsigned long v = strtoul(arg, &end, 0);
+                if (*end || v > 0xFF)
+                    return -1;
+                r->proto = v;
+            }
+        }
+        else if (strcmp(tok, "dport") == 0)
+        {
+            unsigned long lo = strtoul(arg, &end, 0), hi = lo;
+            if (*end == '-')
+                hi = strtoul(end + 1, &end, 0);
+            if (*end || lo > hi || hi > 0xFFFF)
+                return -1;
+            r->has_dport = 1;
+            r->dport_lo = lo;
+            r->dport_hi = hi;
+        }
+        else
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 添加一条规则并重新编译
+ *
+ * @param rule 规则文本，如"drop src 10.0.0.0/8 proto udp dport 53"
+ * @return int 成功为0，格式错误或规则已满为-1
+ */
+int acl_add(const char *rule)
+{
+    if (acl_rule_num == ACL_MAX_RULE)
+    {
+        fprintf(stderr, "Error in acl_add: at most %d rules\n", ACL_MAX_RULE);
+        return -1;
+    }
+    if (acl_parse(rule, &acl_rules[acl_rule_num]) < 0)
+    {
+        fprintf(stderr, "Error in acl_add: bad rule \"%s\"\n", rule);
+        return -1;
+    }
+    acl_rule_num++;
+    acl_compile();
+    return 0;
+}
+
+/**
+ * @brief 删除所有规则
+ *
+ */
+void acl_clear()
+{
+    acl_rule_num = 0;
+    acl_compile();
+}
+
+/**
+ * @brief 对驱动交来的以太网帧做分类，计入命中规则的计数器
+ *        在任何校验和计算之前调用，帧长度至少为以太网头部
+ *
+ * @param buf 收到的以太网帧
+ * @return int 需要丢弃为1，否则为0
+ */
+int acl_filter(buf_t *buf)
+{
+    if (acl_rule_num == 0)
+        return 0;
+    const uint8_t *p = buf->data;
+    uint16_t type = p[12] << 8 | p[13];
+    acl_mask_t match = acl.type_any;
+    for (int t = 0; t < acl.type_num; t++)
+        if (acl.type_val[t] == type)
+        {
+            match = acl.type_mask[t];
+            break;
+        }
+
+    const uint8_t *ip = p + 14;
+    if (type == NET_PROTOCOL_IP && buf->len >= 14 + 20 && (ip[0] >> 4) == 4)
+    {
+        uint32_t src = (uint32_t)ip[12] << 24 | ip[13] << 16 | ip[14] << 8 | ip[15];
+        int hdr_len = (ip[0] & 0xF) * 4;
+        int first = ((ip[6] << 8 | ip[7]) & 0x1FFF) == 0;
+        match &= acl.proto_mask[ip[9]] & acl_ranges_lookup(&acl.src, src);
+        if ((ip[9] == NET_PROTOCOL_UDP || ip[9] == NET_PROTOCOL_TCP) && first && buf->len >= 14 + hdr_len + 4)
+            match &= acl_ranges_lookup(&acl.dport, ip[hdr_len + 2] << 8 | ip[hdr_len + 3]);
+        else
+            match &= acl.no_port;
+    }
+    else
+        match &= acl.no_ip;
+
+    if (match == 0)
+        return 0;
+    int i = __builtin_ctz(match);
+    STATS_ADD_ID(STATS_ACL_RULE0_HITS + i, 1);
+    if (acl_rules[i].drop)
+    {
+        NET_DROP(ETHERNET, ETH_DROP_ACL);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 按配置文件的格式打印所有规则
+ *
+ * @param f 输出文件
+ */
+void acl_dump(FILE *f)
+{
+    for (int i = 0; i < acl_rule_num; i++)
+        fprintf(f, "acl = %s\n", acl_rules[i].text);
+}
@@ -0,0 +1,190 @@
+#include "arena.h"
+#include "conf.h"
+#include "arp.h"
+#include "udp.h"
+#include "qos.h"
+#include "tcp.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define ARENA_ALIGN 64                                               //区域内每块的对齐
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_HUGEPAGE_SIZE (2 << 20)                                //大页大小
+#define ARENA_PAGE_SIZE 4096                                         //预先触发缺页的步长
+#define ARENA_MAX_NODE 1024                                          //节点掩码的位数
+#define ARENA_NET_BUFS 6 //各模块自己的数据包缓冲区：以太网接收，arp、icmp、ip、tcp、udp发送
+
+static uint8_t *arena;
+static size_t arena_size, arena_used;
+static arena_page_t arena_page;
+static int arena_node = -1;
+
+/**
+ * @brief 按配置计算所有表(包括TCP_MAX_CONN个tcp连接)与数据包缓冲区需要的空间，数据包缓冲区包括矢量处理图的vector_size个接收缓冲区
+ *        与优先级接收队列的qos_queue + 1个接收缓冲区
+ *
+ */
+static size_t arena_need()
+{
+    return ARENA_ROUND(sizeof(arp_entry_t) * net_conf.arp_max_entry) +
+           ARENA_ROUND(sizeof(arp_buf_t) * net_conf.arp_max_buf) +
+           ARENA_ROUND(sizeof(udp_entry_t) * net_conf.udp_max_handler) +
+           ARENA_ROUND(sizeof(udp_txbuf_t) * net_conf.udp_tx_bufs) +
+           ARENA_ROUND(sizeof(tcp_conn_t) * TCP_MAX_CONN) +
+           ARENA_ROUND(sizeof(buf_t *) * net_conf.qos_queue) * (QOS_CLASS_NUM + 1) +
+           ARENA_ROUND(sizeof(buf_t)) * (ARENA_NET_BUFS + net_conf.vector_size +
+                                         (net_conf.qos_queue ? net_conf.qos_queue + 1 : 0));
+}
+
+/**
+ * @brief 调用线程所在的NUMA节点
+ *
+ * @return int 节点号，未知为-1
+ */
+static int arena_current_node()
+{
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0)
+        return -1;
+    return node;
+}
+
+/**
+ * @brief 把区域首选放在节点上，在触发缺页之前调用
+ *        用MPOL_PREFERRED而不是MPOL_BIND，节点内存不足时仍可从别的节点分配；
+ *        单节点的机器或不支持NUMA的内核上mbind失败，直接忽略
+ *
+ */
+static void arena_bind(int node)
+{
+    unsigned long mask[ARENA_MAX_NODE / (8 * sizeof(unsigned long))] = {0};
+    if (node < 0 || node >= ARENA_MAX_NODE)
+        return;
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, arena, arena_size, MPOL_PREFERRED, mask, ARENA_MAX_NODE + 1, 0);
+}
+
+/**
+ * @brief 把区域的使用情况写入统计计数器
+ *
+ */
+static void arena_stats()
+{
+    STATS_SET(ARENA_SIZE, arena_size);
+    STATS_SET(ARENA_USED, arena_used);
+    STATS_SET(ARENA_PAGE_KIND, arena_page);
+    if (arena_node >= 0)
+        STATS_SET(ARENA_NODE, arena_node);
+}
+
+/**
+ * @brief 映射区域：先试预留的大页，没有则多映射2MB并截取按2MB对齐的一段，建议内核使用透明大页
+ *
+ * @param size 按大页取整后的大小
+ * @return int 成功为0，失败为-1
+ */
+static int arena_map_huge(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        arena = p;
+        arena_page = ARENA_PAGE_HUGETLB;
+        return 0;
+    }
+    p = mmap(NULL, size + ARENA_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    uint8_t *base = p;
+    arena = (uint8_t *)(((uintptr_t)base + ARENA_HUGEPAGE_SIZE - 1) & ~(uintptr_t)(ARENA_HUGEPAGE_SIZE - 1));
+    if (arena > base)
+        munmap(base, arena - base);
+    munmap(arena + size, ARENA_HUGEPAGE_SIZE - (arena - base));
+    arena_page = madvise(arena, size, MADV_HUGEPAGE) == 0 ? ARENA_PAGE_THP : ARENA_PAGE_NORMAL;
+    return 0;
+}
+
+/**
+ * @brief 创建内存区域并预先触发缺页，之后的分配与收发包不会再访问内核
+ *        先mbind再触发缺页，页才会分配在选定的节点上，所以不用MAP_POPULATE
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int arena_create()
+{
+    size_t size = arena_need();
+    if (net_conf.hugepage)
+    {
+        size_t huge = (size + ARENA_HUGEPAGE_SIZE - 1) & ~(size_t)(ARENA_HUGEPAGE_SIZE - 1);
+        if (arena_map_huge(huge) == 0)
+            size = huge;
+    }
+    if (arena == NULL)
+    {
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+        {
+            arena = NULL;
+            perror("Error in arena_create");
+            return -1;
+        }
+        arena_page = ARENA_PAGE_NORMAL;
+    }
+    arena_size = size;
+    arena_bind(net_conf.numa_node >= 0 ? net_conf.numa_node : arena_current_node());
+
+    for (size_t off = 0; off < arena_size; off += ARENA_PAGE_SIZE)
+        ((volatile uint8_t *)arena)[off] = 0;
+
+    int node;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, arena, MPOL_F_NODE | MPOL_F_ADDR) == 0)
+        arena_node = node;
+    arena_stats();
+    return 0;
+}
+
+/**
+ * @brief 从连续的内存区域中分配一块，不能释放
+ *
+ * @param size 大小
+ * @return void* 按缓存行对齐的内存，已清零，区域不足时为NULL
+ */
+void *arena_alloc(size_t size)
+{
+    if (arena == NULL && arena_create() < 0)
+        return NULL;
+    size = ARENA_ROUND(size);
+    if (arena_used + size > arena_size)
+    {
+        fprintf(stderr, "Error in arena_alloc: %zu bytes requested, %zu left\n", size, arena_size - arena_used);
+        return NULL;
+    }
+    void *p = arena + arena_used;
+    arena_used += size;
+    STATS_SET(ARENA_USED, arena_used);
+    return p;
+}
+
+/**
+ * @brief 查询内存区域的使用情况
+ *
+ * @param used 已分配的字节数，可为NULL
+ * @param page 使用的页，可为NULL
+ * @param node 内存实际所在的NUMA节点，未知为-1，可为NULL
+ * @return size_t 区域大小，尚未创建时为0
+ */
+size_t arena_usage(size_t *used, arena_page_t *page, int *node)
+{
+    if (used)
+        *used = arena_used;
+    if (page)
+        *page = arena_page;
+    if (node)
+        *node = arena_node;
+    return arena_size;
+}
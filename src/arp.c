@@ -2,10 +2,15 @@
 #include "utils.h"
 #include "ethernet.h"
 #include "config.h"
+#include "trace.h"
+#include "conf.h"
+#include "arena.h"
 #include <string.h>
 #include <stdio.h>
 
-#define MAX_ARP_BUF 5
+#define ARP_SNAPSHOT_MAGIC 0x53505241 //"ARPS"
+#define ARP_SNAPSHOT_VERSION 1
+
 /**
  * @brief 初始的arp包
  * 
@@ -15,21 +20,46 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type = swap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = DRIVER_IF_IP,
-    .sender_mac = DRIVER_IF_MAC,
     .target_mac = {0}};
 
 /**
- * @brief arp地址转换表
+ * @brief arp地址转换表，长度为net_conf.arp_max_entry，第一次arp_init()时分配
  * 
  */
-arp_entry_t arp_table[ARP_MAX_ENTRY];
+arp_entry_t *arp_table;
 
 /**
- * @brief 长度为10的arp分组队列，当等待arp回复时暂存未发送的数据包
+ * @brief 长度为net_conf.arp_max_buf的arp分组队列，当等待arp回复时暂存未发送的数据包
  * 
  */
-arp_buf_t arp_buf[MAX_ARP_BUF];
+arp_buf_t *arp_buf;
+
+/**
+ * @brief 快照文件头，其后是count个arp_snapshot_entry_t，均为本机字节序
+ *        本机ip或mac与保存时不同时快照作废
+ */
+typedef struct arp_snapshot_hdr
+{
+    uint32_t magic;           //ARP_SNAPSHOT_MAGIC
+    uint32_t version;         //ARP_SNAPSHOT_VERSION
+    uint32_t count;           //表项个数
+    uint32_t reserved;
+    int64_t saved;            //保存时间
+    uint8_t ip[NET_IP_LEN];   //保存时的本机ip
+    uint8_t mac[NET_MAC_LEN]; //保存时的本机mac
+    uint8_t pad[6];
+} arp_snapshot_hdr_t;
+
+typedef struct arp_snapshot_entry
+{
+    int64_t timeout;          //超时时间戳
+    uint8_t ip[NET_IP_LEN];
+    uint8_t mac[NET_MAC_LEN];
+    uint8_t pad[6];
+} arp_snapshot_entry_t;
+
+static time_t arp_snapshot_next; //下一次定期保存快照的时间
+static buf_t *arp_out_buf;        //构造arp请求与应答的缓冲区，第一次使用时从内存区域分配
 
 /**
  * @brief 更新arp表
@@ -38,6 +68,7 @@ arp_buf_t arp_buf[MAX_ARP_BUF];
  *        并记录超时时间，更改表项的状态为有效。
  *        如果ARP表中没有无效的表项，则找到超时时间最长的一条表项，
  *        将arp_update()函数传递进来的新的IP、MAC信息替换该表项，并记录超时时间，设置表项的状态为有效。
+ *        静态表项不会过期也不会被替换，已有静态表项的ip不再学习
  * 
  * @param ip ip地址
  * @param mac mac地址
@@ -45,35 +76,41 @@ arp_buf_t arp_buf[MAX_ARP_BUF];
  */
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 {
-    for(int i = 0; i < ARP_MAX_ENTRY; i++){
-        if(arp_table[i].state != ARP_INVALID && arp_table[i].timeout < time(0)){
+    TRACE(ARP, ARP_UPDATE, trace_ip(ip), state);
+    for(int i = 0; i < net_conf.arp_max_entry; i++){
+        if(arp_table[i].state == ARP_STATIC && memcmp(arp_table[i].ip, ip, NET_IP_LEN) == 0){
+            return;
+        }
+        if(arp_table[i].state != ARP_INVALID && arp_table[i].state != ARP_STATIC && arp_table[i].timeout < time(0)){
             arp_table[i].state = ARP_INVALID;
         }
     }
 
-    for(int i = 0; i < ARP_MAX_ENTRY; i++){
+    for(int i = 0; i < net_conf.arp_max_entry; i++){
         if(arp_table[i].state == ARP_INVALID){
             memcpy(arp_table[i].ip, ip, NET_IP_LEN);
             memcpy(arp_table[i].mac, mac, NET_MAC_LEN);
             arp_table[i].state = state;
-            arp_table[i].timeout = time(0) + ARP_TIMEOUT_SEC;
+            arp_table[i].timeout = time(0) + net_conf.arp_timeout_sec;
             return;
         }
     }
 
-    time_t min = time(0);
+    // 所有表项都未过期时timeout都不早于当前时间，从第一个动态表项开始比较，保证总能选出一项
     int index = -1;
-    for(int i = 0; i < ARP_MAX_ENTRY; i++){
-        if(min > arp_table[i].timeout){
-            min = arp_table[i].timeout;
+    for(int i = 0; i < net_conf.arp_max_entry; i++){
+        if(arp_table[i].state != ARP_STATIC && (index < 0 || arp_table[i].timeout < arp_table[index].timeout)){
             index = i;
         }
     }
+    if(index < 0){
+        return;
+    }
 
     memcpy(arp_table[index].ip, ip, NET_IP_LEN);
     memcpy(arp_table[index].mac, mac, NET_MAC_LEN);
     arp_table[index].state = state;
-    arp_table[index].timeout = time(0) + ARP_TIMEOUT_SEC;
+    arp_table[index].timeout = time(0) + net_conf.arp_timeout_sec;
     return;
 }
 
@@ -85,15 +122,15 @@ void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
  */
 static uint8_t *arp_lookup(uint8_t *ip)
 {
-    for (int i = 0; i < ARP_MAX_ENTRY; i++)
-        if (arp_table[i].state == ARP_VALID && memcmp(arp_table[i].ip, ip, NET_IP_LEN) == 0)
+    for (int i = 0; i < net_conf.arp_max_entry; i++)
+        if ((arp_table[i].state == ARP_VALID || arp_table[i].state == ARP_STATIC) && memcmp(arp_table[i].ip, ip, NET_IP_LEN) == 0)
             return arp_table[i].mac;
     return NULL;
 }
 
 /**
  * @brief 发送一个arp请求
- *        你需要调用buf_init对txbuf进行初始化
+ *        你需要调用buf_init对发送缓冲区进行初始化
  *        填写ARP报头，将ARP的opcode设置为ARP_REQUEST，注意大小端转换
  *        将ARP数据报发送到ethernet层
  * 
@@ -101,18 +138,19 @@ static uint8_t *arp_lookup(uint8_t *ip)
  */
 static void arp_req(uint8_t *target_ip)
 {
-    buf_init(&txbuf, sizeof(arp_pkt_t));
-    *(uint16_t *)txbuf.data = arp_init_pkt.hw_type;
-    *(uint16_t *)(txbuf.data + 2) = arp_init_pkt.pro_type;
-    *(txbuf.data + 4) = arp_init_pkt.hw_len;
-    *(txbuf.data + 5) = arp_init_pkt.pro_len;
-    *(uint16_t *)(txbuf.data + 6) = swap16(ARP_REQUEST);
+    buf_t *tx = arena_buf(&arp_out_buf);
+    buf_init(tx, sizeof(arp_pkt_t));
+    *(uint16_t *)tx->data = arp_init_pkt.hw_type;
+    *(uint16_t *)(tx->data + 2) = arp_init_pkt.pro_type;
+    *(tx->data + 4) = arp_init_pkt.hw_len;
+    *(tx->data + 5) = arp_init_pkt.pro_len;
+    *(uint16_t *)(tx->data + 6) = swap16(ARP_REQUEST);
 
-    uint8_t *p = txbuf.data + 8;
-    memcpy(p, arp_init_pkt.sender_mac, NET_MAC_LEN);
+    uint8_t *p = tx->data + 8;
+    memcpy(p, net_if_mac, NET_MAC_LEN);
 
     p += NET_MAC_LEN;
-    memcpy(p, arp_init_pkt.sender_ip, NET_IP_LEN);
+    memcpy(p, net_if_ip, NET_IP_LEN);
 
     p += NET_IP_LEN;
     memcpy(p, arp_init_pkt.target_mac, NET_MAC_LEN);
@@ -120,7 +158,9 @@ static void arp_req(uint8_t *target_ip)
     p += NET_MAC_LEN;
     memcpy(p, target_ip, NET_IP_LEN);
 
-    ethernet_out(&txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
+    STATS_INC(ARP_TX_PKTS);
+    TRACE(ARP, ARP_REQUEST, trace_ip(target_ip));
+    ethernet_out(tx, ether_broadcast_mac, NET_PROTOCOL_ARP);
 }
 
 /**
@@ -142,17 +182,16 @@ static void arp_req(uint8_t *target_ip)
  */
 void arp_in(buf_t *buf)
 {
+    STATS_INC(ARP_RX_PKTS);
+    TRACE(ARP, RX, buf->len, swap16(*(uint16_t *)(buf->data + 6)));
+
     // 报头检查
-    if(*(uint16_t *)buf->data != arp_init_pkt.hw_type){
-        return;
-    }
-    if(*(uint16_t *)(buf->data + 2) != arp_init_pkt.pro_type){
-        return;
-    }
-    if(*(buf->data + 4) != arp_init_pkt.hw_len || *(buf->data + 5) != arp_init_pkt.pro_len){
-        return;
-    }
-    if(*(uint16_t *)(buf->data + 6) != swap16(ARP_REQUEST) && *(uint16_t *)(buf->data + 6) != swap16(ARP_REPLY)){
+    if(buf->len < sizeof(arp_pkt_t) ||
+       *(uint16_t *)buf->data != arp_init_pkt.hw_type ||
+       *(uint16_t *)(buf->data + 2) != arp_init_pkt.pro_type ||
+       *(buf->data + 4) != arp_init_pkt.hw_len || *(buf->data + 5) != arp_init_pkt.pro_len ||
+       (*(uint16_t *)(buf->data + 6) != swap16(ARP_REQUEST) && *(uint16_t *)(buf->data + 6) != swap16(ARP_REPLY))){
+        NET_DROP(ARP, ARP_DROP_BAD_HDR);
         return;
     }
 
@@ -161,7 +200,7 @@ void arp_in(buf_t *buf)
 
 
     // arp_buf有效
-    for(int i = 0; i < MAX_ARP_BUF; i++){
+    for(int i = 0; i < net_conf.arp_max_buf; i++){
         if(arp_buf[i].valid == 1){
             uint8_t *mac = arp_lookup(arp_buf[i].ip);
             if(mac){
@@ -175,19 +214,20 @@ void arp_in(buf_t *buf)
     if(*(uint16_t *)(buf->data + 6) == swap16(ARP_REQUEST)){
         if(memcmp(buf->data + 24, net_if_ip, NET_IP_LEN) == 0){
 
-            buf_init(&txbuf, sizeof(arp_pkt_t));
+            buf_t *tx = arena_buf(&arp_out_buf);
+            buf_init(tx, sizeof(arp_pkt_t));
 
-            *(uint16_t *)txbuf.data = arp_init_pkt.hw_type;
-            *(uint16_t *)(txbuf.data + 2) = arp_init_pkt.pro_type;
-            *(txbuf.data + 4) = arp_init_pkt.hw_len;
-            *(txbuf.data + 5) = arp_init_pkt.pro_len;
-            *(uint16_t *)(txbuf.data + 6) = swap16(ARP_REPLY);
+            *(uint16_t *)tx->data = arp_init_pkt.hw_type;
+            *(uint16_t *)(tx->data + 2) = arp_init_pkt.pro_type;
+            *(tx->data + 4) = arp_init_pkt.hw_len;
+            *(tx->data + 5) = arp_init_pkt.pro_len;
+            *(uint16_t *)(tx->data + 6) = swap16(ARP_REPLY);
 
-            uint8_t *p = txbuf.data + 8;
-            memcpy(p, arp_init_pkt.sender_mac, NET_MAC_LEN);
+            uint8_t *p = tx->data + 8;
+            memcpy(p, net_if_mac, NET_MAC_LEN);
 
             p += NET_MAC_LEN;
-            memcpy(p, arp_init_pkt.sender_ip, NET_IP_LEN);
+            memcpy(p, net_if_ip, NET_IP_LEN);
 
             p += NET_IP_LEN;
             memcpy(p, buf->data + 8, NET_MAC_LEN);
@@ -195,7 +235,9 @@ void arp_in(buf_t *buf)
             p += NET_MAC_LEN;
             memcpy(p, buf->data + 14, NET_IP_LEN);    
 
-            ethernet_out(&txbuf, buf->data + 8, NET_PROTOCOL_ARP);
+            STATS_INC(ARP_TX_PKTS);
+            TRACE(ARP, TX, tx->len, ARP_REPLY);
+            ethernet_out(tx, buf->data + 8, NET_PROTOCOL_ARP);
         }
     }
 }
@@ -221,28 +263,185 @@ void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         return;
     }
 
-    for(int i = 0; i < MAX_ARP_BUF; i++){
+    for(int i = 0; i < net_conf.arp_max_buf; i++){
         if(arp_buf[i].valid == 0){
-            arp_buf[i].buf = *buf;
-            arp_buf[i].buf.data = buf->data - buf->payload + arp_buf[i].buf.payload;
+            buf_init(&arp_buf[i].buf, buf->len); //buf->data可能不在buf的负载数组中(如AF_XDP的UMEM帧)，只复制数据
+            memcpy(arp_buf[i].buf.data, buf->data, buf->len);
+            arp_buf[i].buf.csum = buf->csum;
+            arp_buf[i].buf.csum_offset = buf->csum_offset;
             arp_buf[i].valid = 1;
             arp_buf[i].protocol = protocol;
             memcpy(arp_buf[i].ip, ip, NET_IP_LEN);
+            TRACE(ARP, ARP_QUEUE, trace_ip(ip), buf->len);
             arp_req(ip);
             return;
         }   
     }
+    NET_DROP(ARP, ARP_DROP_QUEUE_FULL);
+}
+
+/**
+ * @brief 处理一个要发送的分段数据包
+ *        找到MAC地址时直接交给ethernet层；否则只能合并为一个buffer，再按arp_out()缓存等待应答
+ * 
+ * @param chain 要处理的数据包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void arp_out_chain(buf_chain_t *chain, uint8_t *ip, net_protocol_t protocol)
+{
+    uint8_t *mac = arp_lookup(ip);
+
+    if(mac){
+        ethernet_out_chain(chain, mac, protocol);
+        return;
+    }
+    buf_t *tx = arena_buf(&arp_out_buf);
+    buf_chain_copy(tx, chain);
+    arp_out(tx, ip, protocol);
+}
+
+/**
+ * @brief 加载快照中未过期的表项
+ *        快照太旧、来自未来(时钟回拨)、格式不符或本机地址已改变时整个放弃，
+ *        单个表项按保存的超时时间检查，与静态表项重复的跳过
+ * 
+ * @return int 恢复的表项数，没有可用的快照为0
+ */
+static int arp_snapshot_load()
+{
+    if (net_conf.arp_snapshot[0] == 0)
+        return 0;
+    FILE *f = fopen(net_conf.arp_snapshot, "rb");
+    if (f == NULL)
+        return 0;
+    arp_snapshot_hdr_t hdr;
+    time_t now = time(0);
+    int restored = 0;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != ARP_SNAPSHOT_MAGIC || hdr.version != ARP_SNAPSHOT_VERSION)
+        fprintf(stderr, "arp: ignoring bad snapshot %s\n", net_conf.arp_snapshot);
+    else if (hdr.saved > now || now - hdr.saved > net_conf.arp_snapshot_max_age)
+        fprintf(stderr, "arp: ignoring snapshot %s saved %lld s ago\n", net_conf.arp_snapshot, (long long)(now - hdr.saved));
+    else if (memcmp(hdr.ip, net_if_ip, NET_IP_LEN) != 0 || memcmp(hdr.mac, net_if_mac, NET_MAC_LEN) != 0)
+        fprintf(stderr, "arp: ignoring snapshot %s taken with another address\n", net_conf.arp_snapshot);
+    else
+    {
+        arp_snapshot_entry_t e;
+        for (uint32_t n = 0; n < hdr.count && fread(&e, sizeof(e), 1, f) == 1; n++)
+        {
+            if (e.timeout <= now || arp_lookup(e.ip))
+                continue;
+            int i = 0;
+            while (i < net_conf.arp_max_entry && arp_table[i].state != ARP_INVALID)
+                i++;
+            if (i == net_conf.arp_max_entry)
+                break;
+            memcpy(arp_table[i].ip, e.ip, NET_IP_LEN);
+            memcpy(arp_table[i].mac, e.mac, NET_MAC_LEN);
+            arp_table[i].state = ARP_VALID;
+            arp_table[i].timeout = e.timeout;
+            restored++;
+        }
+        STATS_ADD(ARP_SNAPSHOT_RESTORED, restored);
+    }
+    fclose(f);
+    return restored;
+}
+
+/**
+ * @brief 把有效的动态表项保存到net_conf.arp_snapshot，先写临时文件再改名，不会留下写了一半的快照
+ * 
+ * @return int 成功或未配置快照文件为0，失败为-1
+ */
+int arp_snapshot_save()
+{
+    if (net_conf.arp_snapshot[0] == 0)
+        return 0;
+    char tmp[CONF_PATH_LEN + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", net_conf.arp_snapshot);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+    {
+        perror(tmp);
+        return -1;
+    }
+    time_t now = time(0);
+    arp_snapshot_hdr_t hdr = {.magic = ARP_SNAPSHOT_MAGIC, .version = ARP_SNAPSHOT_VERSION, .saved = now};
+    memcpy(hdr.ip, net_if_ip, NET_IP_LEN);
+    memcpy(hdr.mac, net_if_mac, NET_MAC_LEN);
+    for (int i = 0; i < net_conf.arp_max_entry; i++)
+        if (arp_table[i].state == ARP_VALID && arp_table[i].timeout > now)
+            hdr.count++;
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (int i = 0; ok && i < net_conf.arp_max_entry; i++)
+    {
+        if (arp_table[i].state != ARP_VALID || arp_table[i].timeout <= now)
+            continue;
+        arp_snapshot_entry_t e = {.timeout = arp_table[i].timeout};
+        memcpy(e.ip, arp_table[i].ip, NET_IP_LEN);
+        memcpy(e.mac, arp_table[i].mac, NET_MAC_LEN);
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    if (fclose(f) != 0 || !ok || rename(tmp, net_conf.arp_snapshot) != 0)
+    {
+        perror(net_conf.arp_snapshot);
+        remove(tmp);
+        return -1;
+    }
+    STATS_INC(ARP_SNAPSHOT_SAVED);
+    return 0;
+}
+
+/**
+ * @brief 到时间时保存arp表快照，由net_poll()调用
+ * 
+ */
+void arp_poll()
+{
+    if (net_conf.arp_snapshot[0] == 0 || net_conf.arp_snapshot_sec == 0)
+        return;
+    time_t now = time(0);
+    if (now < arp_snapshot_next)
+        return;
+    arp_snapshot_next = now + net_conf.arp_snapshot_sec;
+    arp_snapshot_save();
+}
+
+/**
+ * @brief 关闭arp协议，保存最后一次快照
+ * 
+ */
+void arp_close()
+{
+    arp_snapshot_save();
 }
 
 /**
  * @brief 初始化arp协议
+ *        先装入静态表项，再加载快照，重启后已知的邻居不需要重新解析
  * 
+ * @return int 成功为0，内存区域不足时为-1
  */
-void arp_init()
+int arp_init()
 {
-    for (int i = 0; i < ARP_MAX_ENTRY; i++)
+    if (arp_table == NULL && (arp_table = arena_alloc(sizeof(arp_entry_t) * net_conf.arp_max_entry)) == NULL)
+        return -1;
+    if (arp_buf == NULL && (arp_buf = arena_alloc(sizeof(arp_buf_t) * net_conf.arp_max_buf)) == NULL)
+        return -1;
+    for (int i = 0; i < net_conf.arp_max_entry; i++)
         arp_table[i].state = ARP_INVALID;
-    for (int i = 0; i < MAX_ARP_BUF; i++)
+    for (int i = 0; i < net_conf.arp_max_buf; i++)
         arp_buf[i].valid = 0;
+    for (int i = 0; i < net_conf.arp_static_num && i < net_conf.arp_max_entry; i++)
+    {
+        memcpy(arp_table[i].ip, net_conf.arp_static[i].ip, NET_IP_LEN);
+        memcpy(arp_table[i].mac, net_conf.arp_static[i].mac, NET_MAC_LEN);
+        arp_table[i].state = ARP_STATIC;
+    }
+    int restored = arp_snapshot_load();
+    if (restored)
+        fprintf(stderr, "arp: restored %d entries from %s\n", restored, net_conf.arp_snapshot);
+    arp_snapshot_next = time(0) + net_conf.arp_snapshot_sec;
     arp_req(net_if_ip);
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "conf.h"
+#include "net.h"
+#include "acl.h"
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t net_if_mac[NET_MAC_LEN] = DRIVER_IF_MAC;
+uint8_t net_if_ip[NET_IP_LEN] = DRIVER_IF_IP;
+
+net_conf_t net_conf = {
+    .if_name = DRIVER_IF_NAME,
+    .mtu = ETHERNET_MTU,
+    .arp_max_entry = ARP_MAX_ENTRY,
+    .arp_timeout_sec = ARP_TIMEOUT_SEC,
+    .arp_max_buf = MAX_ARP_BUF,
+    .udp_max_handler = UDP_MAX_HANDLER,
+    .udp_tx_bufs = UDP_TX_BUFS,
+    .hugepage = ARENA_USE_HUGEPAGE,
+    .numa_node = ARENA_NUMA_NODE,
+    .rx_timestamp = RX_TIMESTAMP,
+    .csum_offload = CSUM_OFFLOAD,
+    .vector_size = GRAPH_VECTOR_SIZE,
+    .qos_queue = QOS_QUEUE,
+    .qos_budget = QOS_BUDGET,
+    .qos_budget_us = QOS_BUDGET_US,
+    .qos_low_watermark = QOS_LOW_WATERMARK,
+    .qos_high_watermark = QOS_HIGH_WATERMARK,
+    .arp_snapshot = ARP_SNAPSHOT_FILE,
+    .arp_snapshot_sec = ARP_SNAPSHOT_SEC,
+    .arp_snapshot_max_age = ARP_SNAPSHOT_MAX_AGE,
+};
+
+/**
+ * @brief 整数配置项及其取值范围
+ *
+ */
+static const struct
+{
+    const char *key;
+    int *value;
+    int min, max;
+} conf_ints[] = {
+    {"mtu", &net_conf.mtu, 68, ETHERNET_MAX_MTU},
+    {"arp_max_entry", &net_conf.arp_max_entry, 1, 1 << 20},
+    {"arp_timeout_sec", &net_conf.arp_timeout_sec, 1, 1 << 30},
+    {"arp_max_buf", &net_conf.arp_max_buf, 1, 1 << 10},
+    {"udp_max_handler", &net_conf.udp_max_handler, 1, 65536},
+    {"udp_tx_bufs", &net_conf.udp_tx_bufs, 1, 1024},
+    {"hugepage", &net_conf.hugepage, 0, 1},
+    {"numa_node", &net_conf.numa_node, -1, 1023},
+    {"rx_timestamp", &net_conf.rx_timestamp, 0, 2},
+    {"csum_offload", &net_conf.csum_offload, 0, 1},
+    {"vector_size", &net_conf.vector_size, 0, GRAPH_VECTOR_MAX},
+    {"qos_queue", &net_conf.qos_queue, 0, QOS_QUEUE_MAX},
+    {"qos_budget", &net_conf.qos_budget, 1, QOS_QUEUE_MAX},
+    {"qos_budget_us", &net_conf.qos_budget_us, 0, 1000000},
+    {"qos_low_watermark", &net_conf.qos_low_watermark, 0, 100},
+    {"qos_high_watermark", &net_conf.qos_high_watermark, 0, 100},
+    {"arp_snapshot_sec", &net_conf.arp_snapshot_sec, 0, 1 << 30},
+    {"arp_snapshot_max_age", &net_conf.arp_snapshot_max_age, 0, 1 << 30},
+};
+
+/**
+ * @brief 解析点分十进制的ip地址
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int conf_parse_ip(const char *s, uint8_t *ip)
+{
+    char end;
+    return sscanf(s, "%hhu.%hhu.%hhu.%hhu%c", &ip[0], &ip[1], &ip[2], &ip[3], &end) == 4 ? 0 : -1;
+}
+
+/**
+ * @brief 解析冒号分隔的mac地址
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int conf_parse_mac(const char *s, uint8_t *mac)
+{
+    char end;
+    return sscanf(s, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &end) == 6 ? 0 : -1;
+}
+
+/**
+ * @brief 设置一个配置项，ip与mac写入net_if_ip与net_if_mac
+ *
+ * @param key 配置项名，与net_conf_t的成员同名，另有ip、mac，以及每次添加一条规则的acl、
+ *            每次添加一个静态表项的arp_static(值为"ip mac")、
+ *            每次添加一个优先处理的UDP端口的qos_udp_port
+ * @param value 值
+ * @return int 成功为0，失败为-1
+ */
+int conf_set(const char *key, const char *value)
+{
+    if (strcmp(key, "if_name") == 0)
+    {
+        if (strlen(value) >= CONF_IF_NAME_LEN)
+            goto bad;
+        strcpy(net_conf.if_name, value);
+        return 0;
+    }
+    if (strcmp(key, "acl") == 0)
+        return acl_add(value);
+    if (strcmp(key, "ip") == 0)
+    {
+        uint8_t ip[NET_IP_LEN];
+        if (conf_parse_ip(value, ip) < 0)
+            goto bad;
+        memcpy(net_if_ip, ip, NET_IP_LEN);
+        return 0;
+    }
+    if (strcmp(key, "mac") == 0)
+    {
+        uint8_t mac[NET_MAC_LEN];
+        if (conf_parse_mac(value, mac) < 0)
+            goto bad;
+        memcpy(net_if_mac, mac, NET_MAC_LEN);
+        return 0;
+    }
+    if (strcmp(key, "arp_snapshot") == 0)
+    {
+        if (strlen(value) >= CONF_PATH_LEN)
+            goto bad;
+        strcpy(net_conf.arp_snapshot, value);
+        return 0;
+    }
+    if (strcmp(key, "arp_static") == 0)
+    {
+        char ip_str[32], mac_str[32], end[2];
+        if (net_conf.arp_static_num == ARP_MAX_STATIC)
+        {
+            fprintf(stderr, "Error in conf_set: at most %d arp_static entries\n", ARP_MAX_STATIC);
+            return -1;
+        }
+        conf_arp_static_t *e = &net_conf.arp_static[net_conf.arp_static_num];
+        if (sscanf(value, "%31s %31s %1s", ip_str, mac_str, end) != 2 ||
+            conf_parse_ip(ip_str, e->ip) < 0 || conf_parse_mac(mac_str, e->mac) < 0)
+            goto bad;
+        net_conf.arp_static_num++;
+        return 0;
+    }
+    if (strcmp(key, "qos_udp_port") == 0)
+    {
+        char *end;
+        long port = strtol(value, &end, 0);
+        if (net_conf.qos_udp_port_num == QOS_MAX_UDP_PORT)
+        {
+            fprintf(stderr, "Error in conf_set: at most %d qos_udp_port entries\n", QOS_MAX_UDP_PORT);
+            return -1;
+        }
+        if (*value == 0 || *end != 0 || port < 1 || port > 65535)
+            goto bad;
+        net_conf.qos_udp_port[net_conf.qos_udp_port_num++] = port;
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(conf_ints) / sizeof(conf_ints[0]); i++)
+    {
+        if (strcmp(key, conf_ints[i].key) != 0)
+            continue;
+        char *end;
+        long v = strtol(value, &end, 0);
+        if (*value == 0 || *end != 0 || v < conf_ints[i].min || v > conf_ints[i].max)
+        {
+            fprintf(stderr, "Error in conf_set: %s must be %d-%d\n", key, conf_ints[i].min, conf_ints[i].max);
+            return -1;
+        }
+        *conf_ints[i].value = v;
+        return 0;
+    }
+    fprintf(stderr, "Error in conf_set: unknown key %s\n", key);
+    return -1;
+bad:
+    fprintf(stderr, "Error in conf_set: bad value for %s: %s\n", key, value);
+    return -1;
+}
+
+/**
+ * @brief 去掉首尾空白
+ *
+ */
+static char *conf_trim(char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\n' || e[-1] == '\r'))
+        *--e = 0;
+    return s;
+}
+
+/**
+ * @brief 读取配置文件，每行一个"key = value"，#开头的为注释
+ *
+ * @param path 文件名
+ * @return int 成功为0，失败为-1
+ */
+int conf_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int lineno = 0, ret = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char *p = conf_trim(line);
+        if (*p == 0 || *p == '#')
+            continue;
+        char *eq = strchr(p, '=');
+        if (eq == NULL)
+        {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, lineno);
+            ret = -1;
+            continue;
+        }
+        *eq = 0;
+        if (conf_set(conf_trim(p), conf_trim(eq + 1)) < 0)
+        {
+            fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+            ret = -1;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/**
+ * @brief 处理命令行中的"--key=value"或"--key value"，"--config 文件"读取配置文件
+ *        识别的参数从argv中移除，其余参数依次前移
+ *
+ * @param argc 参数个数
+ * @param argv 参数
+ * @return int 剩余的参数个数，出错为-1
+ */
+int conf_parse_args(int argc, char *argv[])
+{
+    int n = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0 || argv[i][2] == 0)
+        {
+            argv[n++] = argv[i];
+            continue;
+        }
+        char key[64];
+        const char *value, *eq = strchr(argv[i], '=');
+        if (eq)
+        {
+            snprintf(key, sizeof(key), "%.*s", (int)(eq - argv[i] - 2), argv[i] + 2);
+            value = eq + 1;
+        }
+        else if (i + 1 < argc)
+        {
+            snprintf(key, sizeof(key), "%s", argv[i] + 2);
+            value = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Error in conf_parse_args: %s needs a value\n", argv[i]);
+            return -1;
+        }
+        if (strcmp(key, "config") == 0 ? conf_load(value) < 0 : conf_set(key, value) < 0)
+            return -1;
+    }
+    argv[n] = NULL;
+    return n;
+}
+
+/**
+ * @brief 打印当前配置
+ *
+ * @param f 输出文件
+ */
+void conf_dump(FILE *f)
+{
+    fprintf(f, "if_name = %s\n", net_conf.if_name);
+    fprintf(f, "ip = %d.%d.%d.%d\n", net_if_ip[0], net_if_ip[1], net_if_ip[2], net_if_ip[3]);
+    fprintf(f, "mac = %02x:%02x:%02x:%02x:%02x:%02x\n",
+            net_if_mac[0], net_if_mac[1], net_if_mac[2], net_if_mac[3], net_if_mac[4], net_if_mac[5]);
+    for (size_t i = 0; i < sizeof(conf_ints) / sizeof(conf_ints[0]); i++)
+        fprintf(f, "%s = %d\n", conf_ints[i].key, *conf_ints[i].value);
+    fprintf(f, "arp_snapshot = %s\n", net_conf.arp_snapshot);
+    for (int i = 0; i < net_conf.arp_static_num; i++)
+    {
+        const conf_arp_static_t *e = &net_conf.arp_static[i];
+        fprintf(f, "arp_static = %d.%d.%d.%d %02x:%02x:%02x:%02x:%02x:%02x\n", e->ip[0], e->ip[1], e->ip[2], e->ip[3],
+                e->mac[0], e->mac[1], e->mac[2], e->mac[3], e->mac[4], e->mac[5]);
+    }
+    for (int i = 0; i < net_conf.qos_udp_port_num; i++)
+        fprintf(f, "qos_udp_port = %u\n", net_conf.qos_udp_port[i]);
+    acl_dump(f);
+}
@@ -1,8 +1,14 @@
+#include "config.h"
+#if !defined(DRIVER_TAP) && !defined(DRIVER_XDP) && !defined(DRIVER_REPLAY) && !defined(DRIVER_PACKET)
 #include <pcap.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
 #include "utils.h"
-#include "config.h"
 #include "driver.h"
+#include "stats.h"
+#include "net.h"
+#include "conf.h"
 
 static pcap_t *pcap;
 static char pcap_errbuf[PCAP_ERRBUF_SIZE];
@@ -16,8 +22,8 @@ int driver_open()
 {
     uint32_t net, mask;
 
-    // 根据DRIVER_IF_NAME网卡名，获取网卡的网络号net和子网掩码mask
-    if (pcap_lookupnet(DRIVER_IF_NAME, &net, &mask, pcap_errbuf) == -1) //查找网卡
+    // 根据net_conf.if_name网卡名，获取网卡的网络号net和子网掩码mask
+    if (pcap_lookupnet(net_conf.if_name, &net, &mask, pcap_errbuf) == -1) //查找网卡
     {
         fprintf(stderr, "Error in pcap_lookupnet: %s\n", pcap_geterr(pcap));
         return -1;
@@ -27,7 +33,7 @@ int driver_open()
     // 第二个参数表示捕获的最大字节数，通常来说数据包的大小不会超过65535
     // 第三个参数表示开启混杂模式，0表示非混杂模式，任何其他值表示混合模式
     // 第四个参数指定需要等待的毫秒数，0表示一直等待直到有数据包到来
-    if ((pcap = pcap_open_live(DRIVER_IF_NAME, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
+    if ((pcap = pcap_open_live(net_conf.if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
     {
         fprintf(stderr, "Error in pcap_open_live: %s.\n", pcap_geterr(pcap));
         return -1;
@@ -39,7 +45,7 @@ int driver_open()
     }
     char filter_exp[PCAP_BUF_SIZE];
     struct bpf_program fp;
-    uint8_t mac_addr[6] = DRIVER_IF_MAC;
+    uint8_t *mac_addr = net_if_mac;
     sprintf(filter_exp, //过滤数据包
             "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
             mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
@@ -76,8 +82,10 @@ int driver_recv(buf_t *buf)
         return 0;
     else if (ret == 1)
     {
+        buf_init(buf, pkt_hdr->len); // 上一个包处理时data已被移动，需重新初始化
         memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
+        if (net_conf.rx_timestamp) // libpcap给出的内核接收时间，精确到微秒
+            buf->ts.sw = pkt_hdr->ts.tv_sec * 1000000000ull + pkt_hdr->ts.tv_usec * 1000ull;
         return pkt_hdr->len;
     }
     fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(pcap));
@@ -102,6 +110,51 @@ int driver_send(buf_t *buf)
     return 0;
 }
 
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包
+ *        pcap没有分散发送的接口，直接对pcap打开的套接字调用writev()，与pcap_sendpacket()走同一条路径
+ * 
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+    if (writev(pcap_get_selectable_fd(pcap), iov, cnt) < 0)
+    {
+        fprintf(stderr, "Error in driver_sendv: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 为当前线程选择使用的队列，pcap只有一个队列
+ * 
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue)
+{
+    return queue == 0 ? 0 : -1;
+}
+
+/**
+ * @brief 把pcap_stats的计数写入统计计数器
+ * 
+ */
+void driver_stats()
+{
+    struct pcap_stat ps;
+    if (pcap_stats(pcap, &ps) == 0)
+    {
+        STATS_SET(DRIVER_RECV, ps.ps_recv);
+        STATS_SET(DRIVER_DROP, ps.ps_drop);
+        STATS_SET(DRIVER_IFDROP, ps.ps_ifdrop);
+    }
+}
+
 /**
  * @brief 关闭网卡
  * 
@@ -110,3 +163,4 @@ void driver_close()
 {
     pcap_close(pcap);
 }
+#endif
\ No newline at end of file
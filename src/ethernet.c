@@ -3,31 +3,63 @@
 #include "driver.h"
 #include "arp.h"
 #include "ip.h"
+#include "trace.h"
+#include "latency.h"
+#include "conf.h"
+#include "arena.h"
+#include "acl.h"
 #include <string.h>
 #include <stdio.h>
 
+static buf_t *eth_in_buf; //接收缓冲区，ethernet_init()时从内存区域分配
+
+/**
+ * @brief 检查收到的以太网帧并去掉以太网头部，不交给上层
+ *        在此之前先按ACL规则过滤，被丢弃的帧不做任何校验和计算
+ * 
+ * @param buf 要处理的数据包
+ * @return int 上层协议NET_PROTOCOL_ARP或NET_PROTOCOL_IP，帧被丢弃时为-1
+ */
+int ethernet_demux(buf_t *buf)
+{
+    STATS_INC(ETH_RX_PKTS);
+    STATS_ADD(ETH_RX_BYTES, buf->len);
+    if(buf->len < sizeof(ether_hdr_t)){
+        NET_DROP(ETHERNET, ETH_DROP_BAD_LEN);
+        return -1;
+    }
+    if(acl_filter(buf))
+        return -1;
+    ether_hdr_t *eth_hdr = (ether_hdr_t *)buf->data;
+    uint16_t protocol = swap16(eth_hdr->protocol);
+    TRACE(ETHERNET, RX, buf->len, protocol);
+    if(protocol != NET_PROTOCOL_ARP && protocol != NET_PROTOCOL_IP){
+        NET_DROP(ETHERNET, ETH_DROP_UNKNOWN_TYPE);
+        return -1;
+    }
+    buf_remove_header(buf, sizeof(ether_hdr_t));
+    return protocol;
+}
+
 /**
  * @brief 处理一个收到的数据包
  *        你需要判断以太网数据帧的协议类型，注意大小端转换
  *        如果是ARP协议数据包，则去掉以太网包头，发送到arp层处理arp_in()
  *        如果是IP协议数据包，则去掉以太网包头，发送到IP层处理ip_in()
+ *        检查与去掉包头由ethernet_demux()完成
  * 
  * @param buf 要处理的数据包
  */
 void ethernet_in(buf_t *buf)
 {
-    ether_hdr_t *eth_hdr = (ether_hdr_t *)buf->data;
-    switch(swap16(eth_hdr->protocol)){
+    LATENCY_STAMP(LATENCY_ETHERNET_IN);
+    switch(ethernet_demux(buf)){
         case(NET_PROTOCOL_ARP):
-            buf_remove_header(buf, sizeof(ether_hdr_t));
             arp_in(buf);
             break;
         case(NET_PROTOCOL_IP):
-            buf_remove_header(buf, sizeof(ether_hdr_t));
             ip_in(buf);
             break;
-        default:
-            break;
     }
 }
 
@@ -40,7 +72,7 @@ void ethernet_in(buf_t *buf)
  * @param mac 目标ip地址
  * @param protocol 上层协议
  */
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+static void ethernet_add_header(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {
     buf_add_header(buf, sizeof(ether_hdr_t));
 
@@ -51,8 +83,46 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
     memcpy(eth_hdr->src, net_if_mac, NET_MAC_LEN);
 
     eth_hdr->protocol = swap16(protocol);
+}
+
+void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+{
+    ethernet_add_header(buf, mac, protocol);
     
-    driver_send(buf);
+    TRACE(ETHERNET, TX, buf->len, protocol);
+    STATS_INC(ETH_TX_PKTS);
+    STATS_ADD(ETH_TX_BYTES, buf->len);
+    LATENCY_STAMP(LATENCY_DRIVER_SEND);
+    if(driver_send(buf) < 0){
+        NET_DROP(DRIVER, DRIVER_SEND_FAIL);
+    }
+}
+
+/**
+ * @brief 处理一个要发送的分段数据包
+ *        以太网头部添加到头部段中，头部段与各负载段以iovec一起交给驱动
+ * 
+ * @param chain 要处理的数据包
+ * @param mac 目标mac地址
+ * @param protocol 上层协议
+ */
+void ethernet_out_chain(buf_chain_t *chain, const uint8_t *mac, net_protocol_t protocol)
+{
+    ethernet_add_header(chain->hdr, mac, protocol);
+    uint32_t len = buf_chain_len(chain);
+
+    struct iovec iov[BUF_MAX_SEG + 1];
+    iov[0].iov_base = chain->hdr->data;
+    iov[0].iov_len = chain->hdr->len;
+    memcpy(iov + 1, chain->seg, chain->seg_num * sizeof(struct iovec));
+
+    TRACE(ETHERNET, TX, len, protocol);
+    STATS_INC(ETH_TX_PKTS);
+    STATS_ADD(ETH_TX_BYTES, len);
+    LATENCY_STAMP(LATENCY_DRIVER_SEND);
+    if(driver_sendv(iov, chain->seg_num + 1) < 0){
+        NET_DROP(DRIVER, DRIVER_SEND_FAIL);
+    }
 }
 
 /**
@@ -62,7 +132,9 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
  */
 int ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MTU + sizeof(ether_hdr_t));
+    if (eth_in_buf == NULL && (eth_in_buf = arena_alloc(sizeof(buf_t))) == NULL)
+        return -1;
+    buf_init(eth_in_buf, net_conf.mtu + sizeof(ether_hdr_t));
     return driver_open();
 }
 
@@ -72,6 +144,12 @@ int ethernet_init()
  */
 void ethernet_poll()
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    if (driver_recv(eth_in_buf) > 0)
+    {
+        if (net_conf.rx_timestamp)
+            eth_in_buf->ts.stack = time_ns();
+        LATENCY_BEGIN();
+        ethernet_in(eth_in_buf);
+        LATENCY_END();
+    }
 }
@@ -0,0 +1,207 @@
+#include "graph.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "driver.h"
+#include "conf.h"
+#include "arena.h"
+#include "stats.h"
+#include <string.h>
+
+/**
+ * @brief 图中的节点，按处理顺序排列，数据包只从前面的节点流向后面的节点
+ *
+ */
+typedef enum graph_node
+{
+    GRAPH_ETHERNET,
+    GRAPH_ARP,
+    GRAPH_IP,
+    GRAPH_ICMP,
+    GRAPH_UDP,
+    GRAPH_TCP,
+    GRAPH_NODE_NUM,
+} graph_node_t;
+
+/**
+ * @brief 一个节点待处理的数据包矢量
+ *
+ */
+typedef struct graph_vec
+{
+    int num;
+    buf_t *buf[GRAPH_VECTOR_MAX];
+    uint8_t src_ip[GRAPH_VECTOR_MAX][NET_IP_LEN]; //ip层之上的节点使用，ip头部此时已经去掉
+} graph_vec_t;
+
+static graph_vec_t graph_vec[GRAPH_NODE_NUM];
+static buf_t *graph_bufs[GRAPH_VECTOR_MAX]; //接收缓冲区，graph_init()时从内存区域分配
+
+/**
+ * @brief 处理第i个包时预取：第i+GRAPH_PREFETCH个包的头部，
+ *        以及再往后第i+2*GRAPH_PREFETCH个包的buf_t，下一轮预取头部时要读它的data指针
+ *
+ */
+static inline void graph_prefetch(graph_vec_t *v, int i)
+{
+    if (i + 2 * GRAPH_PREFETCH < v->num)
+        __builtin_prefetch(v->buf[i + 2 * GRAPH_PREFETCH]);
+    if (i + GRAPH_PREFETCH < v->num)
+        __builtin_prefetch(v->buf[i + GRAPH_PREFETCH]->data);
+}
+
+/**
+ * @brief 把包放入下一个节点的矢量
+ *
+ * @param src_ip 源ip地址，ip层之下的节点为NULL
+ */
+static inline void graph_enqueue(graph_node_t node, buf_t *buf, const uint8_t *src_ip)
+{
+    graph_vec_t *v = &graph_vec[node];
+    v->buf[v->num] = buf;
+    if (src_ip)
+        memcpy(v->src_ip[v->num], src_ip, NET_IP_LEN);
+    v->num++;
+}
+
+/**
+ * @brief 以太网节点：检查并去掉以太网头部，按协议分给arp或ip节点
+ *
+ */
+static void graph_ethernet(graph_vec_t *v)
+{
+    for (int i = 0; i < v->num; i++)
+    {
+        graph_prefetch(v, i);
+        switch (ethernet_demux(v->buf[i]))
+        {
+        case NET_PROTOCOL_ARP:
+            graph_enqueue(GRAPH_ARP, v->buf[i], NULL);
+            break;
+        case NET_PROTOCOL_IP:
+            graph_enqueue(GRAPH_IP, v->buf[i], NULL);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief arp节点：在ip节点之前处理，同一矢量中的ip包回复时已经能用上新学到的表项
+ *
+ */
+static void graph_arp(graph_vec_t *v)
+{
+    for (int i = 0; i < v->num; i++)
+    {
+        graph_prefetch(v, i);
+        arp_in(v->buf[i]);
+    }
+}
+
+/**
+ * @brief ip节点：检查并去掉ip头部，按协议分给icmp、udp或tcp节点
+ *
+ */
+static void graph_ip(graph_vec_t *v)
+{
+    uint8_t src_ip[NET_IP_LEN];
+    for (int i = 0; i < v->num; i++)
+    {
+        graph_prefetch(v, i);
+        switch (ip_demux(v->buf[i], src_ip))
+        {
+        case NET_PROTOCOL_ICMP:
+            graph_enqueue(GRAPH_ICMP, v->buf[i], src_ip);
+            break;
+        case NET_PROTOCOL_UDP:
+            graph_enqueue(GRAPH_UDP, v->buf[i], src_ip);
+            break;
+        case NET_PROTOCOL_TCP:
+            graph_enqueue(GRAPH_TCP, v->buf[i], src_ip);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 传输层节点：把矢量中的包依次交给该层的处理函数
+ *
+ */
+static inline void graph_deliver(graph_vec_t *v, void (*in)(buf_t *buf, uint8_t *src_ip))
+{
+    for (int i = 0; i < v->num; i++)
+    {
+        graph_prefetch(v, i);
+        in(v->buf[i], v->src_ip[i]);
+    }
+}
+
+/**
+ * @brief 初始化矢量处理图，从内存区域分配net_conf.vector_size个接收缓冲区
+ *        vector_size为0时不分配，net_poll()仍逐包处理
+ *
+ * @return int 成功为0，失败为-1
+ */
+int graph_init()
+{
+    for (int i = 0; i < net_conf.vector_size; i++)
+        if (graph_bufs[i] == NULL && (graph_bufs[i] = arena_alloc(sizeof(buf_t))) == NULL)
+            return -1;
+    return 0;
+}
+
+/**
+ * @brief 让一个已经收到的矢量依次经过以太网、arp、ip、icmp、udp、tcp节点，每个节点处理完整个矢量后，
+ *        下一个节点再处理分给它的那部分；处理第i个包时预取后面的包
+ *
+ * @param bufs 数据包，批量交付的udp数据报仍指向其中，调用者在udp_flush()之后才能重用
+ * @param num 包数，不超过GRAPH_VECTOR_MAX
+ */
+void graph_process(buf_t **bufs, int num)
+{
+    graph_vec_t *v = &graph_vec[GRAPH_ETHERNET];
+    if (num == 0)
+        return;
+    if (v->buf != bufs)
+        memcpy(v->buf, bufs, num * sizeof(buf_t *));
+    v->num = num;
+    STATS_INC(GRAPH_VECTORS);
+    STATS_ADD(GRAPH_PACKETS, num);
+
+    for (int node = GRAPH_ETHERNET + 1; node < GRAPH_NODE_NUM; node++)
+        graph_vec[node].num = 0;
+    graph_ethernet(v);
+    graph_arp(&graph_vec[GRAPH_ARP]);
+    graph_ip(&graph_vec[GRAPH_IP]);
+    graph_deliver(&graph_vec[GRAPH_ICMP], icmp_in);
+    graph_deliver(&graph_vec[GRAPH_UDP], udp_in);
+    graph_deliver(&graph_vec[GRAPH_TCP], tcp_in);
+}
+
+/**
+ * @brief 一次矢量轮询：从驱动收取至多net_conf.vector_size个包组成矢量，交给graph_process()
+ *        接收缓冲区到下次轮询才重新收取，net_poll()在此之前调用udp_flush()，积压的批交付前一直有效
+ *
+ * @return int 收到的包数
+ */
+int graph_poll()
+{
+    graph_vec_t *v = &graph_vec[GRAPH_ETHERNET];
+    int num = 0;
+    while (num < net_conf.vector_size && graph_bufs[num] && driver_recv(graph_bufs[num]) > 0)
+    {
+        v->buf[num] = graph_bufs[num];
+        num++;
+    }
+    if (num && net_conf.rx_timestamp) // 一个矢量中的包用同一个时间，在矢量中等待的时间计入协议栈内的排队
+    {
+        uint64_t now = time_ns();
+        for (int i = 0; i < num; i++)
+            v->buf[i]->ts.stack = now;
+    }
+    graph_process(v->buf, num);
+    return num;
+}
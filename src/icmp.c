@@ -1,49 +1,194 @@
 #include "icmp.h"
 #include "ip.h"
+#include "ethernet.h"
+#include "trace.h"
+#include "arena.h"
 #include <string.h>
 #include <stdio.h>
 
+/**
+ * @brief 令牌桶，令牌以千分之一为单位保存，按毫秒补充
+ * 
+ */
+typedef struct icmp_bucket
+{
+    uint32_t ip;      // 源地址，全局令牌桶不使用
+    uint32_t tokens;  // 剩余令牌数 * 1000
+    uint64_t last;    // 上次补充令牌的时间(毫秒)，0表示尚未使用
+} icmp_bucket_t;
+
+static buf_t *icmp_out_buf; //构造回显应答与差错报文的缓冲区，第一次使用时从内存区域分配
+
+static uint32_t icmp_rate = ICMP_ERR_RATE, icmp_burst = ICMP_ERR_BURST;
+static uint32_t icmp_src_rate = ICMP_ERR_SRC_RATE, icmp_src_burst = ICMP_ERR_SRC_BURST;
+
+/**
+ * @brief 全局令牌桶
+ * 
+ */
+static icmp_bucket_t icmp_global_bucket;
+
+/**
+ * @brief 按源地址的令牌桶，2路组相联的哈希表，冲突时替换较久未使用的一项
+ * 
+ */
+static icmp_bucket_t icmp_src_buckets[ICMP_ERR_SRC_ENTRY][2];
+
+/**
+ * @brief 按经过的时间补充令牌
+ * 
+ * @param bucket 令牌桶
+ * @param rate 每秒令牌数
+ * @param burst 令牌桶容量
+ * @param now 当前时间(毫秒)
+ */
+static void icmp_bucket_refill(icmp_bucket_t *bucket, uint32_t rate, uint32_t burst, uint64_t now)
+{
+    uint64_t tokens = bucket->last == 0 ? (uint64_t)burst * 1000 : bucket->tokens + (now - bucket->last) * rate;
+    bucket->tokens = tokens > (uint64_t)burst * 1000 ? burst * 1000 : tokens;
+    bucket->last = now;
+}
+
+/**
+ * @brief 查找源地址对应的令牌桶，没有时替换组内较久未使用的一项
+ * 
+ * @param src_ip 源ip地址
+ * @return icmp_bucket_t* 令牌桶
+ */
+static icmp_bucket_t *icmp_src_bucket(uint8_t *src_ip)
+{
+    uint32_t ip;
+    memcpy(&ip, src_ip, NET_IP_LEN);
+    uint32_t h = ip * 0x9E3779B1u;
+    icmp_bucket_t *set = icmp_src_buckets[(h >> 16) & (ICMP_ERR_SRC_ENTRY - 1)];
+    for(int i = 0; i < 2; i++){
+        if(set[i].last != 0 && set[i].ip == ip){
+            return &set[i];
+        }
+    }
+    icmp_bucket_t *victim = set[0].last <= set[1].last ? &set[0] : &set[1];
+    victim->ip = ip;
+    victim->last = 0;
+    return victim;
+}
+
+/**
+ * @brief 判断是否允许向源地址发送一个差错报文，允许时从全局和源地址的令牌桶中各取走一个令牌
+ * 
+ * @param src_ip 源ip地址
+ * @return int 允许为1，不允许为0
+ */
+static int icmp_ratelimit_allow(uint8_t *src_ip)
+{
+    uint64_t now = time_ms();
+    icmp_bucket_t *src = NULL;
+    if(icmp_src_rate){
+        src = icmp_src_bucket(src_ip);
+        icmp_bucket_refill(src, icmp_src_rate, icmp_src_burst, now);
+        if(src->tokens < 1000){
+            NET_DROP(ICMP, ICMP_ERR_SUPPRESSED_SRC);
+            return 0;
+        }
+    }
+    if(icmp_rate){
+        icmp_bucket_refill(&icmp_global_bucket, icmp_rate, icmp_burst, now);
+        if(icmp_global_bucket.tokens < 1000){
+            NET_DROP(ICMP, ICMP_ERR_SUPPRESSED_GLOBAL);
+            return 0;
+        }
+        icmp_global_bucket.tokens -= 1000;
+    }
+    if(src){
+        src->tokens -= 1000;
+    }
+    return 1;
+}
+
+/**
+ * @brief 在收到的帧上原地构造回显应答
+ *        收到的回显请求前面仍然保留着IP头部和以太网头部，
+ *        只需交换IP地址、重置TTL、把类型改为回显应答，并增量更新两个校验和，
+ *        然后直接发回给请求方的MAC地址，不需要复制数据也不需要查询ARP表。
+ *        IP头部带选项或是分片时无法原地处理，返回-1。
+ * 
+ * @param buf 要处理的数据包，data指向ICMP头部
+ * @param src_ip 源ip地址
+ * @return int 成功为0，失败为-1
+ */
+static int icmp_echo_in_place(buf_t *buf, uint8_t *src_ip)
+{
+    ip_hdr_t *ip = (ip_hdr_t *)(buf->data - sizeof(ip_hdr_t));
+    if(ip->version != IP_VERSION_4 || ip->hdr_len * IP_HDR_LEN_PER_BYTE != sizeof(ip_hdr_t) ||
+       memcmp(ip->src_ip, src_ip, NET_IP_LEN) != 0 || (ip->flags_fragment & swap16(0x3fff)) != 0){
+        return -1;
+    }
+
+    // ICMP：类型8改为0，code不变，id和seq原样保留
+    icmp_hdr_t *hdr = (icmp_hdr_t *)buf->data;
+    uint16_t old_word = *(uint16_t *)hdr;
+    hdr->type = ICMP_TYPE_ECHO_REPLY;
+    hdr->checksum = checksum16_update(hdr->checksum, old_word, *(uint16_t *)hdr);
+
+    // IP：交换地址不影响校验和，只需更新TTL所在的16位字
+    memcpy(ip->src_ip, ip->dest_ip, NET_IP_LEN);
+    memcpy(ip->dest_ip, src_ip, NET_IP_LEN);
+    old_word = *(uint16_t *)&ip->ttl;
+    ip->ttl = IP_DEFALUT_TTL;
+    ip->hdr_checksum = checksum16_update(ip->hdr_checksum, old_word, *(uint16_t *)&ip->ttl);
+    buf_add_header(buf, sizeof(ip_hdr_t));
+    STATS_INC(ICMP_TX_PKTS);
+
+    // 以太网：回给请求方的MAC地址
+    ether_hdr_t *eth = (ether_hdr_t *)(buf->data - sizeof(ether_hdr_t));
+    uint8_t mac[NET_MAC_LEN];
+    memcpy(mac, eth->src, NET_MAC_LEN);
+    ethernet_out(buf, mac, NET_PROTOCOL_IP);
+    return 0;
+}
+
 /**
  * @brief 处理一个收到的数据包
  *        你首先要检查ICMP报头长度是否小于icmp头部长度
  *        接着，查看该报文的ICMP类型是否为回显请求，
- *        如果是，则回送一个回显应答（ping应答），需要自行封装应答包。
+ *        如果是，则回送一个回显应答（ping应答）。
  * 
- *        应答包封装如下：
- *        首先调用buf_init()函数初始化txbuf，然后封装报头和数据，
- *        数据部分可以拷贝来自接收到的回显请求报文中的数据。
- *        最后将封装好的ICMP报文发送到IP层。  
+ *        应答包优先在收到的帧上原地构造，见icmp_echo_in_place()；
+ *        无法原地构造时调用buf_init()函数初始化发送缓冲区，复制收到的ICMP报文，
+ *        修改类型并重新计算校验和，最后将封装好的ICMP报文发送到IP层。  
  * 
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
  */
 void icmp_in(buf_t *buf, uint8_t *src_ip)
 {
-    // TODO
+    STATS_INC(ICMP_RX_PKTS);
+    TRACE(ICMP, RX, buf->len, buf->len ? buf->data[0] : 0);
     if(buf->len < sizeof(icmp_hdr_t)){
+        NET_DROP(ICMP, ICMP_DROP_BAD_LEN);
+        return;
+    }
+    icmp_hdr_t *icmp_head = (icmp_hdr_t *)buf->data;
+    if(icmp_head->type != ICMP_TYPE_ECHO_REQUEST){
         return;
     }
-    icmp_hdr_t icmp_head = *(icmp_hdr_t *)buf->data;
-    buf_remove_header(buf, sizeof(icmp_hdr_t));
-
-    if(icmp_head.type == ICMP_TYPE_ECHO_REQUEST){
-        buf_init(&txbuf, buf->len);
-        memcpy(txbuf.data, buf->data, buf->len);
-        buf_add_header(&txbuf, sizeof(icmp_hdr_t));
-        icmp_hdr_t * hdr = (icmp_hdr_t *)txbuf.data;
-        memset(hdr, 0, sizeof(icmp_hdr_t));
-        hdr->type = ICMP_TYPE_ECHO_REPLY;
-        hdr->code = 0;
-        hdr->seq = swap16(1);
-        hdr->id = swap16(1);
-        hdr->checksum  = checksum16((uint16_t *)hdr, txbuf.len);
-        ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    if(icmp_echo_in_place(buf, src_ip) == 0){
+        return;
     }
 
+    buf_t *tx = arena_buf(&icmp_out_buf);
+    buf_init(tx, buf->len);
+    memcpy(tx->data, buf->data, buf->len);
+    icmp_hdr_t *hdr = (icmp_hdr_t *)tx->data;
+    hdr->type = ICMP_TYPE_ECHO_REPLY;
+    hdr->checksum = 0;
+    hdr->checksum = checksum16((uint16_t *)hdr, tx->len);
+    STATS_INC(ICMP_TX_PKTS);
+    ip_out(tx, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
  * @brief 发送icmp不可达
+ *        先经过全局和按源地址的令牌桶限速，超出速率的差错报文只计数不发送
  *        你需要首先调用buf_init初始化buf，长度为ICMP头部 + IP头部 + 原始IP数据报中的前8字节 
  *        填写ICMP报头首部，类型值为目的不可达
  *        填写校验和
@@ -55,16 +200,53 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
  */
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
 {
-    // TODO
-    buf_init(&txbuf, sizeof(ip_hdr_t) + 8);
-    memcpy(txbuf.data, recv_buf->data, sizeof(ip_hdr_t) + 8);
+    if(!icmp_ratelimit_allow(src_ip)){
+        return;
+    }
+    TRACE(ICMP, ICMP_ERROR, trace_ip(src_ip), code);
+    STATS_INC(ICMP_ERR_SENT);
+    STATS_INC(ICMP_TX_PKTS);
 
-    buf_add_header(&txbuf, sizeof(icmp_hdr_t));
-    memset(txbuf.data, 0, sizeof(icmp_hdr_t));
-    icmp_hdr_t *icmp_head = (icmp_hdr_t *)txbuf.data;
+    buf_t *tx = arena_buf(&icmp_out_buf);
+    buf_init(tx, sizeof(ip_hdr_t) + 8);
+    memcpy(tx->data, recv_buf->data, sizeof(ip_hdr_t) + 8);
+
+    buf_add_header(tx, sizeof(icmp_hdr_t));
+    memset(tx->data, 0, sizeof(icmp_hdr_t));
+    icmp_hdr_t *icmp_head = (icmp_hdr_t *)tx->data;
     icmp_head->type = ICMP_TYPE_UNREACH;
     icmp_head->code = code;
-    icmp_head->checksum = checksum16((uint16_t *)icmp_head, txbuf.len);
-    ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    icmp_head->checksum = checksum16((uint16_t *)icmp_head, tx->len);
+    ip_out(tx, src_ip, NET_PROTOCOL_ICMP);
 
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 设置ICMP差错报文的令牌桶限速参数，速率为0表示不限制
+ * 
+ * @param rate 全局每秒令牌数
+ * @param burst 全局令牌桶容量
+ * @param src_rate 每个源地址每秒令牌数
+ * @param src_burst 每个源地址令牌桶容量
+ */
+void icmp_ratelimit_set(uint32_t rate, uint32_t burst, uint32_t src_rate, uint32_t src_burst)
+{
+    icmp_rate = rate;
+    icmp_burst = burst;
+    icmp_src_rate = src_rate;
+    icmp_src_burst = src_burst;
+    icmp_global_bucket.last = 0;
+    memset(icmp_src_buckets, 0, sizeof(icmp_src_buckets));
+}
+
+/**
+ * @brief 获取ICMP差错报文的限速统计
+ * 
+ * @param stats 统计结果
+ */
+void icmp_ratelimit_get_stats(icmp_ratelimit_stats_t *stats)
+{
+    stats->sent = stats_get(STATS_ICMP_ERR_SENT);
+    stats->suppressed_global = stats_get(STATS_ICMP_ERR_SUPPRESSED_GLOBAL);
+    stats->suppressed_src = stats_get(STATS_ICMP_ERR_SUPPRESSED_SRC);
+}
@@ -2,6 +2,11 @@
 #include "arp.h"
 #include "icmp.h"
 #include "udp.h"
+#include "tcp.h"
+#include "trace.h"
+#include "latency.h"
+#include "conf.h"
+#include "arena.h"
 #include <string.h>
 #include <stdio.h>
 #include "ethernet.h"
@@ -24,82 +29,122 @@
  * @param buf 要处理的包
  */
 
-#define PACKET_SIZE (ETHERNET_MTU - sizeof(ip_hdr_t))
+#define PACKET_SIZE (net_conf.mtu - sizeof(ip_hdr_t)) //不分片时IP数据的最大长度
+#define FRAG_SIZE (PACKET_SIZE & ~7)                  //每个分片的数据长度，片偏移以8字节为单位
 
-void ip_in(buf_t *buf)
+/**
+ * @brief 检查收到的IP数据报并去掉IP头部，不交给上层
+ *        不支持的协议在这里回送ICMP协议不可达
+ * 
+ * @param buf 要处理的包
+ * @param src_ip 写入源ip地址
+ * @return int 上层协议NET_PROTOCOL_ICMP、NET_PROTOCOL_UDP或NET_PROTOCOL_TCP，数据报被丢弃时为-1
+ */
+int ip_demux(buf_t *buf, uint8_t *src_ip)
 {
+    STATS_INC(IP_RX_PKTS);
+    STATS_ADD(IP_RX_BYTES, buf->len);
+
     // 报头检查
+    if(buf->len < sizeof(ip_hdr_t)){
+        NET_DROP(IP, IP_DROP_BAD_LEN);
+        return -1;
+    }
     ip_hdr_t ip_head;
     ip_head.version = *(uint8_t *)buf->data >> 4;
     if(ip_head.version != IP_VERSION_4){
-        return;
+        NET_DROP(IP, IP_DROP_BAD_VERSION);
+        return -1;
     }
     ip_head.hdr_len = *(uint8_t *)buf->data & 0x0f;
-    if(ip_head.hdr_len < 5){
-        return;
-    }
     ip_head.total_len = swap16(*((uint16_t *)buf->data + 1));
-    if(ip_head.total_len < 20){
-        return;
+    if(ip_head.hdr_len < 5 || ip_head.total_len < ip_head.hdr_len * IP_HDR_LEN_PER_BYTE || ip_head.total_len > buf->len){
+        NET_DROP(IP, IP_DROP_BAD_LEN);
+        return -1;
     }
+    buf->len = ip_head.total_len; // 去掉以太网帧的填充
 
-    // 计算头部校验和
+    // 计算头部校验和，驱动报告的BUF_CSUM_VALID只覆盖传输层，IP头部总要自己校验
     ip_head.hdr_checksum = *((uint16_t *)buf->data + 5);
     *((uint16_t *)buf->data + 5) = 0;
     if( checksum16((uint16_t *)buf->data, ip_head.hdr_len * IP_HDR_LEN_PER_BYTE) != ip_head.hdr_checksum){
-        return;
+        NET_DROP(IP, IP_DROP_BAD_CHECKSUM);
+        return -1;
     }
+    *((uint16_t *)buf->data + 5) = ip_head.hdr_checksum; // 恢复校验和，上层可以原地修改头部并增量更新
 
     // 检查IP地址
     uint8_t *p = buf->data + 12;
     if(memcmp(p + 4, net_if_ip, NET_IP_LEN) != 0){
-        return;
+        NET_DROP(IP, IP_DROP_NOT_FOR_US);
+        return -1;
     }
-    memcpy(ip_head.src_ip, p, NET_IP_LEN);
-    memcpy(ip_head.dest_ip, p + 4, NET_IP_LEN);
+    memcpy(src_ip, p, NET_IP_LEN);
 
     // 检查协议
     ip_head.protocol = *(buf->data + 9);
+    TRACE(IP, RX, buf->len, ip_head.protocol);
 
     switch(ip_head.protocol){
         case(NET_PROTOCOL_ICMP):
+        case(NET_PROTOCOL_UDP):
+        case(NET_PROTOCOL_TCP):
             buf_remove_header(buf, IP_HDR_LEN_PER_BYTE * ip_head.hdr_len);
-            icmp_in(buf, ip_head.src_ip);
+            return ip_head.protocol;
+        default:
+            NET_DROP(IP, IP_DROP_UNKNOWN_PROTO);
+            icmp_unreachable(buf, src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+            return -1;
+    }
+}
+
+void ip_in(buf_t *buf)
+{
+    LATENCY_STAMP(LATENCY_IP_IN);
+    uint8_t src_ip[NET_IP_LEN];
+    switch(ip_demux(buf, src_ip)){
+        case(NET_PROTOCOL_ICMP):
+            icmp_in(buf, src_ip);
             break;
         case(NET_PROTOCOL_UDP):
-            buf_remove_header(buf, IP_HDR_LEN_PER_BYTE * ip_head.hdr_len);
-            udp_in(buf, ip_head.src_ip);
+            udp_in(buf, src_ip);
             break;
-        default:
-            *((uint16_t *)buf->data + 5) = ip_head.hdr_checksum;
-            icmp_unreachable(buf, ip_head.src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+        case(NET_PROTOCOL_TCP):
+            tcp_in(buf, src_ip);
             break;
     }
+}
 
+/**
+ * @brief 发送的传输层校验和能否交给设备补全：驱动支持、打开了csum_offload，并且数据报不分片
+ *        分片后设备只能看到单个分片，无法计算整个数据报的校验和
+ * 
+ * @param len IP数据部分的长度
+ * @return int 可以为1，否则为0
+ */
+int ip_csum_offload(uint32_t len)
+{
+#ifdef DRIVER_TX_CSUM
+    return net_conf.csum_offload && len <= PACKET_SIZE;
+#else
+    (void)len;
+    return 0;
+#endif
 }
 
 /**
- * @brief 处理一个要发送的ip分片
- *        你需要调用buf_add_header增加IP数据报头部缓存空间。
- *        填写IP数据报头部字段。
- *        将checksum字段填0，再调用checksum16()函数计算校验和，并将计算后的结果填写到checksum字段中。
- *        将封装后的IP数据报发送到arp层。
+ * @brief 在buf前添加IP头部并填写各字段，计入发送计数
  * 
- * @param buf 要发送的分片
- * @param ip 目标ip地址
- * @param protocol 上层协议
- * @param id 数据包id
- * @param offset 分片offset，必须被8整除
- * @param mf 分片mf标志，是否有下一个分片
+ * @param total_len IP数据部分的长度，可能不全在buf中
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+static void ip_add_header(buf_t *buf, uint16_t total_len, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
 {
     buf_add_header(buf, sizeof(ip_hdr_t));
     memset(buf->data, 0, sizeof(ip_hdr_t));
 
     *buf->data = IP_VERSION_4 << 4;
     *buf->data |= 5;
-    *(uint16_t *)(buf->data + 2) = swap16(buf->len);
+    *(uint16_t *)(buf->data + 2) = swap16(total_len + sizeof(ip_hdr_t));
     *(uint16_t *)(buf->data + 4) = swap16(id);
     *(buf->data + 6) |= mf;
     *(uint16_t *)(buf->data + 6) |= swap16(offset);
@@ -112,16 +157,38 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     memcpy(buf->data + 16, ip, NET_IP_LEN);
 
     *(uint16_t *)(buf->data + 10) = checksum16((uint16_t *)buf->data, sizeof(ip_hdr_t));
+    TRACE(IP, IP_FRAGMENT, trace_ip(ip), id, offset, mf, total_len + sizeof(ip_hdr_t));
+    STATS_INC(IP_TX_PKTS);
+    STATS_ADD(IP_TX_BYTES, total_len + sizeof(ip_hdr_t));
+}
+
+/**
+ * @brief 处理一个要发送的ip分片
+ *        你需要调用buf_add_header增加IP数据报头部缓存空间。
+ *        填写IP数据报头部字段。
+ *        将checksum字段填0，再调用checksum16()函数计算校验和，并将计算后的结果填写到checksum字段中。
+ *        将封装后的IP数据报发送到arp层。
+ * 
+ * @param buf 要发送的分片
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @param id 数据包id
+ * @param offset 分片offset，必须被8整除
+ * @param mf 分片mf标志，是否有下一个分片
+ */
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+{
+    ip_add_header(buf, buf->len, ip, protocol, id, offset, mf);
     arp_out(buf, ip, NET_PROTOCOL_IP);
 }
 
 /**
  * @brief 处理一个要发送的ip数据包
- *        你首先需要检查需要发送的IP数据报是否大于以太网帧的最大包长（1500字节 - 以太网报头长度）。
+ *        你首先需要检查需要发送的IP数据报是否大于以太网帧的最大包长（MTU - IP报头长度）。
  *        
  *        如果超过，则需要分片发送。 
  *        分片步骤：
- *        （1）调用buf_init()函数初始化buf，长度为以太网帧的最大包长（1500字节 - 以太网报头长度）
+ *        （1）调用buf_init()函数初始化buf，长度为以太网帧的最大包长向下取8的倍数，如MTU为9000时为8976
  *        （2）将数据报截断，每个截断后的包长度 = 以太网帧的最大包长，调用ip_fragment_out()函数发送出去
  *        （3）如果截断后最后的一个分片小于或等于以太网帧的最大包长，
  *             调用buf_init()函数初始化buf，长度为该分片大小，再调用ip_fragment_out()函数发送出去
@@ -135,29 +202,89 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
  */
 
 static uint16_t buf_id = 0;
+static buf_t *ip_out_buf; //分片的头部段，第一次使用时从内存区域分配
 
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 {
-    if(buf->len < PACKET_SIZE){
+    if(buf->len <= PACKET_SIZE){
         ip_fragment_out(buf, ip, protocol, buf_id++, 0, 0);
         return;
     }
 
-    int frag_num = buf->len / PACKET_SIZE + 1;
+    int frag_num = (buf->len + FRAG_SIZE - 1) / FRAG_SIZE;
     uint16_t length = buf->len;
     uint8_t *base = buf->data;
     uint16_t offset = 0;
 
     for(int i = 0; i < frag_num; i++){
         if(i == frag_num - 1){
-            buf_init(buf, length % PACKET_SIZE);
+            buf_init(buf, length - offset);
             buf->data = base + offset;
             ip_fragment_out(buf, ip, protocol, buf_id++, offset / IP_HDR_OFFSET_PER_BYTE, 0);
             return;
         }
-        buf_init(buf, PACKET_SIZE);
+        buf_init(buf, FRAG_SIZE);
         buf->data = base + offset;
         ip_fragment_out(buf, ip, protocol, buf_id, offset / IP_HDR_OFFSET_PER_BYTE, IP_MORE_FRAGMENT);
-        offset += PACKET_SIZE;
+        offset += FRAG_SIZE;
     }    
 }
+
+/**
+ * @brief 处理一个要发送的分段ip数据包
+ *        不分片时IP头部直接添加到头部段中。
+ *        需要分片时，把头部段中已有的上层头部与各负载段看成一段连续的数据，每个分片取其中一截，
+ *        引用原来的内存作为负载段，IP头部放在单独的头部段中，分片时也不复制负载。
+ *        头部段与负载段总数超过BUF_MAX_SEG时合并为一个buffer，按ip_out()发送
+ * 
+ * @param chain 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out_chain(buf_chain_t *chain, uint8_t *ip, net_protocol_t protocol)
+{
+    uint32_t length = buf_chain_len(chain);
+    if(length <= PACKET_SIZE){
+        ip_add_header(chain->hdr, length, ip, protocol, buf_id++, 0, 0);
+        arp_out_chain(chain, ip, NET_PROTOCOL_IP);
+        return;
+    }
+
+    struct iovec src[BUF_MAX_SEG + 1];
+    int n = 0;
+    if(chain->hdr->len){
+        src[n].iov_base = chain->hdr->data;
+        src[n++].iov_len = chain->hdr->len;
+    }
+    for(int i = 0; i < chain->seg_num; i++)
+        if(chain->seg[i].iov_len)
+            src[n++] = chain->seg[i];
+    buf_t *tx = arena_buf(&ip_out_buf);
+    if(n > BUF_MAX_SEG){
+        buf_chain_copy(tx, chain);
+        ip_out(tx, ip, protocol);
+        return;
+    }
+
+    buf_chain_t frag = {.hdr = tx};
+    int s = 0;
+    size_t s_off = 0;
+    for(uint32_t offset = 0; offset < length; offset += FRAG_SIZE){
+        uint32_t left = length - offset < FRAG_SIZE ? length - offset : FRAG_SIZE;
+        int mf = offset + left < length ? IP_MORE_FRAGMENT : 0;
+        buf_init(tx, 0);
+        frag.seg_num = 0;
+        ip_add_header(tx, left, ip, protocol, mf ? buf_id : buf_id++, offset / IP_HDR_OFFSET_PER_BYTE, mf);
+        while(left){
+            size_t take = src[s].iov_len - s_off < left ? src[s].iov_len - s_off : left;
+            frag.seg[frag.seg_num].iov_base = (uint8_t *)src[s].iov_base + s_off;
+            frag.seg[frag.seg_num++].iov_len = take;
+            left -= take;
+            if((s_off += take) == src[s].iov_len){
+                s++;
+                s_off = 0;
+            }
+        }
+        arp_out_chain(&frag, ip, NET_PROTOCOL_IP);
+    }
+}
@@ -0,0 +1,145 @@
+#include "latency.h"
+#ifdef LATENCY_ENABLE
+#include <string.h>
+
+static const char *const latency_names[LATENCY_STAGE_MAX] = {
+    "driver_recv",
+    "ethernet_in",
+    "ip_in",
+    "udp_in",
+    "handler",
+    "driver_send",
+    "e2e_handler",
+    "e2e_send",
+};
+
+/**
+ * @brief 各阶段的直方图，与协议栈一样只在一个线程中使用
+ *
+ */
+static latency_hist_t latency_hists[LATENCY_STAGE_MAX];
+
+uint64_t latency_start, latency_last;
+
+static double latency_ns_per_tick = 1.0;
+
+/**
+ * @brief 时延所在的桶：最高位决定区间，其后LATENCY_SUB_BITS位决定区间内的桶
+ *
+ */
+static int latency_bucket(uint64_t v)
+{
+    if (v < (1 << LATENCY_SUB_BITS))
+        return (int)v;
+    int shift = 63 - __builtin_clzll(v) - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS) + (int)((v >> shift) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/**
+ * @brief 桶内的最大值，作为该桶样本的代表值
+ *
+ */
+static uint64_t latency_bucket_value(int b)
+{
+    if (b < (1 << LATENCY_SUB_BITS))
+        return b;
+    int shift = (b >> LATENCY_SUB_BITS) - 1;
+    uint64_t base = (uint64_t)((1 << LATENCY_SUB_BITS) | (b & ((1 << LATENCY_SUB_BITS) - 1))) << shift;
+    return base + ((1ULL << shift) - 1);
+}
+
+/**
+ * @brief 记录一个样本
+ *
+ * @param stage 阶段
+ * @param cycles 时延(时间戳计数)
+ */
+void latency_record(latency_stage_t stage, uint64_t cycles)
+{
+    latency_hist_t *h = &latency_hists[stage];
+    if (h->count == 0 || cycles < h->min)
+        h->min = cycles;
+    if (cycles > h->max)
+        h->max = cycles;
+    h->count++;
+    h->bucket[latency_bucket(cycles)]++;
+}
+
+/**
+ * @brief 测量时间戳计数器的频率
+ *
+ */
+void latency_init()
+{
+    latency_ns_per_tick = 1e9 / tsc_ticks_per_sec();
+    latency_reset();
+}
+
+/**
+ * @brief 清空所有直方图
+ *
+ */
+void latency_reset()
+{
+    memset(latency_hists, 0, sizeof(latency_hists));
+    latency_start = latency_last = 0;
+}
+
+/**
+ * @brief 获取一个阶段的分位数(时间戳计数)
+ *
+ */
+static uint64_t latency_percentile_ticks(latency_hist_t *h, double q)
+{
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += h->bucket[b];
+        if (seen >= rank)
+        {
+            uint64_t v = latency_bucket_value(b);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief 获取一个阶段的分位数
+ *
+ * @param stage 阶段
+ * @param q 分位，如0.99
+ * @return uint64_t 时延(纳秒)，没有样本时为0
+ */
+uint64_t latency_percentile(latency_stage_t stage, double q)
+{
+    return (uint64_t)(latency_percentile_ticks(&latency_hists[stage], q) * latency_ns_per_tick);
+}
+
+/**
+ * @brief 输出每个阶段的样本数、最小值、p50/p99/p99.9与最大值(纳秒)
+ *
+ * @param f 输出的文件
+ */
+void latency_report(FILE *f)
+{
+    fprintf(f, "%-12s %12s %10s %10s %10s %10s %10s\n", "stage(ns)", "count", "min", "p50", "p99", "p99.9", "max");
+    for (int i = LATENCY_ETHERNET_IN; i < LATENCY_STAGE_MAX; i++)
+    {
+        latency_hist_t *h = &latency_hists[i];
+        if (h->count == 0)
+            continue;
+        fprintf(f, "%-12s %12llu %10.0f %10.0f %10.0f %10.0f %10.0f\n", latency_names[i], (unsigned long long)h->count,
+                h->min * latency_ns_per_tick,
+                latency_percentile_ticks(h, 0.5) * latency_ns_per_tick,
+                latency_percentile_ticks(h, 0.99) * latency_ns_per_tick,
+                latency_percentile_ticks(h, 0.999) * latency_ns_per_tick,
+                h->max * latency_ns_per_tick);
+    }
+}
+#endif
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
 #include "net.h"
 #include "udp.h"
+#include "conf.h"
 
 void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
 {
@@ -20,16 +22,27 @@ void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
     
     udp_send(data, len, 60000, src_ip, dest_port); //发送udp包
 }
-int main(int argc, char const *argv[])
+static void stop(int sig)
 {
+    net_running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (conf_parse_args(argc, argv) < 0) //如--config net.conf --ip 10.0.0.2 --arp_max_entry 1024
+        return 1;
 
-    net_init();               //初始化协议栈
+    if (net_init() < 0) //初始化协议栈
+        return 1;
     udp_open(60000, handler); //注册端口的udp监听回调
 
-    while (1)
+    signal(SIGINT, stop); //退出前保存arp表快照
+    signal(SIGTERM, stop);
+    while (net_running) //回放后端在回放结束时也会清零
     {
         net_poll(); //一次主循环
     }
 
+    net_close();
     return 0;
 }
@@ -1,24 +1,68 @@
 #include "net.h"
 #include "arp.h"
 #include "udp.h"
+#include "tcp.h"
 #include "ethernet.h"
+#include "graph.h"
+#include "qos.h"
+#include "conf.h"
+#include "driver.h"
+#include "stats.h"
+#include "latency.h"
+#include "trace.h"
+
+volatile sig_atomic_t net_running = 1;
 
 /**
  * @brief 初始化协议栈
  * 
+ * @return int 成功为0，网卡打开失败或内存区域不足时为-1
  */
-void net_init()
+int net_init()
 {
-    ethernet_init();
-    arp_init();
-    udp_init();
+    LATENCY_INIT();
+    trace_init();
+    if (ethernet_init() < 0 || graph_init() < 0 || qos_init() < 0 || arp_init() < 0 || udp_init() < 0 ||
+        tcp_init() < 0)
+    {
+        fprintf(stderr, "Error in net_init: failed to open the driver or allocate from the arena\n");
+        return -1;
+    }
+    stats_export_open(NULL);
+    return 0;
 }
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 一次协议栈轮询，net_conf.qos_queue不为0时按优先级分类并在预算内处理(见qos.h)，
+ *        否则net_conf.vector_size不为0时经矢量处理图一次收取多个包；
+ *        处理完后把积压的udp数据报一次交给批量处理程序
  * 
  */
 void net_poll()
 {
-    ethernet_poll();
-}
\ No newline at end of file
+    if (net_conf.qos_queue)
+        qos_poll();
+    else if (net_conf.vector_size)
+        graph_poll();
+    else
+        ethernet_poll();
+    udp_flush();
+    tcp_poll();
+    arp_poll();
+    if (stats_export_due())
+    {
+        driver_stats();
+        stats_export();
+    }
+}
+
+/**
+ * @brief 关闭协议栈，保存arp表快照并关闭网卡
+ * 
+ */
+void net_close()
+{
+    arp_close();
+    driver_close();
+    stats_export_close();
+}
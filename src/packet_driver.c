@@ -0,0 +1,272 @@
+#include "config.h"
+#ifdef DRIVER_PACKET
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/virtio_net.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include "net.h"
+#include "utils.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "conf.h"
+
+#define PACKET_RX_HEADROOM 64 //接收时在数据前保留的空间，供原地回复时添加协议头
+
+/**
+ * @brief AF_PACKET后端：不经过libpcap，收发各用一个绑定到net_conf.if_name的原始套接字
+ *        接收套接字打开PACKET_AUXDATA，由每帧的tp_status得知内核或网卡已确认校验和(TP_STATUS_CSUM_VALID)，
+ *        或者帧由本机发出、校验和还没有计算(TP_STATUS_CSUMNOTREADY，如veth对端发来的帧)
+ *        发送套接字打开PACKET_VNET_HDR，每帧前带一个virtio_net_hdr，让内核或网卡补全传输层校验和；
+ *        它的协议为0，不接收任何帧
+ *        与pcap后端一样打开混杂模式，只接收发往net_if_mac与广播的帧
+ *        net_conf.rx_timestamp打开时用SO_TIMESTAMPING取得内核的软件时间戳，为2时还有网卡的硬件时间戳
+ */
+static int packet_rx_fd = -1, packet_tx_fd = -1;
+static int packet_ifindex;
+
+/**
+ * @brief 创建一个绑定到网卡的原始套接字
+ *
+ * @param protocol 接收的以太网协议，网络字节序，0为不接收
+ * @return int 文件描述符，失败为-1
+ */
+static int packet_socket(int protocol)
+{
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, protocol);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error in socket(AF_PACKET): %s\n", strerror(errno));
+        return -1;
+    }
+    struct sockaddr_ll sll = {.sll_family = AF_PACKET, .sll_protocol = protocol, .sll_ifindex = packet_ifindex};
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    {
+        fprintf(stderr, "Error in bind %s: %s\n", net_conf.if_name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief 打开接收时间戳，net_conf.rx_timestamp为2时再让网卡给所有收到的帧打硬件时间戳
+ *        SIOCSHWTSTAMP修改的是整个网卡的设置；网卡不支持时只打印提示，仍然有软件时间戳
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int packet_timestamping()
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (net_conf.rx_timestamp == 2)
+    {
+        struct hwtstamp_config cfg = {.tx_type = HWTSTAMP_TX_OFF, .rx_filter = HWTSTAMP_FILTER_ALL};
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, net_conf.if_name, IFNAMSIZ - 1);
+        ifr.ifr_data = (void *)&cfg;
+        if (ioctl(packet_rx_fd, SIOCSHWTSTAMP, &ifr) < 0)
+            fprintf(stderr, "%s: no hardware timestamps (%s), using software timestamps\n", net_conf.if_name, strerror(errno));
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    if (setsockopt(packet_rx_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+    {
+        fprintf(stderr, "Error in setsockopt(SO_TIMESTAMPING): %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open()
+{
+    int on = 1;
+    if ((packet_ifindex = if_nametoindex(net_conf.if_name)) == 0)
+    {
+        fprintf(stderr, "Error in if_nametoindex %s: %s\n", net_conf.if_name, strerror(errno));
+        return -1;
+    }
+    if ((packet_rx_fd = packet_socket(htons(ETH_P_ALL))) < 0)
+        return -1;
+    struct packet_mreq mr = {.mr_ifindex = packet_ifindex, .mr_type = PACKET_MR_PROMISC};
+    if (setsockopt(packet_rx_fd, SOL_PACKET, PACKET_AUXDATA, &on, sizeof(on)) < 0 ||
+        setsockopt(packet_rx_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)) < 0)
+    {
+        fprintf(stderr, "Error in setsockopt(SOL_PACKET): %s\n", strerror(errno));
+        goto fail;
+    }
+    if (net_conf.rx_timestamp && packet_timestamping() < 0)
+        goto fail;
+    if ((packet_tx_fd = packet_socket(0)) < 0)
+        goto fail;
+    if (setsockopt(packet_tx_fd, SOL_PACKET, PACKET_VNET_HDR, &on, sizeof(on)) < 0)
+    {
+        fprintf(stderr, "Error in setsockopt(PACKET_VNET_HDR): %s\n", strerror(errno));
+        goto fail;
+    }
+    return 0;
+fail:
+    driver_close();
+    return -1;
+}
+
+/**
+ * @brief 只有一个队列
+ *
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue)
+{
+    return queue == 0 ? 0 : -1;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(buf_t *buf)
+{
+    struct sockaddr_ll from;
+    union
+    {
+        struct cmsghdr cmsg;
+        char space[CMSG_SPACE(sizeof(struct tpacket_auxdata)) + CMSG_SPACE(sizeof(struct scm_timestamping))];
+    } ctrl;
+    buf_init(buf, BUF_MAX_LEN - PACKET_RX_HEADROOM);
+    struct iovec iov = {buf->data, buf->len};
+    struct msghdr msg = {
+        .msg_name = &from,
+        .msg_namelen = sizeof(from),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = &ctrl,
+        .msg_controllen = sizeof(ctrl),
+    };
+    ssize_t n = recvmsg(packet_rx_fd, &msg, 0);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+        fprintf(stderr, "Error in driver_recv: %s\n", strerror(errno));
+        return -1;
+    }
+    // 自己发出的帧也会被收到
+    if (from.sll_pkttype == PACKET_OUTGOING || n < (ssize_t)sizeof(ether_hdr_t))
+        return 0;
+    if (memcmp(buf->data, net_if_mac, NET_MAC_LEN) != 0 && memcmp(buf->data, ether_broadcast_mac, NET_MAC_LEN) != 0)
+        return 0;
+    buf->len = n;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level == SOL_PACKET && c->cmsg_type == PACKET_AUXDATA)
+        {
+            struct tpacket_auxdata aux;
+            memcpy(&aux, CMSG_DATA(c), sizeof(aux));
+            if (net_conf.csum_offload && (aux.tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)))
+                buf->csum = BUF_CSUM_VALID;
+        }
+        else if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING)
+        {
+            struct scm_timestamping tss; // ts[0]为软件时间戳，ts[2]为网卡的原始硬件时间戳
+            memcpy(&tss, CMSG_DATA(c), sizeof(tss));
+            buf->ts.sw = tss.ts[0].tv_sec * 1000000000ull + tss.ts[0].tv_nsec;
+            buf->ts.hw = tss.ts[2].tv_sec * 1000000000ull + tss.ts[2].tv_nsec;
+        }
+    }
+    return buf->len;
+}
+
+/**
+ * @brief 一次writev()写入virtio_net_hdr与帧的各段
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int packet_writev(struct virtio_net_hdr *hdr, const struct iovec *iov, int cnt)
+{
+    struct iovec v[BUF_MAX_SEG + 2];
+    if (cnt > BUF_MAX_SEG + 1)
+        return -1;
+    v[0].iov_base = hdr;
+    v[0].iov_len = sizeof(*hdr);
+    memcpy(v + 1, iov, cnt * sizeof(struct iovec));
+    if (writev(packet_tx_fd, v, cnt + 1) < 0)
+    {
+        if (errno != EAGAIN && errno != ENOBUFS)
+            fprintf(stderr, "Error in driver_send: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ *        传输层校验和留给设备补全时填写virtio_net_hdr，传输层头部紧跟在IP头部之后
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    struct virtio_net_hdr hdr = {.flags = 0, .gso_type = VIRTIO_NET_HDR_GSO_NONE};
+    if (buf->csum == BUF_CSUM_PARTIAL)
+    {
+        hdr.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr.csum_start = sizeof(ether_hdr_t) + (buf->data[sizeof(ether_hdr_t)] & 0xF) * 4;
+        hdr.csum_offset = buf->csum_offset;
+    }
+    struct iovec iov = {buf->data, buf->len};
+    return packet_writev(&hdr, &iov, 1);
+}
+
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包，virtio_net_hdr之后依次是各段，一次writev()写入
+ *
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+    struct virtio_net_hdr hdr = {.flags = 0, .gso_type = VIRTIO_NET_HDR_GSO_NONE}; //分段发送时协议栈已算好校验和
+    return packet_writev(&hdr, iov, cnt);
+}
+
+/**
+ * @brief 网卡的计数可在/sys/class/net/<if_name>/statistics中查看，这里没有额外的计数
+ *
+ */
+void driver_stats()
+{
+}
+
+/**
+ * @brief 关闭网卡
+ *
+ */
+void driver_close()
+{
+    if (packet_rx_fd >= 0)
+        close(packet_rx_fd);
+    if (packet_tx_fd >= 0)
+        close(packet_tx_fd);
+    packet_rx_fd = packet_tx_fd = -1;
+}
+#endif
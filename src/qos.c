@@ -0,0 +1,208 @@
+#include "qos.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "udp.h"
+#include "graph.h"
+#include "driver.h"
+#include "conf.h"
+#include "arena.h"
+#include "stats.h"
+#include "latency.h"
+
+/**
+ * @brief 一个类别的队列，环形存放等待处理的帧
+ *
+ */
+typedef struct qos_queue
+{
+    buf_t **ring; //net_conf.qos_queue个位置
+    int head, num;
+} qos_queue_t;
+
+static qos_queue_t qos_queues[QOS_CLASS_NUM];
+static int qos_limit[QOS_CLASS_NUM]; //积压达到这个数时丢弃新到的帧
+static int qos_backlog;              //所有队列中的帧数
+static buf_t **qos_free;             //空闲的接收缓冲区
+static int qos_free_num;
+static buf_t *qos_rx;                //下一帧收到这里，入队后换一个空闲的
+static buf_t *qos_vec[GRAPH_VECTOR_MAX];
+
+/**
+ * @brief 初始化优先级接收队列，从内存区域分配net_conf.qos_queue + 1个接收缓冲区
+ *        qos_queue为0时不分配，net_poll()仍按到达顺序处理
+ *
+ * @return int 成功为0，失败为-1
+ */
+int qos_init()
+{
+    int n = net_conf.qos_queue;
+    if (n == 0 || qos_rx)
+        return 0;
+    for (int c = 0; c < QOS_CLASS_NUM; c++)
+        if ((qos_queues[c].ring = arena_alloc(n * sizeof(buf_t *))) == NULL)
+            return -1;
+    if ((qos_free = arena_alloc(n * sizeof(buf_t *))) == NULL)
+        return -1;
+    for (qos_free_num = 0; qos_free_num < n; qos_free_num++)
+        if ((qos_free[qos_free_num] = arena_alloc(sizeof(buf_t))) == NULL)
+            return -1;
+    if ((qos_rx = arena_alloc(sizeof(buf_t))) == NULL)
+        return -1;
+    qos_limit[QOS_ARP] = qos_limit[QOS_ICMP] = n;
+    qos_limit[QOS_TCP] = qos_limit[QOS_UDP_PRIO] = n * net_conf.qos_high_watermark / 100;
+    qos_limit[QOS_BULK] = n * net_conf.qos_low_watermark / 100;
+    return 0;
+}
+
+/**
+ * @brief 只看各层头部判断帧的类别，不做任何检查与校验和计算
+ *
+ * @param buf 以太网帧
+ * @return qos_class_t 类别
+ */
+qos_class_t qos_classify(const buf_t *buf)
+{
+    if (buf->len < sizeof(ether_hdr_t))
+        return QOS_BULK;
+    uint16_t protocol = swap16(((ether_hdr_t *)buf->data)->protocol);
+    if (protocol == NET_PROTOCOL_ARP)
+        return QOS_ARP;
+    if (protocol != NET_PROTOCOL_IP || buf->len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t))
+        return QOS_BULK;
+    ip_hdr_t *ip = (ip_hdr_t *)(buf->data + sizeof(ether_hdr_t));
+    switch (ip->protocol)
+    {
+    case NET_PROTOCOL_ICMP:
+        return QOS_ICMP;
+    case NET_PROTOCOL_TCP:
+        return QOS_TCP;
+    case NET_PROTOCOL_UDP:
+    {
+        size_t off = sizeof(ether_hdr_t) + ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+        if ((swap16(ip->flags_fragment) & 0x1FFF) || buf->len < off + sizeof(udp_hdr_t)) //后续分片没有udp头部
+            return QOS_BULK;
+        uint16_t port = swap16(((udp_hdr_t *)(buf->data + off))->dest_port);
+        for (int i = 0; i < net_conf.qos_udp_port_num; i++)
+            if (net_conf.qos_udp_port[i] == port)
+                return QOS_UDP_PRIO;
+        return QOS_BULK;
+    }
+    }
+    return QOS_BULK;
+}
+
+/**
+ * @brief 丢弃一帧并计入它的类别
+ *
+ */
+static inline void qos_drop(qos_class_t c)
+{
+    STATS_ADD_ID(STATS_QOS_DROP_ARP + c, 1);
+}
+
+/**
+ * @brief 队列满时挤掉比c优先级低的类别中最新的一帧，它的缓冲区回到空闲列表
+ *
+ * @return int 挤掉了一帧为1，没有更低优先级的帧为0
+ */
+static int qos_push_out(qos_class_t c)
+{
+    for (int l = QOS_CLASS_NUM - 1; l > (int)c; l--)
+    {
+        qos_queue_t *q = &qos_queues[l];
+        if (q->num == 0)
+            continue;
+        q->num--;
+        qos_free[qos_free_num++] = q->ring[(q->head + q->num) % net_conf.qos_queue];
+        qos_backlog--;
+        qos_drop(l);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 把qos_rx中刚收到的帧放入它的类别的队列，或者按水位丢弃
+ *
+ */
+static void qos_enqueue()
+{
+    qos_class_t c = qos_classify(qos_rx);
+    if (qos_backlog >= qos_limit[c] && (qos_backlog < net_conf.qos_queue || !qos_push_out(c)))
+    {
+        qos_drop(c);
+        return;
+    }
+    qos_queue_t *q = &qos_queues[c];
+    q->ring[(q->head + q->num) % net_conf.qos_queue] = qos_rx;
+    q->num++;
+    qos_backlog++;
+    qos_rx = qos_free[--qos_free_num];
+}
+
+/**
+ * @brief 按优先级从高到低取出至多max帧
+ *
+ * @return int 取出的帧数
+ */
+static int qos_dequeue(buf_t **bufs, int max)
+{
+    int n = 0;
+    for (int c = 0; c < QOS_CLASS_NUM && n < max; c++)
+    {
+        qos_queue_t *q = &qos_queues[c];
+        while (q->num && n < max)
+        {
+            bufs[n++] = q->ring[q->head];
+            q->head = (q->head + 1) % net_conf.qos_queue;
+            q->num--;
+        }
+    }
+    qos_backlog -= n;
+    return n;
+}
+
+/**
+ * @brief 一次带预算的轮询：
+ *        （1）把驱动中积压的帧(至多qos_queue个)分类放入各自的队列，积压达到类别的水位时丢弃新到的帧：
+ *             QOS_BULK为qos_low_watermark，QOS_TCP与QOS_UDP_PRIO为qos_high_watermark，QOS_ARP与QOS_ICMP为队列满；
+ *             队列满时挤掉优先级更低的类别中最新的一帧，没有则丢弃新到的帧
+ *        （2）按优先级从高到低处理，至多qos_budget帧、qos_budget_us微秒，剩下的留到下次轮询
+ *        net_conf.vector_size不为0时按优先级顺序取出的帧组成矢量交给graph_process()
+ *        处理完的接收缓冲区回到空闲列表，到下次轮询才重新收取，net_poll()在此之前调用udp_flush()，积压的批交付前一直有效
+ *
+ * @return int 处理的帧数
+ */
+int qos_poll()
+{
+    for (int i = 0; i < net_conf.qos_queue && driver_recv(qos_rx) > 0; i++)
+    {
+        if (net_conf.rx_timestamp) // 在队列中等待的时间计入协议栈内的排队
+            qos_rx->ts.stack = time_ns();
+        qos_enqueue();
+    }
+
+    int done = 0, batch = net_conf.vector_size ? net_conf.vector_size : 1;
+    uint64_t deadline = net_conf.qos_budget_us ? time_ns() + net_conf.qos_budget_us * 1000ull : 0;
+    while (qos_backlog && done < net_conf.qos_budget)
+    {
+        if (deadline && time_ns() >= deadline)
+            break;
+        int n = qos_dequeue(qos_vec, batch < net_conf.qos_budget - done ? batch : net_conf.qos_budget - done);
+        if (net_conf.vector_size)
+            graph_process(qos_vec, n);
+        else
+        {
+            LATENCY_BEGIN();
+            ethernet_in(qos_vec[0]);
+            LATENCY_END();
+        }
+        for (int i = 0; i < n; i++)
+            qos_free[qos_free_num++] = qos_vec[i];
+        done += n;
+    }
+    if (qos_backlog)
+        STATS_INC(QOS_BUDGET_EXHAUSTED);
+    STATS_SET(QOS_BACKLOG, qos_backlog);
+    return done;
+}
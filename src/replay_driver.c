@@ -0,0 +1,457 @@
+#include "config.h"
+#ifdef DRIVER_REPLAY
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "net.h"
+#include "utils.h"
+#include "driver.h"
+#include "trace.h"
+#include "conf.h"
+
+#define REPLAY_LINKTYPE_ETHERNET 1
+#define REPLAY_MAX_IF 16 //pcapng中支持的最大接口数
+
+/**
+ * @brief 回放后端：把pcap/pcapng文件整个映射到内存，按指定速度依次交给协议栈，发送的帧写入pcap文件
+ *        用于用抓到的真实流量做容量评估，不需要网卡
+ *
+ *        下列环境变量覆盖config.h中的默认值：
+ *        NET_REPLAY_IN    输入文件，pcap(微秒或纳秒)或pcapng，只回放以太网帧
+ *        NET_REPLAY_OUT   输出文件，纳秒精度的pcap，时间戳为当时正在处理的输入帧的时间戳
+ *        NET_REPLAY_SPEED max为尽快回放，orig为按原始时间间隔，orig*N为N倍速，数字为固定的每秒包数
+ *        NET_REPLAY_LOOPS 回放次数，0为无限循环
+ *        回放结束后打印摘要并清零net_running，由主循环调用net_close()正常关闭
+ *
+ *        帧直接从映射的文件中读取，不经过libpcap；buf_t自带负载数组，所以仍要复制一次到buf
+ */
+typedef enum replay_speed
+{
+    REPLAY_MAX,  //尽快
+    REPLAY_ORIG, //原始时间间隔
+    REPLAY_PPS,  //固定速率
+} replay_speed_t;
+
+static const uint8_t *file;  //映射的输入文件
+static size_t file_len, pos, first_pos;
+static int swapped;          //文件字节序与本机不同
+static int pcapng;
+static uint64_t ts_scale;    //经典pcap的亚秒部分单位(纳秒)
+static int if_cnt;
+static struct
+{
+    uint16_t linktype;
+    uint64_t ts_div, ts_mul; //时间戳换算为纳秒：ts * ts_mul / ts_div
+} ifs[REPLAY_MAX_IF];
+
+static replay_speed_t speed;
+static double speed_arg;     //倍速或每秒包数
+static int loops, loop;
+static uint64_t start_ns, first_ts, cur_ts, frame_idx; //本轮的开始时间、第一帧时间戳、当前帧时间戳与序号
+static uint64_t replay_start_ns;
+static uint64_t frames, bytes;
+static int have_next;        //next_*已读出但尚未到发送时间
+static int done;             //回放已结束
+static const uint8_t *next_data;
+static uint32_t next_len;
+static uint64_t next_ts;
+
+static FILE *sink;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swapped ? swap16(v) : v;
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swapped ? swap32(v) : v;
+}
+
+/**
+ * @brief 解析pcapng接口描述块，记录链路类型与时间戳精度(if_tsresol)
+ *
+ */
+static void replay_parse_idb(const uint8_t *body, uint32_t len)
+{
+    if (if_cnt == REPLAY_MAX_IF || len < 8)
+        return;
+    ifs[if_cnt].linktype = rd16(body);
+    ifs[if_cnt].ts_div = 1000; //默认微秒
+    ifs[if_cnt].ts_mul = 1000;
+    for (uint32_t off = 8; off + 4 <= len;)
+    {
+        uint16_t code = rd16(body + off), olen = rd16(body + off + 2);
+        if (code == 0 || off + 4 + olen > len)
+            break;
+        if (code == 9 && olen >= 1) // if_tsresol
+        {
+            uint8_t res = body[off + 4];
+            uint64_t div = 1;
+            if (res & 0x80)
+                for (int i = 0; i < (res & 0x7f) && i < 63; i++)
+                    div <<= 1;
+            else
+                for (int i = 0; i < res && i < 19; i++)
+                    div *= 10;
+            ifs[if_cnt].ts_div = div;
+            ifs[if_cnt].ts_mul = 1000000000;
+        }
+        off += 4 + ((olen + 3) & ~3);
+    }
+    if_cnt++;
+}
+
+/**
+ * @brief 读出下一个以太网帧
+ *
+ * @return int 读到为1，文件结束为0
+ */
+static int replay_next(const uint8_t **data, uint32_t *len, uint64_t *ts)
+{
+    while (pos < file_len)
+    {
+        if (!pcapng)
+        {
+            if (pos + 16 > file_len)
+                return 0;
+            const uint8_t *rec = file + pos;
+            uint32_t caplen = rd32(rec + 8);
+            if (pos + 16 + caplen > file_len)
+                return 0;
+            pos += 16 + caplen;
+            *ts = rd32(rec) * 1000000000ull + rd32(rec + 4) * ts_scale;
+            *data = rec + 16;
+            *len = caplen;
+            return 1;
+        }
+
+        if (pos + 12 > file_len)
+            return 0;
+        const uint8_t *blk = file + pos;
+        uint32_t type = rd32(blk), blen = rd32(blk + 4);
+        if (type == 0x0A0D0D0A) // 新的节，重新确定字节序
+        {
+            uint32_t magic;
+            memcpy(&magic, blk + 8, 4);
+            swapped = magic != 0x1A2B3C4D;
+            blen = rd32(blk + 4);
+            if_cnt = 0;
+        }
+        if (blen < 12 || pos + blen > file_len)
+            return 0;
+        pos += blen;
+        const uint8_t *body = blk + 8;
+        uint32_t body_len = blen - 12;
+        if (type == 1)
+            replay_parse_idb(body, body_len);
+        else if (type == 6 && body_len >= 20) // 增强分组块
+        {
+            uint32_t id = rd32(body), caplen = rd32(body + 12);
+            if (id >= (uint32_t)if_cnt || caplen > body_len - 20)
+            {
+                STATS_INC(DRIVER_REPLAY_SKIPPED);
+                continue;
+            }
+            if (ifs[id].linktype != REPLAY_LINKTYPE_ETHERNET)
+            {
+                STATS_INC(DRIVER_REPLAY_SKIPPED);
+                continue;
+            }
+            uint64_t raw = ((uint64_t)rd32(body + 4) << 32) | rd32(body + 8);
+            *ts = (uint64_t)((unsigned __int128)raw * ifs[id].ts_mul / ifs[id].ts_div);
+            *data = body + 20;
+            *len = caplen;
+            return 1;
+        }
+        else if (type == 3 && body_len >= 4 && if_cnt > 0 && ifs[0].linktype == REPLAY_LINKTYPE_ETHERNET) // 简单分组块
+        {
+            uint32_t len0 = rd32(body);
+            *len = len0 < body_len - 4 ? len0 : body_len - 4;
+            *data = body + 4;
+            *ts = cur_ts; //没有时间戳，沿用上一帧
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 解析速度参数
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int replay_parse_speed(const char *s)
+{
+    if (strcmp(s, "max") == 0)
+        speed = REPLAY_MAX;
+    else if (strncmp(s, "orig", 4) == 0)
+    {
+        speed = REPLAY_ORIG;
+        speed_arg = s[4] == '*' ? atof(s + 5) : 1;
+        if (speed_arg <= 0)
+            return -1;
+    }
+    else if ((speed_arg = atof(s)) > 0)
+        speed = REPLAY_PPS;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief 打开输出文件并写入pcap文件头
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int replay_open_sink(const char *path)
+{
+    if ((sink = fopen(path, "wb")) == NULL)
+    {
+        fprintf(stderr, "Error in fopen %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(sink, NULL, _IOFBF, DRIVER_REPLAY_OUT_BUF);
+    uint32_t hdr[6] = {0xa1b23c4d, 2 | (4 << 16), 0, 0, BUF_MAX_LEN, REPLAY_LINKTYPE_ETHERNET};
+    fwrite(hdr, sizeof(hdr), 1, sink);
+    return 0;
+}
+
+static const char *env_or(const char *name, const char *def)
+{
+    const char *v = getenv(name);
+    return v && *v ? v : def;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open()
+{
+    const char *in = env_or("NET_REPLAY_IN", DRIVER_REPLAY_IN);
+    if (replay_parse_speed(env_or("NET_REPLAY_SPEED", DRIVER_REPLAY_SPEED)) < 0)
+    {
+        fprintf(stderr, "Error in driver_open: bad NET_REPLAY_SPEED, use max, orig, orig*N or pps\n");
+        return -1;
+    }
+    loops = atoi(env_or("NET_REPLAY_LOOPS", "-1"));
+    if (loops < 0)
+        loops = DRIVER_REPLAY_LOOPS;
+
+    int fd = open(in, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Error in open %s: %s\n", in, strerror(errno));
+        return -1;
+    }
+    file_len = st.st_size;
+    file = file_len ? mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (file == MAP_FAILED || file_len < 24)
+    {
+        fprintf(stderr, "Error in mmap %s: %s\n", in, file_len < 24 ? "file too short" : strerror(errno));
+        file = NULL;
+        return -1;
+    }
+    madvise((void *)file, file_len, MADV_SEQUENTIAL);
+
+    uint32_t magic;
+    memcpy(&magic, file, 4);
+    pcapng = 0;
+    swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    if (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1)
+        ts_scale = 1000;
+    else if (magic == 0xa1b23c4d || magic == 0x4d3cb2a1)
+        ts_scale = 1;
+    else if (magic == 0x0A0D0D0A)
+        pcapng = 1;
+    else
+    {
+        fprintf(stderr, "Error in driver_open: %s is not a pcap or pcapng file\n", in);
+        driver_close();
+        return -1;
+    }
+    if (!pcapng && rd32(file + 20) != REPLAY_LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "Error in driver_open: %s is not an ethernet capture\n", in);
+        driver_close();
+        return -1;
+    }
+    first_pos = pos = pcapng ? 0 : 24;
+    loop = 0;
+    frame_idx = frames = bytes = 0;
+    have_next = done = 0;
+    start_ns = 0;
+    if (replay_open_sink(env_or("NET_REPLAY_OUT", DRIVER_REPLAY_OUT)) < 0)
+    {
+        driver_close();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 为当前线程选择使用的队列，回放只有一个队列
+ *
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue)
+{
+    return queue == 0 ? 0 : -1;
+}
+
+/**
+ * @brief 回放结束，打印摘要并让主循环退出，输出文件由net_close()中的driver_close()写完
+ *
+ */
+static void replay_finish()
+{
+    double sec = (now_ns() - replay_start_ns) / 1e9;
+    fprintf(stderr, "replay: %llu frames, %llu bytes, %d loops in %.3f s, %.0f pps\n",
+            (unsigned long long)frames, (unsigned long long)bytes, loop, sec, sec > 0 ? frames / sec : 0);
+    done = 1;
+    net_running = 0;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *        还没到下一帧的发送时间时返回0，让协议栈继续处理定时器
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，回放已结束或错误为-1
+ */
+int driver_recv(buf_t *buf)
+{
+    if (done || file == NULL)
+        return -1;
+    if (!have_next)
+    {
+        while (!replay_next(&next_data, &next_len, &next_ts))
+        {
+            if (++loop == loops || frame_idx == 0)
+            {
+                replay_finish();
+                return -1;
+            }
+            pos = first_pos;
+            if_cnt = 0;
+            start_ns = now_ns(); //每轮重新计时
+            frame_idx = 0;
+            STATS_INC(DRIVER_REPLAY_RESTARTS);
+        }
+        have_next = 1;
+    }
+    if (frame_idx == 0)
+    {
+        if (start_ns == 0)
+            replay_start_ns = start_ns = now_ns();
+        first_ts = next_ts;
+    }
+    if (speed != REPLAY_MAX)
+    {
+        uint64_t due = speed == REPLAY_ORIG
+                           ? (uint64_t)((next_ts > first_ts ? next_ts - first_ts : 0) / speed_arg)
+                           : (uint64_t)(frame_idx * 1e9 / speed_arg);
+        if (now_ns() - start_ns < due)
+            return 0;
+    }
+    have_next = 0;
+    frame_idx++;
+    cur_ts = next_ts;
+    uint32_t len = next_len < BUF_MAX_LEN ? next_len : BUF_MAX_LEN;
+    buf_init(buf, len);
+    memcpy(buf->data, next_data, len);
+    if (net_conf.rx_timestamp) // 帧到期被取走的时间，不用文件中的原始时间戳
+        buf->ts.sw = time_ns();
+    frames++;
+    bytes += len;
+    return len;
+}
+
+/**
+ * @brief 把发送的帧写入输出文件，时间戳为当前输入帧的时间戳
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    if (sink == NULL)
+        return -1;
+    uint32_t rec[4] = {(uint32_t)(cur_ts / 1000000000), (uint32_t)(cur_ts % 1000000000), buf->len, buf->len};
+    if (fwrite(rec, sizeof(rec), 1, sink) != 1 || fwrite(buf->data, buf->len, 1, sink) != 1)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包，各段依次写入输出文件
+ *
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+    if (sink == NULL)
+        return -1;
+    uint32_t len = 0;
+    for (int i = 0; i < cnt; i++)
+        len += iov[i].iov_len;
+    uint32_t rec[4] = {(uint32_t)(cur_ts / 1000000000), (uint32_t)(cur_ts % 1000000000), len, len};
+    if (fwrite(rec, sizeof(rec), 1, sink) != 1)
+        return -1;
+    for (int i = 0; i < cnt; i++)
+        if (iov[i].iov_len && fwrite(iov[i].iov_base, iov[i].iov_len, 1, sink) != 1)
+            return -1;
+    return 0;
+}
+
+/**
+ * @brief 把回放的帧数写入统计计数器
+ *
+ */
+void driver_stats()
+{
+    STATS_SET(DRIVER_REPLAY_FRAMES, frames);
+}
+
+/**
+ * @brief 关闭网卡，写完输出文件
+ *
+ */
+void driver_close()
+{
+    if (sink)
+    {
+        fclose(sink);
+        sink = NULL;
+    }
+    if (file)
+    {
+        munmap((void *)file, file_len);
+        file = NULL;
+    }
+}
+#endif
@@ -0,0 +1,152 @@
+#include "stats.h"
+#include "utils.h"
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * @brief 所有线程的计数器，按注册顺序分配
+ *
+ */
+static stats_block_t stats_blocks[STATS_MAX_THREADS];
+static int stats_block_cnt;
+
+__thread stats_block_t *stats_local;
+
+static stats_shm_t *stats_shm;
+static char stats_shm_name[64];
+static uint64_t stats_next_export;
+
+/**
+ * @brief 为当前线程分配一块计数器
+ *        超过STATS_MAX_THREADS的线程共用最后一块，此时计数可能因竞争而偏少
+ *
+ * @return stats_block_t* 当前线程的计数器
+ */
+stats_block_t *stats_register()
+{
+    int i = __atomic_fetch_add(&stats_block_cnt, 1, __ATOMIC_RELAXED);
+    if (i >= STATS_MAX_THREADS)
+        i = STATS_MAX_THREADS - 1;
+    stats_local = &stats_blocks[i];
+    return stats_local;
+}
+
+/**
+ * @brief 汇总所有线程的计数器
+ *
+ * @param counter 汇总结果，长度为STATS_MAX
+ */
+void stats_snapshot(uint64_t *counter)
+{
+    int n = __atomic_load_n(&stats_block_cnt, __ATOMIC_RELAXED);
+    if (n > STATS_MAX_THREADS)
+        n = STATS_MAX_THREADS;
+    memset(counter, 0, sizeof(uint64_t) * STATS_MAX);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < STATS_MAX; j++)
+            counter[j] += __atomic_load_n(&stats_blocks[i].counter[j], __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 汇总一个计数器
+ *
+ * @param id 计数器
+ * @return uint64_t 所有线程的和
+ */
+uint64_t stats_get(stats_id_t id)
+{
+    int n = __atomic_load_n(&stats_block_cnt, __ATOMIC_RELAXED);
+    if (n > STATS_MAX_THREADS)
+        n = STATS_MAX_THREADS;
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += __atomic_load_n(&stats_blocks[i].counter[id], __ATOMIC_RELAXED);
+    return sum;
+}
+
+/**
+ * @brief 创建共享内存并导出快照
+ *
+ * @param name 共享内存名，NULL时使用STATS_SHM_NAME
+ * @return int 成功为0，失败为-1
+ */
+int stats_export_open(const char *name)
+{
+    if (name == NULL)
+        name = STATS_SHM_NAME;
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        perror("Error in stats_export_open");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(stats_shm_t)) != 0)
+    {
+        perror("Error in stats_export_open");
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(stats_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        perror("Error in stats_export_open");
+        return -1;
+    }
+    stats_shm = p;
+    memset(stats_shm, 0, sizeof(stats_shm_t));
+    stats_shm->version = STATS_SHM_VERSION;
+    stats_shm->count = STATS_MAX;
+    __atomic_store_n(&stats_shm->magic, STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+    snprintf(stats_shm_name, sizeof(stats_shm_name), "%s", name);
+    stats_next_export = 0;
+    return 0;
+}
+
+/**
+ * @brief 距离上次导出是否已经超过STATS_EXPORT_MS
+ *
+ * @return int 需要导出为1，否则为0
+ */
+int stats_export_due()
+{
+    return stats_shm != NULL && time_ms() >= stats_next_export;
+}
+
+/**
+ * @brief 汇总计数器并写入共享内存
+ *
+ */
+void stats_export()
+{
+    if (stats_shm == NULL)
+        return;
+    uint64_t counter[STATS_MAX];
+    stats_snapshot(counter);
+
+    uint64_t now = time_ms();
+    uint32_t seq = stats_shm->seq;
+    __atomic_store_n(&stats_shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    stats_shm->time_ms = now;
+    for (int i = 0; i < STATS_MAX; i++)
+        __atomic_store_n(&stats_shm->counter[i], counter[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_shm->seq, seq + 2, __ATOMIC_RELEASE);
+    stats_next_export = now + STATS_EXPORT_MS;
+}
+
+/**
+ * @brief 关闭并删除共享内存
+ *
+ */
+void stats_export_close()
+{
+    if (stats_shm == NULL)
+        return;
+    munmap(stats_shm, sizeof(stats_shm_t));
+    shm_unlink(stats_shm_name);
+    stats_shm = NULL;
+}
@@ -0,0 +1,267 @@
+#include "config.h"
+#ifdef DRIVER_TAP
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <linux/virtio_net.h>
+#include "utils.h"
+#include "driver.h"
+#include "trace.h"
+#include "conf.h"
+#include "ethernet.h"
+
+#define TAP_RX_HEADROOM 64 //接收时在数据前保留的空间，供原地回复时添加协议头
+
+/**
+ * @brief TAP后端：通过/dev/net/tun直接收发以太网帧，不需要混杂模式与BPF过滤
+ *        打开DRIVER_TAP_QUEUES个队列(IFF_MULTI_QUEUE)，内核按流把帧分到各队列，driver_recv()从上次读到帧的队列的下一个起轮流读取，
+ *        发送使用最近读到帧的队列；多个工作线程时各自用driver_select_queue()固定到一个队列
+ *        每帧前带一个virtio_net_hdr(IFF_VNET_HDR)，与帧数据一起用readv/writev收发，不需要额外复制
+ *        接收时由virtio_net_hdr得知内核是否已确认或还没计算校验和，发送时让内核补全传输层校验和
+ *
+ *        没有root权限时可以先创建属于当前用户的TAP设备：
+ *        ip tuntap add DRIVER_TAP_NAME mode tap multi_queue vnet_hdr user $USER
+ */
+static int tap_fd[DRIVER_TAP_QUEUES];
+static __thread int tap_queue;                        //最近读到帧的队列，发送也使用它
+static __thread int tap_first;                        //本线程轮询的第一个队列
+static __thread int tap_count = DRIVER_TAP_QUEUES;    //本线程轮询的队列数
+
+/**
+ * @brief 打开一个队列
+ *
+ * @return int 文件描述符，失败为-1
+ */
+static int tap_open_queue()
+{
+    int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error in open /dev/net/tun: %s\n", strerror(errno));
+        return -1;
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | IFF_MULTI_QUEUE;
+    strncpy(ifr.ifr_name, DRIVER_TAP_NAME, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+    {
+        fprintf(stderr, "Error in TUNSETIFF %s: %s\n", DRIVER_TAP_NAME, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    int hdr_len = sizeof(struct virtio_net_hdr);
+    if (ioctl(fd, TUNSETVNETHDRSZ, &hdr_len) < 0)
+    {
+        fprintf(stderr, "Error in TUNSETVNETHDRSZ: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    // 允许内核交给我们未计算校验和的帧(VIRTIO_NET_HDR_F_NEEDS_CSUM)，由驱动补上
+    // 协议栈不处理超过MTU的帧，所以不打开TSO/UFO
+    if (ioctl(fd, TUNSETOFFLOAD, TUN_F_CSUM) < 0)
+    {
+        fprintf(stderr, "Error in TUNSETOFFLOAD: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open()
+{
+    for (int i = 0; i < DRIVER_TAP_QUEUES; i++)
+    {
+        if ((tap_fd[i] = tap_open_queue()) < 0)
+        {
+            while (i-- > 0)
+                close(tap_fd[i]);
+            return -1;
+        }
+    }
+    tap_queue = 0;
+    tap_first = 0;
+    tap_count = DRIVER_TAP_QUEUES;
+    return 0;
+}
+
+/**
+ * @brief 把当前线程固定到一个队列，之后只从这个队列收发
+ *
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue)
+{
+    if (queue < 0 || queue >= DRIVER_TAP_QUEUES)
+        return -1;
+    tap_queue = queue;
+    tap_first = queue;
+    tap_count = 1;
+    return 0;
+}
+
+/**
+ * @brief 补上内核留给我们计算的校验和
+ *        校验和字段中已经是伪首部的部分和，从csum_start开始求和即可
+ *
+ * @return int 成功为0，偏移越界为-1
+ */
+static int tap_finish_csum(buf_t *buf, const struct virtio_net_hdr *hdr)
+{
+    if (hdr->csum_start + hdr->csum_offset + 2 > buf->len)
+        return -1;
+    uint8_t *field = buf->data + hdr->csum_start + hdr->csum_offset;
+    uint16_t sum = checksum16((uint16_t *)(buf->data + hdr->csum_start), buf->len - hdr->csum_start);
+    if (sum == 0 && hdr->csum_offset == 6) // UDP中0表示没有校验和
+        sum = 0xFFFF;
+    memcpy(field, &sum, sizeof(sum));
+    return 0;
+}
+
+/**
+ * @brief 传输层校验和留给内核补全时填写virtio_net_hdr，传输层头部紧跟在IP头部之后
+ *
+ */
+static void tap_csum_hdr(struct virtio_net_hdr *hdr, const buf_t *buf)
+{
+    if (buf->csum != BUF_CSUM_PARTIAL)
+        return;
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->csum_start = sizeof(ether_hdr_t) + (buf->data[sizeof(ether_hdr_t)] & 0xF) * 4;
+    hdr->csum_offset = buf->csum_offset;
+}
+
+/**
+ * @brief 试图从网卡接收数据包，依次尝试本线程的各队列，读到一帧即返回
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(buf_t *buf)
+{
+    struct virtio_net_hdr hdr;
+    buf_init(buf, BUF_MAX_LEN - TAP_RX_HEADROOM);
+    struct iovec iov[2] = {
+        {&hdr, sizeof(hdr)},
+        {buf->data, buf->len},
+    };
+    ssize_t n = -1;
+    for (int i = 1; i <= tap_count && n < 0; i++)
+    {
+        int queue = tap_first + (tap_queue - tap_first + i) % tap_count;
+        n = readv(tap_fd[queue], iov, 2);
+        if (n >= 0)
+            tap_queue = queue; //回复从收到帧的队列发出
+        else if (errno != EAGAIN && errno != EINTR)
+        {
+            fprintf(stderr, "Error in driver_recv: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    if (n < 0)
+        return 0;
+    if (n <= (ssize_t)sizeof(hdr))
+        return 0;
+    buf->len = n - sizeof(hdr);
+    if (net_conf.rx_timestamp) // TAP不提供内核时间戳，用读到帧的时间
+        buf->ts.sw = time_ns();
+    if (hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE)
+    {
+        NET_DROP(DRIVER, DRIVER_TAP_DROP_GSO);
+        return 0;
+    }
+    if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+    {
+        // 本机内核发出的帧，校验和不会出错，打开csum_offload时不必补上
+        STATS_INC(DRIVER_TAP_CSUM_PARTIAL);
+        if (net_conf.csum_offload)
+            buf->csum = BUF_CSUM_VALID;
+        else if (tap_finish_csum(buf, &hdr) < 0)
+        {
+            NET_DROP(DRIVER, DRIVER_TAP_DROP_BAD_HDR);
+            return 0;
+        }
+    }
+    else if ((hdr.flags & VIRTIO_NET_HDR_F_DATA_VALID) && net_conf.csum_offload)
+        buf->csum = BUF_CSUM_VALID;
+    return buf->len;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    struct virtio_net_hdr hdr = {.flags = 0, .gso_type = VIRTIO_NET_HDR_GSO_NONE};
+    tap_csum_hdr(&hdr, buf);
+    struct iovec iov[2] = {
+        {&hdr, sizeof(hdr)},
+        {buf->data, buf->len},
+    };
+    if (writev(tap_fd[tap_queue], iov, 2) < 0)
+    {
+        if (errno != EAGAIN)
+            fprintf(stderr, "Error in driver_send: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包，virtio_net_hdr之后依次是各段，一次writev()写入
+ *
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+    struct virtio_net_hdr hdr = {.flags = 0, .gso_type = VIRTIO_NET_HDR_GSO_NONE}; //分段发送时协议栈已算好校验和
+    struct iovec v[BUF_MAX_SEG + 2];
+    if (cnt > BUF_MAX_SEG + 1)
+        return -1;
+    v[0].iov_base = &hdr;
+    v[0].iov_len = sizeof(hdr);
+    memcpy(v + 1, iov, cnt * sizeof(struct iovec));
+    if (writev(tap_fd[tap_queue], v, cnt + 1) < 0)
+    {
+        if (errno != EAGAIN)
+            fprintf(stderr, "Error in driver_sendv: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief TAP设备的计数可在/sys/class/net/DRIVER_TAP_NAME/statistics中查看，这里没有额外的计数
+ *
+ */
+void driver_stats()
+{
+}
+
+/**
+ * @brief 关闭网卡
+ *
+ */
+void driver_close()
+{
+    for (int i = 0; i < DRIVER_TAP_QUEUES; i++)
+        close(tap_fd[i]);
+}
+#endif
@@ -0,0 +1,1654 @@
+#include "tcp.h"
+#include "ip.h"
+#include "udp.h"
+#include "trace.h"
+#include "conf.h"
+#include "arena.h"
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#define TCP_MAX_CC 4 //最多可注册的拥塞控制算法数
+#define TCP_MSS (net_conf.mtu - 40) //TCP最大报文段长度，随MTU配置
+
+#define TCP_SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define TCP_SEQ_GT(a, b) ((int32_t)((a) - (b)) > 0)
+#define TCP_SEQ_GEQ(a, b) ((int32_t)((a) - (b)) >= 0)
+
+#define TCP_OPT_END 0       //选项结束
+#define TCP_OPT_NOP 1       //填充
+#define TCP_OPT_MSS 2       //最大报文段长度
+#define TCP_OPT_WSCALE 3    //窗口缩放
+#define TCP_OPT_SACK_PERM 4 //允许SACK
+#define TCP_OPT_SACK 5      //SACK块
+
+#define TCP_DEFAULT_MSS 536 //对方未通告MSS时使用的值
+
+/**
+ * @brief 解析后的tcp报文段
+ *
+ */
+typedef struct tcp_seg
+{
+    uint16_t src_port, dest_port;
+    uint32_t seq, ack;
+    uint8_t flags;
+    uint16_t window;                         //未缩放的窗口
+    uint8_t *data;                           //数据
+    uint32_t len;                            //数据长度
+    uint16_t mss;                            //MSS选项，0表示没有
+    int wscale;                              //窗口缩放选项，-1表示没有
+    int sack_perm;                           //允许SACK选项
+    tcp_sack_block_t sack[TCP_MAX_SACK];     //SACK块
+    int sack_cnt;
+} tcp_seg_t;
+
+/**
+ * @brief tcp连接池
+ *
+ */
+static tcp_conn_t *tcp_conns; //连接表，tcp_init()时从内存区域分配
+
+/**
+ * @brief 按四元组索引的连接哈希表
+ *
+ */
+static tcp_conn_t *tcp_hash_table[TCP_HASH_SIZE];
+
+/**
+ * @brief 监听端口表
+ *
+ */
+static tcp_listener_t tcp_listeners[TCP_MAX_LISTEN];
+
+/**
+ * @brief 已注册的拥塞控制算法
+ *
+ */
+static const tcp_cc_ops_t *tcp_cc_table[TCP_MAX_CC];
+
+static uint32_t tcp_isn_counter;
+static buf_t *tcp_out_buf; //构造报文段头部的缓冲区，负载留在发送缓冲区中按段发送，第一次使用时从内存区域分配
+
+static uint32_t min32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+/**
+ * @brief 生成初始序号，按4微秒递增的时钟加上一个计数器
+ *
+ * @return uint32_t 初始序号
+ */
+static uint32_t tcp_isn()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 250000 + ts.tv_nsec / 4000) + (tcp_isn_counter += 64000);
+}
+
+/*--------------------------------- 环形缓冲区 ---------------------------------*/
+
+/**
+ * @brief 从环形缓冲区的head + off处写入数据
+ *
+ */
+static void tcp_ring_write(tcp_ring_t *ring, uint32_t off, const uint8_t *data, uint32_t len)
+{
+    uint32_t pos = (ring->head + off) & (TCP_BUF_SIZE - 1);
+    uint32_t first = min32(len, TCP_BUF_SIZE - pos);
+    memcpy(ring->data + pos, data, first);
+    memcpy(ring->data, data + first, len - first);
+}
+
+/**
+ * @brief 从环形缓冲区的head + off处读出数据
+ *
+ */
+static void tcp_ring_read(tcp_ring_t *ring, uint32_t off, uint8_t *data, uint32_t len)
+{
+    uint32_t pos = (ring->head + off) & (TCP_BUF_SIZE - 1);
+    uint32_t first = min32(len, TCP_BUF_SIZE - pos);
+    memcpy(data, ring->data + pos, first);
+    memcpy(data + first, ring->data, len - first);
+}
+
+/**
+ * @brief 取环形缓冲区head + off处的一段数据，不复制，跨过缓冲区末尾时分成两段
+ *
+ * @return int 段数
+ */
+static int tcp_ring_iov(tcp_ring_t *ring, uint32_t off, uint32_t len, struct iovec *iov)
+{
+    uint32_t pos = (ring->head + off) & (TCP_BUF_SIZE - 1);
+    uint32_t first = min32(len, TCP_BUF_SIZE - pos);
+    iov[0].iov_base = ring->data + pos;
+    iov[0].iov_len = first;
+    if (first == len)
+        return 1;
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = len - first;
+    return 2;
+}
+
+/**
+ * @brief 释放环形缓冲区头部的数据
+ *
+ */
+static void tcp_ring_consume(tcp_ring_t *ring, uint32_t len)
+{
+    ring->head = (ring->head + len) & (TCP_BUF_SIZE - 1);
+    ring->len -= len;
+}
+
+/*--------------------------------- SACK块 ---------------------------------*/
+
+/**
+ * @brief 向SACK块列表中加入一个块，与重叠或相邻的块合并，合并后的块放在最前
+ *        列表已满时丢弃最后一个块
+ *
+ * @param blocks 块列表
+ * @param cnt 块数
+ * @param start 起始序号
+ * @param end 结束序号
+ * @return int 新的块数
+ */
+static int tcp_sack_add(tcp_sack_block_t *blocks, int cnt, uint32_t start, uint32_t end)
+{
+    for (int i = 0; i < cnt; i++)
+    {
+        if (TCP_SEQ_LEQ(blocks[i].start, end) && TCP_SEQ_LEQ(start, blocks[i].end))
+        {
+            if (TCP_SEQ_LT(blocks[i].start, start))
+                start = blocks[i].start;
+            if (TCP_SEQ_GT(blocks[i].end, end))
+                end = blocks[i].end;
+            memmove(blocks + i, blocks + i + 1, (cnt - i - 1) * sizeof(tcp_sack_block_t));
+            cnt--;
+            i = -1;
+        }
+    }
+    if (cnt == TCP_MAX_SACK)
+        cnt--;
+    memmove(blocks + 1, blocks, cnt * sizeof(tcp_sack_block_t));
+    blocks[0].start = start;
+    blocks[0].end = end;
+    return cnt + 1;
+}
+
+/**
+ * @brief 去掉SACK块列表中序号小于seq的部分
+ *
+ * @return int 新的块数
+ */
+static int tcp_sack_trim(tcp_sack_block_t *blocks, int cnt, uint32_t seq)
+{
+    for (int i = 0; i < cnt; i++)
+    {
+        if (TCP_SEQ_LEQ(blocks[i].end, seq))
+        {
+            memmove(blocks + i, blocks + i + 1, (cnt - i - 1) * sizeof(tcp_sack_block_t));
+            cnt--;
+            i--;
+        }
+        else if (TCP_SEQ_LT(blocks[i].start, seq))
+            blocks[i].start = seq;
+    }
+    return cnt;
+}
+
+/*--------------------------------- 拥塞控制 ---------------------------------*/
+
+static void tcp_reno_init(tcp_conn_t *conn)
+{
+    conn->cwnd = 10 * conn->mss;
+    conn->ssthresh = UINT32_MAX;
+    conn->cc_priv[0] = 0;
+}
+
+static void tcp_reno_on_ack(tcp_conn_t *conn, uint32_t acked)
+{
+    if (conn->cwnd < conn->ssthresh)
+    {
+        conn->cwnd += min32(acked, conn->mss);
+        return;
+    }
+    conn->cc_priv[0] += acked; //拥塞避免：每确认一个cwnd的数据增加一个mss
+    if (conn->cc_priv[0] >= conn->cwnd)
+    {
+        conn->cc_priv[0] -= conn->cwnd;
+        conn->cwnd += conn->mss;
+    }
+}
+
+static void tcp_reno_on_loss(tcp_conn_t *conn, int timeout)
+{
+    uint32_t flight = conn->snd_max - conn->snd_una;
+    conn->ssthresh = flight / 2 > 2 * conn->mss ? flight / 2 : 2 * conn->mss;
+    conn->cwnd = timeout ? conn->mss : conn->ssthresh + 3 * conn->mss;
+    conn->cc_priv[0] = 0;
+}
+
+static void tcp_reno_on_recovery_exit(tcp_conn_t *conn)
+{
+    conn->cwnd = conn->ssthresh;
+}
+
+static const tcp_cc_ops_t tcp_reno = {
+    .name = "reno",
+    .init = tcp_reno_init,
+    .on_ack = tcp_reno_on_ack,
+    .on_loss = tcp_reno_on_loss,
+    .on_recovery_exit = tcp_reno_on_recovery_exit};
+
+/**
+ * @brief 注册一个拥塞控制算法
+ *
+ * @param ops 算法
+ * @return int 成功为0，失败为-1
+ */
+int tcp_cc_register(const tcp_cc_ops_t *ops)
+{
+    for (int i = 0; i < TCP_MAX_CC; i++)
+        if (tcp_cc_table[i] == NULL || strcmp(tcp_cc_table[i]->name, ops->name) == 0)
+        {
+            tcp_cc_table[i] = ops;
+            return 0;
+        }
+    return -1;
+}
+
+static const tcp_cc_ops_t *tcp_cc_find(const char *name)
+{
+    for (int i = 0; i < TCP_MAX_CC; i++)
+        if (tcp_cc_table[i] && strcmp(tcp_cc_table[i]->name, name) == 0)
+            return tcp_cc_table[i];
+    return NULL;
+}
+
+/**
+ * @brief 为连接选择拥塞控制算法
+ *
+ * @param conn 连接
+ * @param name 算法名称
+ * @return int 成功为0，未找到为-1
+ */
+int tcp_set_cc(tcp_conn_t *conn, const char *name)
+{
+    const tcp_cc_ops_t *cc = tcp_cc_find(name);
+    if (cc == NULL)
+        return -1;
+    conn->cc = cc;
+    if (conn->state >= TCP_ESTABLISHED)
+        cc->init(conn);
+    return 0;
+}
+
+/*--------------------------------- 连接表 ---------------------------------*/
+
+static int tcp_hash(uint8_t *ip, uint16_t remote_port, uint16_t local_port)
+{
+    uint32_t h = ((uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3]) ^ ((uint32_t)remote_port << 16 | local_port);
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (TCP_HASH_SIZE - 1);
+}
+
+/**
+ * @brief 根据四元组查找连接
+ *
+ * @return tcp_conn_t* 连接，未找到时为NULL
+ */
+static tcp_conn_t *tcp_lookup(uint8_t *remote_ip, uint16_t remote_port, uint16_t local_port)
+{
+    tcp_conn_t *conn = tcp_hash_table[tcp_hash(remote_ip, remote_port, local_port)];
+    for (; conn; conn = conn->hash_next)
+        if (conn->remote_port == remote_port && conn->local_port == local_port &&
+            memcmp(conn->remote_ip, remote_ip, NET_IP_LEN) == 0)
+            return conn;
+    return NULL;
+}
+
+/**
+ * @brief 分配一个连接并加入哈希表
+ *
+ * @return tcp_conn_t* 连接，连接池已满时为NULL
+ */
+static tcp_conn_t *tcp_conn_alloc(uint8_t *remote_ip, uint16_t remote_port, uint16_t local_port)
+{
+    for (int i = 0; i < TCP_MAX_CONN; i++)
+    {
+        tcp_conn_t *conn = &tcp_conns[i];
+        if (conn->state != TCP_CLOSED)
+            continue;
+        memset(conn, 0, offsetof(tcp_conn_t, snd)); //缓冲区内容无需清零
+        conn->snd.head = conn->snd.len = 0;
+        conn->rcv.head = conn->rcv.len = 0;
+        memcpy(conn->remote_ip, remote_ip, NET_IP_LEN);
+        conn->remote_port = remote_port;
+        conn->local_port = local_port;
+        conn->cc = tcp_cc_find(TCP_DEFAULT_CC);
+        conn->mss = TCP_DEFAULT_MSS;
+        conn->rto = TCP_RTO_INIT_MS;
+        while ((TCP_BUF_SIZE >> conn->rcv_wscale) > UINT16_MAX && conn->rcv_wscale < 14)
+            conn->rcv_wscale++;
+
+        int h = tcp_hash(remote_ip, remote_port, local_port);
+        conn->hash_next = tcp_hash_table[h];
+        tcp_hash_table[h] = conn;
+        return conn;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 从监听端口的等待队列中移除一个连接
+ *
+ */
+static void tcp_listener_remove(tcp_listener_t *listener, tcp_conn_t *conn)
+{
+    int count = 0;
+    for (int i = 0; i < listener->count; i++)
+    {
+        tcp_conn_t *c = listener->queue[(listener->head + i) % TCP_MAX_BACKLOG];
+        if (c != conn)
+            listener->queue[(listener->head + count++) % TCP_MAX_BACKLOG] = c;
+    }
+    listener->count = count;
+}
+
+/**
+ * @brief 释放连接，从哈希表和监听队列中移除
+ *        连接内容保留到下一次分配，因此释放后的事件回调仍可以读取
+ *
+ */
+static void tcp_conn_free(tcp_conn_t *conn)
+{
+    tcp_conn_t **p = &tcp_hash_table[tcp_hash(conn->remote_ip, conn->remote_port, conn->local_port)];
+    for (; *p; p = &(*p)->hash_next)
+        if (*p == conn)
+        {
+            *p = conn->hash_next;
+            break;
+        }
+    if (conn->listener)
+    {
+        if (conn->state == TCP_SYN_RCVD)
+        {
+            conn->listener->pending--;
+            conn->handler = NULL; //应用尚未见过该连接，不再通知
+        }
+        else
+            tcp_listener_remove(conn->listener, conn);
+        conn->listener = NULL;
+    }
+    conn->state = TCP_CLOSED;
+}
+
+/**
+ * @brief 依次通知连接的事件处理程序
+ *
+ * @param conn 连接
+ * @param events 以(1 << tcp_event_t)表示的事件集合
+ */
+static void tcp_notify(tcp_conn_t *conn, int events)
+{
+    for (int e = TCP_EVENT_ACCEPT; e <= TCP_EVENT_CLOSED; e++)
+    {
+        if (!(events & (1 << e)) || conn->handler == NULL)
+            continue;
+        if (conn->state == TCP_CLOSED && e != TCP_EVENT_RESET && e != TCP_EVENT_CLOSED)
+            continue;
+        conn->handler(conn, e);
+    }
+}
+
+/*--------------------------------- 发送 ---------------------------------*/
+
+/**
+ * @brief tcp伪校验和计算，与udp_checksum相同，伪头部暂时覆盖在IP头部的位置
+ *
+ * @param buf 要计算的包
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @return uint16_t 伪校验和
+ */
+static uint16_t tcp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
+{
+    uint16_t len = swap16(buf->len);
+    buf_add_header(buf, sizeof(udp_peso_hdr_t));
+    udp_peso_hdr_t *hdr = (udp_peso_hdr_t *)buf->data;
+    udp_peso_hdr_t temp = *hdr;
+
+    memcpy(hdr->src_ip, src_ip, NET_IP_LEN);
+    memcpy(hdr->dest_ip, dest_ip, NET_IP_LEN);
+    hdr->placeholder = 0;
+    hdr->protocol = NET_PROTOCOL_TCP;
+    hdr->total_len = len;
+
+    uint16_t checksum = checksum16((uint16_t *)buf->data, buf->len);
+
+    *hdr = temp;
+    buf_remove_header(buf, sizeof(udp_peso_hdr_t));
+    return checksum;
+}
+
+/**
+ * @brief 分段数据包的tcp伪校验和计算，与udp_checksum_chain相同，伪头部放在栈上
+ *
+ * @param chain 要计算的包，头部段以TCP头部开始
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @return uint16_t 伪校验和
+ */
+static uint16_t tcp_checksum_chain(buf_chain_t *chain, uint8_t *src_ip, uint8_t *dest_ip)
+{
+    udp_peso_hdr_t peso;
+    memcpy(peso.src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso.dest_ip, dest_ip, NET_IP_LEN);
+    peso.placeholder = 0;
+    peso.protocol = NET_PROTOCOL_TCP;
+    peso.total_len = swap16(buf_chain_len(chain));
+
+    struct iovec iov[BUF_MAX_SEG + 2];
+    iov[0].iov_base = &peso;
+    iov[0].iov_len = sizeof(peso);
+    iov[1].iov_base = chain->hdr->data;
+    iov[1].iov_len = chain->hdr->len;
+    memcpy(iov + 2, chain->seg, chain->seg_num * sizeof(struct iovec));
+    return checksum16_iov(iov, chain->seg_num + 2);
+}
+
+/**
+ * @brief 添加tcp头部并发送到IP层
+ *        没有负载段时与原来一样整包发送，可以把校验和交给设备补全；
+ *        有负载段时负载留在原处(发送缓冲区)，与头部一起按段发送，校验和按段计算
+ *
+ * @param chain 要发送的包，hdr中还没有任何头部
+ * @param opt 选项，长度必须是4的倍数
+ */
+static void tcp_out(buf_chain_t *chain, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port,
+                    uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window, uint8_t *opt, int opt_len)
+{
+    buf_t *buf = chain->hdr;
+    buf_add_header(buf, sizeof(tcp_hdr_t) + opt_len);
+    tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
+    hdr->src_port = swap16(src_port);
+    hdr->dest_port = swap16(dest_port);
+    hdr->seq = swap32(seq);
+    hdr->ack = swap32(ack);
+    hdr->reserved = 0;
+    hdr->data_offset = (sizeof(tcp_hdr_t) + opt_len) / 4;
+    hdr->flags = flags;
+    hdr->window = swap16(window);
+    hdr->urgent = 0;
+    if (opt_len)
+        memcpy(hdr + 1, opt, opt_len);
+    uint32_t len = buf_chain_len(chain);
+    if (chain->seg_num == 0 && ip_csum_offload(len))
+    {
+        hdr->checksum = checksum_pseudo(net_if_ip, dest_ip, NET_PROTOCOL_TCP, len);
+        buf->csum = BUF_CSUM_PARTIAL;
+        buf->csum_offset = offsetof(tcp_hdr_t, checksum);
+        STATS_INC(TCP_TX_CSUM_OFFLOAD);
+    }
+    else
+    {
+        hdr->checksum = 0;
+        hdr->checksum = chain->seg_num ? tcp_checksum_chain(chain, net_if_ip, dest_ip) : tcp_checksum(buf, net_if_ip, dest_ip);
+    }
+    TRACE(TCP, TCP_OUT, trace_ip(dest_ip), src_port, dest_port, flags, len - sizeof(tcp_hdr_t) - opt_len);
+    STATS_INC(TCP_TX_PKTS);
+    STATS_ADD(TCP_TX_BYTES, len);
+    if (chain->seg_num)
+        ip_out_chain(chain, dest_ip, NET_PROTOCOL_TCP);
+    else
+        ip_out(buf, dest_ip, NET_PROTOCOL_TCP);
+}
+
+/**
+ * @brief 对没有对应连接的报文段回应RST
+ *
+ */
+static void tcp_send_reset(uint8_t *dest_ip, tcp_seg_t *seg)
+{
+    buf_chain_t chain = {.hdr = arena_buf(&tcp_out_buf)};
+    buf_init(chain.hdr, 0);
+    if (seg->flags & TCP_FLAG_ACK)
+        tcp_out(&chain, seg->dest_port, dest_ip, seg->src_port, seg->ack, 0, TCP_FLAG_RST, 0, NULL, 0);
+    else
+    {
+        uint32_t ack = seg->seq + seg->len + !!(seg->flags & TCP_FLAG_SYN) + !!(seg->flags & TCP_FLAG_FIN);
+        tcp_out(&chain, seg->dest_port, dest_ip, seg->src_port, 0, ack, TCP_FLAG_RST | TCP_FLAG_ACK, 0, NULL, 0);
+    }
+}
+
+/**
+ * @brief 本方的接收窗口
+ *
+ */
+static uint32_t tcp_rcv_space(tcp_conn_t *conn)
+{
+    return TCP_BUF_SIZE - conn->rcv.len;
+}
+
+/**
+ * @brief 填写连接的tcp选项，SYN报文段携带MSS、SACK与窗口缩放，其余报文段在有乱序数据时携带SACK块
+ *
+ * @return int 选项长度
+ */
+static int tcp_build_options(tcp_conn_t *conn, uint8_t flags, uint8_t *opt)
+{
+    int n = 0;
+    if (flags & TCP_FLAG_SYN)
+    {
+        opt[n++] = TCP_OPT_MSS;
+        opt[n++] = 4;
+        opt[n++] = TCP_MSS >> 8;
+        opt[n++] = TCP_MSS & 0xFF;
+        if (conn->sack_ok)
+        {
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_SACK_PERM;
+            opt[n++] = 2;
+        }
+        if (conn->wscale_ok)
+        {
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_WSCALE;
+            opt[n++] = 3;
+            opt[n++] = conn->rcv_wscale;
+        }
+    }
+    else if (conn->sack_ok && conn->ooo_cnt && (flags & TCP_FLAG_ACK))
+    {
+        opt[n++] = TCP_OPT_NOP;
+        opt[n++] = TCP_OPT_NOP;
+        opt[n++] = TCP_OPT_SACK;
+        opt[n++] = 2 + 8 * conn->ooo_cnt;
+        for (int i = 0; i < conn->ooo_cnt; i++)
+        {
+            *(uint32_t *)(opt + n) = swap32(conn->ooo[i].start);
+            *(uint32_t *)(opt + n + 4) = swap32(conn->ooo[i].end);
+            n += 8;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief 扣除选项后一个报文段最多携带的数据量
+ *
+ */
+static uint32_t tcp_payload_max(tcp_conn_t *conn)
+{
+    if (conn->sack_ok && conn->ooo_cnt)
+        return conn->mss - 4 - 8 * conn->ooo_cnt;
+    return conn->mss;
+}
+
+/**
+ * @brief 发送一个属于连接的报文段，数据从发送缓冲区中取出
+ *
+ * @param conn 连接
+ * @param seq 序号
+ * @param len 数据长度
+ * @param flags 标志
+ */
+static void tcp_send_segment(tcp_conn_t *conn, uint32_t seq, uint32_t len, uint8_t flags)
+{
+    uint8_t opt[40];
+    int opt_len = tcp_build_options(conn, flags, opt);
+    uint32_t space = tcp_rcv_space(conn);
+    uint16_t window;
+    if (flags & TCP_FLAG_SYN)
+        window = min32(space, UINT16_MAX); //SYN报文段中的窗口不缩放
+    else
+        window = min32(space >> conn->rcv_wscale, UINT16_MAX);
+
+    buf_chain_t chain = {.hdr = arena_buf(&tcp_out_buf)};
+    buf_init(chain.hdr, 0);
+    if (len)
+        chain.seg_num = tcp_ring_iov(&conn->snd, seq - conn->snd_una, len, chain.seg);
+    tcp_out(&chain, conn->local_port, conn->remote_ip, conn->remote_port,
+            seq, (flags & TCP_FLAG_ACK) ? conn->rcv_nxt : 0, flags, window, opt, opt_len);
+    if (flags & TCP_FLAG_ACK)
+    {
+        conn->ack_pending = 0;
+        conn->delack_deadline = 0;
+    }
+}
+
+static void tcp_send_ack(tcp_conn_t *conn)
+{
+    tcp_send_segment(conn, conn->snd_nxt, 0, TCP_FLAG_ACK);
+}
+
+static void tcp_arm_rto(tcp_conn_t *conn)
+{
+    if (conn->rto_deadline == 0)
+        conn->rto_deadline = time_ms() + conn->rto;
+}
+
+/**
+ * @brief 启动坚持定时器，间隔从rto开始，每次超时加倍，至多TCP_RTO_MAX_MS
+ *
+ */
+static void tcp_arm_persist(tcp_conn_t *conn)
+{
+    if (conn->persist_deadline)
+        return;
+    if (conn->persist_backoff == 0)
+        conn->persist_backoff = conn->rto;
+    conn->persist_deadline = time_ms() + conn->persist_backoff;
+}
+
+/**
+ * @brief 记录新发送的序号，启动RTT测量与重传定时器
+ *
+ */
+static void tcp_advance(tcp_conn_t *conn, uint32_t len)
+{
+    if (!conn->rtt_timing && conn->snd_nxt == conn->snd_max)
+    {
+        conn->rtt_timing = 1;
+        conn->rtt_seq = conn->snd_nxt;
+        conn->rtt_start = time_ms();
+    }
+    conn->snd_nxt += len;
+    if (TCP_SEQ_GT(conn->snd_nxt, conn->snd_max))
+        conn->snd_max = conn->snd_nxt;
+    tcp_arm_rto(conn);
+}
+
+static void tcp_send_syn(tcp_conn_t *conn)
+{
+    uint8_t flags = TCP_FLAG_SYN | (conn->state == TCP_SYN_RCVD ? TCP_FLAG_ACK : 0);
+    conn->snd_nxt = conn->iss;
+    tcp_send_segment(conn, conn->iss, 0, flags);
+    tcp_advance(conn, 1);
+}
+
+/**
+ * @brief 在拥塞窗口和对方窗口允许的范围内发送缓冲区中的数据，数据发送完毕后发送FIN
+ *
+ */
+static void tcp_output(tcp_conn_t *conn)
+{
+    if (conn->state != TCP_ESTABLISHED && conn->state != TCP_CLOSE_WAIT &&
+        conn->state != TCP_FIN_WAIT_1 && conn->state != TCP_CLOSING && conn->state != TCP_LAST_ACK)
+        return;
+
+    uint32_t wnd = min32(conn->cwnd, conn->snd_wnd);
+    while (1)
+    {
+        uint32_t off = conn->snd_nxt - conn->snd_una;
+        uint32_t unsent = conn->snd.len > off ? conn->snd.len - off : 0;
+        if (unsent)
+        {
+            uint32_t room = wnd > off ? wnd - off : 0;
+            if (room == 0)
+            {
+                if (conn->probe && off == 0)
+                    room = 1; //零窗口探测
+                else
+                {
+                    if (conn->snd_wnd == 0 && conn->snd_una == conn->snd_max)
+                        tcp_arm_persist(conn); //没有在途数据，对方的窗口更新丢失后不会再有ACK
+                    break;
+                }
+            }
+            uint32_t max = tcp_payload_max(conn);
+            uint32_t n = min32(min32(unsent, room), max);
+            if (n < unsent && n < max && off > 0) //避免糊涂窗口，等待窗口足够发送满报文段
+                break;
+            tcp_send_segment(conn, conn->snd_nxt, n, TCP_FLAG_ACK | (n == unsent ? TCP_FLAG_PSH : 0));
+            tcp_advance(conn, n);
+            conn->probe = 0;
+            continue;
+        }
+        if (conn->fin_pending && !conn->fin_sent && off == conn->snd.len)
+        {
+            conn->fin_seq = conn->snd_nxt;
+            conn->fin_sent = 1;
+            tcp_send_segment(conn, conn->snd_nxt, 0, TCP_FLAG_FIN | TCP_FLAG_ACK);
+            tcp_advance(conn, 1);
+        }
+        break;
+    }
+}
+
+/**
+ * @brief 重传一个报文段，不改变snd_nxt
+ *
+ */
+static void tcp_retransmit(tcp_conn_t *conn, uint32_t seq, uint32_t len)
+{
+    uint32_t off = seq - conn->snd_una;
+    if (off >= conn->snd.len)
+    {
+        if (conn->fin_sent && seq == conn->fin_seq)
+            tcp_send_segment(conn, seq, 0, TCP_FLAG_FIN | TCP_FLAG_ACK);
+        return;
+    }
+    len = min32(min32(len, conn->snd.len - off), tcp_payload_max(conn));
+    TRACE(TCP, TCP_RETRANSMIT, conn->local_port, seq, len);
+    tcp_send_segment(conn, seq, len, TCP_FLAG_ACK);
+    conn->rtt_timing = 0; //Karn算法：不对重传的报文段测量RTT
+    if (TCP_SEQ_GT(seq + len, conn->rexmit_nxt))
+        conn->rexmit_nxt = seq + len;
+}
+
+/**
+ * @brief 找到从seq开始的第一个未被SACK的空洞
+ *
+ * @param conn 连接
+ * @param seq 起始序号
+ * @param len 返回空洞长度
+ * @return uint32_t 空洞起始序号
+ */
+static uint32_t tcp_next_hole(tcp_conn_t *conn, uint32_t seq, uint32_t *len)
+{
+    if (TCP_SEQ_LT(seq, conn->snd_una))
+        seq = conn->snd_una;
+    for (int i = 0; i < conn->sacked_cnt; i++)
+        if (TCP_SEQ_LEQ(conn->sacked[i].start, seq) && TCP_SEQ_GT(conn->sacked[i].end, seq))
+        {
+            seq = conn->sacked[i].end;
+            i = -1;
+        }
+    uint32_t end = conn->snd_max;
+    for (int i = 0; i < conn->sacked_cnt; i++)
+        if (TCP_SEQ_GT(conn->sacked[i].start, seq) && TCP_SEQ_LT(conn->sacked[i].start, end))
+            end = conn->sacked[i].start;
+    *len = end - seq;
+    return seq;
+}
+
+/**
+ * @brief 对方SACK的最高序号，其下的空洞视为已丢失
+ *
+ */
+static uint32_t tcp_sack_high(tcp_conn_t *conn)
+{
+    uint32_t high = conn->snd_una;
+    for (int i = 0; i < conn->sacked_cnt; i++)
+        if (TCP_SEQ_GT(conn->sacked[i].end, high))
+            high = conn->sacked[i].end;
+    return high;
+}
+
+/*--------------------------------- 接收 ---------------------------------*/
+
+/**
+ * @brief 解析tcp选项
+ *
+ */
+static void tcp_parse_options(uint8_t *opt, int len, tcp_seg_t *seg)
+{
+    seg->mss = 0;
+    seg->wscale = -1;
+    seg->sack_perm = 0;
+    seg->sack_cnt = 0;
+    for (int i = 0; i < len;)
+    {
+        if (opt[i] == TCP_OPT_END)
+            break;
+        if (opt[i] == TCP_OPT_NOP)
+        {
+            i++;
+            continue;
+        }
+        if (i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len)
+            break;
+        switch (opt[i])
+        {
+        case TCP_OPT_MSS:
+            if (opt[i + 1] == 4)
+                seg->mss = opt[i + 2] << 8 | opt[i + 3];
+            break;
+        case TCP_OPT_WSCALE:
+            if (opt[i + 1] == 3)
+                seg->wscale = opt[i + 2] > 14 ? 14 : opt[i + 2];
+            break;
+        case TCP_OPT_SACK_PERM:
+            seg->sack_perm = 1;
+            break;
+        case TCP_OPT_SACK:
+            for (int j = i + 2; j + 8 <= i + opt[i + 1] && seg->sack_cnt < TCP_MAX_SACK; j += 8)
+            {
+                seg->sack[seg->sack_cnt].start = swap32(*(uint32_t *)(opt + j));
+                seg->sack[seg->sack_cnt].end = swap32(*(uint32_t *)(opt + j + 4));
+                seg->sack_cnt++;
+            }
+            break;
+        default:
+            break;
+        }
+        i += opt[i + 1];
+    }
+}
+
+/**
+ * @brief 根据对方SYN中的选项设置连接参数
+ *
+ */
+static void tcp_apply_syn_options(tcp_conn_t *conn, tcp_seg_t *seg)
+{
+    conn->mss = seg->mss ? min32(seg->mss, TCP_MSS) : TCP_DEFAULT_MSS;
+    conn->sack_ok = conn->sack_ok && seg->sack_perm;
+    conn->wscale_ok = conn->wscale_ok && seg->wscale >= 0;
+    if (conn->wscale_ok)
+        conn->snd_wscale = seg->wscale;
+    else
+        conn->snd_wscale = conn->rcv_wscale = 0;
+    conn->irs = seg->seq;
+    conn->rcv_nxt = seg->seq + 1;
+}
+
+/**
+ * @brief 用一次RTT采样更新srtt、rttvar与rto(RFC 6298)
+ *
+ */
+static void tcp_rtt_sample(tcp_conn_t *conn, uint32_t ack)
+{
+    if (!conn->rtt_timing || TCP_SEQ_LEQ(ack, conn->rtt_seq))
+        return;
+    conn->rtt_timing = 0;
+    int32_t rtt = (int32_t)(time_ms() - conn->rtt_start);
+    if (conn->srtt == 0)
+    {
+        conn->srtt = rtt ? rtt : 1;
+        conn->rttvar = rtt / 2;
+    }
+    else
+    {
+        int32_t err = rtt - conn->srtt;
+        conn->rttvar += ((err < 0 ? -err : err) - conn->rttvar) / 4;
+        conn->srtt += err / 8;
+    }
+    uint32_t rto = conn->srtt + (4 * conn->rttvar > 1 ? 4 * conn->rttvar : 1);
+    conn->rto = rto < TCP_RTO_MIN_MS ? TCP_RTO_MIN_MS : (rto > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : rto);
+}
+
+/**
+ * @brief 连接进入ESTABLISHED状态
+ *
+ */
+static void tcp_established(tcp_conn_t *conn, uint32_t ack)
+{
+    tcp_rtt_sample(conn, ack);
+    conn->state = TCP_ESTABLISHED;
+    conn->snd_una = ack;
+    conn->snd_nxt = conn->snd_max = ack;
+    conn->rexmit_nxt = ack;
+    conn->rto_deadline = 0;
+    conn->retries = 0;
+    conn->cc->init(conn);
+}
+
+/**
+ * @brief 检查报文段的序号是否在接收窗口内(RFC 793)
+ *
+ */
+static int tcp_seq_acceptable(tcp_conn_t *conn, tcp_seg_t *seg)
+{
+    uint32_t wnd = tcp_rcv_space(conn);
+    uint32_t seg_len = seg->len + !!(seg->flags & TCP_FLAG_SYN) + !!(seg->flags & TCP_FLAG_FIN);
+    int start_ok = TCP_SEQ_GEQ(seg->seq, conn->rcv_nxt) && TCP_SEQ_LT(seg->seq, conn->rcv_nxt + wnd);
+    if (seg_len == 0)
+        return wnd == 0 ? seg->seq == conn->rcv_nxt : start_ok;
+    if (wnd == 0)
+        return 0;
+    uint32_t last = seg->seq + seg_len - 1;
+    return start_ok || (TCP_SEQ_GEQ(last, conn->rcv_nxt) && TCP_SEQ_LT(last, conn->rcv_nxt + wnd));
+}
+
+/**
+ * @brief 处理报文段的ACK字段：释放已确认的数据，测量RTT，检测重复ACK并驱动拥塞控制
+ *
+ * @return int 报文段应被丢弃时为-1，否则为新确认的数据量
+ */
+static int tcp_ack_input(tcp_conn_t *conn, tcp_seg_t *seg)
+{
+    uint32_t ack = seg->ack;
+    uint32_t wnd = (uint32_t)seg->window << conn->snd_wscale;
+    if (TCP_SEQ_GT(ack, conn->snd_max))
+    {
+        tcp_send_ack(conn); //确认了尚未发送的数据
+        return -1;
+    }
+    if (conn->sack_ok)
+    {
+        for (int i = 0; i < seg->sack_cnt; i++)
+            if (TCP_SEQ_LT(seg->sack[i].start, seg->sack[i].end) &&
+                TCP_SEQ_GT(seg->sack[i].end, ack) && TCP_SEQ_LEQ(seg->sack[i].end, conn->snd_max))
+                conn->sacked_cnt = tcp_sack_add(conn->sacked, conn->sacked_cnt, seg->sack[i].start, seg->sack[i].end);
+    }
+
+    uint32_t data_acked = 0;
+    if (TCP_SEQ_GT(ack, conn->snd_una))
+    {
+        uint32_t acked = ack - conn->snd_una;
+        data_acked = min32(acked, conn->snd.len); //FIN占用的序号不在缓冲区中
+        tcp_ring_consume(&conn->snd, data_acked);
+        conn->snd_una = ack;
+        if (TCP_SEQ_LT(conn->snd_nxt, ack))
+            conn->snd_nxt = ack;
+        if (TCP_SEQ_LT(conn->rexmit_nxt, ack))
+            conn->rexmit_nxt = ack;
+        conn->sacked_cnt = tcp_sack_trim(conn->sacked, conn->sacked_cnt, ack);
+        tcp_rtt_sample(conn, ack);
+        conn->retries = 0;
+
+        if (conn->in_recovery)
+        {
+            if (TCP_SEQ_GEQ(ack, conn->recover))
+            {
+                conn->in_recovery = 0;
+                conn->cc->on_recovery_exit(conn);
+            }
+            else //部分确认，snd_una处的数据也已丢失
+            {
+                uint32_t len, seq = tcp_next_hole(conn, ack, &len);
+                if (seq == ack && TCP_SEQ_GEQ(seq, conn->rexmit_nxt))
+                    tcp_retransmit(conn, seq, len);
+            }
+        }
+        else
+            conn->cc->on_ack(conn, acked);
+        conn->dupacks = 0;
+
+        conn->rto_deadline = 0;
+        if (conn->snd_una != conn->snd_max)
+            tcp_arm_rto(conn);
+    }
+    else if (ack == conn->snd_una && seg->len == 0 && !(seg->flags & (TCP_FLAG_SYN | TCP_FLAG_FIN)) &&
+             conn->snd_max != conn->snd_una && wnd == conn->snd_wnd)
+    {
+        conn->dupacks++;
+        if (!conn->in_recovery && conn->dupacks == 3) //快速重传
+        {
+            conn->cc->on_loss(conn, 0);
+            conn->in_recovery = 1;
+            conn->recover = conn->snd_max;
+            conn->rexmit_nxt = conn->snd_una;
+            uint32_t len, seq = tcp_next_hole(conn, conn->snd_una, &len);
+            tcp_retransmit(conn, seq, len);
+        }
+        else if (!conn->in_recovery) //有限传输(RFC 3042)：前两个重复ACK各允许发送一个新报文段
+        {
+            conn->cwnd += conn->mss;
+            tcp_output(conn);
+            conn->cwnd -= conn->mss;
+        }
+        else
+        {
+            conn->cwnd += conn->mss; //快速恢复中每个重复ACK表示一个报文段离开网络
+            uint32_t len, seq = tcp_next_hole(conn, conn->rexmit_nxt, &len);
+            if (TCP_SEQ_LT(seq, tcp_sack_high(conn)))
+                tcp_retransmit(conn, seq, len);
+        }
+    }
+
+    if (TCP_SEQ_LT(conn->snd_wl1, seg->seq) || (conn->snd_wl1 == seg->seq && TCP_SEQ_LEQ(conn->snd_wl2, ack)))
+    {
+        conn->snd_wnd = wnd;
+        conn->snd_wl1 = seg->seq;
+        conn->snd_wl2 = ack;
+        if (wnd && conn->persist_backoff) //窗口打开，未被接受的探测字节作为普通数据重新发送
+        {
+            conn->persist_deadline = 0;
+            conn->persist_backoff = 0;
+            conn->snd_nxt = conn->snd_una;
+        }
+    }
+    return data_acked;
+}
+
+/**
+ * @brief 把报文段中的数据放入接收缓冲区，乱序数据记录为SACK块
+ *
+ * @return int 有新的按序数据时为1
+ */
+static int tcp_data_input(tcp_conn_t *conn, uint32_t seq, uint8_t *data, uint32_t len)
+{
+    if (TCP_SEQ_LT(seq, conn->rcv_nxt))
+    {
+        uint32_t dup = conn->rcv_nxt - seq;
+        if (dup >= len)
+        {
+            tcp_send_ack(conn);
+            return 0;
+        }
+        data += dup;
+        len -= dup;
+        seq = conn->rcv_nxt;
+    }
+    uint32_t space = tcp_rcv_space(conn);
+    uint32_t off = seq - conn->rcv_nxt;
+    if (off >= space)
+    {
+        tcp_send_ack(conn);
+        return 0;
+    }
+    len = min32(len, space - off);
+    tcp_ring_write(&conn->rcv, conn->rcv.len + off, data, len);
+
+    if (off > 0) //乱序到达，立即发送带SACK的重复ACK
+    {
+        conn->ooo_cnt = tcp_sack_add(conn->ooo, conn->ooo_cnt, seq, seq + len);
+        tcp_send_ack(conn);
+        return 0;
+    }
+
+    int filled = conn->ooo_cnt > 0;
+    conn->rcv_nxt += len;
+    conn->rcv.len += len;
+    for (int i = 0; i < conn->ooo_cnt; i++) //合并已经连续的乱序块
+    {
+        if (TCP_SEQ_LEQ(conn->ooo[i].start, conn->rcv_nxt))
+        {
+            if (TCP_SEQ_GT(conn->ooo[i].end, conn->rcv_nxt))
+            {
+                conn->rcv.len += conn->ooo[i].end - conn->rcv_nxt;
+                conn->rcv_nxt = conn->ooo[i].end;
+            }
+            memmove(conn->ooo + i, conn->ooo + i + 1, (conn->ooo_cnt - i - 1) * sizeof(tcp_sack_block_t));
+            conn->ooo_cnt--;
+            i = -1;
+        }
+    }
+
+    if (filled || ++conn->ack_pending >= 2) //填补空洞或每两个报文段立即确认
+        tcp_send_ack(conn);
+    else if (conn->delack_deadline == 0)
+        conn->delack_deadline = time_ms() + TCP_DELACK_MS;
+    return 1;
+}
+
+/**
+ * @brief 处理发往没有对应连接的报文段，监听端口收到SYN时创建连接
+ *
+ */
+static void tcp_listen_input(uint8_t *src_ip, tcp_seg_t *seg)
+{
+    if (seg->flags & TCP_FLAG_RST)
+        return;
+    tcp_listener_t *listener = NULL;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+        if (tcp_listeners[i].valid && tcp_listeners[i].port == seg->dest_port)
+            listener = &tcp_listeners[i];
+    if (listener == NULL || !(seg->flags & TCP_FLAG_SYN) || (seg->flags & TCP_FLAG_ACK))
+    {
+        if (listener == NULL)
+            NET_DROP(TCP, TCP_DROP_NO_PORT);
+        tcp_send_reset(src_ip, seg);
+        return;
+    }
+    if (listener->pending + listener->count >= listener->backlog)
+        return; //等待队列已满，丢弃SYN等待对方重传
+
+    tcp_conn_t *conn = tcp_conn_alloc(src_ip, seg->src_port, seg->dest_port);
+    if (conn == NULL)
+        return;
+    conn->listener = listener;
+    conn->handler = listener->handler;
+    listener->pending++;
+    conn->sack_ok = 1;
+    conn->wscale_ok = 1;
+    tcp_apply_syn_options(conn, seg);
+    conn->snd_wnd = seg->window;
+    conn->snd_wl1 = seg->seq;
+    conn->iss = tcp_isn();
+    conn->snd_una = conn->snd_max = conn->iss;
+    conn->state = TCP_SYN_RCVD;
+    tcp_send_syn(conn);
+}
+
+/**
+ * @brief 处理SYN_SENT状态下收到的报文段
+ *
+ * @return int 要通知的事件集合
+ */
+static int tcp_syn_sent_input(tcp_conn_t *conn, tcp_seg_t *seg)
+{
+    if ((seg->flags & TCP_FLAG_ACK) && (TCP_SEQ_LEQ(seg->ack, conn->iss) || TCP_SEQ_GT(seg->ack, conn->snd_max)))
+    {
+        if (!(seg->flags & TCP_FLAG_RST))
+            tcp_send_reset(conn->remote_ip, seg);
+        return 0;
+    }
+    if (seg->flags & TCP_FLAG_RST)
+    {
+        if (!(seg->flags & TCP_FLAG_ACK))
+            return 0;
+        tcp_conn_free(conn);
+        return 1 << TCP_EVENT_RESET;
+    }
+    if (!(seg->flags & TCP_FLAG_SYN))
+        return 0;
+
+    tcp_apply_syn_options(conn, seg);
+    conn->snd_wnd = seg->window;
+    conn->snd_wl1 = seg->seq;
+    conn->snd_wl2 = seg->ack;
+    if (!(seg->flags & TCP_FLAG_ACK)) //同时打开
+    {
+        conn->state = TCP_SYN_RCVD;
+        tcp_send_syn(conn);
+        return 0;
+    }
+    tcp_established(conn, seg->ack);
+    tcp_send_ack(conn);
+    tcp_output(conn);
+    return 1 << TCP_EVENT_CONNECTED;
+}
+
+/**
+ * @brief 处理一个收到的tcp数据包
+ *        检查首部长度与校验和，根据四元组查找连接，
+ *        找不到时交给监听端口处理，否则按照连接状态处理ACK、数据与FIN
+ *
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址
+ */
+void tcp_in(buf_t *buf, uint8_t *src_ip)
+{
+    STATS_INC(TCP_RX_PKTS);
+    STATS_ADD(TCP_RX_BYTES, buf->len);
+    tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
+    int hdr_len = hdr->data_offset * 4;
+    if (buf->len < sizeof(tcp_hdr_t) || hdr_len < (int)sizeof(tcp_hdr_t) || hdr_len > buf->len)
+    {
+        NET_DROP(TCP, TCP_DROP_BAD_HDR);
+        return;
+    }
+    if (buf->csum == BUF_CSUM_VALID)
+        STATS_INC(TCP_RX_CSUM_OFFLOAD);
+    else
+    {
+        uint16_t checksum = hdr->checksum;
+        hdr->checksum = 0;
+        if (checksum != tcp_checksum(buf, src_ip, net_if_ip))
+        {
+            NET_DROP(TCP, TCP_DROP_BAD_CHECKSUM);
+            return;
+        }
+    }
+
+    tcp_seg_t seg;
+    seg.src_port = swap16(hdr->src_port);
+    seg.dest_port = swap16(hdr->dest_port);
+    seg.seq = swap32(hdr->seq);
+    seg.ack = swap32(hdr->ack);
+    seg.flags = hdr->flags;
+    seg.window = swap16(hdr->window);
+    tcp_parse_options((uint8_t *)(hdr + 1), hdr_len - sizeof(tcp_hdr_t), &seg);
+    buf_remove_header(buf, hdr_len);
+    seg.data = buf->data;
+    seg.len = buf->len;
+    TRACE(TCP, TCP_IN, trace_ip(src_ip), seg.src_port, seg.dest_port, seg.flags, seg.len);
+
+    tcp_conn_t *conn = tcp_lookup(src_ip, seg.src_port, seg.dest_port);
+    if (conn == NULL)
+    {
+        tcp_listen_input(src_ip, &seg);
+        return;
+    }
+    if (conn->state == TCP_SYN_SENT)
+    {
+        tcp_notify(conn, tcp_syn_sent_input(conn, &seg));
+        return;
+    }
+
+    if (!tcp_seq_acceptable(conn, &seg))
+    {
+        if (!(seg.flags & TCP_FLAG_RST))
+            tcp_send_ack(conn);
+        return;
+    }
+    if (seg.flags & TCP_FLAG_RST)
+    {
+        tcp_conn_free(conn);
+        tcp_notify(conn, 1 << TCP_EVENT_RESET);
+        return;
+    }
+    if (seg.flags & TCP_FLAG_SYN)
+    {
+        if (conn->state == TCP_SYN_RCVD && seg.seq == conn->irs) //对方重传了SYN
+        {
+            tcp_send_syn(conn);
+            return;
+        }
+        tcp_send_segment(conn, conn->snd_nxt, 0, TCP_FLAG_RST);
+        tcp_conn_free(conn);
+        tcp_notify(conn, 1 << TCP_EVENT_RESET);
+        return;
+    }
+    if (!(seg.flags & TCP_FLAG_ACK))
+        return;
+
+    int events = 0;
+    if (conn->state == TCP_SYN_RCVD)
+    {
+        if (seg.ack != conn->iss + 1)
+        {
+            tcp_send_reset(src_ip, &seg);
+            return;
+        }
+        tcp_listener_t *listener = conn->listener;
+        tcp_established(conn, seg.ack);
+        if (listener == NULL) //同时打开的主动连接，不属于任何监听端口
+            events |= 1 << TCP_EVENT_CONNECTED;
+        else
+        {
+            listener->pending--;
+            if (listener->count == TCP_MAX_BACKLOG)
+            {
+                conn->listener = NULL;
+                tcp_abort(conn);
+                return;
+            }
+            listener->queue[(listener->head + listener->count++) % TCP_MAX_BACKLOG] = conn;
+            events |= 1 << TCP_EVENT_ACCEPT;
+        }
+    }
+
+    int acked = tcp_ack_input(conn, &seg);
+    if (acked < 0)
+        return;
+    if (acked > 0)
+        events |= 1 << TCP_EVENT_SEND;
+    if (conn->fin_sent && TCP_SEQ_GT(conn->snd_una, conn->fin_seq)) //FIN已被确认
+    {
+        if (conn->state == TCP_FIN_WAIT_1)
+            conn->state = TCP_FIN_WAIT_2;
+        else if (conn->state == TCP_CLOSING)
+        {
+            conn->state = TCP_TIME_WAIT;
+            conn->timewait_deadline = time_ms() + TCP_TIMEWAIT_MS;
+        }
+        else if (conn->state == TCP_LAST_ACK)
+        {
+            tcp_conn_free(conn);
+            tcp_notify(conn, events | 1 << TCP_EVENT_CLOSED);
+            return;
+        }
+    }
+
+    if (seg.len > 0 && (conn->state == TCP_ESTABLISHED || conn->state == TCP_FIN_WAIT_1 || conn->state == TCP_FIN_WAIT_2))
+        if (tcp_data_input(conn, seg.seq, seg.data, seg.len))
+            events |= 1 << TCP_EVENT_RECV;
+
+    if ((seg.flags & TCP_FLAG_FIN) && conn->rcv_nxt == seg.seq + seg.len &&
+        (conn->state == TCP_ESTABLISHED || conn->state == TCP_FIN_WAIT_1 || conn->state == TCP_FIN_WAIT_2))
+    {
+        conn->rcv_nxt++;
+        if (conn->state == TCP_ESTABLISHED)
+            conn->state = TCP_CLOSE_WAIT;
+        else if (conn->state == TCP_FIN_WAIT_1)
+            conn->state = TCP_CLOSING;
+        else
+        {
+            conn->state = TCP_TIME_WAIT;
+            conn->timewait_deadline = time_ms() + TCP_TIMEWAIT_MS;
+            conn->rto_deadline = 0;
+        }
+        tcp_send_ack(conn);
+        events |= 1 << TCP_EVENT_CLOSE;
+    }
+
+    tcp_output(conn);
+    tcp_notify(conn, events);
+}
+
+/*--------------------------------- 定时器 ---------------------------------*/
+
+/**
+ * @brief 坚持定时器超时：从snd_una发送1字节的零窗口探测，间隔加倍后重新启动
+ *        探测不计入重传次数，也不启动重传定时器，探测丢失时由下一次超时重新发送
+ *
+ */
+static void tcp_persist_timeout(tcp_conn_t *conn)
+{
+    conn->persist_deadline = 0;
+    conn->probe = 1;
+    conn->snd_nxt = conn->snd_una;
+    tcp_output(conn);
+    conn->probe = 0;
+    conn->rto_deadline = 0;
+    conn->rtt_timing = 0;
+    conn->persist_backoff = min32(conn->persist_backoff * 2, TCP_RTO_MAX_MS);
+    tcp_arm_persist(conn);
+}
+
+/**
+ * @brief 重传超时：SYN直接重传；对方窗口已关闭时转为零窗口探测；否则回退到snd_una重新发送
+ *
+ */
+static void tcp_timeout(tcp_conn_t *conn)
+{
+    conn->rto_deadline = 0;
+    conn->rtt_timing = 0;
+    if (conn->snd_wnd == 0 && conn->state >= TCP_ESTABLISHED && conn->snd.len > 0)
+    {
+        if (conn->persist_backoff == 0)
+            conn->persist_backoff = conn->rto;
+        tcp_persist_timeout(conn);
+        return;
+    }
+    TRACE(TCP, TCP_TIMEOUT, conn->local_port, conn->retries + 1, conn->rto);
+    if (++conn->retries > TCP_MAX_RETRIES)
+    {
+        tcp_abort(conn);
+        tcp_notify(conn, 1 << TCP_EVENT_RESET);
+        return;
+    }
+    if (conn->state == TCP_SYN_SENT || conn->state == TCP_SYN_RCVD)
+        tcp_send_syn(conn);
+    else
+    {
+        conn->cc->on_loss(conn, 1);
+        conn->in_recovery = 0;
+        conn->dupacks = 0;
+        conn->sacked_cnt = 0; //对方可能丢弃已SACK的数据
+        conn->snd_nxt = conn->snd_una;
+        if (conn->fin_sent && TCP_SEQ_LEQ(conn->snd_una, conn->fin_seq))
+            conn->fin_sent = 0;
+        tcp_output(conn);
+    }
+    conn->rto = conn->rto * 2 > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : conn->rto * 2;
+    conn->rto_deadline = 0;
+    if (conn->snd_una != conn->snd_max)
+        tcp_arm_rto(conn);
+}
+
+/**
+ * @brief 处理tcp的定时器，由协议栈轮询调用
+ *
+ */
+void tcp_poll()
+{
+    uint64_t now = time_ms();
+    for (int i = 0; i < TCP_MAX_CONN; i++)
+    {
+        tcp_conn_t *conn = &tcp_conns[i];
+        if (conn->state == TCP_CLOSED)
+            continue;
+        if (conn->state == TCP_TIME_WAIT)
+        {
+            if (now >= conn->timewait_deadline)
+            {
+                tcp_conn_free(conn);
+                tcp_notify(conn, 1 << TCP_EVENT_CLOSED);
+            }
+            continue;
+        }
+        if (conn->delack_deadline && now >= conn->delack_deadline)
+            tcp_send_ack(conn);
+        if (conn->rto_deadline && now >= conn->rto_deadline)
+            tcp_timeout(conn);
+        if (conn->persist_deadline && now >= conn->persist_deadline && conn->state != TCP_CLOSED)
+            tcp_persist_timeout(conn);
+    }
+}
+
+/*--------------------------------- 应用接口 ---------------------------------*/
+
+/**
+ * @brief 初始化tcp协议
+ *
+ * @return int 成功为0，内存区域不足时为-1
+ */
+int tcp_init()
+{
+    if (tcp_conns == NULL && (tcp_conns = arena_alloc(sizeof(tcp_conn_t) * TCP_MAX_CONN)) == NULL)
+        return -1;
+    for (int i = 0; i < TCP_MAX_CONN; i++)
+        tcp_conns[i].state = TCP_CLOSED;
+    for (int i = 0; i < TCP_HASH_SIZE; i++)
+        tcp_hash_table[i] = NULL;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+        tcp_listeners[i].valid = 0;
+    tcp_cc_register(&tcp_reno);
+    return 0;
+}
+
+/**
+ * @brief 打开一个tcp端口进行监听
+ *
+ * @param port 端口号
+ * @param backlog 等待队列长度
+ * @param handler 新连接的事件处理程序
+ * @return int 成功为0，失败为-1
+ */
+int tcp_listen(uint16_t port, int backlog, tcp_handler_t handler)
+{
+    if (backlog <= 0 || backlog > TCP_MAX_BACKLOG)
+        backlog = TCP_MAX_BACKLOG;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+        if (tcp_listeners[i].valid && tcp_listeners[i].port == port)
+            return -1;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+        if (!tcp_listeners[i].valid)
+        {
+            tcp_listeners[i].port = port;
+            tcp_listeners[i].backlog = backlog;
+            tcp_listeners[i].pending = 0;
+            tcp_listeners[i].head = tcp_listeners[i].count = 0;
+            tcp_listeners[i].handler = handler;
+            tcp_listeners[i].valid = 1;
+            return 0;
+        }
+    return -1;
+}
+
+/**
+ * @brief 关闭一个tcp监听端口，正在握手和未被accept的连接被复位
+ *
+ * @param port 端口号
+ */
+void tcp_unlisten(uint16_t port)
+{
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+    {
+        tcp_listener_t *listener = &tcp_listeners[i];
+        if (!listener->valid || listener->port != port)
+            continue;
+        for (int j = 0; j < TCP_MAX_CONN; j++)
+            if (tcp_conns[j].state != TCP_CLOSED && tcp_conns[j].listener == listener)
+                tcp_abort(&tcp_conns[j]);
+        listener->valid = 0;
+    }
+}
+
+/**
+ * @brief 从监听端口的等待队列中取出一个已建立的连接
+ *
+ * @param port 端口号
+ * @return tcp_conn_t* 连接，队列为空时为NULL
+ */
+tcp_conn_t *tcp_accept(uint16_t port)
+{
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+    {
+        tcp_listener_t *listener = &tcp_listeners[i];
+        if (!listener->valid || listener->port != port || listener->count == 0)
+            continue;
+        tcp_conn_t *conn = listener->queue[listener->head];
+        listener->head = (listener->head + 1) % TCP_MAX_BACKLOG;
+        listener->count--;
+        conn->listener = NULL;
+        return conn;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 主动打开一个tcp连接
+ *
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param handler 事件处理程序
+ * @return tcp_conn_t* 连接，失败为NULL
+ */
+tcp_conn_t *tcp_connect(uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port, tcp_handler_t handler)
+{
+    if (tcp_lookup(dest_ip, dest_port, src_port))
+        return NULL;
+    tcp_conn_t *conn = tcp_conn_alloc(dest_ip, dest_port, src_port);
+    if (conn == NULL)
+        return NULL;
+    conn->handler = handler;
+    conn->sack_ok = 1;
+    conn->wscale_ok = 1;
+    conn->iss = tcp_isn();
+    conn->snd_una = conn->snd_max = conn->iss;
+    conn->state = TCP_SYN_SENT;
+    tcp_send_syn(conn);
+    return conn;
+}
+
+/**
+ * @brief 获取发送缓冲区中可直接写入的连续空间，写入后调用tcp_send_commit
+ *
+ * @param conn 连接
+ * @param len 返回可写入的长度
+ * @return uint8_t* 可写入的起始地址
+ */
+uint8_t *tcp_send_buf(tcp_conn_t *conn, uint32_t *len)
+{
+    *len = 0;
+    if (conn->fin_pending || (conn->state != TCP_ESTABLISHED && conn->state != TCP_CLOSE_WAIT &&
+                              conn->state != TCP_SYN_SENT && conn->state != TCP_SYN_RCVD))
+        return NULL;
+    uint32_t tail = (conn->snd.head + conn->snd.len) & (TCP_BUF_SIZE - 1);
+    *len = min32(TCP_BUF_SIZE - conn->snd.len, TCP_BUF_SIZE - tail);
+    return conn->snd.data + tail;
+}
+
+/**
+ * @brief 提交已写入发送缓冲区的数据并尝试发送
+ *
+ * @param conn 连接
+ * @param len 写入的长度
+ * @return int 成功为0，失败为-1
+ */
+int tcp_send_commit(tcp_conn_t *conn, uint32_t len)
+{
+    uint32_t room;
+    if (tcp_send_buf(conn, &room) == NULL || len > TCP_BUF_SIZE - conn->snd.len)
+        return -1;
+    conn->snd.len += len;
+    tcp_output(conn);
+    return 0;
+}
+
+/**
+ * @brief 复制数据到发送缓冲区并尝试发送
+ *
+ * @param conn 连接
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @return int 放入发送缓冲区的长度，失败为-1
+ */
+int tcp_send(tcp_conn_t *conn, const uint8_t *data, uint32_t len)
+{
+    uint32_t room;
+    if (tcp_send_buf(conn, &room) == NULL)
+        return -1;
+    len = min32(len, TCP_BUF_SIZE - conn->snd.len);
+    tcp_ring_write(&conn->snd, conn->snd.len, data, len);
+    conn->snd.len += len;
+    tcp_output(conn);
+    return len;
+}
+
+/**
+ * @brief 获取接收缓冲区中可直接读取的连续数据，读取后调用tcp_recv_consume
+ *
+ * @param conn 连接
+ * @param len 返回可读取的长度
+ * @return uint8_t* 可读取的起始地址
+ */
+uint8_t *tcp_recv_buf(tcp_conn_t *conn, uint32_t *len)
+{
+    *len = min32(conn->rcv.len, TCP_BUF_SIZE - conn->rcv.head);
+    return conn->rcv.data + conn->rcv.head;
+}
+
+/**
+ * @brief 释放接收缓冲区中已读取的数据，窗口从不足一半恢复到一半以上时通告新的窗口
+ *
+ * @param conn 连接
+ * @param len 已读取的长度
+ */
+void tcp_recv_consume(tcp_conn_t *conn, uint32_t len)
+{
+    uint32_t old_space = tcp_rcv_space(conn);
+    tcp_ring_consume(&conn->rcv, min32(len, conn->rcv.len));
+    if (old_space < TCP_BUF_SIZE / 2 && tcp_rcv_space(conn) >= TCP_BUF_SIZE / 2 &&
+        (conn->state == TCP_ESTABLISHED || conn->state == TCP_FIN_WAIT_1 || conn->state == TCP_FIN_WAIT_2))
+        tcp_send_ack(conn);
+}
+
+/**
+ * @brief 从接收缓冲区复制数据
+ *
+ * @param conn 连接
+ * @param data 目的地址
+ * @param len 最多复制的长度
+ * @return int 复制的长度
+ */
+int tcp_recv(tcp_conn_t *conn, uint8_t *data, uint32_t len)
+{
+    len = min32(len, conn->rcv.len);
+    tcp_ring_read(&conn->rcv, 0, data, len);
+    tcp_recv_consume(conn, len);
+    return len;
+}
+
+/**
+ * @brief 关闭连接的发送方向，发送完缓冲区中的数据后发送FIN
+ *
+ * @param conn 连接
+ */
+void tcp_close(tcp_conn_t *conn)
+{
+    switch (conn->state)
+    {
+    case TCP_SYN_SENT:
+    case TCP_SYN_RCVD:
+        tcp_abort(conn);
+        return;
+    case TCP_ESTABLISHED:
+        conn->state = TCP_FIN_WAIT_1;
+        break;
+    case TCP_CLOSE_WAIT:
+        conn->state = TCP_LAST_ACK;
+        break;
+    default:
+        return;
+    }
+    conn->fin_pending = 1;
+    tcp_output(conn);
+}
+
+/**
+ * @brief 发送RST并立即释放连接
+ *
+ * @param conn 连接
+ */
+void tcp_abort(tcp_conn_t *conn)
+{
+    if (conn->state == TCP_CLOSED)
+        return;
+    if (conn->state != TCP_SYN_SENT)
+        tcp_send_segment(conn, conn->snd_nxt, 0, TCP_FLAG_RST);
+    tcp_conn_free(conn);
+}
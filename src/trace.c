@@ -0,0 +1,124 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const trace_layer_names[TRACE_LAYER_MAX] = {
+#define TRACE_LAYER_NAME(id, name) name,
+    TRACE_LAYER_LIST(TRACE_LAYER_NAME)
+#undef TRACE_LAYER_NAME
+};
+
+uint32_t trace_mask;
+__thread trace_ring_t *trace_local;
+
+/**
+ * @brief 所有线程的环形缓冲区，按注册顺序分配
+ *
+ */
+static trace_ring_t *trace_rings[TRACE_MAX_THREADS];
+static int trace_ring_cnt;
+
+static uint64_t trace_ticks_per_sec;
+static const char *trace_file;
+
+/**
+ * @brief 为当前线程分配环形缓冲区
+ *
+ * @return trace_ring_t* 环形缓冲区，线程数超过TRACE_MAX_THREADS或内存不足时为NULL
+ */
+trace_ring_t *trace_register()
+{
+    int i = __atomic_fetch_add(&trace_ring_cnt, 1, __ATOMIC_RELAXED);
+    if (i >= TRACE_MAX_THREADS)
+        return NULL;
+    trace_ring_t *ring = calloc(1, sizeof(trace_ring_t));
+    __atomic_store_n(&trace_rings[i], ring, __ATOMIC_RELEASE);
+    trace_local = ring;
+    return ring;
+}
+
+/**
+ * @brief 设置打开跟踪的层
+ *
+ * @param mask 第i位对应trace_layer_t中的第i层
+ */
+void trace_enable(uint32_t mask)
+{
+    if (mask && trace_ticks_per_sec == 0)
+        trace_ticks_per_sec = tsc_ticks_per_sec();
+    __atomic_store_n(&trace_mask, mask, __ATOMIC_RELAXED);
+}
+
+static void trace_atexit()
+{
+    if (trace_dump(trace_file) == 0)
+        fprintf(stderr, "trace written to %s\n", trace_file);
+}
+
+/**
+ * @brief 根据NET_TRACE环境变量打开跟踪，如"ip,udp"或"all"，
+ *        退出时把记录写入NET_TRACE_FILE(默认trace.bin)
+ *
+ */
+void trace_init()
+{
+    const char *env = getenv("NET_TRACE");
+    if (env == NULL || *env == 0)
+        return;
+    uint32_t mask = 0;
+    char list[256];
+    snprintf(list, sizeof(list), "%s", env);
+    for (char *save, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        if (strcmp(tok, "all") == 0)
+            mask = (1u << TRACE_LAYER_MAX) - 1;
+        for (int i = 0; i < TRACE_LAYER_MAX; i++)
+            if (strcmp(tok, trace_layer_names[i]) == 0)
+                mask |= 1u << i;
+    }
+    trace_file = getenv("NET_TRACE_FILE");
+    if (trace_file == NULL)
+        trace_file = "trace.bin";
+    if (mask && trace_mask == 0)
+        atexit(trace_atexit);
+    trace_enable(mask);
+}
+
+/**
+ * @brief 把所有线程的记录写入文件，应在各线程停止写入后调用
+ *
+ * @param path 文件名
+ * @return int 成功为0，失败为-1
+ */
+int trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    int n = __atomic_load_n(&trace_ring_cnt, __ATOMIC_RELAXED);
+    if (n > TRACE_MAX_THREADS)
+        n = TRACE_MAX_THREADS;
+    trace_file_hdr_t hdr = {TRACE_FILE_MAGIC, TRACE_FILE_VERSION, sizeof(trace_rec_t), 0, trace_ticks_per_sec};
+    for (int i = 0; i < n; i++)
+        if (trace_rings[i])
+            hdr.rings++;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    for (int i = 0; i < n; i++)
+    {
+        trace_ring_t *ring = __atomic_load_n(&trace_rings[i], __ATOMIC_ACQUIRE);
+        if (ring == NULL)
+            continue;
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        trace_file_ring_t fr = {i, 0, count};
+        fwrite(&fr, sizeof(fr), 1, f);
+        for (uint64_t j = head - count; j < head; j++)
+            fwrite(&ring->rec[j & (TRACE_RING_SIZE - 1)], sizeof(trace_rec_t), 1, f);
+    }
+    int ret = ferror(f) ? -1 : 0;
+    fclose(f);
+    return ret;
+}
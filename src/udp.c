@@ -1,15 +1,41 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "trace.h"
+#include "latency.h"
+#include "conf.h"
+#include "arena.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 
 /**
- * @brief udp处理程序表
+ * @brief udp处理程序表，长度为net_conf.udp_max_handler，第一次udp_init()时分配
  * 
  */
-static udp_entry_t udp_table[UDP_MAX_HANDLER];
+static udp_entry_t *udp_table;
+
+/**
+ * @brief 零拷贝发送缓冲池，长度为net_conf.udp_tx_bufs，第一次udp_init()时分配
+ * 
+ */
+static udp_txbuf_t *udp_txbufs;
+static int udp_txbuf_next; //下一次分配开始查找的位置
+static buf_t *udp_out_buf; //udp_send()复制负载与udp_sendv()构造头部的缓冲区，第一次使用时从内存区域分配
+
+/**
+ * @brief 一个批量交付端口积压的数据报，entry为NULL时空闲
+ * 
+ */
+typedef struct udp_batch
+{
+    udp_entry_t *entry;
+    int num;
+    udp_dgram_t dgram[UDP_BATCH_MAX];
+} udp_batch_t;
+
+static udp_batch_t udp_batches[UDP_BATCH_PORTS];
 
 /**
  * @brief udp伪校验和计算
@@ -42,21 +68,100 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
     hdr->placeholder = 0;
     hdr->total_len = len;
     
-    uint32_t sum = 0;
+    uint16_t checksum = checksum16((uint16_t *)buf->data, buf->len);
+    
+    *hdr = temp;
+    buf_remove_header(buf, sizeof(udp_peso_hdr_t));
+    return checksum;
+}
 
-    for(int i = 0; i < buf->len / 2; i++){
-        sum += (uint32_t)*((uint16_t *)buf->data + i);
-    }
+/**
+ * @brief 分段数据包的udp伪校验和计算
+ *        伪头部放在栈上，与头部段、各负载段一起按段计算，不需要在buffer中腾出位置
+ * 
+ * @param chain 要计算的包，头部段以UDP头部开始
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @return uint16_t 伪校验和
+ */
+static uint16_t udp_checksum_chain(buf_chain_t *chain, uint8_t *src_ip, uint8_t *dest_ip)
+{
+    udp_peso_hdr_t peso;
+    memcpy(peso.src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso.dest_ip, dest_ip, NET_IP_LEN);
+    peso.placeholder = 0;
+    peso.protocol = NET_PROTOCOL_UDP;
+    peso.total_len = ((udp_hdr_t *)chain->hdr->data)->total_len;
+
+    struct iovec iov[BUF_MAX_SEG + 2];
+    iov[0].iov_base = &peso;
+    iov[0].iov_len = sizeof(peso);
+    iov[1].iov_base = chain->hdr->data;
+    iov[1].iov_len = chain->hdr->len;
+    memcpy(iov + 2, chain->seg, chain->seg_num * sizeof(struct iovec));
+    return checksum16_iov(iov, chain->seg_num + 2);
+}
+
+/**
+ * @brief 把一个端口积压的批交给它的批量处理程序
+ * 
+ */
+static void udp_batch_deliver(udp_batch_t *b)
+{
+    int num = b->num;
+    b->num = 0;
+    STATS_INC(UDP_RX_BATCHES);
+    LATENCY_STAMP(LATENCY_HANDLER);
+    b->entry->batch_handler(b->entry, b->dgram, num);
+}
 
-    if(buf->len % 2 == 1){
-        sum += (uint32_t)*(buf->data + buf->len - 1);
+/**
+ * @brief 把去掉udp头部的数据报加入端口的批，可合并时接在上一项之后
+ * 
+ */
+static void udp_batch_add(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+    udp_batch_t *b = &udp_batches[entry->batch];
+    udp_dgram_t *d = b->num ? &b->dgram[b->num - 1] : NULL;
+    if (entry->coalesce && d && d->seg_num < BUF_MAX_SEG && d->src_port == src_port &&
+        memcmp(d->src_ip, src_ip, NET_IP_LEN) == 0)
+        STATS_INC(UDP_RX_COALESCED);
+    else
+    {
+        if (b->num == UDP_BATCH_MAX)
+            udp_batch_deliver(b);
+        d = &b->dgram[b->num++];
+        memcpy(d->src_ip, src_ip, NET_IP_LEN);
+        d->src_port = src_port;
+        d->seg_num = 0;
+        d->len = 0;
     }
+    d->seg[d->seg_num++] = buf;
+    d->len += buf->len;
+}
 
-    sum += sum >> 16;
-    
-    *hdr = temp;
-    buf_remove_header(buf, sizeof(udp_peso_hdr_t));
-    return (uint16_t)~sum;
+/**
+ * @brief 不再批量交付，丢弃积压的数据报并释放端口的批
+ * 
+ */
+static void udp_batch_release(udp_entry_t *entry)
+{
+    if (entry->batch_handler == NULL)
+        return;
+    udp_batches[entry->batch].entry = NULL;
+    udp_batches[entry->batch].num = 0;
+    entry->batch_handler = NULL;
+}
+
+/**
+ * @brief 把各端口积压的批交给批量处理程序，net_poll()每次从驱动收取并处理完后调用
+ * 
+ */
+void udp_flush()
+{
+    for (int i = 0; i < UDP_BATCH_PORTS; i++)
+        if (udp_batches[i].num)
+            udp_batch_deliver(&udp_batches[i]);
 }
 
 /**
@@ -80,27 +185,40 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
 void udp_in(buf_t *buf, uint8_t *src_ip)
 {
     // TODO
+    LATENCY_STAMP(LATENCY_UDP_IN);
+    STATS_INC(UDP_RX_PKTS);
+    STATS_ADD(UDP_RX_BYTES, buf->len);
     udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
-    if(swap16(hdr->total_len) < 8){
-        printf("UDP: total lengnth less than 8!\n");
+    if(buf->len < sizeof(udp_hdr_t) || swap16(hdr->total_len) < 8){
+        NET_DROP(UDP, UDP_DROP_BAD_LEN);
         return;
     }
-    uint16_t checksum = hdr->checksum;
-    hdr->checksum = 0;
-    if(checksum != udp_checksum(buf, src_ip, net_if_ip)){
-        printf("UDP: checksum failed!\n");
-        return;
+    if(buf->csum == BUF_CSUM_VALID){
+        STATS_INC(UDP_RX_CSUM_OFFLOAD);
+    }else{
+        uint16_t checksum = hdr->checksum;
+        hdr->checksum = 0;
+        if(checksum != udp_checksum(buf, src_ip, net_if_ip)){
+            NET_DROP(UDP, UDP_DROP_BAD_CHECKSUM);
+            return;
+        }
     }
 
-    for(int i = 0; i < UDP_MAX_HANDLER; i++){
+    for(int i = 0; i < net_conf.udp_max_handler; i++){
         if(udp_table[i].valid == 1 && udp_table[i].port == swap16(hdr->dest_port)){
             buf_remove_header(buf, sizeof(udp_hdr_t));
+            TRACE(UDP, UDP_DELIVER, trace_ip(src_ip), swap16(hdr->src_port), swap16(hdr->dest_port), buf->len);
+            if(udp_table[i].batch_handler){
+                udp_batch_add(&udp_table[i], src_ip, swap16(hdr->src_port), buf);
+                return;
+            }
+            LATENCY_STAMP(LATENCY_HANDLER);
             udp_table[i].handler(&udp_table[i], src_ip, swap16(hdr->src_port), buf);
             return;
         }
     }
-    printf("UDP: Port not found!\n");
     // Port not found.
+    NET_DROP(UDP, UDP_DROP_NO_PORT);
     buf_add_header(buf, sizeof(ip_hdr_t));
     icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
 }
@@ -125,59 +243,157 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port
     hdr->total_len = swap16(buf->len);
     hdr->dest_port = swap16(dest_port);
     hdr->src_port = swap16(src_port);
-    hdr->checksum = 0;
-    hdr->checksum = udp_checksum(buf, net_if_ip, dest_ip);
+    if(ip_csum_offload(buf->len)){
+        // 只填伪首部的部分和，由设备补全
+        hdr->checksum = checksum_pseudo(net_if_ip, dest_ip, NET_PROTOCOL_UDP, buf->len);
+        buf->csum = BUF_CSUM_PARTIAL;
+        buf->csum_offset = offsetof(udp_hdr_t, checksum);
+        STATS_INC(UDP_TX_CSUM_OFFLOAD);
+    }else{
+        hdr->checksum = 0;
+        hdr->checksum = udp_checksum(buf, net_if_ip, dest_ip);
+    }
+    TRACE(UDP, TX, buf->len, NET_PROTOCOL_UDP);
+    STATS_INC(UDP_TX_PKTS);
+    STATS_ADD(UDP_TX_BYTES, buf->len);
     ip_out(buf, dest_ip, NET_PROTOCOL_UDP);
 }
 
+/**
+ * @brief 处理一个要发送的分段数据包，UDP头部添加到头部段中
+ * 
+ * @param chain 要处理的包
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ */
+void udp_out_chain(buf_chain_t *chain, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+{
+    buf_add_header(chain->hdr, sizeof(udp_hdr_t));
+    uint32_t len = buf_chain_len(chain);
+    udp_hdr_t *hdr = (udp_hdr_t *)chain->hdr->data;
+    hdr->total_len = swap16(len);
+    hdr->dest_port = swap16(dest_port);
+    hdr->src_port = swap16(src_port);
+    hdr->checksum = 0;
+    hdr->checksum = udp_checksum_chain(chain, net_if_ip, dest_ip);
+    TRACE(UDP, TX, len, NET_PROTOCOL_UDP);
+    STATS_INC(UDP_TX_PKTS);
+    STATS_ADD(UDP_TX_BYTES, len);
+    ip_out_chain(chain, dest_ip, NET_PROTOCOL_UDP);
+}
+
 /**
  * @brief 初始化udp协议
  * 
+ * @return int 成功为0，内存区域不足时为-1
  */
-void udp_init()
+int udp_init()
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++)
+    if (udp_table == NULL && (udp_table = arena_alloc(sizeof(udp_entry_t) * net_conf.udp_max_handler)) == NULL)
+        return -1;
+    if (udp_txbufs == NULL && (udp_txbufs = arena_alloc(sizeof(udp_txbuf_t) * net_conf.udp_tx_bufs)) == NULL)
+        return -1;
+    for (int i = 0; i < net_conf.udp_max_handler; i++)
+    {
         udp_table[i].valid = 0;
+        udp_table[i].batch_handler = NULL;
+    }
+    for (int i = 0; i < UDP_BATCH_PORTS; i++)
+        udp_batches[i].entry = NULL;
+    for (int i = 0; i < net_conf.udp_tx_bufs; i++)
+        udp_txbufs[i].in_use = 0;
+    return 0;
 }
 
 /**
- * @brief 打开一个udp端口并注册处理程序
+ * @brief 查找端口的表项，没有则占用一个无效的表项
  * 
- * @param port 端口号
- * @param handler 处理程序
- * @return int 成功为0，失败为-1
+ * @return udp_entry_t* 表项，表已满时为NULL
  */
-int udp_open(uint16_t port, udp_handler_t handler)
+static udp_entry_t *udp_entry_get(uint16_t port)
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++) //试图更新
+    for (int i = 0; i < net_conf.udp_max_handler; i++) //试图更新
         if (udp_table[i].port == port)
-        {
-            udp_table[i].handler = handler;
-            udp_table[i].valid = 1;
-            return 0;
-        }
+            return &udp_table[i];
 
-    for (int i = 0; i < UDP_MAX_HANDLER; i++) //试图插入
+    for (int i = 0; i < net_conf.udp_max_handler; i++) //试图插入
         if (udp_table[i].valid == 0)
         {
-            udp_table[i].handler = handler;
+            udp_batch_release(&udp_table[i]);
             udp_table[i].port = port;
-            udp_table[i].valid = 1;
-            return 0;
+            return &udp_table[i];
         }
-    return -1;
+    return NULL;
+}
+
+/**
+ * @brief 打开一个udp端口并注册处理程序
+ * 
+ * @param port 端口号
+ * @param handler 处理程序，收到的数据带有接收时间戳，见udp_handler_t
+ * @return int 成功为0，失败为-1
+ */
+int udp_open(uint16_t port, udp_handler_t handler)
+{
+    udp_entry_t *entry = udp_entry_get(port);
+    if (entry == NULL)
+        return -1;
+    if (entry->valid && entry->batch_handler && udp_batches[entry->batch].num) //已经积压的仍交给原来的批量处理程序
+        udp_batch_deliver(&udp_batches[entry->batch]);
+    udp_batch_release(entry);
+    entry->handler = handler;
+    entry->valid = 1;
+    return 0;
+}
+
+/**
+ * @brief 打开一个udp端口并注册批量处理程序：一次轮询中发往该端口的数据报先积压起来，
+ *        由udp_flush()一次交给处理程序，积压到UDP_BATCH_MAX项时提前交付
+ *        矢量处理图或优先级接收队列一次轮询处理多个包时才有多于一项的批
+ * 
+ * @param port 端口号
+ * @param handler 批量处理程序
+ * @param coalesce 为1时同一源ip与源端口的连续数据报合并为一项，至多BUF_MAX_SEG个
+ * @return int 成功为0，表已满或已有UDP_BATCH_PORTS个批量端口时为-1
+ */
+int udp_open_batch(uint16_t port, udp_batch_handler_t handler, int coalesce)
+{
+    udp_entry_t *entry = udp_entry_get(port);
+    if (entry == NULL)
+        return -1;
+    if (entry->batch_handler == NULL)
+    {
+        int i = 0;
+        while (i < UDP_BATCH_PORTS && udp_batches[i].entry)
+            i++;
+        if (i == UDP_BATCH_PORTS)
+            return -1;
+        udp_batches[i].entry = entry;
+        udp_batches[i].num = 0;
+        entry->batch = i;
+    }
+    else if (entry->valid && udp_batches[entry->batch].num) //已经积压的仍交给原来的批量处理程序
+        udp_batch_deliver(&udp_batches[entry->batch]);
+    entry->batch_handler = handler;
+    entry->coalesce = coalesce;
+    entry->valid = 1;
+    return 0;
 }
 
 /**
- * @brief 关闭一个udp端口
+ * @brief 关闭一个udp端口，积压的数据报被丢弃
  * 
  * @param port 端口号
  */
 void udp_close(uint16_t port)
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++)
+    for (int i = 0; i < net_conf.udp_max_handler; i++)
         if (udp_table[i].port == port)
+        {
             udp_table[i].valid = 0;
+            udp_batch_release(&udp_table[i]);
+        }
 }
 
 /**
@@ -191,7 +407,99 @@ void udp_close(uint16_t port)
  */
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
-    udp_out(&txbuf, src_port, dest_ip, dest_port);
-}
\ No newline at end of file
+    buf_t *tx = arena_buf(&udp_out_buf);
+    buf_init(tx, len);
+    memcpy(tx->data, data, len);
+    udp_out(tx, src_port, dest_ip, dest_port);
+}
+
+/**
+ * @brief 从发送缓冲池分配一个缓冲区，buf->data处有len字节供应用直接写入负载，
+ *        前面为UDP、IP与以太网头部留出了空间
+ * 
+ * @param len 负载长度
+ * @return buf_t* 缓冲区，池已用完或len过大时为NULL
+ */
+buf_t *udp_alloc(uint16_t len)
+{
+    if (len > UINT16_MAX - sizeof(ip_hdr_t) - sizeof(udp_hdr_t))
+        return NULL;
+    for (int n = 0; n < net_conf.udp_tx_bufs; n++)
+    {
+        int i = (udp_txbuf_next + n) % net_conf.udp_tx_bufs;
+        if (!udp_txbufs[i].in_use)
+        {
+            udp_txbufs[i].in_use = 1;
+            udp_txbuf_next = (i + 1) % net_conf.udp_tx_bufs;
+            buf_init(&udp_txbufs[i].buf, len);
+            return &udp_txbufs[i].buf;
+        }
+    }
+    STATS_INC(UDP_TX_NO_BUF);
+    return NULL;
+}
+
+/**
+ * @brief 把未发送的缓冲区还给发送缓冲池
+ * 
+ * @param buf udp_alloc()得到的缓冲区
+ */
+void udp_free(buf_t *buf)
+{
+    udp_txbuf_t *tb = (udp_txbuf_t *)buf;
+    if (tb >= udp_txbufs && tb < udp_txbufs + net_conf.udp_tx_bufs)
+        tb->in_use = 0;
+}
+
+/**
+ * @brief 零拷贝发送：在buf中原地添加各层头部并交给驱动，协议栈不再复制负载
+ *        调用后buf归协议栈所有，驱动释放帧后调用done，再把buf还给缓冲池
+ *        现有的驱动都在driver_send()返回前把帧复制进内核或UMEM，等待ARP的包也已复制到arp_buf，
+ *        所以udp_out()返回时帧已被释放
+ * 
+ * @param buf udp_alloc()得到并已写入负载的缓冲区
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param done 完成回调，可为NULL
+ * @param ctx 传给回调的参数
+ */
+void udp_send_buf(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port, udp_done_t done, void *ctx)
+{
+    STATS_INC(UDP_TX_ZEROCOPY);
+    udp_out(buf, src_port, dest_ip, dest_port);
+    if (done)
+        done(buf, ctx);
+    udp_free(buf);
+}
+
+/**
+ * @brief 分散发送：负载由应用内存中的若干段依次组成，协议栈只在自己的缓冲区中构造头部，
+ *        各段由驱动与头部一起发送(writev或复制进UMEM)，不先合并为一块
+ *        驱动在返回前已用完各段，返回后应用即可重用
+ * 
+ * @param iov 负载的各段
+ * @param cnt 段数，不超过BUF_MAX_SEG - 1，留一段给分片时的UDP头部
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @return int 成功为0，段数过多或负载过长为-1
+ */
+int udp_sendv(const struct iovec *iov, int cnt, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+{
+    size_t len = 0;
+    if (cnt < 0 || cnt > BUF_MAX_SEG - 1)
+        return -1;
+    for (int i = 0; i < cnt; i++)
+        len += iov[i].iov_len;
+    if (len > UINT16_MAX - sizeof(ip_hdr_t) - sizeof(udp_hdr_t))
+        return -1;
+
+    buf_t *tx = arena_buf(&udp_out_buf);
+    buf_chain_t chain = {.hdr = tx, .seg_num = cnt};
+    buf_init(tx, 0);
+    memcpy(chain.seg, iov, cnt * sizeof(struct iovec));
+    STATS_INC(UDP_TX_SCATTER);
+    udp_out_chain(&chain, src_port, dest_ip, dest_port);
+    return 0;
+}
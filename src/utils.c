@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #define IPTOSBUFFERS 12
 
 /**
@@ -28,6 +29,8 @@ char *iptos(uint8_t *ip)
 void buf_init(buf_t *buf, int len)
 {
     buf->len = len;
+    buf->csum = BUF_CSUM_NONE;
+    buf->ts = (buf_ts_t){0};
     buf->data = buf->payload + BUF_MAX_LEN - len;
 }
 
@@ -65,6 +68,81 @@ void buf_copy(buf_t *dst, buf_t *src)
 {
     buf_init(dst, src->len);
     memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+    dst->csum = src->csum;
+    dst->csum_offset = src->csum_offset;
+}
+
+/**
+ * @brief 分段数据包的总长度
+ * 
+ * @param chain 分段数据包
+ * @return uint32_t 头部段与所有负载段的长度之和
+ */
+uint32_t buf_chain_len(const buf_chain_t *chain)
+{
+    uint32_t len = chain->hdr->len;
+    for (int i = 0; i < chain->seg_num; i++)
+        len += chain->seg[i].iov_len;
+    return len;
+}
+
+/**
+ * @brief 把分段数据包合并到一个buffer中
+ * 
+ * @param dst 目的buffer
+ * @param chain 分段数据包，总长度不能超过BUF_MAX_LEN
+ */
+void buf_chain_copy(buf_t *dst, const buf_chain_t *chain)
+{
+    buf_init(dst, buf_chain_len(chain));
+    uint8_t *p = dst->data;
+    memcpy(p, chain->hdr->data, chain->hdr->len);
+    p += chain->hdr->len;
+    for (int i = 0; i < chain->seg_num; i++)
+    {
+        memcpy(p, chain->seg[i].iov_base, chain->seg[i].iov_len);
+        p += chain->seg[i].iov_len;
+    }
+}
+
+// 把一段数据以32位为单位累加到64位的和中，不折叠
+static inline uint64_t checksum_add(const uint8_t *p, int len, uint64_t sum)
+{
+    for(; len >= 4; p += 4, len -= 4){
+        uint32_t v;
+        memcpy(&v, p, 4);
+        sum += v;
+    }
+    if(len >= 2){
+        uint16_t v;
+        memcpy(&v, p, 2);
+        sum += v;
+        p += 2;
+        len -= 2;
+    }
+    if(len){
+        uint16_t v = 0; // 奇数长度时最后一个字节补0
+        memcpy(&v, p, 1);
+        sum += v;
+    }
+    return sum;
+}
+
+// checksum16_iov()使用的不内联版本：内联进按段循环后生成的代码反而慢一倍
+static __attribute__((noinline)) uint64_t checksum_add_seg(const uint8_t *p, int len, uint64_t sum)
+{
+    return checksum_add(p, len, sum);
+}
+
+// 把累加和折叠为16位
+static inline uint16_t checksum_fold(uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
 }
 
 /**
@@ -82,11 +160,118 @@ void buf_copy(buf_t *dst, buf_t *src)
  */
 uint16_t checksum16(uint16_t *buf, int len)
 {
-    // TODO
-    uint32_t sum = 0;
-    for(int i = 0; i < len / 2; i++){
-        sum += (uint32_t)*(buf + i);
+    // 以32位为单位累加到64位的和中，最后再折叠为16位，结果与按16位累加相同
+    return (uint16_t)~checksum_fold(checksum_add((const uint8_t *)buf, len, 0));
+}
+
+/**
+ * @brief 计算若干段内存依次连接后的16位校验和，段长度可以为奇数
+ *        从偶数位置开始的段直接累加；前面各段的总长度为奇数时，本段的字节在16位字中的位置互换，
+ *        所以把本段单独求和并按字节交换后再累加(RFC 1071)
+ * 
+ * @param iov 各段
+ * @param cnt 段数
+ * @return uint16_t 校验和
+ */
+uint16_t checksum16_iov(const struct iovec *iov, int cnt)
+{
+    uint64_t sum = 0;
+    int odd = 0;
+    for (int i = 0; i < cnt; i++)
+    {
+        if (odd)
+        {
+            uint16_t s = checksum_fold(checksum_add_seg(iov[i].iov_base, iov[i].iov_len, 0));
+            sum += (uint16_t)(s >> 8 | s << 8);
+        }
+        else
+            sum = checksum_add_seg(iov[i].iov_base, iov[i].iov_len, sum);
+        odd ^= iov[i].iov_len & 1;
     }
-    sum += sum >> 16;
+    return (uint16_t)~checksum_fold(sum);
+}
+
+/**
+ * @brief 计算伪首部的部分和(不取反)，发送时填入传输层校验和字段，由设备补全(BUF_CSUM_PARTIAL)
+ * 
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @param protocol 传输层协议
+ * @param len 传输层头部与数据的总长度
+ * @return uint16_t 伪首部的部分和
+ */
+uint16_t checksum_pseudo(const uint8_t *src_ip, const uint8_t *dest_ip, uint8_t protocol, uint16_t len)
+{
+    uint8_t hdr[12];
+    memcpy(hdr, src_ip, 4);
+    memcpy(hdr + 4, dest_ip, 4);
+    hdr[8] = 0;
+    hdr[9] = protocol;
+    hdr[10] = len >> 8;
+    hdr[11] = len & 0xFF;
+    return (uint16_t)checksum_fold(checksum_add(hdr, sizeof(hdr), 0));
+}
+
+/**
+ * @brief 增量更新16位校验和(RFC 1624)
+ *        HC' = ~(~HC + ~m + m')，其中m为被修改的16位字的原值，m'为新值
+ *        只需要修改报文中的少数字段时，无需重新计算整个报文的校验和
+ * 
+ * @param checksum 原校验和
+ * @param old_val 被修改的16位字的原值
+ * @param new_val 被修改的16位字的新值
+ * @return uint16_t 新的校验和
+ */
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_val, uint16_t new_val)
+{
+    uint32_t sum = (uint16_t)~checksum + (uint16_t)~old_val + new_val;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
     return (uint16_t)~sum;
+}
+
+/**
+ * @brief 获取毫秒级的单调时间，用于协议定时器
+ * 
+ * @return uint64_t 当前时间(毫秒)
+ */
+uint64_t time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 获取纳秒级的系统时间(CLOCK_REALTIME)，与内核的接收时间戳可以直接比较
+ * 
+ * @return uint64_t 当前时间(纳秒)
+ */
+uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 获取时间戳计数器的频率，第一次调用时用单调时钟测量，约耗时10毫秒
+ * 
+ * @return uint64_t 每秒的计数
+ */
+uint64_t tsc_ticks_per_sec()
+{
+    static uint64_t ticks_per_sec;
+    if (ticks_per_sec)
+        return ticks_per_sec;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t c0 = tsc_now();
+    do
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    while ((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec) < 10000000L);
+    uint64_t c1 = tsc_now();
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    ticks_per_sec = c1 > c0 ? (uint64_t)((c1 - c0) * 1e9 / ns) : 1000000000;
+    return ticks_per_sec;
 }
\ No newline at end of file
@@ -0,0 +1,592 @@
+#include "config.h"
+#ifdef DRIVER_XDP
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include "net.h"
+#include "utils.h"
+#include "driver.h"
+#include "trace.h"
+#include "conf.h"
+
+#define XDP_FRAME_SIZE 4096                    //UMEM中每帧的大小，不能超过页大小
+#define XDP_RING_SIZE (DRIVER_XDP_FRAMES / 2)  //每个环的大小，接收与发送各用一半帧
+#define XDP_MAP_ENTRIES 64                     //xsk映射表大小，即支持的最大队列号
+#define XDP_UMEM_LEN ((size_t)DRIVER_XDP_FRAMES * XDP_FRAME_SIZE)
+
+#ifndef XDP_USE_SG // 较旧的内核头文件中没有多缓冲区的定义
+#define XDP_USE_SG (1 << 4)
+#endif
+#ifndef XDP_PKT_CONTD
+#define XDP_PKT_CONTD (1 << 0)
+#endif
+
+/**
+ * @brief AF_XDP后端：帧收发都在与内核共享的UMEM中，收发通过四个环完成，不经过内核协议栈
+ *        附加到net_conf.if_name上的XDP程序只把目的MAC为net_if_mac或广播的帧重定向到本套接字，
+ *        其他帧照常交给内核
+ *
+ *        套接字优先以零拷贝模式(XDP_ZEROCOPY，网卡直接读写UMEM)绑定，网卡不支持时重新创建套接字以拷贝模式(XDP_COPY)绑定；
+ *        XDP程序优先以驱动模式附加，网卡不支持时退回通用(skb)模式，veth上可以直接测试：
+ *        ip link add veth0 address 00:11:22:33:44:55 type veth peer name veth1
+ *        ethtool -K veth1 tx off   # 否则从本机套接字发出的帧不带校验和
+ *
+ *        接收时buf->data直接指向UMEM中的帧，不复制；帧挂在这个buf上，直到下一次在同一个buf上接收时才归还填充环，
+ *        graph_poll()与qos_poll()到下次轮询才重新收取处理过的缓冲区，所以帧在整个轮询(包括udp_flush())中都有效；
+ *        在收到的帧上原地构造的回复(如icmp回显应答)直接把这一帧提交给发送环，换一个空闲的发送帧给填充环；
+ *        协议栈在自己的缓冲区中构造的帧复制一次，放进从完成环回收的发送帧
+ *        接收时每次最多从环中取DRIVER_XDP_BATCH个描述符，发送的描述符攒够一批或到下一次接收时一起提交
+ *
+ *        MTU放不进一帧(巨型帧)时打开多缓冲区(XDP_USE_SG，需要Linux 6.6以上)，
+ *        一个数据包占连续的几个描述符，除最后一个外都带XDP_PKT_CONTD，这样的包接收时仍复制进buf的负载数组
+ */
+typedef struct xdp_ring
+{
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *desc;
+    uint32_t cached_prod; //本地的生产者位置
+    uint32_t cached_cons; //本地的消费者位置
+    void *map;            //mmap得到的地址
+    size_t map_len;
+} xdp_ring_t;
+
+static int xsk_fd = -1, map_fd = -1, prog_fd = -1, link_fd = -1;
+static uint8_t *umem;
+static xdp_ring_t rx_ring, tx_ring, fill_ring, comp_ring;
+static uint64_t tx_free[XDP_RING_SIZE]; //空闲的发送帧
+static buf_t *rx_owner[DRIVER_XDP_FRAMES]; //正在使用这一帧的接收缓冲区，帧不在协议栈中时为NULL
+static int tx_free_cnt, tx_pending;
+static int need_wakeup;
+static int xdp_sg; //是否使用多缓冲区
+static uint64_t xdp_rx_ns; //取出当前一批接收帧的时间，net_conf.rx_timestamp打开时记录
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+#define INSN(c, d, s, o, i) ((struct bpf_insn){.code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i)})
+
+/**
+ * @brief 加载XDP程序：目的MAC为本机或广播的帧重定向到对应队列的AF_XDP套接字，否则XDP_PASS
+ *
+ * @return int 程序的文件描述符，失败为-1
+ */
+static int xdp_load_prog()
+{
+    uint32_t lo;
+    uint16_t hi;
+    memcpy(&lo, net_if_mac, 4);
+    memcpy(&hi, net_if_mac + 4, 2);
+
+    struct bpf_insn prog[] = {
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),           // 0: r6 = ctx
+        INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, 0, 0),             // 1: r2 = ctx->data
+        INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 1, 4, 0),             // 2: r3 = ctx->data_end
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),           // 3: r4 = r2
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, 6),           // 4: r4 += 6
+        INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 12, 0),            // 5: 不足6字节 -> 18
+        INSN(BPF_LDX | BPF_MEM | BPF_W, 4, 2, 0, 0),             // 6: w4 = 目的MAC前4字节
+        INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 4, 0),             // 7: w5 = 目的MAC后2字节
+        INSN(BPF_JMP32 | BPF_JNE | BPF_K, 4, 0, 1, (int32_t)lo), // 8: 不是本机 -> 10
+        INSN(BPF_JMP32 | BPF_JEQ | BPF_K, 5, 0, 2, hi),          // 9: 是本机 -> 12
+        INSN(BPF_JMP32 | BPF_JNE | BPF_K, 4, 0, 7, -1),          // 10: 不是广播 -> 18
+        INSN(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, 6, 0xffff),      // 11: 不是广播 -> 18
+        INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 16, 0),            // 12: r2 = ctx->rx_queue_index
+        INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd), // 13: r1 = xsk映射表
+        INSN(0, 0, 0, 0, 0),                                     // 14
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),    // 15: 队列上没有套接字时XDP_PASS
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),// 16
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),                    // 17
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),    // 18: r0 = XDP_PASS
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),                    // 19
+    };
+    static char log[4096];
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uint64_t)(uintptr_t) "GPL";
+    attr.log_buf = (uint64_t)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    attr.prog_flags = xdp_sg ? BPF_F_XDP_HAS_FRAGS : 0; //程序只读以太网头，可以处理分成多段的帧
+    int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0)
+        fprintf(stderr, "Error in BPF_PROG_LOAD: %s\n%s\n", strerror(errno), log);
+    return fd;
+}
+
+/**
+ * @brief 把XDP程序附加到网卡，先试驱动模式，再退回通用模式
+ *        通过bpf_link附加，进程退出时自动卸载
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_attach(int ifindex)
+{
+    static const struct
+    {
+        uint32_t flags;
+        const char *name;
+    } modes[] = {{XDP_FLAGS_DRV_MODE, "driver"}, {XDP_FLAGS_SKB_MODE, "generic"}};
+    for (int i = 0; i < 2; i++)
+    {
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = prog_fd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = modes[i].flags;
+        if ((link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) >= 0)
+        {
+            fprintf(stderr, "xdp: program attached to %s in %s mode\n", net_conf.if_name, modes[i].name);
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error in BPF_LINK_CREATE: %s\n", strerror(errno));
+    return -1;
+}
+
+/**
+ * @brief 映射一个环
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_map_ring(xdp_ring_t *ring, const struct xdp_ring_offset *off, size_t desc_size, off_t pgoff)
+{
+    ring->map_len = off->desc + XDP_RING_SIZE * desc_size;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd, pgoff);
+    if (ring->map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error in mmap xdp ring: %s\n", strerror(errno));
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+    ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+    ring->flags = (uint32_t *)((uint8_t *)ring->map + off->flags);
+    ring->desc = (uint8_t *)ring->map + off->desc;
+    ring->cached_prod = *ring->producer;
+    ring->cached_cons = *ring->consumer;
+    return 0;
+}
+
+/**
+ * @brief 关闭AF_XDP套接字，释放四个环与UMEM
+ *
+ */
+static void xdp_close_socket()
+{
+    xdp_ring_t *rings[] = {&rx_ring, &tx_ring, &fill_ring, &comp_ring};
+    for (int i = 0; i < 4; i++)
+        if (rings[i]->map)
+        {
+            munmap(rings[i]->map, rings[i]->map_len);
+            rings[i]->map = NULL;
+        }
+    if (xsk_fd >= 0)
+    {
+        close(xsk_fd);
+        xsk_fd = -1;
+    }
+    if (umem)
+    {
+        munmap(umem, XDP_UMEM_LEN);
+        umem = NULL;
+    }
+}
+
+/**
+ * @brief 创建AF_XDP套接字与UMEM，映射四个环，把接收帧全部放入填充环，并以给定模式绑定到队列
+ *        绑定失败后内核已经释放了填充环与完成环，换模式要重新创建套接字
+ *
+ * @param mode XDP_ZEROCOPY或XDP_COPY
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_open_socket(int ifindex, uint16_t mode)
+{
+    if ((xsk_fd = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+    {
+        fprintf(stderr, "Error in socket(AF_XDP): %s\n", strerror(errno));
+        return -1;
+    }
+    umem = mmap(NULL, XDP_UMEM_LEN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED)
+    {
+        umem = NULL;
+        fprintf(stderr, "Error in mmap umem: %s\n", strerror(errno));
+        return -1;
+    }
+    struct xdp_umem_reg reg = {.addr = (uint64_t)(uintptr_t)umem, .len = XDP_UMEM_LEN, .chunk_size = XDP_FRAME_SIZE};
+    int ring_size = XDP_RING_SIZE;
+    if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0)
+    {
+        fprintf(stderr, "Error in setsockopt(SOL_XDP): %s\n", strerror(errno));
+        return -1;
+    }
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+    {
+        fprintf(stderr, "Error in getsockopt(XDP_MMAP_OFFSETS): %s\n", strerror(errno));
+        return -1;
+    }
+    if (xdp_map_ring(&fill_ring, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        xdp_map_ring(&comp_ring, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        xdp_map_ring(&rx_ring, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        xdp_map_ring(&tx_ring, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0)
+        return -1;
+
+    // 前一半帧用于接收，后一半用于发送
+    uint64_t *fill = fill_ring.desc;
+    for (int i = 0; i < XDP_RING_SIZE; i++)
+        fill[(fill_ring.cached_prod++) & (XDP_RING_SIZE - 1)] = (uint64_t)i * XDP_FRAME_SIZE;
+    __atomic_store_n(fill_ring.producer, fill_ring.cached_prod, __ATOMIC_RELEASE);
+    for (tx_free_cnt = 0; tx_free_cnt < XDP_RING_SIZE; tx_free_cnt++)
+        tx_free[tx_free_cnt] = (uint64_t)(XDP_RING_SIZE + tx_free_cnt) * XDP_FRAME_SIZE;
+    memset(rx_owner, 0, sizeof(rx_owner));
+    tx_pending = 0;
+
+    struct sockaddr_xdp sxdp = {.sxdp_family = AF_XDP, .sxdp_ifindex = ifindex, .sxdp_queue_id = DRIVER_XDP_QUEUE};
+    xdp_sg = net_conf.mtu + 14 > XDP_FRAME_SIZE - XDP_PACKET_HEADROOM;
+    sxdp.sxdp_flags = mode | XDP_USE_NEED_WAKEUP | (xdp_sg ? XDP_USE_SG : 0);
+    if (bind(xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+    {
+        if (mode == XDP_ZEROCOPY)
+            fprintf(stderr, "xdp: zero-copy not available on %s queue %d (%s), falling back to copy mode\n",
+                    net_conf.if_name, DRIVER_XDP_QUEUE, strerror(errno));
+        else
+            fprintf(stderr, "Error in bind(AF_XDP) %s queue %d: %s\n", net_conf.if_name, DRIVER_XDP_QUEUE, strerror(errno));
+        return -1;
+    }
+    need_wakeup = 1;
+    fprintf(stderr, "xdp: socket bound to %s queue %d in %s mode%s\n", net_conf.if_name, DRIVER_XDP_QUEUE,
+            mode == XDP_ZEROCOPY ? "zero-copy" : "copy", xdp_sg ? ", multi-buffer" : "");
+    return 0;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open()
+{
+    int ifindex = if_nametoindex(net_conf.if_name);
+    if (ifindex == 0)
+    {
+        fprintf(stderr, "Error in if_nametoindex %s: %s\n", net_conf.if_name, strerror(errno));
+        return -1;
+    }
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = XDP_MAP_ENTRIES;
+    if ((map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0)
+    {
+        fprintf(stderr, "Error in BPF_MAP_CREATE: %s\n", strerror(errno));
+        goto fail;
+    }
+    if (xdp_open_socket(ifindex, XDP_ZEROCOPY) < 0)
+    {
+        xdp_close_socket();
+        if (xdp_open_socket(ifindex, XDP_COPY) < 0)
+            goto fail;
+    }
+
+    uint32_t key = DRIVER_XDP_QUEUE, value = xsk_fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.value = (uint64_t)(uintptr_t)&value;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    {
+        fprintf(stderr, "Error in BPF_MAP_UPDATE_ELEM: %s\n", strerror(errno));
+        goto fail;
+    }
+    if ((prog_fd = xdp_load_prog()) < 0 || xdp_attach(ifindex) < 0)
+        goto fail;
+    return 0;
+fail:
+    driver_close();
+    return -1;
+}
+
+/**
+ * @brief 为当前线程选择使用的队列，AF_XDP后端只绑定DRIVER_XDP_QUEUE一个队列
+ *
+ * @param queue 队列号
+ * @return int 成功为0，失败为-1
+ */
+int driver_select_queue(int queue)
+{
+    return queue == 0 ? 0 : -1;
+}
+
+/**
+ * @brief 提交攒下的发送描述符，需要时通知内核
+ *
+ */
+static void xdp_flush_tx()
+{
+    if (tx_pending == 0)
+        return;
+    __atomic_store_n(tx_ring.producer, tx_ring.cached_prod, __ATOMIC_RELEASE);
+    tx_pending = 0;
+    if (!need_wakeup || (__atomic_load_n(tx_ring.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP))
+        sendto(xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+/**
+ * @brief 回收已发送完成的帧
+ *
+ */
+static void xdp_reclaim_tx()
+{
+    uint32_t prod = __atomic_load_n(comp_ring.producer, __ATOMIC_ACQUIRE);
+    uint64_t *comp = comp_ring.desc;
+    while (comp_ring.cached_cons != prod)
+        tx_free[tx_free_cnt++] = comp[(comp_ring.cached_cons++) & (XDP_RING_SIZE - 1)];
+    __atomic_store_n(comp_ring.consumer, comp_ring.cached_cons, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 保证至少有n个空闲的发送帧，不够时先回收完成环
+ *
+ * @return int 够用为0，不够为-1
+ */
+static int xdp_tx_frames(int n)
+{
+    if (tx_free_cnt < n)
+        xdp_reclaim_tx();
+    if (tx_free_cnt < n)
+    {
+        xdp_flush_tx();
+        NET_DROP(DRIVER, DRIVER_XDP_DROP_NO_FRAME);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 向发送环写入一个描述符，由调用者在写完一个包后计入tx_pending
+ *
+ */
+static void xdp_tx_desc(uint64_t addr, uint32_t len, uint32_t options)
+{
+    struct xdp_desc *desc = &((struct xdp_desc *)tx_ring.desc)[(tx_ring.cached_prod++) & (XDP_RING_SIZE - 1)];
+    desc->addr = addr;
+    desc->len = len;
+    desc->options = options;
+}
+
+/**
+ * @brief 把一帧放入填充环，在下一批接收开始时一起提交
+ *
+ */
+static void xdp_fill(uint64_t addr)
+{
+    ((uint64_t *)fill_ring.desc)[(fill_ring.cached_prod++) & (XDP_RING_SIZE - 1)] = addr;
+}
+
+/**
+ * @brief 指针所在的UMEM帧
+ *
+ * @return int 帧号，不在UMEM中为-1
+ */
+static int xdp_frame_of(const uint8_t *p)
+{
+    if (umem == NULL || p < umem || p >= umem + XDP_UMEM_LEN)
+        return -1;
+    return (p - umem) / XDP_FRAME_SIZE;
+}
+
+/**
+ * @brief 试图从网卡接收数据包，buf->data直接指向UMEM中的帧
+ *        buf上一次收到的帧此时已经处理完，先把它放回填充环
+ *        接收环每次最多看DRIVER_XDP_BATCH个描述符，取下一批之前一起归还接收环并提交填充环
+ *        多缓冲区的数据包可以越过一批的末尾，内核总是把一个包的所有描述符一起提交，这样的包复制进buf
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(buf_t *buf)
+{
+    xdp_flush_tx();
+    int frame = xdp_frame_of(buf->data);
+    if (frame >= 0 && rx_owner[frame] == buf)
+    {
+        rx_owner[frame] = NULL;
+        xdp_fill((uint64_t)frame * XDP_FRAME_SIZE);
+    }
+    if (rx_ring.cached_cons == rx_ring.cached_prod)
+    {
+        __atomic_store_n(rx_ring.consumer, rx_ring.cached_cons, __ATOMIC_RELEASE);
+        __atomic_store_n(fill_ring.producer, fill_ring.cached_prod, __ATOMIC_RELEASE);
+        uint32_t prod = __atomic_load_n(rx_ring.producer, __ATOMIC_ACQUIRE);
+        if (prod - rx_ring.cached_cons > DRIVER_XDP_BATCH)
+            prod = rx_ring.cached_cons + DRIVER_XDP_BATCH;
+        rx_ring.cached_prod = prod;
+        if (rx_ring.cached_cons == prod)
+        {
+            if (need_wakeup && (__atomic_load_n(fill_ring.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP))
+                recvfrom(xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+            return 0;
+        }
+        if (net_conf.rx_timestamp) // 没有内核时间戳，同一批帧用从接收环取出这一批的时间
+            xdp_rx_ns = time_ns();
+    }
+    struct xdp_desc *ring = rx_ring.desc;
+    uint32_t len = 0, n = 0;
+    do
+    {
+        if (rx_ring.cached_cons + n == rx_ring.cached_prod)
+            rx_ring.cached_prod = __atomic_load_n(rx_ring.producer, __ATOMIC_ACQUIRE);
+        len += ring[(rx_ring.cached_cons + n) & (XDP_RING_SIZE - 1)].len;
+    } while (ring[(rx_ring.cached_cons + n++) & (XDP_RING_SIZE - 1)].options & XDP_PKT_CONTD);
+    if (n == 1)
+    {
+        struct xdp_desc *desc = &ring[(rx_ring.cached_cons++) & (XDP_RING_SIZE - 1)];
+        buf->data = umem + desc->addr;
+        buf->len = desc->len;
+        buf->csum = BUF_CSUM_NONE;
+        buf->ts = (buf_ts_t){.sw = xdp_rx_ns};
+        rx_owner[desc->addr / XDP_FRAME_SIZE] = buf;
+        return len;
+    }
+    if (len > BUF_MAX_LEN)
+        len = BUF_MAX_LEN;
+    buf_init(buf, len);
+    buf->ts.sw = xdp_rx_ns;
+    for (uint32_t i = 0, off = 0; i < n; i++)
+    {
+        struct xdp_desc *desc = &ring[(rx_ring.cached_cons++) & (XDP_RING_SIZE - 1)];
+        uint32_t seg = desc->len < len - off ? desc->len : len - off;
+        memcpy(buf->data + off, umem + desc->addr, seg);
+        off += seg;
+        xdp_fill(desc->addr & ~(uint64_t)(XDP_FRAME_SIZE - 1));
+    }
+    return len;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ *        在收到的帧上原地构造的包直接提交这一帧，换一个空闲的发送帧放入填充环，接收与发送的帧数都不变；
+ *        其他包复制进空闲的发送帧
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    int frame = xdp_frame_of(buf->data);
+    if (frame >= 0 && rx_owner[frame] == buf && xdp_frame_of(buf->data + buf->len - 1) == frame)
+    {
+        if (xdp_tx_frames(1) < 0)
+            return -1;
+        rx_owner[frame] = NULL;
+        xdp_fill(tx_free[--tx_free_cnt]);
+        xdp_tx_desc(buf->data - umem, buf->len, 0);
+        if (++tx_pending >= DRIVER_XDP_BATCH)
+            xdp_flush_tx();
+        return 0;
+    }
+    struct iovec iov = {buf->data, buf->len};
+    return driver_sendv(&iov, 1);
+}
+
+/**
+ * @brief 使用网卡发送一个由若干段内存组成的数据包，各段直接复制进从完成环回收的UMEM帧，只复制这一次
+ *        描述符攒够DRIVER_XDP_BATCH个才提交，剩下的在下一次driver_recv()时提交
+ *        超过一帧的数据包在多缓冲区模式下分成几个描述符
+ *
+ * @param iov 各段，第一段为各层头部
+ * @param cnt 段数
+ * @return int 成功为0，失败为-1
+ */
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+    uint32_t len = 0;
+    for (int i = 0; i < cnt; i++)
+        len += iov[i].iov_len;
+    int n = (len + XDP_FRAME_SIZE - 1) / XDP_FRAME_SIZE;
+    if (n > 1 && !xdp_sg)
+        return -1;
+    if (xdp_tx_frames(n) < 0)
+        return -1;
+    int s = 0;
+    size_t s_off = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t addr = tx_free[--tx_free_cnt];
+        uint32_t seg = i < n - 1 ? XDP_FRAME_SIZE : len - i * XDP_FRAME_SIZE;
+        for (uint32_t off = 0; off < seg;)
+        {
+            size_t take = iov[s].iov_len - s_off < seg - off ? iov[s].iov_len - s_off : seg - off;
+            memcpy(umem + addr + off, (uint8_t *)iov[s].iov_base + s_off, take);
+            off += take;
+            if ((s_off += take) == iov[s].iov_len)
+            {
+                s++;
+                s_off = 0;
+            }
+        }
+        xdp_tx_desc(addr, seg, i < n - 1 ? XDP_PKT_CONTD : 0);
+    }
+    if ((tx_pending += n) >= DRIVER_XDP_BATCH)
+        xdp_flush_tx();
+    return 0;
+}
+
+/**
+ * @brief 把XDP_STATISTICS的计数写入统计计数器
+ *
+ */
+void driver_stats()
+{
+    struct xdp_statistics st;
+    socklen_t optlen = sizeof(st);
+    if (getsockopt(xsk_fd, SOL_XDP, XDP_STATISTICS, &st, &optlen) == 0)
+    {
+        STATS_SET(DRIVER_XDP_RX_DROPPED, st.rx_dropped);
+        STATS_SET(DRIVER_XDP_RX_RING_FULL, st.rx_ring_full);
+        STATS_SET(DRIVER_XDP_FILL_EMPTY, st.rx_fill_ring_empty_descs);
+    }
+}
+
+/**
+ * @brief 关闭网卡，卸载XDP程序
+ *
+ */
+void driver_close()
+{
+    if (xsk_fd >= 0)
+        xdp_flush_tx();
+    int *fds[] = {&link_fd, &prog_fd, &map_fd};
+    for (int i = 0; i < 3; i++)
+        if (*fds[i] >= 0)
+        {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    xdp_close_socket();
+}
+#endif
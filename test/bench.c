@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+#include "udp.h"
+#include "driver.h"
+#include "latency.h"
+#include "conf.h"
+#include "stats.h"
+#include "faker/mem_driver.h"
+
+/**
+ * @brief 协议栈回放基准测试
+ *        把pcap文件整体读入内存，经内存驱动反复送入net_poll()，测量每个工作负载的
+ *        包/秒、纳秒/包与周期/包，结果写成CSV，并与保存的基线比较
+ *        每轮一直调用net_poll()直到所有帧都被取走，逐包处理与矢量处理图(-v)的结果可以直接比较
+ *        每个工作负载运行前把本机地址设为其中单播帧的目的地址，使帧不会被当作发给别人的而丢弃
+ *        -q打开优先级接收队列，内存驱动总有帧可取，相当于一直过载，结束时打印各类别的丢包数
+ *        -B用批量处理程序打开各端口，-C再合并同一来源的连续数据报，与-v一起使用时每批才有多项
+ *
+ *        用法: net_bench [-d 秒] [-r 重复次数] [-o 结果.csv] [-b 基线.csv] [-t 允许变慢的百分比]
+ *                        [-v 矢量长度] [-q 队列容量] [-B] [-C] pcap...
+ */
+
+#define BENCH_MAX_WORKLOAD 64
+#define BENCH_UDP_PORT 60000 //打开的第一个端口，与pcap_gen的默认端口一致
+#define BENCH_UDP_PORTS 8     //打开的端口数
+
+typedef struct workload
+{
+        char name[64];
+        uint8_t *file;          //整个pcap文件
+        mem_frame_t *frames;
+        int count;
+        int has_addr;           //找到了本机地址时，运行前写入net_if_ip与net_if_mac
+        uint8_t if_ip[NET_IP_LEN];
+        uint8_t if_mac[NET_MAC_LEN];
+        double pps, ns_per_pkt, cycles_per_pkt;
+        double ns_per_done, drop_pct; //优先级接收队列：按实际处理的帧计的开销与被丢弃的比例
+} workload_t;
+
+static workload_t workloads[BENCH_MAX_WORKLOAD];
+static int workload_cnt;
+static uint64_t delivered;
+static int batch = -1; //-1逐个交付，0批量交付，1批量交付并合并
+
+static double now_sec()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t rd32(const uint8_t *p, int swap)
+{
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return swap ? swap32(v) : v;
+}
+
+/**
+ * @brief 工作负载中的本机地址：单播IPv4帧中出现最多的目的ip与mac，
+ *        测试数据与pcap_gen生成的文件发往不同的地址，逐个工作负载设置
+ */
+static void find_if_addr(workload_t *w)
+{
+        static const uint8_t broadcast[NET_MAC_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        struct { uint8_t mac[NET_MAC_LEN], ip[NET_IP_LEN]; int cnt; } cand[16];
+        int cand_cnt = 0, best = -1;
+        for(int i = 0; i < w->count; i++){
+                const uint8_t *p = w->frames[i].data;
+                if(w->frames[i].len < 34 || p[12] != 0x08 || p[13] != 0x00 || !memcmp(p, broadcast, NET_MAC_LEN))
+                        continue;
+                int j = 0;
+                while(j < cand_cnt && (memcmp(cand[j].mac, p, NET_MAC_LEN) || memcmp(cand[j].ip, p + 30, NET_IP_LEN)))
+                        j++;
+                if(j == cand_cnt){
+                        if(cand_cnt == sizeof(cand) / sizeof(cand[0]))
+                                continue;
+                        memcpy(cand[j].mac, p, NET_MAC_LEN);
+                        memcpy(cand[j].ip, p + 30, NET_IP_LEN);
+                        cand[j].cnt = 0;
+                        cand_cnt++;
+                }
+                if(++cand[j].cnt > (best < 0 ? 0 : cand[best].cnt))
+                        best = j;
+        }
+        w->has_addr = best >= 0;
+        if(w->has_addr){
+                memcpy(w->if_ip, cand[best].ip, NET_IP_LEN);
+                memcpy(w->if_mac, cand[best].mac, NET_MAC_LEN);
+        }
+}
+
+/**
+ * @brief 读入一个pcap文件，帧直接指向文件内容，不再复制
+ *        工作负载名取pcap所在目录名与文件名，如eth_in/in
+ *        失败时释放已分配的内存
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int load_pcap(const char *path, workload_t *w)
+{
+        FILE *f = fopen(path, "rb");
+        if(f == NULL){
+                perror(path);
+                return -1;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        w->file = malloc(size);
+        w->frames = NULL;
+        if(size < 24 || fread(w->file, 1, size, f) != (size_t)size){
+                fprintf(stderr, "%s: short file\n", path);
+                fclose(f);
+                goto LOAD_PCAP_FAIL;
+        }
+        fclose(f);
+
+        uint32_t magic = rd32(w->file, 0);
+        int swap;
+        if(magic == 0xa1b2c3d4 || magic == 0xa1b23c4d)
+                swap = 0;
+        else if(magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1)
+                swap = 1;
+        else{
+                fprintf(stderr, "%s: not a pcap file\n", path);
+                goto LOAD_PCAP_FAIL;
+        }
+
+        int cap = 1024;
+        w->frames = malloc(cap * sizeof(mem_frame_t));
+        w->count = 0;
+        for(long off = 24; off + 16 <= size;){
+                uint32_t caplen = rd32(w->file + off + 8, swap);
+                off += 16;
+                if(off + caplen > (uint64_t)size)
+                        break;
+                if(caplen > 0 && caplen <= BUF_MAX_LEN){
+                        if(w->count == cap)
+                                w->frames = realloc(w->frames, (cap *= 2) * sizeof(mem_frame_t));
+                        w->frames[w->count].len = caplen;
+                        w->frames[w->count].data = w->file + off;
+                        w->count++;
+                }
+                off += caplen;
+        }
+
+        const char *end = path + strlen(path);
+        const char *base = end;
+        for(int slash = 0; base > path; base--)
+                if(base[-1] == '/' && ++slash == 2)
+                        break;
+        snprintf(w->name, sizeof(w->name), "%.*s", (int)(end - base), base);
+        char *dot = strrchr(w->name, '.');
+        if(dot && strcmp(dot, ".pcap") == 0)
+                *dot = 0;
+        if(w->count == 0){
+                fprintf(stderr, "%s: no frames\n", path);
+                goto LOAD_PCAP_FAIL;
+        }
+        find_if_addr(w);
+        return 0;
+
+LOAD_PCAP_FAIL:
+        free(w->frames);
+        free(w->file);
+        w->frames = NULL;
+        w->file = NULL;
+        return -1;
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        delivered++;
+}
+
+static void batch_handler(udp_entry_t *entry, udp_dgram_t *dgram, int num)
+{
+        for(int i = 0; i < num; i++)
+                delivered += dgram[i].seg_num;
+}
+
+/**
+ * @brief 优先级接收队列没有处理的帧数：各类别丢弃的帧加上队列中的积压
+ */
+static uint64_t qos_unprocessed()
+{
+        uint64_t n = stats_get(STATS_QOS_BACKLOG);
+        for(int i = STATS_QOS_DROP_ARP; i <= STATS_QOS_DROP_BULK; i++)
+                n += stats_get(i);
+        return n;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 测量一个工作负载：先预热一轮，再重复reps次，每次至少运行duration秒，取中位数
+ */
+static void run(workload_t *w, double duration, int reps)
+{
+        double ns[reps], cyc[reps], done_ns[reps], drop[reps];
+        if(w->has_addr){
+                memcpy(net_if_ip, w->if_ip, NET_IP_LEN);
+                memcpy(net_if_mac, w->if_mac, NET_MAC_LEN);
+        }
+        mem_driver_load(w->frames, w->count);
+        while(mem_driver_pending())
+                net_poll();
+#ifdef LATENCY_ENABLE
+        latency_reset();
+#endif
+        for(int r = 0; r < reps; r++){
+                uint64_t pkts = 0, lost0 = qos_unprocessed();
+                double start = now_sec(), elapsed;
+                uint64_t c0 = tsc_now();
+                do{
+                        mem_driver_rewind();
+                        while(mem_driver_pending())
+                                net_poll();
+                        pkts += w->count;
+                }while((elapsed = now_sec() - start) < duration);
+                ns[r] = elapsed * 1e9 / pkts;
+                cyc[r] = (double)(tsc_now() - c0) / pkts;
+                uint64_t done = pkts - (qos_unprocessed() - lost0);
+                done_ns[r] = done ? elapsed * 1e9 / done : 0;
+                drop[r] = (double)(pkts - done) / pkts * 100;
+        }
+        qsort(ns, reps, sizeof(double), cmp_double);
+        qsort(cyc, reps, sizeof(double), cmp_double);
+        qsort(done_ns, reps, sizeof(double), cmp_double);
+        qsort(drop, reps, sizeof(double), cmp_double);
+        w->ns_per_pkt = ns[reps / 2];
+        w->cycles_per_pkt = cyc[reps / 2];
+        w->pps = 1e9 / w->ns_per_pkt;
+        w->ns_per_done = done_ns[reps / 2];
+        w->drop_pct = drop[reps / 2];
+}
+
+/**
+ * @brief 与基线比较，ns/包超过基线threshold百分比的视为退化
+ *
+ * @return int 退化的工作负载数
+ */
+static int compare(const char *path, double threshold)
+{
+        FILE *f = fopen(path, "r");
+        if(f == NULL){
+                perror(path);
+                return 0;
+        }
+        char line[256], name[64];
+        double ns;
+        int regressions = 0;
+        while(fgets(line, sizeof(line), f)){
+                if(sscanf(line, "%63[^,],%*[^,],%*[^,],%lf", name, &ns) != 2)
+                        continue;
+                for(int i = 0; i < workload_cnt; i++){
+                        workload_t *w = &workloads[i];
+                        if(strcmp(w->name, name) != 0)
+                                continue;
+                        double change = (w->ns_per_pkt - ns) / ns * 100;
+                        if(change > threshold){
+                                printf("\e[1;31mREGRESSION %s: %.1f ns/pkt, baseline %.1f (+%.1f%%)\e[0m\n", name, w->ns_per_pkt, ns, change);
+                                regressions++;
+                        }else{
+                                printf("%s: %+.1f%% vs baseline\n", name, change);
+                        }
+                }
+        }
+        fclose(f);
+        return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+        double duration = 0.2, threshold = 10;
+        int reps = 5, opt;
+        const char *out = NULL, *baseline = NULL;
+        while((opt = getopt(argc, argv, "d:r:o:b:t:v:q:BC")) != -1){
+                switch(opt){
+                case 'd': duration = atof(optarg); break;
+                case 'r': reps = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+                case 'o': out = optarg; break;
+                case 'b': baseline = optarg; break;
+                case 't': threshold = atof(optarg); break;
+                case 'v':
+                        if(conf_set("vector_size", optarg) < 0)
+                                return 1;
+                        break;
+                case 'B': batch = 0; break;
+                case 'C': batch = 1; break;
+                case 'q':
+                        if(conf_set("qos_queue", optarg) < 0)
+                                return 1;
+                        break;
+                default:
+                        fprintf(stderr, "Usage: %s [-d sec] [-r reps] [-o out.csv] [-b baseline.csv] [-t pct] [-v vector] [-q queue] [-B] [-C] pcap...\n", argv[0]);
+                        return 1;
+                }
+        }
+        for(int i = optind; i < argc && workload_cnt < BENCH_MAX_WORKLOAD; i++)
+                if(load_pcap(argv[i], &workloads[workload_cnt]) == 0)
+                        workload_cnt++;
+        if(workload_cnt == 0){
+                fprintf(stderr, "no workload loaded\n");
+                return 1;
+        }
+
+        if(net_init() < 0)
+                return 1;
+        for(int i = 0; i < BENCH_UDP_PORTS; i++)
+                if(batch < 0)
+                        udp_open(BENCH_UDP_PORT + i, handler);
+                else
+                        udp_open_batch(BENCH_UDP_PORT + i, batch_handler, batch);
+
+        if(net_conf.vector_size)
+                printf("vector size %d, prefetch %d\n", net_conf.vector_size, GRAPH_PREFETCH);
+        if(net_conf.qos_queue)
+                printf("qos queue %d, budget %d packets %d us\n", net_conf.qos_queue, net_conf.qos_budget, net_conf.qos_budget_us);
+        printf("%-24s %8s %12s %10s %10s\n", "workload", "packets", "pps", "ns/pkt", "cycles/pkt");
+        for(int i = 0; i < workload_cnt; i++){
+                workload_t *w = &workloads[i];
+                run(w, duration, reps);
+                printf("%-24s %8d %12.0f %10.1f %10.1f\n", w->name, w->count, w->pps, w->ns_per_pkt, w->cycles_per_pkt);
+                if(net_conf.qos_queue) // ns/pkt按从驱动取出的帧计，包括被丢弃的；这里只计实际处理的帧
+                        printf("%-24s processed %.1f ns/pkt, dropped %.1f%%\n", "", w->ns_per_done, w->drop_pct);
+#ifdef LATENCY_ENABLE
+                latency_report(stdout);
+#endif
+        }
+
+        if(batch >= 0){
+                uint64_t c[STATS_MAX];
+                stats_snapshot(c);
+                printf("udp batches %lu, %.1f datagrams per batch, %lu coalesced\n", (unsigned long)c[STATS_UDP_RX_BATCHES],
+                       c[STATS_UDP_RX_BATCHES] ? (double)delivered / c[STATS_UDP_RX_BATCHES] : 0.0, (unsigned long)c[STATS_UDP_RX_COALESCED]);
+        }
+        if(net_conf.qos_queue){
+                uint64_t c[STATS_MAX];
+                stats_snapshot(c);
+                for(int i = STATS_QOS_DROP_ARP; i <= STATS_QOS_BUDGET_EXHAUSTED; i++)
+                        printf("%s %lu\n", stats_names[i], (unsigned long)c[i]);
+        }
+
+        if(out){
+                FILE *f = fopen(out, "w");
+                if(f == NULL){
+                        perror(out);
+                        return 1;
+                }
+                fprintf(f, "workload,packets,pps,ns_per_pkt,cycles_per_pkt\n");
+                for(int i = 0; i < workload_cnt; i++)
+                        fprintf(f, "%s,%d,%.0f,%.2f,%.2f\n", workloads[i].name, workloads[i].count,
+                                workloads[i].pps, workloads[i].ns_per_pkt, workloads[i].cycles_per_pkt);
+                fclose(f);
+        }
+        return baseline && compare(baseline, threshold) ? 2 : 0;
+}
@@ -14,8 +14,10 @@ char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
-arp_entry_t arp_table[ARP_MAX_ENTRY];
-arp_buf_t arp_buf;
+static buf_t txbuf; //合并分段数据包用
+
+arp_entry_t *arp_table;
+arp_buf_t *arp_buf;
 
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 {
@@ -39,7 +41,14 @@ void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         fprint_buf(arp_fout,buf);
 }
 
-void arp_init()
+void arp_out_chain(buf_chain_t *chain, uint8_t *ip, net_protocol_t protocol)
+{
+        buf_chain_copy(&txbuf, chain);
+        arp_out(&txbuf, ip, protocol);
+}
+
+int arp_init()
 {
         fprintf(arp_fout,"arp_init\n");
+        return 0;
 }
\ No newline at end of file
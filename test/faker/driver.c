@@ -5,6 +5,7 @@
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
 static char pcap_errbuf[PCAP_ERRBUF_SIZE];
+static buf_t txbuf; //合并分段数据包用
 extern FILE* pcap_in;
 extern FILE* pcap_out;
 extern FILE *control_flow;
@@ -55,6 +56,17 @@ int driver_send(buf_t *buf)
         return 0;
 }
 
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+        int len = 0;
+        for(int i = 0; i < cnt; i++)
+                len += iov[i].iov_len;
+        buf_init(&txbuf, len);
+        for(int i = 0, off = 0; i < cnt; off += iov[i++].iov_len)
+                memcpy(txbuf.data + off, iov[i].iov_base, iov[i].iov_len);
+        return driver_send(&txbuf);
+}
+
 void driver_close()
 {
         fprintf(control_flow,"\ndriver closed\n");
@@ -0,0 +1,88 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "driver.h"
+#include "trace.h"
+
+#define LOOP_QUEUE_LEN 1024     //环回队列长度
+#define LOOP_FRAME_MAX (ETHERNET_MAX_MTU + 14) //每帧最大长度，容纳巨型帧
+
+/**
+ * @brief 环回驱动：发送的帧原样排队，下一次接收时取出
+ *        LOOP_DROP环境变量设置为N时以1/N的概率随机丢弃帧，用于测试重传
+ */
+static struct
+{
+        uint16_t len;
+        uint8_t data[LOOP_FRAME_MAX];
+} loop_queue[LOOP_QUEUE_LEN];
+static int loop_head, loop_count;
+static int loop_drop;
+static unsigned int loop_seed;
+
+int driver_open()
+{
+        char *drop = getenv("LOOP_DROP");
+        loop_drop = drop ? atoi(drop) : 0;
+        loop_head = loop_count = 0;
+        loop_seed = 1;
+        return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+        if(loop_count == 0)
+                return 0;
+        buf_init(buf, loop_queue[loop_head].len);
+        memcpy(buf->data, loop_queue[loop_head].data, buf->len);
+        loop_head = (loop_head + 1) % LOOP_QUEUE_LEN;
+        loop_count--;
+        return buf->len;
+}
+
+int driver_send(buf_t *buf)
+{
+        if(buf->len > LOOP_FRAME_MAX)
+                return -1;
+        if(loop_count == LOOP_QUEUE_LEN){
+                NET_DROP(DRIVER, DRIVER_RING_DROP);
+                return -1;
+        }
+        if(loop_drop && rand_r(&loop_seed) % loop_drop == 0)
+                return 0;
+        int tail = (loop_head + loop_count) % LOOP_QUEUE_LEN;
+        loop_queue[tail].len = buf->len;
+        memcpy(loop_queue[tail].data, buf->data, buf->len);
+        loop_count++;
+        return 0;
+}
+
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+        uint32_t len = 0;
+        for(int i = 0; i < cnt; i++)
+                len += iov[i].iov_len;
+        if(len > LOOP_FRAME_MAX)
+                return -1;
+        if(loop_count == LOOP_QUEUE_LEN){
+                NET_DROP(DRIVER, DRIVER_RING_DROP);
+                return -1;
+        }
+        if(loop_drop && rand_r(&loop_seed) % loop_drop == 0)
+                return 0;
+        int tail = (loop_head + loop_count) % LOOP_QUEUE_LEN;
+        loop_queue[tail].len = len;
+        for(int j = 0, off = 0; j < cnt; off += iov[j++].iov_len)
+                memcpy(loop_queue[tail].data + off, iov[j].iov_base, iov[j].iov_len);
+        loop_count++;
+        return 0;
+}
+
+void driver_stats()
+{
+}
+
+void driver_close()
+{
+}
@@ -0,0 +1,79 @@
+#include <string.h>
+#include <stdio.h>
+#include "utils.h"
+#include "driver.h"
+#include "mem_driver.h"
+
+/**
+ * @brief 内存驱动：依次返回预先加载到内存中的帧，发送的帧只计数不保存
+ *        用于测量协议栈本身的处理速度
+ */
+static const mem_frame_t *mem_frames;
+static int mem_count, mem_next;
+uint64_t mem_sent_pkts, mem_sent_bytes;
+
+/**
+ * @brief 设置要返回的帧，从第一帧开始
+ */
+void mem_driver_load(const mem_frame_t *frames, int count)
+{
+        mem_frames = frames;
+        mem_count = count;
+        mem_next = 0;
+}
+
+/**
+ * @brief 回到第一帧
+ */
+void mem_driver_rewind()
+{
+        mem_next = 0;
+}
+
+/**
+ * @brief 还没有返回的帧数
+ */
+int mem_driver_pending()
+{
+        return mem_count - mem_next;
+}
+
+int driver_open()
+{
+        mem_next = mem_count = 0;
+        mem_sent_pkts = mem_sent_bytes = 0;
+        return 0;
+}
+
+int driver_recv(buf_t *buf)
+{
+        if(mem_next == mem_count)
+                return 0;
+        const mem_frame_t *f = &mem_frames[mem_next++];
+        buf_init(buf, f->len);
+        memcpy(buf->data, f->data, f->len);
+        return f->len;
+}
+
+int driver_send(buf_t *buf)
+{
+        mem_sent_pkts++;
+        mem_sent_bytes += buf->len;
+        return 0;
+}
+
+int driver_sendv(const struct iovec *iov, int cnt)
+{
+        mem_sent_pkts++;
+        for(int i = 0; i < cnt; i++)
+                mem_sent_bytes += iov[i].iov_len;
+        return 0;
+}
+
+void driver_stats()
+{
+}
+
+void driver_close()
+{
+}
@@ -0,0 +1,30 @@
+#ifndef MEM_DRIVER_H
+#define MEM_DRIVER_H
+#include <stdint.h>
+
+/**
+ * @brief 内存驱动返回的一帧，数据由调用者持有
+ */
+typedef struct mem_frame
+{
+        uint32_t len;
+        const uint8_t *data;
+} mem_frame_t;
+
+extern uint64_t mem_sent_pkts, mem_sent_bytes;
+
+/**
+ * @brief 设置要返回的帧，从第一帧开始
+ */
+void mem_driver_load(const mem_frame_t *frames, int count);
+
+/**
+ * @brief 回到第一帧
+ */
+void mem_driver_rewind();
+
+/**
+ * @brief 还没有返回的帧数
+ */
+int mem_driver_pending();
+#endif
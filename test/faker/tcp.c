@@ -0,0 +1,24 @@
+#include "tcp.h"
+#include "ip.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+extern FILE *udp_fout;
+char* print_ip(uint8_t *ip);
+void fprint_buf(FILE* f, buf_t* buf);
+
+void tcp_in(buf_t *buf, uint8_t *src_ip)
+{
+        fprintf(udp_fout,"tcp_in:\tsrc_ip:%s\n",print_ip(src_ip));
+        fprint_buf(udp_fout, buf);
+}
+
+int tcp_init()
+{
+        return 0;
+}
+
+void tcp_poll()
+{
+}
@@ -0,0 +1,120 @@
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <linux/virtio_net.h>
+#include "tun.h"
+
+/**
+ * @brief 假的/dev/net/tun，只接管打开/dev/net/tun得到的fd，其它fd交给真正的系统调用
+ */
+#define TUN_FAKER_FD 1000 //第一个队列的fd，不会与真正的fd冲突
+
+int __real_open(const char *path, int flags, ...);
+int __real_ioctl(int fd, unsigned long req, ...);
+ssize_t __real_readv(int fd, const struct iovec *iov, int cnt);
+ssize_t __real_writev(int fd, const struct iovec *iov, int cnt);
+int __real_close(int fd);
+
+static tun_frame_t tun_rx[TUN_FAKER_FRAMES];
+static int tun_rx_cnt;
+static int tun_open_cnt;
+tun_frame_t tun_sent[TUN_FAKER_FRAMES];
+int tun_sent_cnt;
+int tun_read_order[TUN_FAKER_FRAMES];
+int tun_read_cnt;
+
+static int tun_queue(int fd)
+{
+        return fd >= TUN_FAKER_FD && fd < TUN_FAKER_FD + tun_open_cnt ? fd - TUN_FAKER_FD : -1;
+}
+
+void tun_faker_push(int queue, const uint8_t *data, uint32_t len)
+{
+        tun_frame_t *f = &tun_rx[tun_rx_cnt++];
+        f->queue = queue;
+        f->len = len;
+        memcpy(f->data, data, len);
+}
+
+int tun_faker_pending(int queue)
+{
+        int n = 0;
+        for(int i = 0; i < tun_rx_cnt; i++)
+                n += tun_rx[i].queue == queue;
+        return n;
+}
+
+void tun_faker_reset()
+{
+        tun_rx_cnt = tun_sent_cnt = tun_read_cnt = 0;
+}
+
+int __wrap_open(const char *path, int flags, ...)
+{
+        if(strcmp(path, "/dev/net/tun") == 0 && tun_open_cnt < TUN_FAKER_QUEUES)
+                return TUN_FAKER_FD + tun_open_cnt++;
+        va_list ap;
+        va_start(ap, flags);
+        int mode = va_arg(ap, int);
+        va_end(ap);
+        return __real_open(path, flags, mode);
+}
+
+int __wrap_ioctl(int fd, unsigned long req, ...)
+{
+        va_list ap;
+        va_start(ap, req);
+        void *arg = va_arg(ap, void *);
+        va_end(ap);
+        if(tun_queue(fd) >= 0)
+                return 0; //TUNSETIFF、TUNSETVNETHDRSZ与TUNSETOFFLOAD都接受
+        return __real_ioctl(fd, req, arg);
+}
+
+/**
+ * @brief 从队列取出最早放入的一帧，前面是全0的virtio_net_hdr；没有帧时与非阻塞的fd一样返回EAGAIN
+ */
+ssize_t __wrap_readv(int fd, const struct iovec *iov, int cnt)
+{
+        int queue = tun_queue(fd);
+        if(queue < 0)
+                return __real_readv(fd, iov, cnt);
+        for(int i = 0; i < tun_rx_cnt; i++){
+                if(tun_rx[i].queue != queue)
+                        continue;
+                tun_frame_t f = tun_rx[i];
+                memmove(tun_rx + i, tun_rx + i + 1, (tun_rx_cnt - i - 1) * sizeof(tun_frame_t));
+                tun_rx_cnt--;
+                memset(iov[0].iov_base, 0, iov[0].iov_len);
+                memcpy(iov[1].iov_base, f.data, f.len);
+                tun_read_order[tun_read_cnt++] = queue;
+                return sizeof(struct virtio_net_hdr) + f.len;
+        }
+        errno = EAGAIN;
+        return -1;
+}
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int cnt)
+{
+        int queue = tun_queue(fd);
+        if(queue < 0)
+                return __real_writev(fd, iov, cnt);
+        tun_frame_t *f = &tun_sent[tun_sent_cnt++];
+        f->queue = queue;
+        f->len = 0;
+        for(int i = 1; i < cnt; i++){ //跳过virtio_net_hdr
+                memcpy(f->data + f->len, iov[i].iov_base, iov[i].iov_len);
+                f->len += iov[i].iov_len;
+        }
+        ssize_t n = f->len;
+        return n + iov[0].iov_len;
+}
+
+int __wrap_close(int fd)
+{
+        if(tun_queue(fd) >= 0)
+                return 0;
+        return __real_close(fd);
+}
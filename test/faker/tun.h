@@ -0,0 +1,39 @@
+#ifndef TUN_FAKER_H
+#define TUN_FAKER_H
+#include <stdint.h>
+
+/**
+ * @brief 假的/dev/net/tun：用-Wl,--wrap替换open、ioctl、readv、writev与close，
+ *        打开/dev/net/tun得到的每个fd是一个队列，接收的帧由测试放入，发送的帧按队列记录
+ */
+#define TUN_FAKER_QUEUES 8
+#define TUN_FAKER_FRAMES 64
+#define TUN_FAKER_FRAME_LEN 128
+
+typedef struct tun_frame
+{
+        int queue;      //收发所在的队列，即第几个打开的fd
+        uint32_t len;
+        uint8_t data[TUN_FAKER_FRAME_LEN];
+} tun_frame_t;
+
+extern tun_frame_t tun_sent[TUN_FAKER_FRAMES];  //发送的帧，按发送顺序，不含virtio_net_hdr
+extern int tun_sent_cnt;
+extern int tun_read_order[TUN_FAKER_FRAMES];    //读到帧的队列，按读取顺序
+extern int tun_read_cnt;
+
+/**
+ * @brief 把一帧放入队列的接收端，之后readv()可以读到
+ */
+void tun_faker_push(int queue, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief 队列中还没有被读取的帧数
+ */
+int tun_faker_pending(int queue);
+
+/**
+ * @brief 清空各队列与记录
+ */
+void tun_faker_reset();
+#endif
@@ -25,9 +25,10 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port
         fprint_buf(udp_fout, buf);
 }
 
-void udp_init()
+int udp_init()
 {
         fprintf(udp_fout,"udp_init\n");
+        return 0;
 }
 
 int udp_open(uint16_t port, udp_handler_t handler)
@@ -0,0 +1,545 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "net.h"
+#include "ip.h"
+#include "ethernet.h"
+#include "conf.h"
+#include "acl.h"
+
+// arp_lookup与udp_checksum是静态函数，直接包含源文件以便单独测量
+#include "../src/arp.c"
+#include "../src/udp.c"
+
+/**
+ * @brief 协议栈基本函数的微基准测试
+ *        每项测试先预热，再把迭代次数调整到每轮约BENCH_ROUND_NS，重复若干轮，
+ *        输出每次操作耗时的最小值、中位数、平均值、标准差与p90
+ *
+ *        用法: micro_bench [--arp_max_entry N] [--udp_max_handler N] [-c cpu] [-r 轮数] [-o 结果.csv] [过滤子串]
+ *        表大小与协议栈一样在运行时配置，见conf.h
+ */
+
+#define BENCH_ROUND_NS 10000000.0 //每轮的目标时间
+
+typedef struct bench
+{
+        const char *name;
+        void (*setup)(int arg);
+        void (*fn)(int arg);
+        int arg;
+} bench_t;
+
+static int reps = 11;
+static FILE *csv;
+static volatile uint32_t sink;
+
+static double now_ns()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 运行一项测试并输出统计结果
+ */
+static void run(const char *name, void (*setup)(int), void (*fn)(int), int arg)
+{
+        if(setup)
+                setup(arg);
+        long iters = 1;
+        double t;
+        // 预热并找到每轮约BENCH_ROUND_NS的迭代次数
+        for(;;){
+                double start = now_ns();
+                for(long i = 0; i < iters; i++)
+                        fn(arg);
+                t = now_ns() - start;
+                if(t >= BENCH_ROUND_NS / 4)
+                        break;
+                iters *= 2;
+        }
+        iters = (long)(iters * BENCH_ROUND_NS / t) + 1;
+
+        double ns[reps], sum = 0, sq = 0;
+        for(int r = 0; r < reps; r++){
+                double start = now_ns();
+                for(long i = 0; i < iters; i++)
+                        fn(arg);
+                ns[r] = (now_ns() - start) / iters;
+                sum += ns[r];
+        }
+        double mean = sum / reps;
+        for(int r = 0; r < reps; r++)
+                sq += (ns[r] - mean) * (ns[r] - mean);
+        double sd = reps > 1 ? sqrt(sq / (reps - 1)) : 0;
+        qsort(ns, reps, sizeof(double), cmp_double);
+        double p90 = ns[(int)(0.9 * (reps - 1) + 0.5)];
+        printf("%-32s %10.1f %10.1f %10.1f %8.1f %10.1f\n", name, ns[0], ns[reps / 2], mean, sd, p90);
+        if(csv)
+                fprintf(csv, "%s,%.2f,%.2f,%.2f,%.2f,%.2f\n", name, ns[0], ns[reps / 2], mean, sd, p90);
+}
+
+/* ---------------- checksum ---------------- */
+
+static uint8_t data[BUF_MAX_LEN];
+
+static void bench_checksum16(int len)
+{
+        sink += checksum16((uint16_t *)data, len);
+}
+
+/**
+ * @brief 逐字节计算的参考校验和，用于检查checksum16的结果
+ */
+static uint16_t checksum_ref(const uint8_t *p, int len)
+{
+        uint32_t sum = 0;
+        for(int i = 0; i < len; i += 2){
+                uint16_t v = 0;
+                memcpy(&v, p + i, len - i >= 2 ? 2 : 1);
+                sum += v;
+                sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        return (uint16_t)~sum;
+}
+
+static int check_checksum16()
+{
+        int bad = 0;
+        srand(1);
+        for(int len = 0; len < 2048; len++){
+                for(int i = 0; i < len; i++)
+                        data[i] = (uint8_t)(rand() % 3 ? 0xFF : rand());
+                if(checksum16((uint16_t *)data, len) != checksum_ref(data, len)){
+                        if(bad++ < 5)
+                                fprintf(stderr, "checksum16 mismatch at len %d\n", len);
+                }
+        }
+        for(int i = 0; i < (int)sizeof(data); i++)
+                data[i] = (uint8_t)i;
+        return bad;
+}
+
+/**
+ * @brief 把数据随机切成若干段(含奇数长度与空段)，按段计算的结果应与整体计算相同
+ */
+static int check_checksum16_iov()
+{
+        int bad = 0;
+        struct iovec iov[BUF_MAX_SEG];
+        srand(2);
+        for(int round = 0; round < 4096; round++){
+                int len = rand() % 2048, cnt = 1 + rand() % BUF_MAX_SEG, off = 0;
+                for(int i = 0; i < len; i++)
+                        data[i] = (uint8_t)rand();
+                for(int i = 0; i < cnt; i++){
+                        int n = i == cnt - 1 ? len - off : rand() % (len - off + 1);
+                        iov[i].iov_base = data + off;
+                        iov[i].iov_len = n;
+                        off += n;
+                }
+                if(checksum16_iov(iov, cnt) != checksum16((uint16_t *)data, len)){
+                        if(bad++ < 5)
+                                fprintf(stderr, "checksum16_iov mismatch at len %d, %d segments\n", len, cnt);
+                }
+        }
+        for(int i = 0; i < (int)sizeof(data); i++)
+                data[i] = (uint8_t)i;
+        return bad;
+}
+
+static buf_t udp_buf;
+static uint8_t peer_ip[NET_IP_LEN] = {192, 168, 56, 1};
+
+static void setup_udp_checksum(int len)
+{
+        buf_init(&udp_buf, len);
+        memset(udp_buf.data, 0x5a, len);
+        ((udp_hdr_t *)udp_buf.data)->total_len = swap16(len);
+}
+
+static void bench_udp_checksum(int len)
+{
+        sink += udp_checksum(&udp_buf, peer_ip, net_if_ip);
+}
+
+/* ---------------- arp ---------------- */
+
+static uint8_t arp_ip[NET_IP_LEN];
+static uint8_t arp_mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 1};
+static uint32_t arp_next;
+
+static void arp_fill(int n)
+{
+        for(int i = 0; i < net_conf.arp_max_entry; i++)
+                arp_table[i].state = ARP_INVALID;
+        for(int i = 0; i < n; i++){
+                uint8_t ip[NET_IP_LEN] = {10, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+                arp_update(ip, arp_mac, ARP_VALID);
+        }
+}
+
+// 命中最后插入的表项
+static void setup_arp_hit(int n)
+{
+        arp_fill(n);
+        uint8_t ip[NET_IP_LEN] = {10, (uint8_t)((n - 1) >> 16), (uint8_t)((n - 1) >> 8), (uint8_t)(n - 1)};
+        memcpy(arp_ip, ip, NET_IP_LEN);
+}
+
+static void setup_arp_miss(int n)
+{
+        arp_fill(n);
+        uint8_t ip[NET_IP_LEN] = {11, 0, 0, 1};
+        memcpy(arp_ip, ip, NET_IP_LEN);
+}
+
+static void bench_arp_lookup(int n)
+{
+        sink += arp_lookup(arp_ip) != NULL;
+}
+
+// 表已满时不断插入新地址，每次都要替换表项
+static void bench_arp_update_churn(int n)
+{
+        uint32_t i = arp_next++;
+        uint8_t ip[NET_IP_LEN] = {12, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        arp_update(ip, arp_mac, ARP_VALID);
+}
+
+static void bench_arp_update_existing(int n)
+{
+        arp_update(arp_ip, arp_mac, ARP_VALID);
+}
+
+/* ---------------- udp_in ---------------- */
+
+static buf_t udp_in_buf;
+static uint8_t *udp_in_start;
+static uint16_t udp_in_len, udp_in_sum;
+
+static void udp_bench_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        sink += buf->len;
+}
+
+// 打开n个端口，数据包发往最后打开的端口
+static void setup_udp_in(int n)
+{
+        udp_init();
+        for(int i = 0; i < n; i++)
+                udp_open(20000 + i, udp_bench_handler);
+        udp_in_len = 8 + 64;
+        buf_init(&udp_in_buf, udp_in_len);
+        udp_hdr_t *hdr = (udp_hdr_t *)udp_in_buf.data;
+        memset(hdr, 0, udp_in_len);
+        hdr->src_port = swap16(1234);
+        hdr->dest_port = swap16(20000 + n - 1);
+        hdr->total_len = swap16(udp_in_len);
+        hdr->checksum = udp_checksum(&udp_in_buf, peer_ip, net_if_ip);
+        udp_in_start = udp_in_buf.data;
+        udp_in_sum = hdr->checksum;
+}
+
+// 驱动已确认校验和(BUF_CSUM_VALID)，udp_in不再计算
+static void setup_udp_in_valid(int n)
+{
+        setup_udp_in(n);
+        udp_in_buf.csum = BUF_CSUM_VALID;
+}
+
+static void bench_udp_in(int n)
+{
+        udp_in_buf.data = udp_in_start;
+        udp_in_buf.len = udp_in_len;
+        ((udp_hdr_t *)udp_in_start)->checksum = udp_in_sum;
+        udp_in(&udp_in_buf, peer_ip);
+}
+
+/* ---------------- buf ---------------- */
+
+static buf_t buf_a, buf_b;
+
+static void bench_buf_init(int len)
+{
+        buf_init(&buf_a, len);
+        sink += buf_a.len;
+}
+
+static void bench_buf_header(int len)
+{
+        buf_add_header(&buf_a, len);
+        buf_remove_header(&buf_a, len);
+        sink += buf_a.len;
+}
+
+static void bench_buf_copy(int len)
+{
+        buf_init(&buf_a, len);
+        buf_copy(&buf_b, &buf_a);
+        sink += buf_b.len;
+}
+
+/* ---------------- ip_out ---------------- */
+
+static buf_t ip_buf;
+
+static void setup_ip_out(int len)
+{
+        uint8_t mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 2};
+        arp_init();
+        arp_update(peer_ip, mac, ARP_VALID);
+}
+
+static void bench_ip_out(int len)
+{
+        buf_init(&ip_buf, len);
+        ip_out(&ip_buf, peer_ip, NET_PROTOCOL_UDP);
+}
+
+/* ---------------- udp_send ---------------- */
+
+static void setup_udp_send(int len)
+{
+        setup_ip_out(len);
+        udp_init();
+}
+
+// 应用先在自己的内存中准备好负载，udp_send再复制一次
+static void bench_udp_send(int len)
+{
+        data[0]++;
+        udp_send(data, len, 40000, peer_ip, 50000);
+}
+
+static void udp_send_done(buf_t *buf, void *ctx)
+{
+        sink++;
+}
+
+// 应用直接写入发送缓冲区，协议栈不再复制
+static void bench_udp_send_buf(int len)
+{
+        buf_t *buf = udp_alloc(len);
+        buf->data[0]++;
+        udp_send_buf(buf, 40000, peer_ip, 50000, udp_send_done, NULL);
+}
+
+// 应用的负载分成自己的报文头与数据两段，协议栈只构造各层头部，与两段一起交给驱动
+static void bench_udp_sendv(int len)
+{
+        struct iovec iov[2] = {{data, 16}, {data + 16, len - 16}};
+        data[0]++;
+        udp_sendv(iov, 2, 40000, peer_ip, 50000);
+}
+
+/* ---------------- iptos ---------------- */
+
+static void bench_iptos(int arg)
+{
+        sink += iptos(peer_ip)[0];
+}
+
+/* ---------------- acl ---------------- */
+
+static buf_t acl_buf;
+
+/**
+ * @brief 构造一个以太网帧，IPv4时带20字节IP头部与目的端口
+ */
+static void acl_frame(uint16_t type, const char *src, uint8_t proto, uint16_t dport, uint16_t frag)
+{
+        buf_init(&acl_buf, 14 + 20 + 8);
+        memset(acl_buf.data, 0, acl_buf.len);
+        uint8_t *p = acl_buf.data, *ip = p + 14;
+        p[12] = type >> 8;
+        p[13] = type & 0xFF;
+        ip[0] = 0x45;
+        ip[6] = frag >> 8;
+        ip[7] = frag & 0xFF;
+        ip[9] = proto;
+        sscanf(src, "%hhu.%hhu.%hhu.%hhu", &ip[12], &ip[13], &ip[14], &ip[15]);
+        ip[22] = dport >> 8;
+        ip[23] = dport & 0xFF;
+}
+
+static int check_acl()
+{
+        static const char *rules[] = {
+                "pass src 192.168.56.1 proto udp dport 53",
+                "drop proto udp dport 1-1023",
+                "drop type 0x86dd",
+                "drop src 10.0.0.0/8",
+        };
+        static const struct{
+                uint16_t type;
+                const char *src;
+                uint8_t proto;
+                uint16_t dport, frag;
+                int drop;
+        } cases[] = {
+                {NET_PROTOCOL_IP, "192.168.56.1", NET_PROTOCOL_UDP, 53, 0, 0},
+                {NET_PROTOCOL_IP, "192.168.56.2", NET_PROTOCOL_UDP, 53, 0, 1},
+                {NET_PROTOCOL_IP, "192.168.56.2", NET_PROTOCOL_UDP, 2000, 0, 0},
+                {NET_PROTOCOL_IP, "192.168.56.2", NET_PROTOCOL_UDP, 53, 100, 0}, //非首个分片没有端口
+                {NET_PROTOCOL_IP, "10.1.2.3", NET_PROTOCOL_TCP, 80, 0, 1},
+                {NET_PROTOCOL_IP, "11.0.0.0", NET_PROTOCOL_TCP, 80, 0, 0},
+                {NET_PROTOCOL_ARP, "10.1.2.3", 0, 0, 0, 0},
+                {0x86dd, "0.0.0.0", 0, 0, 0, 1},
+        };
+        int bad = 0;
+        acl_clear();
+        for(int i = 0; i < 4; i++)
+                if(acl_add(rules[i]) < 0)
+                        return 1;
+        for(int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++){
+                acl_frame(cases[i].type, cases[i].src, cases[i].proto, cases[i].dport, cases[i].frag);
+                if(acl_filter(&acl_buf) != cases[i].drop){
+                        fprintf(stderr, "acl_filter wrong for case %d\n", i);
+                        bad++;
+                }
+        }
+        acl_clear();
+        return bad;
+}
+
+/**
+ * @brief 加入n条都不匹配的规则，测量一个UDP帧经过所有规则的开销
+ */
+static void setup_acl(int n)
+{
+        char rule[ACL_TEXT_LEN];
+        acl_clear();
+        for(int i = 0; i < n; i++){
+                snprintf(rule, sizeof(rule), "drop src 10.%d.0.0/16 proto udp dport %d-%d", i, 1000 + i * 10, 1005 + i * 10);
+                acl_add(rule);
+        }
+        acl_frame(NET_PROTOCOL_IP, "192.168.56.1", NET_PROTOCOL_UDP, 60000, 0);
+}
+
+static void bench_acl(int n)
+{
+        sink += acl_filter(&acl_buf);
+}
+
+int main(int argc, char *argv[])
+{
+        int cpu = -1, opt;
+        if((argc = conf_parse_args(argc, argv)) < 0)
+                return 1;
+        const char *out = NULL;
+        while((opt = getopt(argc, argv, "c:r:o:")) != -1){
+                switch(opt){
+                case 'c': cpu = atoi(optarg); break;
+                case 'r': reps = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+                case 'o': out = optarg; break;
+                default:
+                        fprintf(stderr, "Usage: %s [--arp_max_entry N] [--udp_max_handler N] [-c cpu] [-r reps] [-o out.csv] [filter]\n", argv[0]);
+                        return 1;
+                }
+        }
+        const char *filter = optind < argc ? argv[optind] : NULL;
+
+        // 固定在一个CPU上，避免迁移带来的抖动
+        if(cpu < 0)
+                cpu = sched_getcpu();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) != 0)
+                perror("sched_setaffinity");
+
+        if(check_checksum16()){
+                fprintf(stderr, "checksum16 is wrong, aborting\n");
+                return 1;
+        }
+        if(check_checksum16_iov()){
+                fprintf(stderr, "checksum16_iov is wrong, aborting\n");
+                return 1;
+        }
+        if(check_acl()){
+                fprintf(stderr, "acl is wrong, aborting\n");
+                return 1;
+        }
+        if(out && (csv = fopen(out, "w")) == NULL){
+                perror(out);
+                return 1;
+        }
+        if(csv)
+                fprintf(csv, "name,min_ns,median_ns,mean_ns,stddev_ns,p90_ns\n");
+
+        ethernet_init();
+        arp_init();
+
+        int sizes[] = {20, 64, 576, 1500, 9000, 65000};
+        int arp_sizes[] = {1, net_conf.arp_max_entry / 2, net_conf.arp_max_entry};
+        int udp_sizes[] = {1, net_conf.udp_max_handler / 2, net_conf.udp_max_handler};
+        int frag_sizes[] = {64, 1472, 4000, 9000, 65000};
+        bench_t benches[64];
+        char names[64][48];
+        int n = 0;
+#define ADD(fmt, a, s, f)                                              \
+        do{                                                            \
+                snprintf(names[n], sizeof(names[n]), fmt, a);          \
+                benches[n] = (bench_t){names[n], s, f, a};             \
+                n++;                                                   \
+        }while(0)
+        for(int i = 0; i < 6; i++)
+                ADD("checksum16/%d", sizes[i], NULL, bench_checksum16);
+        ADD("udp_checksum/%d", 64, setup_udp_checksum, bench_udp_checksum);
+        ADD("udp_checksum/%d", 1472, setup_udp_checksum, bench_udp_checksum);
+        for(int i = 0; i < 3; i++)
+                if(arp_sizes[i] > 0){
+                        ADD("arp_lookup_hit/%d", arp_sizes[i], setup_arp_hit, bench_arp_lookup);
+                        ADD("arp_lookup_miss/%d", arp_sizes[i], setup_arp_miss, bench_arp_lookup);
+                        ADD("arp_update_existing/%d", arp_sizes[i], setup_arp_hit, bench_arp_update_existing);
+                }
+        ADD("arp_update_churn/%d", net_conf.arp_max_entry, arp_fill, bench_arp_update_churn);
+        for(int i = 0; i < 3; i++)
+                if(udp_sizes[i] > 0)
+                        ADD("udp_in/%d", udp_sizes[i], setup_udp_in, bench_udp_in);
+        ADD("udp_in_csum_valid/%d", 1, setup_udp_in_valid, bench_udp_in);
+        ADD("buf_init/%d", 1500, NULL, bench_buf_init);
+        ADD("buf_add_remove_header/%d", 20, NULL, bench_buf_header);
+        ADD("buf_copy/%d", 1500, NULL, bench_buf_copy);
+        for(int i = 0; i < 5; i++)
+                ADD("ip_out/%d", frag_sizes[i], setup_ip_out, bench_ip_out);
+        for(int i = 1; i < 5; i++){
+                ADD("udp_send/%d", frag_sizes[i] - 8, setup_udp_send, bench_udp_send);
+                ADD("udp_send_buf/%d", frag_sizes[i] - 8, setup_udp_send, bench_udp_send_buf);
+                ADD("udp_sendv/%d", frag_sizes[i] - 8, setup_udp_send, bench_udp_sendv);
+        }
+        ADD("iptos%.0d", 0, NULL, bench_iptos);
+        ADD("acl_filter/%d", 0, setup_acl, bench_acl);
+        ADD("acl_filter/%d", 4, setup_acl, bench_acl);
+        ADD("acl_filter/%d", ACL_MAX_RULE, setup_acl, bench_acl);
+#undef ADD
+
+        printf("cpu %d, %d rounds, arp_max_entry %d, udp_max_handler %d\n", cpu, reps, net_conf.arp_max_entry, net_conf.udp_max_handler);
+        const char *pages[] = {"4KB pages", "transparent hugepages", "2MB hugepages"};
+        size_t arena_used;
+        arena_page_t arena_page;
+        int arena_node;
+        size_t arena_size = arena_usage(&arena_used, &arena_page, &arena_node);
+        printf("arena %zu/%zu bytes, %s, numa node %d\n", arena_used, arena_size, pages[arena_page], arena_node);
+        printf("%-32s %10s %10s %10s %8s %10s\n", "ns/op", "min", "median", "mean", "stddev", "p90");
+        for(int i = 0; i < n; i++)
+                if(filter == NULL || strstr(benches[i].name, filter))
+                        run(benches[i].name, benches[i].setup, benches[i].fn, benches[i].arg);
+        if(csv)
+                fclose(csv);
+        return 0;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+#include "udp.h"
+
+/**
+ * @brief 两个协议栈实例的端到端基准测试
+ *        客户端与服务器各是一份完整的协议栈，经成对环回驱动相连，在同一线程交替轮询，
+ *        真实地交换ARP/IP/UDP报文。服务器与main.c一样把收到的UDP数据原样回送，
+ *        客户端保持window个未完成的请求，统计往返时间与吞吐量
+ *
+ *        用法: pair_bench [-n 请求数] [-s 负载字节数] [-w 窗口] [-m MTU]
+ *        窗口为1时测量的是单个请求的往返时间，窗口超过驱动队列长度时会丢包
+ *        -m同时设置两侧的MTU，负载字节数为0时取该MTU下不分片的最大值，
+ *        用不同的MTU比较每字节的开销，见Makefile中的bench_jumbo目标
+ */
+
+#define PAIR_SRV_PORT 60000
+#define PAIR_CLI_PORT 40000
+#define PAIR_MAX_SIZE (ETHERNET_MAX_MTU - 20 - 8)
+#define PAIR_TIMEOUT_SEC 1 //这么久没有收到回应则认为请求丢失
+
+// 两个实例的函数由objcopy加上cli_与srv_前缀
+int cli_conf_set(const char *key, const char *value);
+int srv_conf_set(const char *key, const char *value);
+int cli_net_init();
+void cli_net_poll();
+int cli_udp_open(uint16_t port, udp_handler_t handler);
+void cli_udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+int srv_net_init();
+void srv_net_poll();
+int srv_udp_open(uint16_t port, udp_handler_t handler);
+void srv_udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+
+static uint8_t srv_ip[NET_IP_LEN] = PAIR_SRV_IP;
+
+typedef struct req
+{
+        uint32_t seq;
+        uint64_t sent_ns;
+} req_t;
+
+static uint64_t *rtt;           //每个请求的往返时间
+static uint32_t replies, errors;
+static uint16_t size;
+static uint8_t payload[PAIR_MAX_SIZE];
+
+static uint64_t now_ns()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void echo_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        srv_udp_send(buf->data, buf->len, PAIR_SRV_PORT, src_ip, src_port);
+}
+
+static void reply_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        req_t req;
+        if(buf->len != size){
+                errors++;
+                return;
+        }
+        memcpy(&req, buf->data, sizeof(req));
+        rtt[replies++] = now_ns() - req.sent_ns;
+}
+
+static void send_req(uint32_t seq)
+{
+        req_t req = {seq, now_ns()};
+        memcpy(payload, &req, sizeof(req));
+        cli_udp_send(payload, size, PAIR_CLI_PORT, srv_ip, PAIR_SRV_PORT);
+}
+
+/**
+ * @brief 两侧各轮询一次，直到收到target个回应或超时
+ *
+ * @return int 收到为0，超时为-1
+ */
+static int wait_replies(uint32_t target)
+{
+        uint32_t last = replies;
+        uint64_t deadline = now_ns() + PAIR_TIMEOUT_SEC * 1000000000ull;
+        while(replies < target){
+                cli_net_poll();
+                srv_net_poll();
+                if(replies != last){
+                        last = replies;
+                        deadline = now_ns() + PAIR_TIMEOUT_SEC * 1000000000ull;
+                }
+                else if(now_ns() > deadline)
+                        return -1;
+        }
+        return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+        uint32_t count = 100000, window = 1;
+        int opt, mtu = ETHERNET_MTU;
+        size = 64;
+        while((opt = getopt(argc, argv, "n:s:w:m:")) != -1){
+                switch(opt){
+                case 'n': count = atoi(optarg); break;
+                case 's': size = atoi(optarg); break;
+                case 'w': window = atoi(optarg); break;
+                case 'm': mtu = atoi(optarg); break;
+                default:
+                        fprintf(stderr, "Usage: %s [-n requests] [-s size] [-w window] [-m mtu]\n", argv[0]);
+                        return 1;
+                }
+        }
+        char mtu_str[16];
+        snprintf(mtu_str, sizeof(mtu_str), "%d", mtu);
+        if(srv_conf_set("mtu", mtu_str) < 0 || cli_conf_set("mtu", mtu_str) < 0)
+                return 1;
+        // 协议栈不重组IP分片，请求必须放得进一个以太网帧
+        int max_size = mtu - 20 - 8;
+        if(size == 0)
+                size = max_size;
+        if(size < sizeof(req_t) || size > max_size || count == 0 || window == 0){
+                fprintf(stderr, "invalid arguments, size must be %d-%d\n", (int)sizeof(req_t), max_size);
+                return 1;
+        }
+        rtt = malloc((count + 1) * sizeof(uint64_t));
+
+        if(srv_net_init() < 0 || cli_net_init() < 0)
+                return 1;
+        srv_udp_open(PAIR_SRV_PORT, echo_handler);
+        cli_udp_open(PAIR_CLI_PORT, reply_handler);
+
+        // 第一个请求完成两侧的ARP解析，不计入结果
+        send_req(0);
+        if(wait_replies(1) < 0){
+                fprintf(stderr, "no reply from server\n");
+                return 1;
+        }
+        replies = 0;
+
+        uint32_t seq = 0;
+        uint64_t start = now_ns();
+        while(seq < count){
+                while(seq < count && seq - replies < window)
+                        send_req(++seq);
+                if(wait_replies(replies + 1) < 0)
+                        break;
+        }
+        if(seq == count)
+                wait_replies(count);
+        double elapsed = (now_ns() - start) / 1e9;
+
+        printf("%u/%u replies, mtu %d, %u bytes, window %u, %.3f s, %.0f req/s, %.1f MB/s each way, %.3f ns/byte, %u errors\n",
+               replies, count, mtu, size, window, elapsed, replies / elapsed, replies * (double)size / elapsed / 1e6,
+               elapsed * 1e9 / ((double)replies * size * 2), errors);
+        if(replies > 0){
+                qsort(rtt, replies, sizeof(uint64_t), cmp_u64);
+                printf("rtt ns: min %llu, median %llu, p99 %llu, max %llu\n",
+                       (unsigned long long)rtt[0], (unsigned long long)rtt[replies / 2],
+                       (unsigned long long)rtt[(uint32_t)(replies * 0.99)], (unsigned long long)rtt[replies - 1]);
+        }
+        return replies == count && errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "qos.h"
+#include "conf.h"
+#include "stats.h"
+#include "faker/mem_driver.h"
+
+// 优先级接收队列的行为测试：内存驱动按给定顺序返回构造的帧，检查分类、水位、挤出、预算与交付顺序，
+// 以及经过矢量处理图与优先级接收队列的udp批量交付
+#define QOS_TEST_QUEUE "16"     //水位50%为8帧，80%为12帧
+#define QOS_TEST_PRIO_PORT 7000
+#define QOS_TEST_BULK_PORT 9000
+#define QOS_TEST_BATCH_PORT 9100    //批量交付，合并同一来源的连续数据报
+#define QOS_TEST_NOMERGE_PORT 9200  //批量交付，不合并
+#define QOS_TEST_CONTROL_PORT 9300  //逐个交付，收到时执行control，在一次轮询的中途重新注册或关闭端口
+#define QOS_TEST_VECTOR "128"
+#define PAYLOAD_LEN(id) (4 + (id) % 3 * 2) //批量交付测试中各数据报的负载长度，检查各项的len
+#define QOS_TEST_MAX_FRAME 512
+#define QOS_TEST_FRAME_LEN 64
+
+static uint8_t peer_ip[NET_IP_LEN] = {10, 0, 0, 9};
+static uint8_t peer_mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 9};
+
+static uint8_t frame_data[QOS_TEST_MAX_FRAME][QOS_TEST_FRAME_LEN];
+static mem_frame_t frames[QOS_TEST_MAX_FRAME];
+static int frame_cnt;
+
+// 交付给udp处理程序的数据报，按交付顺序记录端口与负载中的编号
+static struct{
+        uint16_t port;
+        uint8_t id;
+} delivered[QOS_TEST_MAX_FRAME];
+static int delivered_cnt;
+static uint64_t icmp_rx_at_first; //第一个udp数据报交付时已处理的icmp帧
+
+static int bad;
+#define CHECK(cond, ...)                                       \
+        do{                                                    \
+                if(!(cond)){                                   \
+                        fprintf(stderr, "\e[1;31m");           \
+                        fprintf(stderr, __VA_ARGS__);          \
+                        fprintf(stderr, "\e[0m\n");            \
+                        bad++;                                 \
+                }                                              \
+        }while(0)
+
+/**
+ * @brief 追加一帧的以太网头部，返回其后的位置
+ */
+static uint8_t *frame_begin(const uint8_t *dest, uint16_t protocol, uint32_t len)
+{
+        uint8_t *p = frame_data[frame_cnt];
+        frames[frame_cnt].data = p;
+        frames[frame_cnt].len = len;
+        frame_cnt++;
+        ether_hdr_t *eth = (ether_hdr_t *)p;
+        memcpy(eth->dest, dest, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol = swap16(protocol);
+        return p + sizeof(ether_hdr_t);
+}
+
+/**
+ * @brief 追加一个发给本机的IP数据报，返回IP负载的位置
+ */
+static uint8_t *ip_begin(uint8_t protocol, uint16_t len, uint16_t frag)
+{
+        ip_hdr_t *ip = (ip_hdr_t *)frame_begin(net_if_mac, NET_PROTOCOL_IP, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + len);
+        memset(ip, 0, sizeof(ip_hdr_t));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + len);
+        ip->flags_fragment = swap16(frag);
+        ip->ttl = 64;
+        ip->protocol = protocol;
+        memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(ip->dest_ip, net_if_ip, NET_IP_LEN);
+        ip->hdr_checksum = checksum16((uint16_t *)ip, sizeof(ip_hdr_t));
+        return (uint8_t *)(ip + 1);
+}
+
+/**
+ * @brief 追加一个udp数据报，负载的第一个字节为编号
+ */
+static void add_udp_len(uint16_t src_port, uint16_t dest_port, uint8_t id, uint16_t frag, int payload)
+{
+        uint16_t len = sizeof(udp_hdr_t) + payload;
+        udp_hdr_t *udp = (udp_hdr_t *)ip_begin(NET_PROTOCOL_UDP, len, frag);
+        udp->src_port = swap16(src_port);
+        udp->dest_port = swap16(dest_port);
+        udp->total_len = swap16(len);
+        udp->checksum = 0;
+        uint8_t *data = (uint8_t *)(udp + 1);
+        memset(data, 0, payload);
+        data[0] = id;
+        udp_peso_hdr_t peso;
+        memcpy(peso.src_ip, peer_ip, NET_IP_LEN);
+        memcpy(peso.dest_ip, net_if_ip, NET_IP_LEN);
+        peso.placeholder = 0;
+        peso.protocol = NET_PROTOCOL_UDP;
+        peso.total_len = udp->total_len;
+        struct iovec iov[2] = {{&peso, sizeof(peso)}, {udp, len}};
+        udp->checksum = checksum16_iov(iov, 2);
+}
+
+static void add_udp(uint16_t src_port, uint16_t dest_port, uint8_t id, uint16_t frag)
+{
+        add_udp_len(src_port, dest_port, id, frag, 4);
+}
+
+static void add_icmp_echo(uint16_t seq)
+{
+        uint16_t len = sizeof(icmp_hdr_t) + 4;
+        icmp_hdr_t *icmp = (icmp_hdr_t *)ip_begin(NET_PROTOCOL_ICMP, len, 0);
+        memset(icmp, 0, len);
+        icmp->type = ICMP_TYPE_ECHO_REQUEST;
+        icmp->id = swap16(1);
+        icmp->seq = swap16(seq);
+        icmp->checksum = checksum16((uint16_t *)icmp, len);
+}
+
+static void add_arp_request()
+{
+        static const uint8_t broadcast[NET_MAC_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        arp_pkt_t *arp = (arp_pkt_t *)frame_begin(broadcast, NET_PROTOCOL_ARP, sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+        memset(arp, 0, sizeof(arp_pkt_t));
+        arp->hw_type = swap16(ARP_HW_ETHER);
+        arp->pro_type = swap16(NET_PROTOCOL_IP);
+        arp->hw_len = NET_MAC_LEN;
+        arp->pro_len = NET_IP_LEN;
+        arp->opcode = swap16(ARP_REQUEST);
+        memcpy(arp->sender_mac, peer_mac, NET_MAC_LEN);
+        memcpy(arp->sender_ip, peer_ip, NET_IP_LEN);
+        memcpy(arp->target_ip, net_if_ip, NET_IP_LEN);
+}
+
+static void add_tcp_syn()
+{
+        uint8_t *tcp = ip_begin(NET_PROTOCOL_TCP, 20, 0);
+        memset(tcp, 0, 20);
+}
+
+/**
+ * @brief 把已构造的帧交给内存驱动，下一组帧从头构造
+ */
+static void load()
+{
+        mem_driver_load(frames, frame_cnt);
+        frame_cnt = 0;
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        if(delivered_cnt == 0)
+                icmp_rx_at_first = stats_get(STATS_ICMP_RX_PKTS);
+        delivered[delivered_cnt].port = entry->port;
+        delivered[delivered_cnt].id = buf->data[0];
+        delivered_cnt++;
+}
+
+/**
+ * @brief 检查记录的交付顺序，expect中小于256的为优先端口的编号，其余减去256为普通端口的编号
+ */
+static void check_delivered(const char *name, const int *expect, int num)
+{
+        CHECK(delivered_cnt == num, "%s: %d datagrams delivered, expected %d", name, delivered_cnt, num);
+        for(int i = 0; i < num && i < delivered_cnt; i++){
+                uint16_t port = expect[i] < 256 ? QOS_TEST_PRIO_PORT : QOS_TEST_BULK_PORT;
+                CHECK(delivered[i].port == port && delivered[i].id == expect[i] % 256,
+                      "%s: datagram %d is port %u id %u, expected port %u id %d", name, i,
+                      delivered[i].port, delivered[i].id, port, expect[i] % 256);
+        }
+        delivered_cnt = 0;
+}
+
+/**
+ * @brief 与上次调用相比各计数器的增量
+ */
+static uint64_t stats_last[STATS_MAX];
+static void stats_delta(uint64_t *delta)
+{
+        uint64_t now[STATS_MAX];
+        stats_snapshot(now);
+        for(int i = 0; i < STATS_MAX; i++)
+                delta[i] = now[i] - stats_last[i];
+        memcpy(stats_last, now, sizeof(now));
+}
+
+static void test_classify()
+{
+        static const struct{
+                const char *name;
+                qos_class_t class;
+        } expect[] = {
+                {"arp", QOS_ARP},
+                {"icmp", QOS_ICMP},
+                {"tcp", QOS_TCP},
+                {"udp priority port", QOS_UDP_PRIO},
+                {"udp other port", QOS_BULK},
+                {"udp first fragment", QOS_UDP_PRIO},
+                {"udp later fragment", QOS_BULK},
+                {"ipv6", QOS_BULK},
+                {"runt", QOS_BULK},
+        };
+        add_arp_request();
+        add_icmp_echo(0);
+        add_tcp_syn();
+        add_udp(5000, QOS_TEST_PRIO_PORT, 0, 0);
+        add_udp(5000, QOS_TEST_BULK_PORT, 0, 0);
+        add_udp(5000, QOS_TEST_PRIO_PORT, 0, 0x2000); //MF位
+        add_udp(5000, QOS_TEST_PRIO_PORT, 0, 100); //后续分片的负载不是udp头部
+        frame_begin(net_if_mac, 0x86dd, 60);
+        frame_begin(net_if_mac, NET_PROTOCOL_IP, 10);
+        for(int i = 0; i < frame_cnt; i++){
+                buf_t buf;
+                buf_init(&buf, frames[i].len);
+                memcpy(buf.data, frames[i].data, frames[i].len);
+                qos_class_t c = qos_classify(&buf);
+                CHECK(c == expect[i].class, "classify %s: class %d, expected %d", expect[i].name, c, expect[i].class);
+        }
+        frame_cnt = 0;
+}
+
+/**
+ * @brief 每次轮询只处理一帧，让积压依次越过各类别的水位，最后队列满时挤掉普通帧
+ */
+static void test_watermark()
+{
+        uint64_t d[STATS_MAX];
+        net_conf.qos_budget = 1;
+        stats_delta(d);
+
+        // 普通帧在积压达到8时被丢弃，优先端口的帧仍能进入
+        for(int i = 0; i < 12; i++)
+                add_udp(5000, QOS_TEST_BULK_PORT, i, 0);
+        for(int i = 0; i < 4; i++)
+                add_udp(5000, QOS_TEST_PRIO_PORT, i, 0);
+        load();
+        CHECK(qos_poll() == 1, "watermark: budget 1 not honoured");
+        stats_delta(d);
+        CHECK(d[STATS_QOS_DROP_BULK] == 4, "low watermark: %lu bulk drops, expected 4", (unsigned long)d[STATS_QOS_DROP_BULK]);
+        CHECK(d[STATS_QOS_DROP_UDP_PRIO] == 0, "low watermark: priority udp dropped");
+        CHECK(stats_get(STATS_QOS_BACKLOG) == 11, "low watermark: backlog %lu, expected 11", (unsigned long)stats_get(STATS_QOS_BACKLOG));
+
+        // 优先端口的帧在积压达到12时被丢弃
+        for(int i = 4; i < 8; i++)
+                add_udp(5000, QOS_TEST_PRIO_PORT, i, 0);
+        load();
+        qos_poll();
+        stats_delta(d);
+        CHECK(d[STATS_QOS_DROP_UDP_PRIO] == 3, "high watermark: %lu priority drops, expected 3", (unsigned long)d[STATS_QOS_DROP_UDP_PRIO]);
+        CHECK(d[STATS_QOS_DROP_BULK] == 0, "high watermark: bulk dropped");
+
+        // arp与icmp直到队列满，满后挤掉最新的普通帧；没有更低的类别时丢弃新到的普通帧
+        for(int i = 0; i < 4; i++)
+                add_icmp_echo(i);
+        add_arp_request();
+        add_icmp_echo(4);
+        add_udp(5000, QOS_TEST_PRIO_PORT, 8, 0);
+        add_udp(5000, QOS_TEST_BULK_PORT, 12, 0);
+        load();
+        qos_poll();
+        stats_delta(d);
+        CHECK(d[STATS_QOS_DROP_ARP] == 0 && d[STATS_QOS_DROP_ICMP] == 0, "push-out: arp or icmp dropped");
+        CHECK(d[STATS_QOS_DROP_UDP_PRIO] == 0, "push-out: priority udp dropped with bulk frames queued");
+        CHECK(d[STATS_QOS_DROP_BULK] == 3, "push-out: %lu bulk drops, expected 3", (unsigned long)d[STATS_QOS_DROP_BULK]);
+        CHECK(d[STATS_ARP_RX_PKTS] == 1 && d[STATS_ICMP_RX_PKTS] == 0, "push-out: arp not processed first");
+        static const int first[] = {0, 1}; //前两次轮询各处理了一个优先端口的帧
+        check_delivered("watermark", first, 2);
+
+        // 剩下的按类别顺序交付，被挤掉的是最新的普通帧6与7
+        net_conf.qos_budget = 16;
+        qos_poll();
+        static const int expect[] = {2, 3, 4, 8, 256, 257, 258, 259, 260, 261};
+        CHECK(icmp_rx_at_first - stats_last[STATS_ICMP_RX_PKTS] == 5, "priority: icmp not processed before udp");
+        check_delivered("priority", expect, sizeof(expect) / sizeof(expect[0]));
+        CHECK(stats_get(STATS_QOS_BACKLOG) == 0, "priority: backlog left");
+        stats_delta(d);
+}
+
+/**
+ * @brief 超过预算的帧留在队列中，下次轮询按原来的顺序继续处理
+ */
+static void test_budget()
+{
+        uint64_t d[STATS_MAX];
+        net_conf.qos_budget = 4;
+        stats_delta(d);
+        for(int i = 0; i < 10; i++)
+                add_udp(5000, QOS_TEST_PRIO_PORT, 20 + i, 0);
+        load();
+        static const int done[] = {4, 4, 2, 0};
+        static const uint64_t backlog[] = {6, 2, 0, 0};
+        for(int i = 0; i < 4; i++){
+                int n = qos_poll();
+                CHECK(n == done[i], "budget: poll %d processed %d, expected %d", i, n, done[i]);
+                CHECK(stats_get(STATS_QOS_BACKLOG) == backlog[i], "budget: poll %d backlog %lu, expected %lu", i,
+                      (unsigned long)stats_get(STATS_QOS_BACKLOG), (unsigned long)backlog[i]);
+        }
+        stats_delta(d);
+        CHECK(d[STATS_QOS_BUDGET_EXHAUSTED] == 2, "budget: exhausted %lu times, expected 2", (unsigned long)d[STATS_QOS_BUDGET_EXHAUSTED]);
+        CHECK(d[STATS_QOS_DROP_UDP_PRIO] == 0, "budget: frames dropped");
+        int expect[10];
+        for(int i = 0; i < 10; i++)
+                expect[i] = 20 + i;
+        check_delivered("budget", expect, 10);
+}
+
+/**
+ * @brief 普通udp持续过载时，夹在其中的arp请求与ping仍得到处理和回应
+ */
+static void test_flood()
+{
+        uint64_t d[STATS_MAX];
+        net_conf.qos_budget = 4;
+        stats_delta(d);
+        for(int i = 0; i < 300; i++){
+                if(i == 100)
+                        add_arp_request();
+                else if(i == 200)
+                        add_icmp_echo(100);
+                else
+                        add_udp(5000, QOS_TEST_BULK_PORT, i % 256, 0);
+        }
+        load();
+        uint64_t sent = mem_sent_pkts;
+        while(mem_driver_pending() || stats_get(STATS_QOS_BACKLOG))
+                net_poll();
+        stats_delta(d);
+        CHECK(d[STATS_QOS_DROP_BULK] > 0, "flood: no bulk frame dropped, the queue was not overloaded");
+        CHECK(d[STATS_QOS_DROP_ARP] == 0 && d[STATS_QOS_DROP_ICMP] == 0, "flood: arp or icmp dropped");
+        CHECK(d[STATS_ARP_RX_PKTS] == 1 && d[STATS_ARP_TX_PKTS] == 1, "flood: arp request not answered");
+        CHECK(d[STATS_ICMP_RX_PKTS] == 1 && d[STATS_ICMP_TX_PKTS] == 1, "flood: ping not answered");
+        CHECK(mem_sent_pkts - sent == 2, "flood: %lu frames sent, expected 2", (unsigned long)(mem_sent_pkts - sent));
+        CHECK(delivered_cnt + d[STATS_QOS_DROP_BULK] == 298, "flood: %d delivered and %lu dropped of 298", delivered_cnt,
+              (unsigned long)d[STATS_QOS_DROP_BULK]);
+        delivered_cnt = 0;
+}
+
+// 批量处理程序收到的各项，按交付顺序记录
+typedef struct batch_rec
+{
+        int call;               //第几次调用批量处理程序
+        int handler;            //1为batch_a，2为batch_b
+        uint16_t port, src_port;
+        uint8_t src_host;       //源ip的最后一个字节
+        int seg_num;
+        uint32_t len;
+        uint8_t id[BUF_MAX_SEG];
+} batch_rec_t;
+static batch_rec_t batch_recs[QOS_TEST_MAX_FRAME];
+static int batch_rec_cnt, batch_call_cnt;
+static void (*control)();
+
+/**
+ * @brief 期望的一项：first起seg_num个编号连续的数据报
+ */
+typedef struct batch_expect
+{
+        int call, handler;
+        uint16_t port, src_port;
+        uint8_t src_host;
+        int first, seg_num;
+} batch_expect_t;
+
+static void batch_record(int handler, udp_entry_t *entry, udp_dgram_t *dgram, int num)
+{
+        for(int i = 0; i < num; i++){
+                batch_rec_t *r = &batch_recs[batch_rec_cnt++];
+                r->call = batch_call_cnt;
+                r->handler = handler;
+                r->port = entry->port;
+                r->src_port = dgram[i].src_port;
+                r->src_host = dgram[i].src_ip[NET_IP_LEN - 1];
+                r->seg_num = dgram[i].seg_num;
+                r->len = dgram[i].len;
+                uint32_t sum = 0;
+                for(int j = 0; j < dgram[i].seg_num; j++){
+                        r->id[j] = dgram[i].seg[j]->data[0]; //交付时各数据报的缓冲区还没有被重用
+                        sum += dgram[i].seg[j]->len;
+                }
+                CHECK(sum == dgram[i].len, "batch: entry len %u is not the sum %u of its datagrams", dgram[i].len, sum);
+        }
+        batch_call_cnt++;
+}
+
+static void batch_a(udp_entry_t *entry, udp_dgram_t *dgram, int num)
+{
+        batch_record(1, entry, dgram, num);
+}
+
+static void batch_b(udp_entry_t *entry, udp_dgram_t *dgram, int num)
+{
+        batch_record(2, entry, dgram, num);
+}
+
+static void control_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        control();
+}
+
+static void reopen_nomerge()
+{
+        CHECK(udp_open_batch(QOS_TEST_BATCH_PORT, batch_b, 0) == 0, "handover: re-registration failed");
+}
+
+static void close_batch()
+{
+        udp_close(QOS_TEST_BATCH_PORT);
+}
+
+/**
+ * @brief 交给内存驱动并轮询到全部处理完，每次轮询的最后由udp_flush()交付积压的批
+ */
+static void poll_all()
+{
+        load();
+        while(mem_driver_pending() || stats_get(STATS_QOS_BACKLOG))
+                net_poll();
+}
+
+static void check_batches(const char *name, const batch_expect_t *expect, int num)
+{
+        CHECK(batch_rec_cnt == num, "%s: %d entries delivered, expected %d", name, batch_rec_cnt, num);
+        for(int i = 0; i < num && i < batch_rec_cnt; i++){
+                const batch_rec_t *r = &batch_recs[i];
+                const batch_expect_t *e = &expect[i];
+                uint32_t len = 0;
+                for(int j = 0; j < e->seg_num; j++)
+                        len += PAYLOAD_LEN(e->first + j);
+                CHECK(r->call == e->call && r->handler == e->handler && r->port == e->port && r->src_port == e->src_port &&
+                      r->src_host == e->src_host && r->seg_num == e->seg_num && r->len == len,
+                      "%s: entry %d is call %d handler %d port %u from .%u:%u, %d datagrams %u bytes; "
+                      "expected call %d handler %d port %u from .%u:%u, %d datagrams %u bytes", name, i,
+                      r->call, r->handler, r->port, r->src_host, r->src_port, r->seg_num, r->len,
+                      e->call, e->handler, e->port, e->src_host, e->src_port, e->seg_num, len);
+                for(int j = 0; j < r->seg_num && j < e->seg_num; j++)
+                        CHECK(r->id[j] == e->first + j, "%s: entry %d datagram %d is %u, expected %d", name, i, j, r->id[j], e->first + j);
+        }
+        batch_rec_cnt = batch_call_cnt = 0;
+}
+
+/**
+ * @brief 同一来源的连续数据报合并为一项，至多BUF_MAX_SEG个；来源改变时另起一项；
+ *        各端口的批互不影响，不合并的端口每个数据报一项
+ */
+static void test_batch_coalesce()
+{
+        for(int i = 0; i < 10; i++){
+                add_udp_len(5000, QOS_TEST_BATCH_PORT, i, 0, PAYLOAD_LEN(i));
+                if(i == 1)
+                        add_udp_len(5000, QOS_TEST_NOMERGE_PORT, 20, 0, PAYLOAD_LEN(20));
+        }
+        add_udp_len(5001, QOS_TEST_BATCH_PORT, 10, 0, PAYLOAD_LEN(10));
+        add_udp_len(5001, QOS_TEST_BATCH_PORT, 11, 0, PAYLOAD_LEN(11));
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 12, 0, PAYLOAD_LEN(12));
+        peer_ip[NET_IP_LEN - 1] = 8;
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 13, 0, PAYLOAD_LEN(13));
+        peer_ip[NET_IP_LEN - 1] = 9;
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 14, 0, PAYLOAD_LEN(14));
+        add_udp_len(5000, QOS_TEST_NOMERGE_PORT, 21, 0, PAYLOAD_LEN(21));
+        add_udp_len(5000, QOS_TEST_NOMERGE_PORT, 22, 0, PAYLOAD_LEN(22));
+        poll_all();
+        static const batch_expect_t expect[] = {
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 0, BUF_MAX_SEG},
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 8, 2},
+                {0, 1, QOS_TEST_BATCH_PORT, 5001, 9, 10, 2},
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 12, 1},
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 8, 13, 1},
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 14, 1},
+                {1, 2, QOS_TEST_NOMERGE_PORT, 5000, 9, 20, 1},
+                {1, 2, QOS_TEST_NOMERGE_PORT, 5000, 9, 21, 1},
+                {1, 2, QOS_TEST_NOMERGE_PORT, 5000, 9, 22, 1},
+        };
+        check_batches("coalesce", expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+/**
+ * @brief 一批积压到UDP_BATCH_MAX项时在轮询中途提前交付，其余的在udp_flush()时交付
+ */
+static void test_batch_early()
+{
+        int n = UDP_BATCH_MAX + 6;
+        batch_expect_t expect[UDP_BATCH_MAX + 6];
+        for(int i = 0; i < n; i++){
+                add_udp_len(5000, QOS_TEST_NOMERGE_PORT, i, 0, PAYLOAD_LEN(i));
+                expect[i] = (batch_expect_t){i >= UDP_BATCH_MAX, 2, QOS_TEST_NOMERGE_PORT, 5000, 9, i, 1};
+        }
+        poll_all();
+        check_batches("early delivery", expect, n);
+}
+
+/**
+ * @brief 轮询中途重新注册时，已经积压的交给原来的处理程序，之后的交给新的处理程序
+ */
+static void test_batch_handover()
+{
+        control = reopen_nomerge;
+        for(int i = 0; i < 3; i++)
+                add_udp_len(5000, QOS_TEST_BATCH_PORT, i, 0, PAYLOAD_LEN(i));
+        add_udp(5000, QOS_TEST_CONTROL_PORT, 0, 0);
+        for(int i = 3; i < 5; i++)
+                add_udp_len(5000, QOS_TEST_BATCH_PORT, i, 0, PAYLOAD_LEN(i));
+        poll_all();
+        static const batch_expect_t expect[] = {
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 0, 3},
+                {1, 2, QOS_TEST_BATCH_PORT, 5000, 9, 3, 1},
+                {1, 2, QOS_TEST_BATCH_PORT, 5000, 9, 4, 1},
+        };
+        check_batches("handover", expect, sizeof(expect) / sizeof(expect[0]));
+        CHECK(udp_open_batch(QOS_TEST_BATCH_PORT, batch_a, 1) == 0, "handover: restoring the handler failed");
+}
+
+/**
+ * @brief 轮询中途关闭端口时积压的数据报被丢弃，之后到达的视为端口不存在
+ */
+static void test_batch_close()
+{
+        uint64_t d[STATS_MAX];
+        control = close_batch;
+        stats_delta(d);
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 0, 0, PAYLOAD_LEN(0));
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 1, 0, PAYLOAD_LEN(1));
+        add_udp(5000, QOS_TEST_CONTROL_PORT, 0, 0);
+        add_udp_len(5000, QOS_TEST_BATCH_PORT, 2, 0, PAYLOAD_LEN(2));
+        poll_all();
+        stats_delta(d);
+        check_batches("close", NULL, 0);
+        CHECK(d[STATS_UDP_DROP_NO_PORT] == 1, "close: %lu datagrams to the closed port, expected 1", (unsigned long)d[STATS_UDP_DROP_NO_PORT]);
+        CHECK(udp_open_batch(QOS_TEST_BATCH_PORT, batch_a, 1) == 0, "close: the batch slot was not released");
+}
+
+/**
+ * @brief 经过优先级接收队列：优先端口的帧先交付，批在每次轮询的最后交付，预算用完时分成两次轮询的两批
+ */
+static void test_batch_qos()
+{
+        net_conf.qos_budget = 16;
+        for(int i = 0; i < 6; i++){
+                add_udp_len(5000, QOS_TEST_BATCH_PORT, i, 0, PAYLOAD_LEN(i));
+                if(i == 2)
+                        add_udp(5000, QOS_TEST_PRIO_PORT, 30, 0);
+        }
+        poll_all();
+        static const int prio[] = {30};
+        check_delivered("qos batch", prio, 1);
+        static const batch_expect_t one[] = {
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 0, 6},
+        };
+        check_batches("qos batch", one, 1);
+
+        net_conf.qos_budget = 4;
+        for(int i = 6; i < 12; i++)
+                add_udp_len(5000, QOS_TEST_BATCH_PORT, i, 0, PAYLOAD_LEN(i));
+        poll_all();
+        static const batch_expect_t two[] = {
+                {0, 1, QOS_TEST_BATCH_PORT, 5000, 9, 6, 4},
+                {1, 1, QOS_TEST_BATCH_PORT, 5000, 9, 10, 2},
+        };
+        check_batches("qos budget batch", two, 2);
+}
+
+int main()
+{
+        char port[8];
+        snprintf(port, sizeof(port), "%d", QOS_TEST_PRIO_PORT);
+        if(conf_set("qos_queue", QOS_TEST_QUEUE) < 0 || conf_set("qos_budget_us", "0") < 0 ||
+           conf_set("vector_size", QOS_TEST_VECTOR) < 0 ||
+           conf_set("qos_low_watermark", "50") < 0 || conf_set("qos_high_watermark", "80") < 0 ||
+           conf_set("qos_udp_port", port) < 0)
+                return 1;
+        if(net_init() < 0)
+                return 1;
+        udp_open(QOS_TEST_PRIO_PORT, handler);
+        udp_open(QOS_TEST_BULK_PORT, handler);
+        udp_open_batch(QOS_TEST_BATCH_PORT, batch_a, 1);
+        udp_open_batch(QOS_TEST_NOMERGE_PORT, batch_b, 0);
+        udp_open(QOS_TEST_CONTROL_PORT, control_handler);
+
+        printf("\e[0;34mTest qos begin.\n");
+        // 逐包处理
+        int qos_queue = net_conf.qos_queue;
+        net_conf.vector_size = 0;
+        test_classify();
+        test_watermark();
+        test_budget();
+        test_flood();
+
+        // 不经过优先级接收队列，由graph_poll()一次收取至多128帧
+        net_conf.qos_queue = 0;
+        net_conf.vector_size = atoi(QOS_TEST_VECTOR);
+        test_batch_coalesce();
+        test_batch_early();
+        test_batch_handover();
+        test_batch_close();
+
+        // 经过优先级接收队列，按优先级顺序取出的帧每8个组成一个矢量
+        net_conf.qos_queue = qos_queue;
+        net_conf.vector_size = 8;
+        test_batch_qos();
+        net_close();
+        if(bad){
+                printf("\e[1;31m====> %d qos checks failed.\n\e[0m", bad);
+                return 1;
+        }
+        printf("\e[1;32m====> All qos checks passed.\n\e[0m");
+        return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "driver.h"
+#include "faker/tun.h"
+
+// TAP多队列的行为测试：假的/dev/net/tun把每个打开的fd当作一个队列，
+// 检查driver_recv()轮流读取各队列、回复从收到请求的队列发出，以及driver_select_queue()固定队列
+static uint8_t peer_mac[NET_MAC_LEN] = {2, 0, 0, 0, 0, 9};
+
+static int bad;
+#define CHECK(cond, ...)                                       \
+        do{                                                    \
+                if(!(cond)){                                   \
+                        fprintf(stderr, "\e[1;31m");           \
+                        fprintf(stderr, __VA_ARGS__);          \
+                        fprintf(stderr, "\e[0m\n");            \
+                        bad++;                                 \
+                }                                              \
+        }while(0)
+
+/**
+ * @brief 向队列放入一个询问本机mac地址的arp请求，发送方的ip最后一字节为host
+ */
+static void push_arp_request(int queue, uint8_t host)
+{
+        uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_pkt_t)];
+        ether_hdr_t *eth = (ether_hdr_t *)frame;
+        memset(eth->dest, 0xff, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol = swap16(NET_PROTOCOL_ARP);
+        arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+        memset(arp, 0, sizeof(arp_pkt_t));
+        arp->hw_type = swap16(ARP_HW_ETHER);
+        arp->pro_type = swap16(NET_PROTOCOL_IP);
+        arp->hw_len = NET_MAC_LEN;
+        arp->pro_len = NET_IP_LEN;
+        arp->opcode = swap16(ARP_REQUEST);
+        memcpy(arp->sender_mac, peer_mac, NET_MAC_LEN);
+        uint8_t ip[NET_IP_LEN] = {10, 0, 0, host};
+        memcpy(arp->sender_ip, ip, NET_IP_LEN);
+        memcpy(arp->target_ip, net_if_ip, NET_IP_LEN);
+        tun_faker_push(queue, frame, sizeof(frame));
+}
+
+/**
+ * @brief 发给host的arp回复所在的队列，没有发送时为-1
+ */
+static int reply_queue(uint8_t host)
+{
+        for(int i = 0; i < tun_sent_cnt; i++){
+                arp_pkt_t *arp = (arp_pkt_t *)(tun_sent[i].data + sizeof(ether_hdr_t));
+                if(tun_sent[i].len >= sizeof(ether_hdr_t) + sizeof(arp_pkt_t) &&
+                   arp->opcode == swap16(ARP_REPLY) && arp->target_ip[3] == host)
+                        return tun_sent[i].queue;
+        }
+        return -1;
+}
+
+static void poll_times(int n)
+{
+        for(int i = 0; i < n; i++)
+                net_poll();
+}
+
+/**
+ * @brief 只有部分队列有帧时，空的队列不妨碍读取，回复从请求所在的队列发出
+ */
+static void test_sparse()
+{
+        tun_faker_reset();
+        push_arp_request(1, 11);
+        push_arp_request(3, 13);
+        poll_times(DRIVER_TAP_QUEUES);
+        CHECK(tun_read_cnt == 2, "sparse: read %d frames, expected 2", tun_read_cnt);
+        CHECK(reply_queue(11) == 1, "sparse: reply to the request on queue 1 sent on queue %d", reply_queue(11));
+        CHECK(reply_queue(13) == 3, "sparse: reply to the request on queue 3 sent on queue %d", reply_queue(13));
+}
+
+/**
+ * @brief 多个队列都有积压时轮流读取，一个队列不会饿死其它队列
+ */
+static void test_round_robin()
+{
+        tun_faker_reset();
+        for(int i = 0; i < 3; i++){
+                push_arp_request(0, 20 + i);
+                push_arp_request(2, 30 + i);
+        }
+        poll_times(6);
+        CHECK(tun_read_cnt == 6, "round robin: read %d frames, expected 6", tun_read_cnt);
+        for(int i = 1; i < tun_read_cnt; i++)
+                CHECK(tun_read_order[i] != tun_read_order[i - 1], "round robin: frames %d and %d both read from queue %d",
+                      i - 1, i, tun_read_order[i]);
+        for(int i = 0; i < 3; i++){
+                CHECK(reply_queue(20 + i) == 0, "round robin: reply %d sent on queue %d, expected 0", i, reply_queue(20 + i));
+                CHECK(reply_queue(30 + i) == 2, "round robin: reply %d sent on queue %d, expected 2", i, reply_queue(30 + i));
+        }
+}
+
+/**
+ * @brief 固定到一个队列后只从这个队列收发
+ */
+static void test_select_queue()
+{
+        tun_faker_reset();
+        CHECK(driver_select_queue(DRIVER_TAP_QUEUES) < 0, "select: queue %d out of range accepted", DRIVER_TAP_QUEUES);
+        CHECK(driver_select_queue(2) == 0, "select: queue 2 rejected");
+        push_arp_request(1, 41);
+        push_arp_request(2, 42);
+        poll_times(DRIVER_TAP_QUEUES);
+        CHECK(tun_faker_pending(1) == 1, "select: queue 1 read although the thread is bound to queue 2");
+        CHECK(reply_queue(42) == 2, "select: reply sent on queue %d, expected 2", reply_queue(42));
+}
+
+int main()
+{
+        if(net_init() < 0)
+                return 1;
+        printf("\e[0;34mTest tap queues begin.\n");
+        test_sparse();
+        test_round_robin();
+        test_select_queue();
+        net_close();
+        if(bad){
+                printf("\e[1;31m====> %d tap queue checks failed.\n\e[0m", bad);
+                return 1;
+        }
+        printf("\e[1;32m====> All tap queue checks passed.\n\e[0m");
+        return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "tcp.h"
+#include "driver.h"
+#include "latency.h"
+
+#define BENCH_PORT 9000
+#define BENCH_CLIENT_PORT 40000
+
+static uint64_t total;          //要传输的字节数
+static uint64_t sent, received;
+static uint32_t pattern;        //接收方校验数据顺序
+static int errors, done;
+static tcp_conn_t *client;
+
+static double now_sec()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 直接写入发送缓冲区，数据为递增的字节序列
+static void fill(tcp_conn_t *conn)
+{
+        uint32_t len;
+        uint8_t *p;
+        while(sent < total && (p = tcp_send_buf(conn, &len)) != NULL && len > 0){
+                if(len > total - sent)
+                        len = total - sent;
+                for(uint32_t i = 0; i < len; i++)
+                        p[i] = (uint8_t)(sent + i);
+                sent += len;
+                tcp_send_commit(conn, len);
+        }
+        if(sent == total)
+                tcp_close(conn);
+}
+
+static void client_handler(tcp_conn_t *conn, tcp_event_t event)
+{
+        if(event == TCP_EVENT_CONNECTED || event == TCP_EVENT_SEND)
+                fill(conn);
+        else if(event == TCP_EVENT_RESET)
+                done = -1;
+}
+
+// 直接从接收缓冲区读取并校验
+static void server_handler(tcp_conn_t *conn, tcp_event_t event)
+{
+        uint32_t len;
+        uint8_t *p;
+        if(event == TCP_EVENT_ACCEPT)
+                tcp_accept(BENCH_PORT);
+        while((p = tcp_recv_buf(conn, &len)) != NULL && len > 0){
+                for(uint32_t i = 0; i < len; i++)
+                        if(p[i] != (uint8_t)(pattern++))
+                                errors++;
+                received += len;
+                tcp_recv_consume(conn, len);
+        }
+        if(event == TCP_EVENT_CLOSE){
+                tcp_close(conn);
+                done = 1;
+        }
+        else if(event == TCP_EVENT_RESET)
+                done = -1;
+}
+
+int main(int argc, char const *argv[])
+{
+        total = (argc > 1 ? strtoull(argv[1], NULL, 10) : 256) << 20;
+        if(net_init() < 0)
+                return 1;
+        tcp_listen(BENCH_PORT, 4, server_handler);
+
+        double start = now_sec();
+        client = tcp_connect(BENCH_CLIENT_PORT, net_if_ip, BENCH_PORT, client_handler);
+        while(!done && now_sec() - start < 60)
+                net_poll();
+        double elapsed = now_sec() - start;
+
+        printf("transferred %llu/%llu bytes in %.3f s, %.1f MB/s, %d errors%s\n",
+               (unsigned long long)received, (unsigned long long)total, elapsed,
+               received / elapsed / 1e6, errors, done == 1 ? "" : ", incomplete");
+#ifdef LATENCY_ENABLE
+        latency_report(stdout);
+#endif
+        driver_close();
+        return done == 1 && received == total && errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "tcp.h"
+
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *pcap_demo;
+extern FILE *control_flow;
+extern FILE *udp_fout;
+extern FILE *demo_log;
+extern FILE *out_log;
+extern FILE *arp_log_f;
+
+char* print_ip(uint8_t *ip);
+
+int check_log();
+int check_pcap();
+
+#define TCP_TEST_PORT 80            //被动打开的监听端口
+#define TCP_TEST_CONNECT_PORT 1234  //主动打开的本地端口
+
+// 每个用例对应data/下的一个目录，connect_round不为0时在该轮之后主动连接对方的connect_port
+static const struct {
+        const char *name;
+        int connect_round;
+        uint16_t connect_port;
+} cases[] = {
+        {"tcp_handshake", 1, 5678},
+        {"tcp_data", 0, 0},
+        {"tcp_rst", 0, 0},
+        {"tcp_fin", 0, 0},
+        {"tcp_persist", 0, 0},
+};
+
+uint8_t peer_ip[] = {192,168,163,10};
+
+static const char *event_name[] = {
+        [TCP_EVENT_ACCEPT] "accept",
+        [TCP_EVENT_CONNECTED] "connected",
+        [TCP_EVENT_RECV] "recv",
+        [TCP_EVENT_SEND] "send",
+        [TCP_EVENT_CLOSE] "close",
+        [TCP_EVENT_RESET] "reset",
+        [TCP_EVENT_CLOSED] "closed",
+};
+
+static const char *state_name[] = {
+        [TCP_CLOSED] "CLOSED",
+        [TCP_LISTEN] "LISTEN",
+        [TCP_SYN_SENT] "SYN_SENT",
+        [TCP_SYN_RCVD] "SYN_RCVD",
+        [TCP_ESTABLISHED] "ESTABLISHED",
+        [TCP_FIN_WAIT_1] "FIN_WAIT_1",
+        [TCP_FIN_WAIT_2] "FIN_WAIT_2",
+        [TCP_CLOSE_WAIT] "CLOSE_WAIT",
+        [TCP_CLOSING] "CLOSING",
+        [TCP_LAST_ACK] "LAST_ACK",
+        [TCP_TIME_WAIT] "TIME_WAIT",
+};
+
+// 假时钟：每轮前进100ms，使ISN与定时器在每次运行时都相同
+static long fake_ms;
+int clock_gettime(clockid_t clk, struct timespec *ts)
+{
+        ts->tv_sec = fake_ms / 1000;
+        ts->tv_nsec = fake_ms % 1000 * 1000000;
+        return 0;
+}
+
+// 回显应用：接受连接，把收到的数据原样发回，对方关闭后也关闭
+void handler(tcp_conn_t *conn, tcp_event_t event)
+{
+        fprintf(control_flow,"tcp event:\t%s\tport:%d->%d\tstate:%s\n",event_name[event],
+                conn->remote_port,conn->local_port,state_name[conn->state]);
+        if(event == TCP_EVENT_ACCEPT){
+                tcp_conn_t *c = tcp_accept(TCP_TEST_PORT);
+                fprintf(control_flow,"tcp accept:\t%s:%d\n",print_ip(c->remote_ip),c->remote_port);
+        }else if(event == TCP_EVENT_RECV){
+                uint8_t data[256];
+                int len = tcp_recv(conn,data,sizeof(data));
+                fprintf(control_flow,"tcp recv:\t%d bytes\n",len);
+                tcp_send(conn,data,len);
+        }else if(event == TCP_EVENT_CLOSE){
+                tcp_close(conn);
+        }
+}
+
+buf_t buf;
+int main(int argc, char *argv[]){
+        int ret;
+        char path[64];
+        if(argc != 2){
+                printf("\e[1;31mUsage: %s <case>\n",argv[0]);
+                return 0;
+        }
+        const char *name = argv[1];
+        int c = 0;
+        while(c < sizeof(cases) / sizeof(cases[0]) && strcmp(cases[c].name,name))
+                c++;
+        if(c == sizeof(cases) / sizeof(cases[0])){
+                printf("\e[1;31mUnknown case %s\n",name);
+                return 0;
+        }
+        printf("\e[0;34mTest %s begin.\n",name);
+        sprintf(path,"data/%s/in.pcap",name);
+        pcap_in = fopen(path,"r");
+        sprintf(path,"data/%s/out.pcap",name);
+        pcap_out = fopen(path,"w");
+        sprintf(path,"data/%s/log",name);
+        control_flow = fopen(path,"w");
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                if(pcap_in) fclose(pcap_in); else printf("\e[1;31mFailed to open in.pcap\n");
+                if(pcap_out)fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n");
+                if(control_flow) fclose(control_flow); else printf("\e[1;31mFailed to open log\n");
+                return 0;
+        }
+        udp_fout = control_flow;
+        arp_log_f = control_flow;
+
+        if(ethernet_init()){
+                fprintf(stderr,"\e[1;31mDriver open failed,exiting\n");
+                fclose(pcap_in);
+                fclose(pcap_out);
+                fclose(control_flow);
+                return 0;
+        }
+        arp_init();
+        tcp_init();
+        tcp_listen(TCP_TEST_PORT,TCP_MAX_BACKLOG,handler);
+        int i = 1;
+        printf("\e[0;34mFeeding input %02d",i);
+        while((ret = driver_recv(&buf)) > 0){
+                printf("\b\b%02d",i);
+                fake_ms += 100;
+                fprintf(control_flow,"\nRound %02d -----------------------------\n",i);
+                ethernet_in(&buf);
+                tcp_poll();
+                if(i++ == cases[c].connect_round){
+                        tcp_conn_t *conn = tcp_connect(TCP_TEST_CONNECT_PORT,peer_ip,cases[c].connect_port,handler);
+                        fprintf(control_flow,"tcp connect:\t%s:%d\tstate:%s\n",print_ip(peer_ip),
+                                cases[c].connect_port,conn ? state_name[conn->state] : "(failed)");
+                }
+        }
+        if(ret < 0){
+                fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
+        }
+        driver_close();
+        printf("\e[0;34m\nSample input all processed, checking output\n");
+
+        fclose(control_flow);
+
+        sprintf(path,"data/%s/demo_log",name);
+        demo_log = fopen(path,"r");
+        sprintf(path,"data/%s/log",name);
+        out_log = fopen(path,"r");
+        sprintf(path,"data/%s/out.pcap",name);
+        pcap_out = fopen(path,"r");
+        sprintf(path,"data/%s/demo_out.pcap",name);
+        pcap_demo = fopen(path,"r");
+        if(demo_log == 0 || out_log == 0 || pcap_out == 0 || pcap_demo == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n\e[0m");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n\e[0m");
+                if(pcap_demo) fclose(pcap_demo); else printf("\e[1;31mFailed to open demo_out.pcap\n\e[0m");
+                if(pcap_out) fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n\e[0m");
+                return 0;
+        }
+        check_log();
+        check_pcap();
+        printf("\e[1;33mFor this test, log is only a reference. Your implementation is OK if your pcap file is the same to the demo pcap file.\n");
+        fclose(demo_log);
+        fclose(out_log);
+        return 0;
+}
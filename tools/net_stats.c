@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+/**
+ * @brief 读取协议栈导出的统计快照
+ *        用法: net_stats [-n 共享内存名] [-i 刷新间隔(毫秒)] [-a]
+ *        指定-i时每次输出与上一次的差值，-a时同时输出为0的计数器
+ */
+
+/**
+ * @brief 按序列锁读取一份完整的快照
+ *
+ * @param shm 共享内存
+ * @param counter 读取结果
+ * @return uint64_t 快照时间(毫秒)
+ */
+static uint64_t read_snapshot(const stats_shm_t *shm, uint64_t *counter)
+{
+    for (;;)
+    {
+        uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            usleep(100);
+            continue;
+        }
+        uint64_t time = shm->time_ms;
+        for (int i = 0; i < STATS_MAX; i++)
+            counter[i] = __atomic_load_n(&shm->counter[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+            return time;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = STATS_SHM_NAME;
+    int interval = 0, all = 0, opt;
+    while ((opt = getopt(argc, argv, "n:i:a")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 'a':
+            all = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n shm_name] [-i interval_ms] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror(name);
+        return 1;
+    }
+    const stats_shm_t *shm = mmap(NULL, sizeof(stats_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    if (shm->magic != STATS_SHM_MAGIC || shm->version != STATS_SHM_VERSION || shm->count != STATS_MAX)
+    {
+        fprintf(stderr, "%s: incompatible stats segment\n", name);
+        return 1;
+    }
+
+    uint64_t counter[STATS_MAX], last[STATS_MAX];
+    uint64_t time = read_snapshot(shm, counter);
+    for (int i = 0; i < STATS_MAX; i++)
+        if (all || counter[i])
+            printf("%-32s %llu\n", stats_names[i], (unsigned long long)counter[i]);
+    while (interval > 0)
+    {
+        memcpy(last, counter, sizeof(counter));
+        uint64_t last_time = time;
+        usleep(interval * 1000);
+        time = read_snapshot(shm, counter);
+        printf("\n--- %llu ms ---\n", (unsigned long long)(time - last_time));
+        for (int i = 0; i < STATS_MAX; i++)
+            if (all || counter[i] != last[i])
+                printf("%-32s %llu\n", stats_names[i], (unsigned long long)(counter[i] - last[i]));
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "net.h"
+#include "ethernet.h"
+
+/**
+ * @brief 生成用于基准测试的pcap文件，所有帧都发往DRIVER_IF_IP/DRIVER_IF_MAC
+ *        用法: pcap_gen [-o out.pcap] [-n 包数] [-m 混合比例] [-N 邻居数] [-M 端口数] [-K 流数]
+ *                       [-p 起始端口] [-z 大小分布] [-f 分片方式] [-r 包/秒] [-s 种子]
+ *
+ *        -m  各类流量的权重，如"arp=1,icmp=1,udp=8,frag=1,badsum=1,closed=1"
+ *            arp    邻居发来的ARP请求与应答，邻居数超过ARP表大小时表项不断被替换
+ *            icmp   回显请求
+ *            udp    发往M个打开端口的K条流
+ *            frag   分片的大UDP数据报
+ *            badsum 校验和错误的UDP或IP报文
+ *            closed 发往未打开端口的UDP
+ *        -z  UDP负载大小分布：fixed:N、uniform:A-B或imix(64/594/1518字节帧按7:4:1)
+ *        -f  分片顺序：inorder、reorder(随机打乱)、dup(随机重复)或mix
+ *        -r  时间戳按该速率递增，供按原始时间回放使用
+ */
+
+#define GEN_MAX_FRAME 1514
+#define GEN_FRAG_MAX 9000 //分片前的最大UDP负载
+
+enum
+{
+    GEN_ARP,
+    GEN_ICMP,
+    GEN_UDP,
+    GEN_FRAG,
+    GEN_BADSUM,
+    GEN_CLOSED,
+    GEN_KIND_MAX,
+};
+static const char *const gen_kind_names[GEN_KIND_MAX] = {"arp", "icmp", "udp", "frag", "badsum", "closed"};
+
+typedef struct flow
+{
+    int neighbor;
+    uint16_t src_port, dest_port;
+} flow_t;
+
+static uint8_t if_ip[] = DRIVER_IF_IP;
+static uint8_t if_mac[] = DRIVER_IF_MAC;
+
+static FILE *out;
+static uint64_t ts_ns, ts_step_ns;
+static uint64_t written;
+static uint64_t rng = 88172645463325252ULL;
+
+static int neighbors = 64, ports = 8, flows = 256, base_port = 60000;
+static int weight[GEN_KIND_MAX] = {1, 1, 8, 1, 1, 1};
+static enum { SIZE_FIXED, SIZE_UNIFORM, SIZE_IMIX } size_mode = SIZE_IMIX;
+static int size_a = 64, size_b = 1472;
+static enum { FRAG_INORDER, FRAG_REORDER, FRAG_DUP, FRAG_MIX } frag_mode = FRAG_MIX;
+static flow_t *flow_table;
+static uint16_t ip_id;
+
+static uint64_t rnd()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static uint32_t rnd_range(uint32_t n)
+{
+    return (uint32_t)(rnd() % n);
+}
+
+static void neighbor_ip(int i, uint8_t *ip)
+{
+    ip[0] = if_ip[0];
+    ip[1] = if_ip[1];
+    ip[2] = (uint8_t)(100 + i / 254);
+    ip[3] = (uint8_t)(1 + i % 254);
+}
+
+static void neighbor_mac(int i, uint8_t *mac)
+{
+    uint8_t m[NET_MAC_LEN] = {0x02, 0x00, 0x00, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+    memcpy(mac, m, NET_MAC_LEN);
+}
+
+/**
+ * @brief 16位反码和，奇数长度时最后一个字节补0
+ */
+static uint32_t sum16(const uint8_t *p, int len, uint32_t sum)
+{
+    for (int i = 0; i + 1 < len; i += 2)
+        sum += (p[i] << 8) | p[i + 1];
+    if (len & 1)
+        sum += p[len - 1] << 8;
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static void write_frame(const uint8_t *frame, uint32_t len)
+{
+    uint32_t hdr[4] = {(uint32_t)(ts_ns / 1000000000), (uint32_t)(ts_ns % 1000000000 / 1000), len, len};
+    fwrite(hdr, sizeof(hdr), 1, out);
+    fwrite(frame, 1, len, out);
+    ts_ns += ts_step_ns;
+    written++;
+}
+
+/**
+ * @brief 填写以太网头部，源地址为邻居
+ */
+static uint8_t *eth_hdr(uint8_t *frame, int neighbor, uint16_t type, const uint8_t *dest)
+{
+    memcpy(frame, dest, NET_MAC_LEN);
+    neighbor_mac(neighbor, frame + 6);
+    put16(frame + 12, type);
+    return frame + 14;
+}
+
+/**
+ * @brief 填写IP头部并计算校验和
+ */
+static void ip_hdr(uint8_t *p, int neighbor, uint8_t protocol, uint16_t total_len, uint16_t id, uint16_t frag)
+{
+    memset(p, 0, 20);
+    p[0] = 0x45;
+    put16(p + 2, total_len);
+    put16(p + 4, id);
+    put16(p + 6, frag);
+    p[8] = 64;
+    p[9] = protocol;
+    neighbor_ip(neighbor, p + 12);
+    memcpy(p + 16, if_ip, NET_IP_LEN);
+    put16(p + 10, fold(sum16(p, 20, 0)));
+}
+
+static uint16_t udp_checksum(const uint8_t *ip, const uint8_t *udp, int len)
+{
+    uint32_t sum = sum16(ip + 12, 8, 0);
+    sum += NET_PROTOCOL_UDP + len;
+    uint16_t c = fold(sum16(udp, len, sum));
+    return c ? c : 0xffff;
+}
+
+static int payload_size()
+{
+    switch (size_mode)
+    {
+    case SIZE_FIXED:
+        return size_a;
+    case SIZE_UNIFORM:
+        return size_a + rnd_range(size_b - size_a + 1);
+    default:
+    {
+        uint32_t r = rnd_range(12);
+        int frame = r < 7 ? 64 : r < 11 ? 594 : 1518;
+        int len = frame - 4 - 14 - 20 - 8; //减去FCS和各层头部
+        return len < 18 ? 18 : len;
+    }
+    }
+}
+
+static void gen_arp()
+{
+    uint8_t frame[GEN_MAX_FRAME] = {0};
+    int n = rnd_range(neighbors);
+    int reply = rnd_range(2);
+    uint8_t *p = eth_hdr(frame, n, NET_PROTOCOL_ARP, reply ? if_mac : ether_broadcast_mac);
+    put16(p, 1);
+    put16(p + 2, NET_PROTOCOL_IP);
+    p[4] = NET_MAC_LEN;
+    p[5] = NET_IP_LEN;
+    put16(p + 6, reply ? 2 : 1);
+    neighbor_mac(n, p + 8);
+    neighbor_ip(n, p + 14);
+    if (reply)
+        memcpy(p + 18, if_mac, NET_MAC_LEN);
+    memcpy(p + 24, if_ip, NET_IP_LEN);
+    write_frame(frame, 14 + 28 + 18); //补齐到以太网最小帧长
+}
+
+static void gen_icmp()
+{
+    uint8_t frame[GEN_MAX_FRAME];
+    int n = rnd_range(neighbors);
+    int len = 8 + 56;
+    uint8_t *ip = eth_hdr(frame, n, NET_PROTOCOL_IP, if_mac);
+    uint8_t *icmp = ip + 20;
+    memset(icmp, 0, 8);
+    icmp[0] = 8;
+    put16(icmp + 4, (uint16_t)n);
+    put16(icmp + 6, (uint16_t)written);
+    for (int i = 8; i < len; i++)
+        icmp[i] = (uint8_t)i;
+    put16(icmp + 2, fold(sum16(icmp, len, 0)));
+    ip_hdr(ip, n, NET_PROTOCOL_ICMP, 20 + len, ip_id++, 0);
+    write_frame(frame, 14 + 20 + len);
+}
+
+/**
+ * @brief 构造一个UDP数据报(含UDP头部)，不含IP头部
+ */
+static int build_udp(uint8_t *udp, const uint8_t *ip, uint16_t sport, uint16_t dport, int payload)
+{
+    int len = 8 + payload;
+    put16(udp, sport);
+    put16(udp + 2, dport);
+    put16(udp + 4, len);
+    put16(udp + 6, 0);
+    for (int i = 0; i < payload; i++)
+        udp[8 + i] = (uint8_t)(written + i);
+    put16(udp + 6, udp_checksum(ip, udp, len));
+    return len;
+}
+
+static void gen_udp(int kind)
+{
+    uint8_t frame[GEN_MAX_FRAME];
+    flow_t *f = &flow_table[rnd_range(flows)];
+    uint16_t dport = kind == GEN_CLOSED ? (uint16_t)(base_port - 1 - rnd_range(1000)) : f->dest_port;
+    int payload = payload_size();
+    if (payload > GEN_MAX_FRAME - 14 - 28)
+        payload = GEN_MAX_FRAME - 14 - 28;
+    uint8_t *ip = eth_hdr(frame, f->neighbor, NET_PROTOCOL_IP, if_mac);
+    ip_hdr(ip, f->neighbor, NET_PROTOCOL_UDP, 28 + payload, ip_id++, 0); //先填地址供伪头部使用
+    build_udp(ip + 20, ip, f->src_port, dport, payload);
+    if (kind == GEN_BADSUM)
+    {
+        if (rnd_range(2))
+            ip[20 + 6] ^= 0x5a; //UDP校验和错误
+        else
+            ip[10] ^= 0x5a;     //IP头部校验和错误
+    }
+    write_frame(frame, 14 + 28 + payload);
+}
+
+static void gen_frag()
+{
+    static uint8_t udp[8 + GEN_FRAG_MAX];
+    uint8_t frame[GEN_MAX_FRAME];
+    uint8_t pseudo[20];
+    flow_t *f = &flow_table[rnd_range(flows)];
+    int payload = 1473 + rnd_range(GEN_FRAG_MAX - 1473);
+    ip_hdr(pseudo, f->neighbor, NET_PROTOCOL_UDP, 0, 0, 0);
+    int len = build_udp(udp, pseudo, f->src_port, f->dest_port, payload);
+
+    int unit = (ETHERNET_MTU - 20) & ~7;
+    int count = (len + unit - 1) / unit;
+    int order[count * 2];
+    for (int i = 0; i < count; i++)
+        order[i] = i;
+    int mode = frag_mode == FRAG_MIX ? (int)rnd_range(3) : (int)frag_mode;
+    int total = count;
+    if (mode == FRAG_REORDER)
+        for (int i = count - 1; i > 0; i--)
+        {
+            int j = rnd_range(i + 1), t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+    else if (mode == FRAG_DUP)
+        for (int i = 0; i < count; i++)
+            if (rnd_range(2))
+                order[total++] = i;
+
+    uint16_t id = ip_id++;
+    for (int k = 0; k < total; k++)
+    {
+        int i = order[k];
+        int off = i * unit;
+        int flen = len - off < unit ? len - off : unit;
+        uint8_t *ip = eth_hdr(frame, f->neighbor, NET_PROTOCOL_IP, if_mac);
+        ip_hdr(ip, f->neighbor, NET_PROTOCOL_UDP, 20 + flen, id, (uint16_t)((off / 8) | (i < count - 1 ? 0x2000 : 0)));
+        memcpy(ip + 20, udp + off, flen);
+        write_frame(frame, 14 + 20 + flen);
+    }
+}
+
+static int parse_mix(char *s)
+{
+    memset(weight, 0, sizeof(weight));
+    for (char *save, *tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(tok, '=');
+        int k;
+        for (k = 0; k < GEN_KIND_MAX; k++)
+            if (eq && strncmp(tok, gen_kind_names[k], eq - tok) == 0 && gen_kind_names[k][eq - tok] == 0)
+                break;
+        if (k == GEN_KIND_MAX)
+            return -1;
+        weight[k] = atoi(eq + 1);
+    }
+    return 0;
+}
+
+static int parse_size(const char *s)
+{
+    if (strcmp(s, "imix") == 0)
+        size_mode = SIZE_IMIX;
+    else if (sscanf(s, "fixed:%d", &size_a) == 1)
+        size_mode = SIZE_FIXED;
+    else if (sscanf(s, "uniform:%d-%d", &size_a, &size_b) == 2 && size_a <= size_b)
+        size_mode = SIZE_UNIFORM;
+    else
+        return -1;
+    return size_a >= 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = "gen.pcap";
+    uint64_t count = 100000;
+    double pps = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:n:m:N:M:K:p:z:f:r:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o': path = optarg; break;
+        case 'n': count = strtoull(optarg, NULL, 10); break;
+        case 'N': neighbors = atoi(optarg); break;
+        case 'M': ports = atoi(optarg); break;
+        case 'K': flows = atoi(optarg); break;
+        case 'p': base_port = atoi(optarg); break;
+        case 'r': pps = atof(optarg); break;
+        case 's': rng = strtoull(optarg, NULL, 10) * 2654435761ULL + 1; break;
+        case 'm':
+            if (parse_mix(optarg) == 0)
+                break;
+            fprintf(stderr, "bad mix: expected kind=weight,... with kinds arp,icmp,udp,frag,badsum,closed\n");
+            return 1;
+        case 'z':
+            if (parse_size(optarg) == 0)
+                break;
+            fprintf(stderr, "bad size distribution: expected fixed:N, uniform:A-B or imix\n");
+            return 1;
+        case 'f':
+            if (strcmp(optarg, "inorder") == 0) frag_mode = FRAG_INORDER;
+            else if (strcmp(optarg, "reorder") == 0) frag_mode = FRAG_REORDER;
+            else if (strcmp(optarg, "dup") == 0) frag_mode = FRAG_DUP;
+            else if (strcmp(optarg, "mix") == 0) frag_mode = FRAG_MIX;
+            else
+            {
+                fprintf(stderr, "bad fragment order: expected inorder, reorder, dup or mix\n");
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-o out.pcap] [-n packets] [-m mix] [-N neighbors] [-M ports] [-K flows] "
+                            "[-p base_port] [-z size] [-f frag_order] [-r pps] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    int weight_sum = 0;
+    for (int k = 0; k < GEN_KIND_MAX; k++)
+        weight_sum += weight[k];
+    if (weight_sum <= 0 || neighbors <= 0 || neighbors > 254 * 150 || ports <= 0 || flows <= 0 || pps <= 0 ||
+        base_port <= 1000 || base_port + ports > 65536)
+    {
+        fprintf(stderr, "invalid parameters\n");
+        return 1;
+    }
+
+    flow_table = malloc(flows * sizeof(flow_t));
+    for (int i = 0; i < flows; i++)
+    {
+        flow_table[i].neighbor = rnd_range(neighbors);
+        flow_table[i].src_port = (uint16_t)(1024 + rnd_range(60000 - 1024));
+        flow_table[i].dest_port = (uint16_t)(base_port + i % ports);
+    }
+
+    out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    uint32_t ghdr[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1}; //版本2.4，链路类型以太网
+    fwrite(ghdr, sizeof(ghdr), 1, out);
+    ts_step_ns = (uint64_t)(1e9 / pps);
+    ts_ns = 0;
+
+    while (written < count)
+    {
+        int r = rnd_range(weight_sum), k = 0;
+        while (r >= weight[k])
+            r -= weight[k++];
+        switch (k)
+        {
+        case GEN_ARP: gen_arp(); break;
+        case GEN_ICMP: gen_icmp(); break;
+        case GEN_FRAG: gen_frag(); break;
+        default: gen_udp(k); break;
+        }
+    }
+    fclose(out);
+    printf("wrote %llu packets to %s\n", (unsigned long long)written, path);
+    return 0;
+}
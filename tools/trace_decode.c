@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/**
+ * @brief 把协议栈写出的二进制跟踪文件转换为文本
+ *        用法: trace_decode [trace.bin]
+ *        所有线程的记录按时间排序，时间为距第一条记录的微秒数
+ */
+
+static const char *const layer_names[TRACE_LAYER_MAX] = {
+#define LAYER_NAME(id, name) name,
+    TRACE_LAYER_LIST(LAYER_NAME)
+#undef LAYER_NAME
+};
+
+static const char *const event_names[TRACE_EVENT_MAX] = {
+#define EVENT_NAME(id, name, args) name,
+    TRACE_EVENT_LIST(EVENT_NAME)
+#undef EVENT_NAME
+};
+
+static const char *const event_args[TRACE_EVENT_MAX] = {
+#define EVENT_ARGS(id, name, args) args,
+    TRACE_EVENT_LIST(EVENT_ARGS)
+#undef EVENT_ARGS
+};
+
+typedef struct entry
+{
+    trace_rec_t rec;
+    uint32_t thread;
+} entry_t;
+
+static int entry_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const entry_t *)a)->rec.ts, y = ((const entry_t *)b)->rec.ts;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 按参数名输出参数
+ *
+ */
+static void print_args(const trace_rec_t *rec)
+{
+    char names[64];
+    snprintf(names, sizeof(names), "%s", rec->event < TRACE_EVENT_MAX ? event_args[rec->event] : "");
+    int i = 0;
+    for (char *save, *name = strtok_r(names, ",", &save); name && i < TRACE_ARGS; name = strtok_r(NULL, ",", &save), i++)
+    {
+        uint32_t v = rec->arg[i];
+        if (strncmp(name, "ip", 2) == 0)
+        {
+            uint8_t *ip = (uint8_t *)&v;
+            printf(" %s=%d.%d.%d.%d", name, ip[0], ip[1], ip[2], ip[3]);
+        }
+        else if (strcmp(name, "reason") == 0)
+            printf(" %s=%s", name, v < STATS_MAX ? stats_names[v] : "?");
+        else if (strcmp(name, "flags") == 0 || strcmp(name, "proto") == 0)
+            printf(" %s=0x%x", name, v);
+        else
+            printf(" %s=%u", name, v);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "trace.bin";
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    trace_file_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_FILE_MAGIC ||
+        hdr.version != TRACE_FILE_VERSION || hdr.rec_size != sizeof(trace_rec_t))
+    {
+        fprintf(stderr, "%s: not a trace file of this version\n", path);
+        return 1;
+    }
+
+    entry_t *entries = NULL;
+    size_t n = 0;
+    for (uint32_t r = 0; r < hdr.rings; r++)
+    {
+        trace_file_ring_t fr;
+        if (fread(&fr, sizeof(fr), 1, f) != 1)
+            break;
+        entries = realloc(entries, (n + fr.count) * sizeof(entry_t));
+        for (uint64_t i = 0; i < fr.count; i++, n++)
+        {
+            if (fread(&entries[n].rec, sizeof(trace_rec_t), 1, f) != 1)
+                break;
+            entries[n].thread = fr.thread;
+        }
+    }
+    fclose(f);
+    qsort(entries, n, sizeof(entry_t), entry_cmp);
+
+    double ticks_per_us = hdr.ticks_per_sec ? hdr.ticks_per_sec / 1e6 : 1.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        trace_rec_t *rec = &entries[i].rec;
+        printf("%14.3f t%u %-8s %-11s", (rec->ts - entries[0].rec.ts) / ticks_per_us, entries[i].thread,
+               rec->layer < TRACE_LAYER_MAX ? layer_names[rec->layer] : "?",
+               rec->event < TRACE_EVENT_MAX ? event_names[rec->event] : "?");
+        print_args(rec);
+        printf("\n");
+    }
+    free(entries);
+    return 0;
+}